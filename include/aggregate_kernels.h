@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief count/sum/min/max of a column range
+ */
+struct ColumnSummary {
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+
+    ColumnSummary() : count(0), sum(0.0), min(0.0), max(0.0) {}
+
+    double mean() const { return count ? sum / count : 0.0; }
+
+    /**
+     * @brief Combine with the summary of another, disjoint range
+     */
+    void merge(const ColumnSummary& other);
+};
+
+/**
+ * @brief Instruction set used by the aggregation kernels
+ */
+enum class KernelIsa {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+/**
+ * @brief Vectorised min/max/sum/count over contiguous columns
+ *
+ * The best implementation the CPU supports is picked once at runtime
+ * (AVX2, then SSE2, then plain C++), so the binary does not need to be built
+ * for a specific machine. Non-x86 builds always use the scalar code.
+ */
+namespace AggregateKernels {
+    /**
+     * @brief Instruction set the dispatching functions use
+     */
+    KernelIsa activeIsa();
+
+    /**
+     * @brief Whether this CPU and build can run an instruction set
+     */
+    bool isSupported(KernelIsa isa);
+
+    /**
+     * @brief Override the dispatch choice (benchmarks and tests)
+     * @return false if the CPU cannot run that instruction set
+     */
+    bool forceIsa(KernelIsa isa);
+
+    const char* isaName(KernelIsa isa);
+
+    /**
+     * @brief Summarise raw sensor values (deci-µg/m³)
+     */
+    ColumnSummary summarizeU16(const uint16_t* data, size_t count);
+
+    /**
+     * @brief Summarise float values (µg/m³)
+     */
+    ColumnSummary summarizeFloat(const float* data, size_t count);
+
+    /**
+     * @brief Run a specific implementation regardless of the dispatch choice
+     */
+    ColumnSummary summarizeU16With(KernelIsa isa, const uint16_t* data, size_t count);
+    ColumnSummary summarizeFloatWith(KernelIsa isa, const float* data, size_t count);
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief What an alert rule compares against its threshold
+ */
+enum class AlertCondition : uint8_t {
+    Above,  // value above the threshold
+    Below,  // value below the threshold
+    Rise    // increase over the rule's window, in µg/m³
+};
+
+/**
+ * @brief One alert rule
+ *
+ * Parsed from a spec such as
+ *   "name=pm25_high,above=35,window=300,for=600,clear=25,clear-for=300"
+ * The keys are:
+ *   name        identifier used in events (required, no spaces)
+ *   above=X     fire when the value is above X
+ *   below=X     fire when the value is below X
+ *   rise=X      fire when the value rose by X over the window
+ *   metric      pm25 (default) or pm10; corrected values when available
+ *   sensor      sensor id, or * for every sensor (default)
+ *   window      seconds: mean over this span for above/below (0, the default,
+ *               uses each reading), span of the change for rise (required)
+ *   for         seconds the condition must hold before firing (default 0)
+ *   clear       level that clears the alert (default the threshold);
+ *               below it for above and rise, above it for below
+ *   clear-for   seconds the clear condition must hold (default 0)
+ * Exactly one of above, below and rise must be given.
+ */
+struct AlertRule {
+    std::string name;
+    AlertCondition condition;
+    bool pm10;                  // metric: PM10 instead of PM2.5
+    std::string sensor;         // "*" for every sensor
+    double threshold;
+    double clearLevel;
+    int64_t windowMs;
+    int64_t forMs;
+    int64_t clearForMs;
+
+    AlertRule() : condition(AlertCondition::Above), pm10(false), sensor("*"), threshold(0.0), clearLevel(0.0),
+                  windowMs(0), forMs(0), clearForMs(0) {}
+
+    /**
+     * @brief Parse a rule spec
+     * @return false on unknown keys, invalid values, or a clear level on the
+     *         wrong side of the threshold
+     */
+    static bool parse(const std::string& spec, AlertRule& rule);
+
+    /**
+     * @brief Parse a file of rule specs, one per line; '#' starts a comment
+     * @return false if the file cannot be read or a line is invalid
+     */
+    static bool loadFile(const std::string& path, std::vector<AlertRule>& rules);
+
+    std::string toString() const;
+};
+
+/**
+ * @brief A rule starting or stopping to fire for a sensor
+ */
+struct AlertEvent {
+    std::string rule;
+    std::string sensor;
+    bool firing;            // false when the alert clears
+    int64_t timestamp_ms;   // reading that triggered the change
+    double value;           // the value the rule compared (mean or rise if windowed)
+    double threshold;       // the level it crossed: threshold when firing, clear level when clearing
+
+    AlertEvent() : firing(false), timestamp_ms(0), value(0.0), threshold(0.0) {}
+
+    /**
+     * @brief "ALERT <FIRING|CLEARED> <rule> <sensor> <unix_ms> <value> <threshold>"
+     */
+    std::string toLine() const;
+};
+
+/**
+ * @brief Evaluates alert rules incrementally as readings arrive
+ *
+ * Rules are compiled per sensor the first time it reports: the sensor gets
+ * the rules that name it or "*", and one rolling window per distinct
+ * (metric, window) pair among them, shared by every rule that needs it. A
+ * reading then updates those windows in amortised O(1) and steps each of the
+ * sensor's rules through a small state machine (idle, pending, firing,
+ * clearing), so its cost is O(rules touching that sensor) however many
+ * sensors and rules there are and however long the windows.
+ *
+ * Hysteresis comes from separate fire and clear levels and durations: an
+ * alert that fired stays firing until the value has been past the clear
+ * level for clear-for seconds.
+ *
+ * Not thread-safe; the daemon calls it under its mutex.
+ */
+class AlertEngine {
+public:
+    /**
+     * @brief A firing alert
+     */
+    struct ActiveAlert {
+        std::string rule;
+        std::string sensor;
+        int64_t sinceMs;
+        double value;       // latest compared value
+    };
+
+private:
+    // Rolling sum over the last windowMs of one metric
+    struct Window {
+        bool pm10;
+        int64_t windowMs;
+        std::deque<std::pair<int64_t, float>> samples;
+        double sum;
+    };
+
+    enum class Phase : uint8_t { Idle, Pending, Firing, Clearing };
+
+    struct RuleState {
+        size_t rule;        // index into rules
+        int window;         // index into SensorAlerts::windows, -1 for the reading itself
+        Phase phase;
+        int64_t sinceMs;    // when the current phase started
+        int64_t firedMs;
+        double lastValue;
+    };
+
+    struct SensorAlerts {
+        std::vector<Window> windows;
+        std::vector<RuleState> states;
+    };
+
+    std::vector<AlertRule> rules;
+    std::map<std::string, SensorAlerts> sensors;
+
+    SensorAlerts& compile(const std::string& sensor);
+    bool evaluate(const AlertRule& rule, const SensorAlerts& alerts, const RuleState& state, float reading,
+                  double& value) const;
+
+public:
+    AlertEngine() {}
+
+    /**
+     * @brief Replace the rules; alert state is reset
+     */
+    void setRules(const std::vector<AlertRule>& ruleSet);
+
+    const std::vector<AlertRule>& getRules() const { return rules; }
+    bool isEnabled() const { return !rules.empty(); }
+
+    /**
+     * @brief Feed one reading of a sensor
+     * @param pm25 Pass NaN to leave PM2.5 rules untouched (e.g. an outlier)
+     * @param pm10 Likewise for PM10
+     * @param events Receives the alerts that fired or cleared
+     */
+    void process(const std::string& sensor, int64_t timestampMs, float pm25, float pm10,
+                 std::vector<AlertEvent>& events);
+
+    std::vector<ActiveAlert> active() const;
+};
+
+/**
+ * @brief Where alert events are written: a file, a FIFO or a Unix socket
+ *
+ * The kind follows the target: "unix:PATH" or an existing socket is
+ * connected as a stream socket, an existing FIFO is opened for writing, and
+ * anything else is a file that events are appended to. Writes never block:
+ * with no FIFO reader or a socket that is gone, the event is dropped and
+ * counted, and the sink reconnects on a later event.
+ */
+class AlertSink {
+public:
+    enum class Kind : uint8_t { File, Fifo, Socket };
+
+private:
+    std::string path;
+    Kind kind;
+    int fd;
+    uint64_t dropped;
+
+    bool connect();
+    void disconnect();
+
+public:
+    AlertSink();
+    ~AlertSink();
+    AlertSink(const AlertSink&) = delete;
+    AlertSink& operator=(const AlertSink&) = delete;
+
+    /**
+     * @brief Choose the target; a file must be creatable, a FIFO or socket
+     *        may come and go
+     * @return false if a file target cannot be opened
+     */
+    bool open(const std::string& target);
+
+    Kind getKind() const { return kind; }
+    uint64_t getDropped() const { return dropped; }
+
+    /**
+     * @brief Write one event as a line
+     * @return false if it was dropped
+     */
+    bool write(const AlertEvent& event);
+};
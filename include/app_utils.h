@@ -1,6 +1,61 @@
 #pragma once
 
+#include "serial_port.h"
+#include "aqi_engine.h"
+#include "outlier_filter.h"
+#include "humidity_correction.h"
+#include "io_backend.h"
+#include "alert_engine.h"
+#include "store_compactor.h"
+#include "write_ahead_log.h"
+#include "arrow_export.h"
+#include <cstdint>
 #include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Options collected from the command line
+ */
+struct AppOptions {
+    std::string serial_port;
+    bool use_tui;
+    bool use_interactive;
+    std::string trace_file;         // --trace FILE
+    std::string trace_json_input;   // --trace-json IN OUT
+    std::string trace_json_output;
+    std::string capture_file;       // --capture FILE
+    std::string history_file;       // --history-file FILE
+    std::string export_file;        // --export-arrow FILE
+    ArrowExportFilter export_filter;    // --export-filter SPEC
+    std::string replay_file;        // --replay FILE
+    bool replay_real_time;          // --replay-speed real|max
+    std::vector<std::pair<std::string, SerialIOProfile>> io_profiles;  // --io-profile [PORT=]NAME
+    int probe_frames;               // --probe-io N, 0 when not probing
+    bool port_specified;            // serial_port was given on the command line
+    bool daemon_mode;               // --daemon
+    bool attach;                    // --attach
+    std::string socket_path;        // --socket PATH
+    std::string data_file;          // --data-file PATH
+    std::string store_directory;    // --store DIR
+    std::string export_dir;         // --export-dir DIR
+    RetentionPolicy retention;      // --retention SPEC
+    WalConfig wal;                  // --wal SPEC
+    std::vector<std::string> sensor_ports;  // --sensor PORT (daemon, repeatable)
+    AQIStandard aqi_standard;       // --aqi-standard us|in|uk
+    std::string benchmark;          // --bench NAME
+    FilterConfig filter;            // --filter SPEC
+    std::string humidity_source;    // --humidity PATH
+    HumidityModel humidity_model;   // --humidity-model SPEC
+    IoBackendKind io_backend;       // --io-backend auto|epoll|uring
+    std::vector<AlertRule> alert_rules; // --alert SPEC (repeatable), --alert-rules FILE
+    std::string alert_sink;         // --alert-sink PATH
+    
+    AppOptions() : use_tui(true), use_interactive(true), replay_real_time(true), probe_frames(0),
+                   port_specified(false), daemon_mode(false), attach(false),
+                   socket_path("/tmp/sensor_reader.sock"), data_file("sensor_readings.csv"),
+                   aqi_standard(AQIStandard::USEPA), io_backend(IoBackendKind::Auto) {}
+};
 
 /**
  * @brief Application utilities and helper functions
@@ -22,11 +77,11 @@ namespace AppUtils {
      * @brief Parse command line arguments
      * @param argc Number of command line arguments
      * @param argv Array of command line arguments
-     * @param serial_port Reference to store the serial port
-     * @param use_tui Reference to store TUI preference
+     * @param options Reference to store the parsed options
      * @return true if arguments were parsed successfully, false if help was requested
+     *         or an option was malformed
      */
-    bool parseArguments(int argc, char* argv[], std::string& serial_port, bool& use_tui);
+    bool parseArguments(int argc, char* argv[], AppOptions& options);
 
     /**
      * @brief Format a float value without trailing zeroes
@@ -35,6 +90,13 @@ namespace AppUtils {
      * @return Formatted string without trailing zeroes
      */
     std::string formatFloat(float value, int maxPrecision = 1);
+
+    /**
+     * @brief Format a nanosecond duration with a human-readable unit
+     * @param ns Duration in nanoseconds
+     * @return Formatted string such as "850ns", "12.3us" or "4.56ms"
+     */
+    std::string formatDuration(uint64_t ns);
 }
 
 // Global flag for clean shutdown
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief National air quality index scales with PM breakpoint tables
+ */
+enum class AQIStandard {
+    USEPA,      // US EPA AQI (2024 PM2.5 breakpoints), 0-500
+    IndiaNAQI,  // India National AQI (CPCB), 0-500
+    UKDAQI      // UK Daily Air Quality Index, bands 1-10
+};
+
+enum class Pollutant {
+    PM25,
+    PM10
+};
+
+/**
+ * @brief One row of a breakpoint table
+ */
+struct AQIBreakpoint {
+    double concentrationLow;    // µg/m³
+    double concentrationHigh;
+    int indexLow;
+    int indexHigh;
+    int level;                  // 0 = best; drives the colour
+    const char* category;
+};
+
+/**
+ * @brief An index value with its category
+ */
+struct AQIResult {
+    int index;
+    int level;
+    const char* category;
+    double concentration;       // averaged concentration the index was computed from
+    bool valid;                 // false when there is no data at all
+    bool provisional;           // too little history for the full averaging period
+
+    AQIResult() : index(0), level(0), category("No data"), concentration(0.0),
+                  valid(false), provisional(true) {}
+};
+
+/**
+ * @brief Incremental NowCast and 24-hour AQI for one sensor
+ *
+ * Readings are folded into 24 hourly buckets (sum and count per pollutant).
+ * Running 24-hour sums are adjusted as buckets are recycled, so addReading()
+ * is O(1); NowCast looks at a fixed 12 buckets. The current, still-open hour
+ * counts as the most recent NowCast hour so the index follows the air within
+ * minutes instead of once an hour.
+ */
+class AQIEngine {
+private:
+    struct HourBucket {
+        int64_t hour;           // Unix hour number, -1 when empty
+        double sum[2];
+        uint32_t count;
+    };
+
+    static const int HOURS = 24;
+    static const int NOWCAST_HOURS = 12;
+
+    AQIStandard standard;
+    HourBucket buckets[HOURS];
+    int64_t latestHour;
+    double windowSum[2];        // sums over the buckets currently in the 24 h window
+    uint32_t windowCount;
+    int hoursWithData;
+
+    HourBucket& bucketFor(int64_t hour) { return buckets[((hour % HOURS) + HOURS) % HOURS]; }
+    const HourBucket* bucketAt(int64_t hour) const;
+    void clearBucket(HourBucket& bucket);
+
+public:
+    explicit AQIEngine(AQIStandard standard = AQIStandard::USEPA);
+
+    void setStandard(AQIStandard value) { standard = value; }
+    AQIStandard getStandard() const { return standard; }
+
+    /**
+     * @brief Fold a reading into the hourly buckets
+     * @param unixSeconds Reading time; readings older than the 24 h window are ignored
+     */
+    void addReading(int64_t unixSeconds, float pm25, float pm10);
+
+    /**
+     * @brief EPA NowCast concentration over the last 12 hours
+     * @param pollutant Which particle size
+     * @param provisional Set when fewer than 2 of the last 3 hours have data
+     * @return µg/m³, or a negative value when there is no data
+     */
+    double nowCast(Pollutant pollutant, bool& provisional) const;
+
+    /**
+     * @brief Mean concentration over the last 24 hours, negative without data
+     */
+    double mean24h(Pollutant pollutant) const;
+
+    /**
+     * @brief Index from the NowCast concentrations (worse of PM2.5 and PM10)
+     */
+    AQIResult nowCastAQI() const;
+
+    /**
+     * @brief Index from the 24-hour means (worse of PM2.5 and PM10)
+     */
+    AQIResult dailyAQI() const;
+
+    /**
+     * @brief Forget all readings
+     */
+    void reset();
+
+    /**
+     * @brief Look up a concentration in a standard's breakpoint table
+     */
+    static AQIResult classify(AQIStandard standard, Pollutant pollutant, double concentration);
+
+    /**
+     * @brief TUI colour pair for a level (1 = green, 2 = yellow, 3 = red, 6 = magenta)
+     */
+    static int colorPair(int level);
+
+    /**
+     * @brief Short name ("us", "in", "uk") and its inverse
+     */
+    static const char* standardName(AQIStandard standard);
+    static bool parseStandard(const std::string& name, AQIStandard& standard);
+};
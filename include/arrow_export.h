@@ -0,0 +1,119 @@
+#pragma once
+
+#include "reading_history.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Time range and sensors an export is limited to
+ *
+ * Parsed from a spec such as "from=1700000000000,to=1700086400000,sensor=/dev/ttyUSB0";
+ * times are Unix milliseconds, from inclusive and to exclusive, and sensor
+ * may be repeated. Unspecified keys do not limit the export.
+ */
+struct ArrowExportFilter {
+    int64_t fromMs;
+    int64_t toMs;
+    std::vector<std::string> sensors;   // empty for all
+
+    ArrowExportFilter() : fromMs(INT64_MIN), toMs(INT64_MAX) {}
+
+    /**
+     * @brief Parse an export filter spec
+     * @return false on unknown keys, invalid times or an empty range
+     */
+    static bool parse(const std::string& spec, ArrowExportFilter& filter);
+
+    bool includes(const std::string& sensor) const;
+};
+
+/**
+ * @brief Self-contained writer of Arrow IPC files from ReadingHistory
+ *
+ * The file has the columns timestamp (timestamp[ms, UTC]), sensor
+ * (dictionary<int16, utf8>), pm25 and pm10 (float32, µg/m³ as sent by the
+ * sensor) and flags (uint8, ReadingFlags bits). The FlatBuffers metadata is
+ * encoded here, so no Arrow library is needed to write it, and pyarrow,
+ * pandas, polars or DuckDB read it directly.
+ *
+ * Every chunk of a history becomes one record batch: the timestamp and
+ * flags columns are copied from the chunk as they are, the value columns
+ * scaled in one vectorisable pass, and the sensor column is a run of the
+ * sensor's dictionary index. The time range is cut with lowerBound(), so
+ * no row is looked at on its own. The file is written aside and renamed
+ * into place by close().
+ */
+class ArrowWriter {
+public:
+    static const size_t FLUSH_BYTES = 1 << 20;
+
+    // Where a message starts in the file, as listed in the footer
+    struct Block {
+        int64_t offset;
+        int32_t metaDataLength;     // continuation marker, length and metadata
+        int32_t padding;
+        int64_t bodyLength;
+    };
+
+private:
+    std::string path;
+    int fd;
+    std::string buffer;                 // written out once it holds FLUSH_BYTES
+    uint64_t flushed;                   // file bytes before the buffer
+    std::vector<std::string> sensors;
+    std::vector<Block> dictionaries;
+    std::vector<Block> batches;
+    uint64_t rowCount;
+
+    bool flush();
+    void appendMessage(const std::string& metadata, std::vector<Block>& blocks, int64_t bodyLength);
+    void appendBatch(uint16_t sensor, const ReadingHistory::Chunk& chunk, size_t begin, size_t end);
+
+public:
+    ArrowWriter();
+    ~ArrowWriter();
+    ArrowWriter(const ArrowWriter&) = delete;
+    ArrowWriter& operator=(const ArrowWriter&) = delete;
+
+    /**
+     * @brief Start a file with the schema and the sensor dictionary
+     * @param sensorIds Sensor ids, indexed by write()'s sensor argument
+     */
+    bool open(const std::string& file, const std::vector<std::string>& sensorIds);
+
+    /**
+     * @brief Append the rows of a history in [fromMs, toMs) as record batches
+     * @param sensor Index into the ids given to open()
+     * @return false on a write error
+     */
+    bool write(uint16_t sensor, const ReadingHistory& history, int64_t fromMs = INT64_MIN,
+               int64_t toMs = INT64_MAX);
+
+    /**
+     * @brief Write the footer and move the file into place
+     */
+    bool close();
+
+    /**
+     * @brief Abandon the file
+     */
+    void discard();
+
+    uint64_t rows() const { return rowCount; }
+
+    /**
+     * @brief Bytes written so far, footer included after close()
+     */
+    uint64_t bytes() const { return flushed + buffer.size(); }
+
+    /**
+     * @brief Export several sensors' histories into one file
+     * @param rows Receives the number of rows written
+     */
+    static bool exportHistories(const std::string& file,
+                                const std::vector<std::pair<std::string, const ReadingHistory*>>& histories,
+                                const ArrowExportFilter& filter, uint64_t* rows = nullptr);
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+// C++20 only: configure with -DENABLE_COROUTINES=ON
+#ifdef ENABLE_COROUTINES
+
+#include "event_loop.h"
+#include "sds011_stream.h"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename T = void>
+class Task;
+
+/**
+ * @brief Promise state shared by all Task types
+ */
+class TaskPromiseBase {
+public:
+    /**
+     * @brief Hands control back to the awaiting coroutine when a task finishes
+     */
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+            std::coroutine_handle<> next = finished.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::coroutine_handle<> continuation;   // coroutine awaiting this one, if any
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+public:
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+public:
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+/**
+ * @brief Lazily started coroutine producing a T
+ *
+ * Nothing runs until the task is awaited (co_await task) or handed to
+ * Scheduler::spawn(). An exception thrown inside is rethrown to the awaiter.
+ */
+template <typename T>
+class Task {
+public:
+    typedef TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+private:
+    Handle handle;
+
+public:
+    explicit Task(Handle coroutine) : handle(coroutine) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, Handle())) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, Handle());
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool done() const { return !handle || handle.done(); }
+    std::coroutine_handle<> coroutine() const { return handle; }
+
+    bool await_ready() const noexcept { return handle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    /**
+     * @brief Result of a finished task; rethrows what escaped it
+     */
+    T await_resume() { return handle.promise().result(); }
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief Runs many coroutines on one thread, driven by an EventLoop
+ *
+ * Coroutines suspend on input (readable()) and on time (sleepFor(),
+ * sleepUntil()); the scheduler resumes them from the loop's poll(). All
+ * deadlines share one loop timer armed at the earliest of them, so a
+ * thousand sleeping sensors cost one timerfd, not a thousand.
+ *
+ * At most one coroutine may wait for input on a given descriptor.
+ */
+class Scheduler {
+public:
+    /**
+     * @brief One suspended coroutine: input on a descriptor, a deadline, or both
+     */
+    struct Wait {
+        std::coroutine_handle<> handle;
+        int fd;                 // -1 if not waiting for input
+        uint64_t deadlineNs;    // 0 if there is no deadline
+        bool timedOut;
+        std::multimap<uint64_t, Wait*>::iterator timer;
+    };
+
+    /**
+     * @brief co_await result: true when resumed by input or a plain sleep
+     *        ended, false when a readable() wait timed out
+     */
+    class WaitAwaiter {
+    private:
+        Scheduler& scheduler;
+        Wait wait;
+
+    public:
+        WaitAwaiter(Scheduler& owner, int fd, uint64_t deadlineNs);
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            wait.handle = handle;
+            scheduler.suspend(wait);
+        }
+        bool await_resume() const noexcept { return wait.fd < 0 || !wait.timedOut; }
+    };
+
+private:
+    EventLoop& loop;
+    int timerId;
+    std::multimap<uint64_t, Wait*> deadlines;
+    std::map<int, Wait*> inputs;
+    std::vector<std::coroutine_handle<>> ready;     // resumed before the next wait
+    std::list<Task<>> tasks;
+
+    void suspend(Wait& wait);
+    void wake(Wait& wait, bool timedOut);
+    void expireDeadlines();
+    void resumeReady();
+
+public:
+    explicit Scheduler(EventLoop& events);
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief Start a task on the next run round; the scheduler keeps it alive
+     */
+    void spawn(Task<> task);
+
+    /**
+     * @brief Spawned tasks that have not finished yet
+     */
+    size_t activeTasks() const { return tasks.size(); }
+
+    /**
+     * @brief Resume coroutines until every spawned task has finished
+     *
+     * Returns early, by rethrowing, if a spawned task throws.
+     */
+    void run();
+
+    WaitAwaiter sleepUntil(uint64_t deadlineNs);
+    WaitAwaiter sleepFor(std::chrono::nanoseconds duration);
+
+    /**
+     * @brief Wait until fd is readable, hung up or in error
+     * @param deadlineNs SampleClock::nowNs() time to give up at, 0 for never
+     */
+    WaitAwaiter readable(int fd, uint64_t deadlineNs = 0);
+};
+
+/**
+ * @brief SDS011 sensor read by a coroutine instead of a thread
+ *
+ *   Task<> monitor(Scheduler& scheduler, AsyncSensor& sensor) {
+ *       while (auto frame = co_await sensor.nextFrame(std::chrono::seconds(3))) {
+ *           ...
+ *           co_await scheduler.sleepFor(std::chrono::seconds(1));
+ *       }
+ *   }
+ *
+ * The port is read without blocking: a frame that is still arriving stays in
+ * the parser while other coroutines run.
+ */
+class AsyncSensor {
+private:
+    Scheduler& scheduler;
+    int fd;
+    bool ownsFd;
+    SDS011Stream stream;
+
+public:
+    explicit AsyncSensor(Scheduler& owner);
+    ~AsyncSensor();
+    AsyncSensor(const AsyncSensor&) = delete;
+    AsyncSensor& operator=(const AsyncSensor&) = delete;
+
+    /**
+     * @brief Open and configure a serial port in non-blocking mode
+     * @return false if the port could not be opened or configured
+     */
+    bool open(const std::string& port);
+
+    /**
+     * @brief Read from a descriptor the caller keeps (a pipe, a socket)
+     */
+    void attach(int descriptor, const std::string& sensorId);
+
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    bool isLinkLost() const { return stream.isLinkLost(); }
+    bool atEndOfStream() const { return stream.atEndOfStream(); }
+
+    /**
+     * @brief Next valid frame
+     * @return Empty on timeout, end of stream or a lost link
+     */
+    Task<std::optional<SDS011Frame>> nextFrame(std::chrono::nanoseconds timeout);
+};
+
+#endif
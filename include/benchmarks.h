@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Built-in micro-benchmarks, run with --bench NAME
+ *
+ * They exercise the same code paths as the live pipeline on synthetic data,
+ * so results can be compared across machines without a sensor attached.
+ */
+namespace Benchmarks {
+    /**
+     * @brief Names accepted by run()
+     */
+    std::vector<std::string> names();
+
+    /**
+     * @brief Run one benchmark and print its results
+     * @param name Benchmark name, or "all"
+     * @param out Where the report goes
+     * @return false if the name is unknown
+     */
+    bool run(const std::string& name, std::ostream& out);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "raw_capture.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Result of replaying a capture file
+ */
+struct ReplayReport {
+    uint64_t bytes;
+    uint64_t framesRecorded;   // frames decoded when the capture was taken
+    uint64_t framesDecoded;    // frames decoded during replay
+    uint64_t mismatches;       // decoded values that differ from the recording
+    int64_t firstDivergence;   // index of the first differing frame, -1 if none
+    double elapsedSeconds;
+
+    ReplayReport()
+        : bytes(0), framesRecorded(0), framesDecoded(0), mismatches(0),
+          firstDivergence(-1), elapsedSeconds(0.0) {}
+
+    double framesPerSecond() const {
+        return elapsedSeconds > 0.0 ? framesDecoded / elapsedSeconds : 0.0;
+    }
+};
+
+/**
+ * @brief Feeds a raw capture through SDS011Reader for reproduction and benchmarks
+ *
+ * The recorded bytes are written into a pipe whose read end is attached to an
+ * SDS011Reader, so they take the same readFrame path as live serial input.
+ * Decoded frames are compared against the frames recorded at capture time.
+ */
+class CaptureReplayer {
+private:
+    std::string path;
+    bool realTime;
+    std::vector<CaptureRecord> chunks;
+    std::vector<uint32_t> expected;  // recorded frames, pm25_raw | pm10_raw << 16
+
+    /**
+     * @brief Write all chunks into the pipe, pacing them if realTime is set
+     */
+    void feed(int fd, uint64_t& bytesWritten) const;
+
+public:
+    /**
+     * @brief Constructor
+     * @param capturePath Capture file produced with --capture
+     * @param paceRealTime true to reproduce the recorded inter-read timing,
+     *        false to replay as fast as the parser can go
+     */
+    CaptureReplayer(const std::string& capturePath, bool paceRealTime);
+
+    /**
+     * @brief Load the capture file into memory
+     * @return true if the file was read successfully
+     */
+    bool load();
+
+    /**
+     * @brief Replay the loaded capture
+     * @param report Filled with throughput and divergence figures
+     * @return true if the replay ran to completion
+     */
+    bool run(ReplayReport& report);
+
+    /**
+     * @brief Print a replay report in human-readable form
+     */
+    static void printReport(const ReplayReport& report, std::ostream& out);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Hardware identity of a USB serial port
+ *
+ * Survives re-enumeration: after an adapter reset the same sensor may come
+ * back as /dev/ttyUSB1 instead of /dev/ttyUSB0, but its key stays the same.
+ */
+struct DeviceId {
+    std::string key;        // "usb-<vid>:<pid>-<serial>:<if>", or "usb-path-<port>:<if>" without a serial
+    std::string byIdPath;   // udev's /dev/serial/by-id link to the port, if there is one
+
+    bool empty() const { return key.empty(); }
+};
+
+/**
+ * @brief Maps serial ports to stable identities and back
+ *
+ * Identities come from sysfs (/sys/class/tty/<name>/device, walked up to the
+ * USB device's idVendor, idProduct and serial) and from the /dev/serial/by-id
+ * links udev creates. Ports that are not USB ttys (pipes, files, on-board
+ * UARTs) have no identity and are always used by their path. Linux only;
+ * elsewhere every identity is empty.
+ */
+namespace DeviceLookup {
+    /**
+     * @brief Identify the device a port path refers to
+     * @param path Device node or a link to one (e.g. a by-id path)
+     * @return Empty identity if the port is not a USB serial device
+     */
+    DeviceId identify(const std::string& path);
+
+    /**
+     * @brief Current device node of an identity
+     * @return e.g. "/dev/ttyUSB1", or an empty string while it is not present
+     */
+    std::string locate(const DeviceId& id);
+
+    /**
+     * @brief Look up devices under another root instead of "/"
+     *
+     * For tests and chroots; not thread-safe, call before any lookup.
+     */
+    void setRoot(const std::string& root);
+}
+
+/**
+ * @brief Wakes reconnect logic when device nodes appear
+ *
+ * Watches /dev with inotify, so a re-enumerated adapter can be reopened as
+ * soon as its node exists instead of at the next backoff step.
+ */
+class DeviceWatcher {
+private:
+    int inotify_fd;
+
+public:
+    DeviceWatcher();
+    ~DeviceWatcher();
+    DeviceWatcher(const DeviceWatcher&) = delete;
+    DeviceWatcher& operator=(const DeviceWatcher&) = delete;
+
+    /**
+     * @brief Descriptor that becomes readable on device changes, -1 if unavailable
+     */
+    int fd() const { return inotify_fd; }
+
+    /**
+     * @brief Wait for device nodes to be added or changed
+     * @param timeoutMs 0 only checks, -1 waits indefinitely
+     * @return true if something changed; pending events are consumed
+     */
+    bool wait(int timeoutMs);
+};
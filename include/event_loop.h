@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+#include <signal.h>
+
+/**
+ * @brief Single-threaded loop over descriptors, signals and timers
+ *
+ * Sleeps in one poll() until something happens: a watched descriptor becomes
+ * readable, a watched signal arrives (signalfd on Linux, a self-pipe
+ * elsewhere) or a timer expires (timerfd on Linux, the poll() timeout
+ * elsewhere). Nothing wakes it on a fixed period, so an idle TUI costs no
+ * CPU and a keypress is handled as soon as it arrives.
+ *
+ * Handlers may watch, unwatch and re-arm from inside a dispatch.
+ */
+class EventLoop {
+public:
+    typedef std::function<void()> Handler;
+    typedef std::function<void(int)> SignalHandler;
+
+private:
+    struct Timer {
+        int fd;                 // timerfd, -1 where there is none
+        uint64_t deadlineNs;    // 0 when disarmed
+        Handler handler;
+    };
+
+    std::map<int, Handler> readers;
+    std::vector<Timer> timers;
+    int signal_fd;
+    SignalHandler signalHandler;
+    std::vector<int> signalNumbers;
+    sigset_t previousMask;
+    uint64_t wakeups;
+
+    void dispatchSignals();
+
+public:
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    /**
+     * @brief Receive signals as loop events instead of asynchronous handlers
+     *
+     * The signals are blocked in the calling thread, which must be the one
+     * running the loop, until the loop is destroyed. Threads that should not
+     * take them must block them too (see TraceRecorder's flusher).
+     * @return false if the signals could not be redirected
+     */
+    bool watchSignals(const std::vector<int>& signals, SignalHandler handler);
+
+    /**
+     * @brief Call handler whenever fd is readable, hung up or in error
+     *
+     * Level-triggered: the handler must consume the data or unwatch the fd.
+     * Replaces an earlier handler for the same fd; negative fds are ignored.
+     */
+    void watchReadable(int fd, Handler handler);
+    void unwatch(int fd);
+
+    /**
+     * @brief Create a disarmed one-shot timer
+     * @return Timer id for armTimer()/disarmTimer()
+     */
+    int addTimer(Handler handler);
+
+    /**
+     * @brief Fire the timer once at a SampleClock::nowNs() time (re-arming replaces)
+     */
+    void armTimer(int timer, uint64_t deadlineNs);
+    void disarmTimer(int timer);
+
+    /**
+     * @brief Wait for events and dispatch them
+     * @param timeoutMs -1 to wait until something happens, 0 to only check
+     * @return Number of handlers run
+     */
+    int runOnce(int timeoutMs = -1);
+
+    /**
+     * @brief Times runOnce() returned from poll()
+     */
+    uint64_t getWakeups() const { return wakeups; }
+};
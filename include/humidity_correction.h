@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Hygroscopic growth model used to correct PM readings for humidity
+ *
+ * Optical sensors count water-swollen particles as dry mass. Following the
+ * kappa-Koehler form, the raw value is divided by
+ *
+ *   C = 1 + (kappa / 1.65) / (100 / RH - 1)
+ *
+ * with a kappa per pollutant. RH is capped at maxRH, where the factor would
+ * otherwise grow without bound. Parsed from a spec such as
+ * "kappa25=0.4,kappa10=0.35,max-rh=95,max-age=900".
+ */
+struct HumidityModel {
+    double kappa25;
+    double kappa10;
+    double maxRH;           // percent
+    int64_t maxAgeMs;       // humidity older than this is not joined
+
+    HumidityModel() : kappa25(0.4), kappa10(0.35), maxRH(95.0), maxAgeMs(15 * 60 * 1000LL) {}
+
+    /**
+     * @brief Divisor C for a kappa at a relative humidity (percent)
+     */
+    double growthFactor(double kappa, double rh) const;
+
+    static bool parse(const std::string& spec, HumidityModel& model);
+};
+
+/**
+ * @brief Recent humidity samples and the as-of join against them
+ *
+ * Keeps the newest CAPACITY samples ordered by time. A lookup walks back
+ * from the newest sample, and PM readings are close to it, so the join costs
+ * the same however long the history or the humidity log gets.
+ */
+class HumidityJoin {
+public:
+    static const size_t CAPACITY = 256;
+
+private:
+    struct Sample {
+        int64_t timestampMs;
+        float rh;
+    };
+
+    Sample samples[CAPACITY];   // ring, oldest at head
+    size_t head;
+    size_t count;
+
+    const Sample& at(size_t index) const { return samples[(head + index) % CAPACITY]; }
+
+public:
+    HumidityJoin();
+
+    /**
+     * @brief Add a humidity sample; late ones are slotted into time order
+     */
+    void addSample(int64_t timestampMs, float rh);
+
+    /**
+     * @brief Latest humidity at or before a time
+     * @param maxAgeMs Samples older than this relative to timestampMs do not match
+     * @return false if there is none
+     */
+    bool lookup(int64_t timestampMs, int64_t maxAgeMs, float& rh) const;
+
+    size_t size() const { return count; }
+    void clear();
+};
+
+/**
+ * @brief Non-blocking reader of humidity lines from a file or FIFO
+ *
+ * Lines are "<unix_time> <rh>" or "<unix_time>,<rh>" with the time in
+ * seconds or milliseconds, or just "<rh>", which is stamped on arrival.
+ * A regular file is followed like `tail -f`: what is appended later is
+ * read on the next poll.
+ */
+class HumidityFeed {
+private:
+    std::string path;
+    int fd;
+    std::string buffer;
+    uint64_t malformedLines;
+
+public:
+    HumidityFeed();
+    ~HumidityFeed();
+    HumidityFeed(const HumidityFeed&) = delete;
+    HumidityFeed& operator=(const HumidityFeed&) = delete;
+
+    bool open(const std::string& source);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    const std::string& getPath() const { return path; }
+    uint64_t getMalformedLines() const { return malformedLines; }
+
+    /**
+     * @brief Read whatever is available and add it to a join
+     * @return Number of samples added
+     */
+    size_t poll(HumidityJoin& join);
+};
+
+/**
+ * @brief A reading after the humidity stage
+ */
+struct CorrectedReading {
+    float pm25;             // corrected, or the raw value if no humidity matched
+    float pm10;
+    float rh;               // joined humidity, -1 if none
+    bool corrected;
+};
+
+/**
+ * @brief The humidity correction stage: feed, join and model together
+ *
+ * Without a feed, samples can still be pushed with addHumidity() (e.g. by a
+ * plugin that measures RH itself).
+ */
+class HumidityCorrector {
+private:
+    HumidityModel model;
+    HumidityJoin join;
+    HumidityFeed feed;
+    bool enabled;
+
+public:
+    HumidityCorrector() : enabled(false) {}
+
+    /**
+     * @brief Enable the stage, reading humidity from a file or FIFO if given
+     * @return false if the source cannot be opened
+     */
+    bool configure(const std::string& source, const HumidityModel& settings);
+
+    bool isEnabled() const { return enabled; }
+    const HumidityModel& getModel() const { return model; }
+
+    void addHumidity(int64_t timestampMs, float rh) { join.addSample(timestampMs, rh); }
+
+    /**
+     * @brief Poll the feed and correct one reading
+     */
+    CorrectedReading apply(int64_t timestampMs, float pm25, float pm10);
+};
@@ -2,6 +2,16 @@
 
 #include "sensor_plugin.h"
 #include "sensor_registry.h"
+#include "metrics.h"
+#include "tdigest.h"
+#include "aqi_engine.h"
+#include "reading_history.h"
+#include "trend_buckets.h"
+#include "outlier_filter.h"
+#include "humidity_correction.h"
+#include "sensor_health.h"
+#include "device_lookup.h"
+#include "event_loop.h"
 #include <ncurses.h>
 #include <deque>
 #include <memory>
@@ -16,15 +26,54 @@ private:
     WINDOW* menuWin;
     WINDOW* dataWin;
     WINDOW* statsWin;
+    WINDOW* percentileWin;
     WINDOW* statusWin;
+    WINDOW* debugWin;
+    WINDOW* chartWin;
+    
+    // One line of the data window and what the pipeline made of it
+    struct RecentReading {
+        std::unique_ptr<SensorData> data;
+        AQIResult aqi;                  // NowCast index right after the reading
+        uint8_t flags;                  // ReadingFlags, outlier and gap bits
+        CorrectedReading correction;    // humidity stage result
+
+        RecentReading(std::unique_ptr<SensorData> reading, const AQIResult& index, uint8_t readingFlags,
+                      const CorrectedReading& corrected)
+            : data(std::move(reading)), aqi(index), flags(readingFlags), correction(corrected) {}
+    };
     
     SensorRegistry registry;
     std::unique_ptr<SensorPlugin> currentSensor;
-    std::deque<std::unique_ptr<SensorData>> readings;
+    std::deque<RecentReading> readings;
+    ReadingHistory history;             // whole session, columnar, for the statistics; mapped with historyFile
+    TrendBuckets trend;                 // same readings, pre-aggregated for the chart
+    FilterPipeline filter;              // flags spikes before anything aggregates them
+    HumidityCorrector humidity;         // corrected values feed every aggregate
+    size_t outlierCount;
     static const size_t MAX_READINGS = 100;
+    TDigest pm25Digest;     // every reading since the sensor was selected
+    TDigest pm10Digest;
+    AQIEngine aqiEngine;
     
     int maxY, maxX;
     bool inSensorMode;
+    bool showDebugPanel;
+    bool showChart;
+    size_t chartSpan;       // index into the chart span presets
+    bool unicodeBlocks;     // terminal can draw block elements
+    
+    std::string captureFile;
+    std::string historyFile;            // ring file the history is kept in, empty for memory only
+    std::string sensorPort;             // kept while the link is down and being reopened
+    SensorHealth health;
+    DeviceWatcher deviceWatcher;        // reconnects as soon as a re-enumerated adapter appears
+    EventLoop events;                   // stdin, signals, sensor and device changes, health deadlines
+    int watchedSensorFd;
+    int healthTimer;
+    bool quitRequested;
+    SensorMetrics* sensorMetrics;
+    std::vector<uint64_t> pendingRender;  // decode times of readings not drawn yet
     
     /**
      * @brief Create and position all windows
@@ -41,6 +90,31 @@ private:
      */
     void showSensorData();
     
+    /**
+     * @brief Read one frame if the sensor is readable, reopen it once its
+     *        backoff expired, and close it when it errors out or stalls
+     *
+     * An unplugged sensor costs one open() per backoff step instead of a busy
+     * retry loop.
+     */
+    void serviceSensor(bool readable);
+    
+    /**
+     * @brief Point the event loop at the sensor's current descriptor and arm
+     *        the timer for its next health deadline
+     */
+    void watchSensor();
+    
+    /**
+     * @brief Dispatch every key waiting on stdin
+     */
+    void processInput();
+    
+    /**
+     * @brief Redraw the current screen
+     */
+    void redraw();
+    
     /**
      * @brief Update the data display window
      */
@@ -51,26 +125,59 @@ private:
      */
     void updateStatsWindow();
     
+    /**
+     * @brief Update the P50/P90/P98 window
+     */
+    void updatePercentileWindow();
+    
     /**
      * @brief Update the status window
      */
     void updateStatusWindow();
     
     /**
-     * @brief Handle input in menu mode
+     * @brief Update the hidden pipeline metrics panel
+     */
+    void updateDebugWindow();
+    
+    /**
+     * @brief Show or hide the pipeline metrics panel
+     */
+    void toggleDebugPanel();
+    
+    /**
+     * @brief (Re)create the debug and chart panels that overlay the data window
+     */
+    void placeOverlayWindows();
+    
+    /**
+     * @brief Update the trend chart (sparklines and PM2.5 distribution)
+     */
+    void updateChartWindow();
+    
+    /**
+     * @brief Handle a key in menu mode
+     * @return 1 to quit
      */
-    int handleMenuInput();
+    int handleMenuInput(int ch);
     
     /**
-     * @brief Handle input in sensor mode
+     * @brief Handle a key in sensor mode
+     * @return 1 to quit
      */
-    int handleSensorInput();
+    int handleSensorInput(int ch);
     
     /**
      * @brief Select and initialize a sensor
      */
     bool selectSensor(const SensorInfo& info);
     
+    /**
+     * @brief Rebuild the chart, percentiles, AQI and the last readings from
+     *        a re-attached history
+     */
+    void restoreFromHistory();
+    
 public:
     /**
      * @brief Constructor
@@ -97,6 +204,39 @@ public:
      */
     void cleanup();
     
+    /**
+     * @brief Tee raw input of the sensors selected from now on into a file
+     * @param path Capture file, empty to disable
+     */
+    void setCaptureFile(const std::string& path) { captureFile = path; }
+    
+    /**
+     * @brief Keep the history of the selected sensor in a memory-mapped ring file
+     *
+     * Selecting the same sensor again, in this or a later process, brings its
+     * history back at once.
+     * @param path Ring file, empty to keep the history in memory only
+     */
+    void setHistoryFile(const std::string& path) { historyFile = path; }
+    
+    /**
+     * @brief Select the AQI scale used for colours and quality labels
+     */
+    void setAQIStandard(AQIStandard standard) { aqiEngine.setStandard(standard); }
+    
+    /**
+     * @brief Configure the outlier filter stage
+     */
+    void setFilterConfig(const FilterConfig& config) { filter.configure(config); }
+    
+    /**
+     * @brief Enable humidity correction from a file or FIFO
+     * @return false if the source cannot be opened
+     */
+    bool setHumiditySource(const std::string& path, const HumidityModel& model) {
+        return humidity.configure(path, model);
+    }
+    
     /**
      * @brief Add a new sensor reading
      */
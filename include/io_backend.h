@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+/**
+ * @brief Which kernel interface an IoBackend uses
+ */
+enum class IoBackendKind {
+    Auto,       // io_uring where the kernel allows it, otherwise Readiness
+    Readiness,  // epoll on Linux, poll() elsewhere; one read() per ready port
+    IoUring     // multishot reads and linked write+fdatasync, Linux 5.17+
+};
+
+/**
+ * @brief Counters for comparing backends
+ */
+struct IoBackendStats {
+    uint64_t syscalls;          // every system call the backend made
+    uint64_t readCompletions;   // chunks handed to read handlers
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t syncs;             // completed fdatasync() calls
+    uint64_t writeErrors;
+
+    IoBackendStats() : syscalls(0), readCompletions(0), bytesRead(0), bytesWritten(0), syncs(0), writeErrors(0) {}
+};
+
+/**
+ * @brief Completion-style I/O over many serial ports and append-only logs
+ *
+ * Readers get the bytes of a descriptor as they arrive; writes are queued,
+ * coalesced per descriptor and submitted together on the next runOnce(),
+ * each batch optionally followed by fdatasync(). With io_uring one
+ * io_uring_enter() submits all writes and collects every port's input, where
+ * the readiness backend needs a read() per port and a write() and
+ * fdatasync() per log.
+ *
+ * Single-threaded: all calls must come from the thread running the backend.
+ */
+class IoBackend {
+public:
+    /**
+     * @brief Receives input; length 0 is end of file, negative is -errno.
+     *        After either the descriptor is no longer read.
+     */
+    typedef std::function<void(const unsigned char* data, ssize_t length)> ReadHandler;
+
+protected:
+    IoBackendStats counters;
+
+public:
+    virtual ~IoBackend() {}
+
+    /**
+     * @brief Backend for a kind, falling back to Readiness if io_uring is unavailable
+     */
+    static std::unique_ptr<IoBackend> create(IoBackendKind kind = IoBackendKind::Auto);
+
+    /**
+     * @brief Parse "auto", "epoll" (or "poll") and "uring"
+     * @return false if the name is unknown
+     */
+    static bool parseKind(const std::string& name, IoBackendKind& kind);
+
+    /**
+     * @brief "io_uring", "epoll" or "poll"
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief Descriptor that polls readable when runOnce(0) has work, for
+     *        embedding in another loop
+     */
+    virtual int fd() const = 0;
+
+    /**
+     * @brief Deliver everything read from fd to handler
+     *
+     * fd should be non-blocking. Replaces an earlier reader of the same fd.
+     */
+    virtual bool addReader(int fd, ReadHandler handler) = 0;
+    virtual void removeReader(int fd) = 0;
+
+    /**
+     * @brief Queue bytes for the file position of fd (use O_APPEND files)
+     * @param sync fdatasync() once this batch is written
+     */
+    virtual void queueWrite(int fd, const void* data, size_t length, bool sync) = 0;
+
+    /**
+     * @brief Submit queued writes, wait for input and dispatch it
+     * @param timeoutMs -1 to wait for input, 0 to only collect what is there
+     * @return Number of read handlers run
+     */
+    virtual int runOnce(int timeoutMs) = 0;
+
+    /**
+     * @brief Wait until every queued write has completed
+     */
+    virtual void drainWrites() = 0;
+
+    const IoBackendStats& stats() const { return counters; }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Lock-free latency histogram with HDR-style log-linear buckets
+ *
+ * Values are grouped by power of two and every power of two is split into
+ * SUB_BUCKETS linear sub-buckets, which keeps the relative error below ~3%
+ * from 1 ns up to about 18 minutes. Recording is a handful of relaxed atomic
+ * operations, so it is safe to call from any acquisition thread.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_MAGNITUDE = 40;
+    static const int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    /**
+     * @brief Record a single value (nanoseconds)
+     */
+    void record(uint64_t value);
+
+    /**
+     * @brief Number of recorded values
+     */
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Sum of all recorded values
+     */
+    uint64_t sumOfValues() const { return sum.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Smallest recorded value, 0 if empty
+     */
+    uint64_t min() const;
+
+    /**
+     * @brief Largest recorded value, 0 if empty
+     */
+    uint64_t max() const { return maxValue.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Arithmetic mean of the recorded values
+     */
+    double mean() const;
+
+    /**
+     * @brief Value at the given percentile (0-100)
+     * @return Representative value of the bucket containing the percentile
+     */
+    uint64_t valueAtPercentile(double percentile) const;
+
+    /**
+     * @brief Clear all recorded values
+     */
+    void reset();
+
+    /**
+     * @brief Map a value to its bucket index
+     */
+    static int bucketIndex(uint64_t value);
+
+    /**
+     * @brief Smallest value that maps to the given bucket
+     */
+    static uint64_t bucketLowerBound(int index);
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> minValue;
+    std::atomic<uint64_t> maxValue;
+};
+
+/**
+ * @brief Instrumentation for one sensor's acquisition pipeline
+ *
+ * Histograms hold nanosecond latencies, counters are plain event counts.
+ */
+struct SensorMetrics {
+    LatencyHistogram readSyscall;   // time spent inside read() on the serial fd
+    LatencyHistogram frameParse;    // header/checksum validation and decode
+    LatencyHistogram frameAssembly; // first byte of a frame delivered -> frame decoded
+    LatencyHistogram queueWait;     // frame decoded -> shown by a consumer
+    LatencyHistogram render;        // one redraw of the sensor view
+
+    std::atomic<uint64_t> readCalls;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> framesAccepted;
+    std::atomic<uint64_t> checksumFailures;
+    std::atomic<uint64_t> resyncEvents;
+    std::atomic<uint64_t> readTimeouts;
+    std::atomic<uint64_t> outliers;         // readings flagged by the filter stage
+    std::atomic<uint64_t> missedFrames;     // frames expected from the cadence but never received
+    std::atomic<uint64_t> reconnects;       // links reopened after a stall or error
+    std::atomic<uint64_t> busDropped;       // readings the daemon lost to a full ReadingBus
+
+    std::atomic<const char*> ioProfile;  // SerialPort::profileName() of the port
+
+    SensorMetrics();
+
+    /**
+     * @brief Clear all histograms and counters
+     */
+    void reset();
+};
+
+/**
+ * @brief Process-wide registry of per-sensor metrics
+ *
+ * Lookups take a mutex, so callers resolve their SensorMetrics once (e.g. on
+ * initialize) and keep the reference; the entries are never freed while the
+ * process runs, so the reference stays valid.
+ */
+class MetricsRegistry {
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<SensorMetrics>> sensors;
+
+    MetricsRegistry() {}
+
+public:
+    /**
+     * @brief Get the global registry
+     */
+    static MetricsRegistry& instance();
+
+    /**
+     * @brief Get (or create) the metrics block for a sensor
+     * @param sensorId Sensor identifier, usually its port
+     */
+    SensorMetrics& forSensor(const std::string& sensorId);
+
+    /**
+     * @brief List registered sensors with their metrics
+     */
+    std::vector<std::pair<std::string, const SensorMetrics*>> list() const;
+
+    /**
+     * @brief Write all metrics in Prometheus text exposition format
+     */
+    void exportText(std::ostream& out) const;
+
+    /**
+     * @brief Monotonic timestamp in nanoseconds used for all measurements
+     */
+    static uint64_t nowNs();
+};
+
+/**
+ * @brief Records the lifetime of the object into a histogram
+ */
+class ScopedLatency {
+private:
+    LatencyHistogram* histogram;
+    uint64_t start;
+
+public:
+    explicit ScopedLatency(LatencyHistogram* h)
+        : histogram(h), start(h ? MetricsRegistry::nowNs() : 0) {}
+
+    ~ScopedLatency() {
+        if (histogram) {
+            histogram->record(MetricsRegistry::nowNs() - start);
+        }
+    }
+};
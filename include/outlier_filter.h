@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Settings of the outlier filter stage
+ *
+ * Parsed from a spec such as "window=15,threshold=3,min=5,rate=50,ceiling=999"
+ * or "off"; unspecified keys keep their defaults.
+ */
+struct FilterConfig {
+    bool enabled;
+    size_t window;              // Hampel window in samples, 0 disables it
+    double threshold;           // deviations, in scaled MADs, that count as outliers
+    float minDeviation;         // µg/m³ below which nothing is an outlier (flat signals have MAD 0)
+    float maxRatePerSecond;     // µg/m³ per second from the last accepted value, 0 disables it
+    float ceiling;              // values at or above this are the sensor's saturation value
+
+    FilterConfig() : enabled(true), window(15), threshold(3.0), minDeviation(5.0f),
+                     maxRatePerSecond(0.0f), ceiling(999.9f) {}
+
+    /**
+     * @brief Parse a filter spec
+     * @return false on unknown keys or invalid values
+     */
+    static bool parse(const std::string& spec, FilterConfig& config);
+
+    std::string toString() const;
+};
+
+/**
+ * @brief One check applied to each sample of one pollutant
+ *
+ * Implementations keep fixed-size state allocated at construction, so
+ * inspecting a sample never allocates.
+ */
+class SampleFilter {
+public:
+    virtual ~SampleFilter() {}
+
+    /**
+     * @brief Inspect the next sample
+     * @return true if it is an outlier
+     */
+    virtual bool inspect(int64_t timestampMs, float value) = 0;
+
+    virtual void reset() = 0;
+    virtual const char* getName() const = 0;
+};
+
+/**
+ * @brief Flags values at or above the sensor's ceiling
+ */
+class CeilingFilter : public SampleFilter {
+private:
+    float ceiling;
+
+public:
+    explicit CeilingFilter(float limit) : ceiling(limit) {}
+
+    bool inspect(int64_t timestampMs, float value) override;
+    void reset() override {}
+    const char* getName() const override { return "ceiling"; }
+};
+
+/**
+ * @brief Causal Hampel filter: distance from the rolling median in MADs
+ *
+ * A sample is an outlier when |x - median| > max(threshold * 1.4826 * MAD,
+ * minDeviation) over the previous `window` samples. Flagged samples still
+ * enter the window, so a sustained change of level is accepted once it makes
+ * up half of it. The window is kept sorted, making each sample O(window).
+ */
+class HampelFilter : public SampleFilter {
+public:
+    static const size_t MAX_WINDOW = 63;
+
+private:
+    size_t window;
+    double threshold;
+    float minDeviation;
+    float arrivals[MAX_WINDOW];     // ring in arrival order
+    float sorted[MAX_WINDOW];
+    size_t count;
+    size_t next;
+
+public:
+    HampelFilter(size_t windowSize, double thresholdMads, float minimumDeviation);
+
+    bool inspect(int64_t timestampMs, float value) override;
+    void reset() override;
+    const char* getName() const override { return "hampel"; }
+};
+
+/**
+ * @brief Flags changes faster than a limit from the last accepted value
+ *
+ * After `reanchorAfter` consecutive rejections the new level is accepted,
+ * so a real step does not keep being rejected.
+ */
+class RateOfChangeFilter : public SampleFilter {
+private:
+    float maxRatePerSecond;
+    float minDeviation;
+    size_t reanchorAfter;
+    bool hasLast;
+    int64_t lastTimestampMs;
+    float lastValue;
+    size_t rejected;
+
+public:
+    RateOfChangeFilter(float maxRate, float minimumDeviation, size_t reanchor);
+
+    bool inspect(int64_t timestampMs, float value) override;
+    void reset() override;
+    const char* getName() const override { return "rate"; }
+};
+
+/**
+ * @brief The filter stage between frame decode and history append
+ *
+ * Runs the configured filters on PM2.5 and PM10 separately and returns the
+ * ReadingFlags outlier bits of the sample; every filter sees every sample.
+ */
+class FilterPipeline {
+private:
+    FilterConfig config;
+    std::vector<std::unique_ptr<SampleFilter>> channels[2];
+
+public:
+    explicit FilterPipeline(const FilterConfig& cfg = FilterConfig());
+
+    /**
+     * @brief Rebuild the filters; also clears their state
+     */
+    void configure(const FilterConfig& cfg);
+
+    const FilterConfig& getConfig() const { return config; }
+
+    /**
+     * @brief Inspect one reading
+     * @return ReadingFlags::OutlierPM25 / OutlierPM10 bits, 0 if clean
+     */
+    uint8_t process(int64_t timestampMs, float pm25, float pm10);
+
+    void reset();
+};
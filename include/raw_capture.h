@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One record of a raw serial capture file
+ */
+struct CaptureRecord {
+    enum Type : uint16_t {
+        Bytes = 1,  // raw bytes as returned by one read()
+        Frame = 2   // frame decoded from the bytes so far (4 bytes: pm25_raw, pm10_raw)
+    };
+
+    uint64_t timestamp_ns;  // arrival time, MetricsRegistry::nowNs() clock
+    Type type;
+    std::vector<unsigned char> payload;
+};
+
+/**
+ * @brief Tees raw serial bytes and their decode to a capture file
+ *
+ * File layout: 8-byte magic "SDSRAW01", then records of
+ * {u64 timestamp_ns, u16 type, u16 length, u32 reserved} + payload.
+ */
+class RawCaptureWriter {
+private:
+    std::ofstream file;
+    std::mutex mutex;
+
+    void writeRecord(uint64_t timestampNs, CaptureRecord::Type type,
+                     const unsigned char* data, size_t length);
+
+public:
+    /**
+     * @brief Create (truncate) the capture file
+     * @return true if the file could be opened
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Check whether a capture file is open
+     */
+    bool isOpen() const { return file.is_open(); }
+
+    /**
+     * @brief Record bytes returned by one read() call
+     */
+    void writeBytes(uint64_t timestampNs, const unsigned char* data, size_t length);
+
+    /**
+     * @brief Record a frame decoded at capture time
+     */
+    void writeFrame(uint64_t timestampNs, uint16_t pm25Raw, uint16_t pm10Raw);
+
+    /**
+     * @brief Flush and close the file
+     */
+    void close();
+};
+
+/**
+ * @brief Sequential reader for capture files
+ */
+class RawCaptureReader {
+private:
+    std::ifstream file;
+
+public:
+    /**
+     * @brief Open a capture file and validate its magic
+     * @return true if the file is a capture file
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Read the next record
+     * @return false at end of file or on a truncated record
+     */
+    bool next(CaptureRecord& record);
+};
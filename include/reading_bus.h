@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief One reading as carried by a ReadingBus (32 bytes, trivially copyable)
+ */
+struct BusReading {
+    uint64_t monotonic_ns;  // SampleClock time the frame was decoded
+    int64_t timestamp_ms;   // Unix time in milliseconds
+    float pm25;
+    float pm10;
+    uint8_t flags;          // ReadingFlags known at acquisition
+    uint8_t reserved[7];
+
+    BusReading() : monotonic_ns(0), timestamp_ms(0), pm25(0.0f), pm10(0.0f), flags(0), reserved() {}
+};
+
+/**
+ * @brief What a consumer does when it falls a full ring behind its producer
+ */
+enum class BusPolicy : uint8_t {
+    DropOldest, // skip what was overwritten and count it as dropped
+    Block,      // the producer waits for this consumer; nothing is lost
+    Sample      // only ever see the newest reading; older ones are skipped, not dropped
+};
+
+/**
+ * @brief Counters for one consumer
+ */
+struct BusConsumerStats {
+    int consumer;           // index among the bus's consumers
+    BusPolicy policy;
+    uint64_t delivered;
+    uint64_t dropped;       // overwritten before they were read (DropOldest)
+    uint64_t skipped;       // passed over on purpose (Sample)
+    uint64_t lag;           // published but not yet read, now
+    uint64_t maxLag;
+
+    BusConsumerStats() : consumer(-1), policy(BusPolicy::DropOldest), delivered(0), dropped(0), skipped(0), lag(0),
+                         maxLag(0) {}
+};
+
+class ReadingBus;
+
+/**
+ * @brief A consumer's cursor into a ReadingBus
+ *
+ * Owned and polled by one consumer thread; the producer only reads the
+ * position of Block consumers. Destroying it detaches it from the bus, which
+ * must outlive it.
+ */
+class BusConsumer {
+private:
+    friend class ReadingBus;
+
+    ReadingBus* bus;
+    int slot;
+    BusPolicy policy;
+
+    BusConsumer(ReadingBus* owner, int index, BusPolicy mode) : bus(owner), slot(index), policy(mode) {}
+
+public:
+    ~BusConsumer();
+    BusConsumer(const BusConsumer&) = delete;
+    BusConsumer& operator=(const BusConsumer&) = delete;
+
+    /**
+     * @brief Next reading for this consumer, without waiting
+     * @return false if it has seen everything published so far
+     */
+    bool poll(BusReading& reading);
+
+    BusPolicy getPolicy() const { return policy; }
+    BusConsumerStats stats() const;
+};
+
+/**
+ * @brief Lock-free broadcast ring from one producer to many consumers
+ *
+ * Every consumer sees every reading (policy permitting) through its own
+ * cursor; nothing is copied per consumer. The producer writes a slot under
+ * a sequence number that readers check before and after copying, so a
+ * consumer that is lapped mid-copy notices and retries instead of returning
+ * a torn reading. Publishing never takes a lock and never waits, unless a
+ * Block consumer is a full ring behind.
+ *
+ * One thread may publish; subscribe() and consumer destruction are safe
+ * from any thread.
+ */
+class ReadingBus {
+public:
+    static const size_t DEFAULT_CAPACITY = 1024;   // readings, a power of two
+    static const int MAX_CONSUMERS = 16;
+
+private:
+    friend class BusConsumer;
+
+    static const size_t WORDS = sizeof(BusReading) / sizeof(uint64_t);
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;     // 2 * (position + 1) once written, odd while writing
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    // Written by the consumer, read by the producer (Block) and stats()
+    struct Cursor {
+        std::atomic<bool> active;
+        std::atomic<uint8_t> policy;
+        std::atomic<uint64_t> position;     // next position to read
+        std::atomic<uint64_t> delivered;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> skipped;
+        std::atomic<uint64_t> maxLag;
+        char padding[16];                   // one cache line per consumer
+    };
+
+    size_t capacity;
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> head;                 // next position to publish
+    std::atomic<uint32_t> blockingMask;         // Cursor indices with BusPolicy::Block
+    std::atomic<uint64_t> stallCount;           // publishes that had to wait for a Block consumer
+    char padding[48];                           // keep the producer's line apart from the cursors
+    Cursor cursors[MAX_CONSUMERS];
+    mutable std::mutex subscribeMutex;
+
+    void waitForBlockingConsumers(uint64_t position);
+    void detach(int slot);
+    BusConsumerStats cursorStats(int slot) const;
+
+public:
+    /**
+     * @param capacityHint Rounded up to a power of two
+     */
+    explicit ReadingBus(size_t capacityHint = DEFAULT_CAPACITY);
+    ReadingBus(const ReadingBus&) = delete;
+    ReadingBus& operator=(const ReadingBus&) = delete;
+
+    /**
+     * @brief Add a consumer that starts with the next published reading
+     * @return null if MAX_CONSUMERS are attached already
+     */
+    std::unique_ptr<BusConsumer> subscribe(BusPolicy policy);
+
+    /**
+     * @brief Broadcast a reading; only the producer thread may call this
+     */
+    void publish(const BusReading& reading);
+
+    size_t getCapacity() const { return capacity; }
+    uint64_t published() const { return head.load(std::memory_order_acquire); }
+    uint64_t stalls() const { return stallCount.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Stats of every attached consumer
+     */
+    std::vector<BusConsumerStats> consumerStats() const;
+
+    /**
+     * @brief "drop-oldest", "block" or "sample"
+     */
+    static const char* policyName(BusPolicy policy);
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "aggregate_kernels.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Column selector for ReadingHistory aggregations
+ */
+enum class HistoryColumn {
+    PM25,
+    PM10,
+    PM25Corrected,      // after the humidity stage; equal to PM25 where it did not apply
+    PM10Corrected
+};
+
+/**
+ * @brief Pollutant of a column: 0 for PM2.5, 1 for PM10
+ */
+inline int pollutantIndex(HistoryColumn column) {
+    return (column == HistoryColumn::PM25 || column == HistoryColumn::PM25Corrected) ? 0 : 1;
+}
+
+/**
+ * @brief Bits of the flags column
+ */
+namespace ReadingFlags {
+    const uint8_t OutlierPM25 = 0x01;   // kept, but excluded from PM2.5 aggregates
+    const uint8_t OutlierPM10 = 0x02;   // kept, but excluded from PM10 aggregates
+    const uint8_t HumidityCorrected = 0x04; // the corrected columns differ from the raw ones
+    const uint8_t GapBefore = 0x08;     // frames were missed or the link was reopened before this one
+
+    /**
+     * @brief Outlier bit of a column
+     */
+    inline uint8_t outlierBit(HistoryColumn column) {
+        return pollutantIndex(column) == 0 ? OutlierPM25 : OutlierPM10;
+    }
+}
+
+/**
+ * @brief One reading materialised from the columns
+ */
+struct HistoryRow {
+    static const uint8_t HUMIDITY_UNKNOWN = 0xFF;
+
+    int64_t timestamp_ms;   // Unix time in milliseconds
+    uint16_t pm25_raw;      // deci-µg/m³, as sent by the sensor
+    uint16_t pm10_raw;
+    uint16_t pm25_corrected_raw;    // deci-µg/m³ after the humidity stage
+    uint16_t pm10_corrected_raw;
+    uint8_t humidity;       // joined RH in percent, HUMIDITY_UNKNOWN if none
+    uint8_t flags;
+
+    float pm25() const { return pm25_raw / 10.0f; }
+    float pm10() const { return pm10_raw / 10.0f; }
+    float pm25Corrected() const { return pm25_corrected_raw / 10.0f; }
+    float pm10Corrected() const { return pm10_corrected_raw / 10.0f; }
+    bool hasHumidity() const { return humidity != HUMIDITY_UNKNOWN; }
+    bool excluded(HistoryColumn column) const { return (flags & ReadingFlags::outlierBit(column)) != 0; }
+};
+
+/**
+ * @brief Struct-of-arrays reading history in fixed-size chunks
+ *
+ * Each chunk holds CHUNK_ROWS readings as contiguous columns (timestamp,
+ * raw and humidity-corrected pm25/pm10, humidity, flags), so aggregations only touch the columns they
+ * need and run through the SIMD kernels a chunk at a time. Appending is O(1):
+ * a new chunk is only needed every CHUNK_ROWS readings, and once the capacity
+ * is reached the oldest chunk is recycled instead of freed.
+ *
+ * Timestamps are expected to be non-decreasing, which lets lowerBound()
+ * binary-search first across chunks and then inside one.
+ *
+ * Rows flagged as outliers stay in the history but are left out of
+ * summarize(). Chunks count their flagged rows, so only chunks that contain
+ * some fall back from the SIMD kernels to a masked loop.
+ *
+ * attach() moves the chunks into a shared memory-mapped file: a versioned
+ * header with the ring's first slot and chunk count, followed by one slot
+ * per chunk in exactly the in-memory layout. Appends write straight into
+ * the mapping, so a later process that attaches the same file sees the
+ * whole history at once, without parsing or replaying anything. The file is
+ * locked while attached, so it has one writer at a time.
+ */
+class ReadingHistory {
+public:
+    static const size_t CHUNK_ROWS = 4096;
+
+    struct Chunk {
+        int64_t timestamp_ms[CHUNK_ROWS];
+        uint16_t pm25_raw[CHUNK_ROWS];
+        uint16_t pm10_raw[CHUNK_ROWS];
+        uint16_t pm25_corrected_raw[CHUNK_ROWS];
+        uint16_t pm10_corrected_raw[CHUNK_ROWS];
+        uint8_t humidity[CHUNK_ROWS];
+        uint8_t flags[CHUNK_ROWS];
+        size_t rows;
+        size_t excluded[2];     // rows flagged as PM2.5 / PM10 outliers
+
+        Chunk() : rows(0) { excluded[0] = excluded[1] = 0; }
+    };
+
+private:
+    // Heap chunks are deleted, chunks in a mapped file are not
+    struct ChunkRelease {
+        bool owned;
+        explicit ChunkRelease(bool own = true) : owned(own) {}
+        void operator()(Chunk* chunk) const { if (owned) delete chunk; }
+    };
+    typedef std::unique_ptr<Chunk, ChunkRelease> ChunkPtr;
+
+    struct RingFile;                    // the mapping, defined in reading_history.cpp
+
+    std::deque<ChunkPtr> chunks;
+    size_t maxChunks;
+    size_t totalRows;
+    std::unique_ptr<RingFile> ring;     // set while attached
+
+    Chunk* nextChunk();
+
+public:
+    /**
+     * @brief Constructor
+     * @param capacityRows Approximate number of readings kept; rounded up to
+     *        whole chunks
+     */
+    explicit ReadingHistory(size_t capacityRows = 7 * 24 * 3600);
+    ~ReadingHistory();
+    ReadingHistory(ReadingHistory&& other);
+    ReadingHistory& operator=(ReadingHistory&& other);
+
+    /**
+     * @brief Keep the history in a memory-mapped ring file
+     *
+     * If the file holds a ring of this build's layout and the same label, it
+     * is re-attached as it is and replaces the rows in memory; a ring of
+     * another capacity keeps its newest rows. Otherwise the file is
+     * (re)created for the current capacity and the rows in memory move in.
+     * @param label Owner of the ring, e.g. the sensor port; a ring with
+     *        another label is started afresh
+     * @return false if the file cannot be created or mapped, or another
+     *         process has it attached; the history then stays in memory
+     */
+    bool attach(const std::string& path, const std::string& label = "");
+
+    /**
+     * @brief Stop using the file, keeping its rows in memory
+     */
+    void detach();
+
+    /**
+     * @brief Copy the rows of a ring file into memory, leaving the file as it is
+     *
+     * The capacity becomes the ring's. Meant for readers of a ring that
+     * another process may own, such as an export.
+     * @param label Receives the ring's label
+     * @return false if the file is not a ring of this build's layout
+     */
+    bool load(const std::string& path, std::string* label = nullptr);
+
+    bool attached() const { return ring != nullptr; }
+
+    /**
+     * @brief Append a reading with all its columns
+     */
+    void append(const HistoryRow& reading);
+
+    /**
+     * @brief Append rows [begin, end) of a chunk, copied a column at a time
+     *
+     * Meant for forEachSlice() of another history, e.g. to snapshot a range.
+     */
+    void appendSlice(const Chunk& source, size_t begin, size_t end);
+
+    /**
+     * @brief Append an uncorrected reading
+     */
+    void append(int64_t timestampMs, uint16_t pm25Raw, uint16_t pm10Raw, uint8_t flags = 0);
+
+    /**
+     * @brief Append an uncorrected reading given in µg/m³
+     */
+    void append(int64_t timestampMs, float pm25, float pm10, uint8_t flags = 0);
+
+    /**
+     * @brief Row from values in µg/m³
+     * @param rh Joined humidity in percent, negative if the reading was not
+     *        corrected; sets ReadingFlags::HumidityCorrected otherwise
+     */
+    static HistoryRow makeRow(int64_t timestampMs, float pm25, float pm10, float pm25Corrected,
+                              float pm10Corrected, float rh, uint8_t flags);
+
+    /**
+     * @brief µg/m³ to the deci-µg/m³ column unit, rounded and clamped
+     */
+    static uint16_t toRaw(float value);
+
+    /**
+     * @brief Change the capacity, dropping the oldest chunks if needed
+     *
+     * An attached ring file is laid out again for the new capacity.
+     */
+    void setCapacity(size_t capacityRows);
+
+    size_t size() const { return totalRows; }
+    bool empty() const { return totalRows == 0; }
+
+    /**
+     * @brief Drop every row; an attached ring file is emptied as well
+     */
+    void clear();
+
+    /**
+     * @brief Reading at an index (0 = oldest retained)
+     */
+    HistoryRow at(size_t index) const;
+
+    /**
+     * @brief Index of the first reading with timestamp >= timestampMs
+     * @return size() if there is none
+     */
+    size_t lowerBound(int64_t timestampMs) const;
+
+    /**
+     * @brief count/sum/min/max of a column over [first, first + count), in deci-µg/m³
+     *
+     * Outliers of that column are skipped; count is the number of rows used.
+     */
+    ColumnSummary summarize(HistoryColumn column, size_t first, size_t count) const;
+
+    /**
+     * @brief Same as summarize() over the whole history, converted to µg/m³
+     */
+    ColumnSummary summarizeAll(HistoryColumn column) const;
+
+    /**
+     * @brief Visit [first, first + count) as contiguous column slices
+     *
+     * fn(const Chunk& chunk, size_t begin, size_t end) is called once per
+     * chunk overlapping the range; [begin, end) are row offsets in that chunk.
+     */
+    template <typename Fn>
+    void forEachSlice(size_t first, size_t count, Fn fn) const {
+        if (first >= totalRows) return;
+        size_t last = first + ((count < totalRows - first) ? count : totalRows - first);
+        size_t index = first;
+        while (index < last) {
+            const Chunk& chunk = *chunks[index / CHUNK_ROWS];
+            size_t begin = index % CHUNK_ROWS;
+            size_t end = begin + (last - index);
+            if (end > chunk.rows) end = chunk.rows;
+            fn(chunk, begin, end);
+            index += end - begin;
+        }
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <time.h>
+
+/**
+ * @brief Time base of readings, metrics, traces and captures
+ *
+ * Everything is stamped with CLOCK_MONOTONIC, which NTP never steps, so the
+ * difference between two stamps is exact. Wall-clock time is derived from a
+ * stamp through an offset to CLOCK_REALTIME that is measured separately and
+ * re-measured at most every RESYNC_INTERVAL_NS. Readings stamped between two
+ * re-measurements therefore keep their exact spacing in wall time as well,
+ * and the mapping follows clock adjustments only at those points.
+ */
+namespace SampleClock {
+    const uint64_t RESYNC_INTERVAL_NS = 60ULL * 1000000000ULL;
+
+    /**
+     * @brief CLOCK_MONOTONIC in nanoseconds
+     */
+    inline uint64_t nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    /**
+     * @brief Unix time in nanoseconds of a monotonic stamp
+     *
+     * Re-measures the offset first if it is older than RESYNC_INTERVAL_NS.
+     * Thread-safe.
+     */
+    int64_t toUnixNs(uint64_t monotonicNs);
+
+    inline int64_t toUnixMs(uint64_t monotonicNs) {
+        return toUnixNs(monotonicNs) / 1000000;
+    }
+
+    inline std::chrono::system_clock::time_point toSystemTime(uint64_t monotonicNs) {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::nanoseconds(toUnixNs(monotonicNs))));
+    }
+
+    /**
+     * @brief Measure the offset to CLOCK_REALTIME now
+     *
+     * Called automatically; useful right after the system clock was set.
+     */
+    void resync();
+
+    /**
+     * @brief Current offset: Unix time minus monotonic time, in nanoseconds
+     */
+    int64_t offsetNs();
+}
@@ -1,7 +1,12 @@
 #pragma once
 
 #include "sensor_plugin.h"
+#include "metrics.h"
+#include "sds011_stream.h"
+#include "device_lookup.h"
+#include "sample_clock.h"
 #include <chrono>
+#include <cstdint>
 
 /**
  * @brief SDS011 specific sensor data
@@ -10,10 +15,24 @@ class SDS011Data : public SensorData {
 public:
     float pm25;
     float pm10;
-    std::chrono::system_clock::time_point timestamp;
+    std::chrono::system_clock::time_point timestamp;   // monotonic_ns mapped to wall-clock time
+    uint64_t monotonic_ns;  // SampleClock::nowNs() when the frame's last byte was read
     
-    SDS011Data(float p25, float p10) 
-        : pm25(p25), pm10(p10), timestamp(std::chrono::system_clock::now()) {}
+    /**
+     * @brief Constructor
+     * @param arrivalNs Monotonic arrival stamp; defaults to now for readings
+     *        that do not come from a stream
+     */
+    SDS011Data(float p25, float p10, uint64_t arrivalNs = SampleClock::nowNs())
+        : pm25(p25), pm10(p10), timestamp(SampleClock::toSystemTime(arrivalNs)),
+          monotonic_ns(arrivalNs) {}
+    
+    /**
+     * @brief Wall-clock time of the reading in Unix milliseconds
+     */
+    int64_t unixMs() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(timestamp.time_since_epoch()).count();
+    }
     
     std::string toString() const override;
     std::string getDisplayString() const override;
@@ -26,17 +45,10 @@ class SDS011Plugin : public SensorPlugin {
 private:
     int serial_fd;
     std::string current_port;
-    
-    // SDS011 Protocol constants
-    static const unsigned char HEADER = 0xAA;
-    static const unsigned char TAIL = 0xAB;
-    static const unsigned char CMD_ID = 0xC0;
-    static const int DATA_LENGTH = 10;
-    
-    /**
-     * @brief Read a raw packet from the sensor
-     */
-    bool readPacket(std::vector<unsigned char>& packet);
+    std::string device_path;    // node opened for current_port
+    std::string bound_port;     // port the identity below belongs to; kept across cleanup()
+    DeviceId device;            // learned on the first open, followed on reopens
+    SDS011Stream stream;
     
     /**
      * @brief Setup serial port configuration
@@ -53,9 +65,14 @@ public:
     bool isAvailable(const std::string& port) const override;
     bool initialize(const std::string& port) override;
     std::unique_ptr<SensorData> readData() override;
+    std::unique_ptr<SensorData> readAvailableData() override;
     std::string getCurrentPort() const override { return current_port; }
     std::vector<std::string> getDisplayHeaders() const override;
     int getColorCode(const SensorData& data) const override;
     std::string getQualityDescription(const SensorData& data) const override;
     void cleanup() override;
+    bool enableCapture(const std::string& path) override { return stream.enableCapture(path); }
+    bool isLinkLost() const override { return stream.isLinkLost(); }
+    std::string getDevicePath() const override { return device_path; }
+    int getFd() const override { return serial_fd; }
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief A decoded SDS011 measurement frame
+ */
+struct SDS011Frame {
+    uint16_t pm25_raw;  // PM2.5 in 0.1 µg/m³
+    uint16_t pm10_raw;  // PM10 in 0.1 µg/m³
+    uint16_t device_id;
+    unsigned char bytes[10];
+    uint64_t arrival_ns;    // SampleClock::nowNs() when the last byte was read, 0 if not read from a stream
+
+    float pm25() const { return pm25_raw / 10.0f; }
+    float pm10() const { return pm10_raw / 10.0f; }
+};
+
+/**
+ * @brief Incremental SDS011 frame decoder
+ *
+ * Bytes are pushed one at a time; the parser hunts for the 0xAA 0xC0 header,
+ * validates tail and checksum, and re-synchronises inside the buffered bytes
+ * after a bad frame instead of discarding a whole read.
+ */
+class SDS011FrameParser {
+public:
+    static const unsigned char HEADER = 0xAA;
+    static const unsigned char TAIL = 0xAB;
+    static const unsigned char CMD_ID = 0xC0;
+    static const int FRAME_LENGTH = 10;
+
+    /**
+     * @brief Outcome of pushing one byte
+     */
+    enum Status {
+        NeedMore,     // frame incomplete
+        FrameReady,   // frame() holds a valid frame
+        BadChecksum,  // complete frame failed the checksum
+        Resync        // stream lost alignment, hunting for a header
+    };
+
+    SDS011FrameParser();
+
+    /**
+     * @brief Push one received byte
+     */
+    Status push(unsigned char byte);
+
+    /**
+     * @brief Last frame completed by push()
+     */
+    const SDS011Frame& frame() const { return current; }
+
+    /**
+     * @brief Bytes still missing for the frame in progress
+     */
+    int bytesNeeded() const { return FRAME_LENGTH - fill; }
+
+    /**
+     * @brief Drop any partially received frame
+     */
+    void reset() { fill = 0; hunting = false; }
+
+    /**
+     * @brief Decode a complete, validated 10-byte frame
+     */
+    static void decode(const unsigned char* bytes, SDS011Frame& out);
+
+    /**
+     * @brief Check header, command id, tail and checksum of a 10-byte frame
+     */
+    static bool isValid(const unsigned char* bytes);
+
+private:
+    unsigned char buffer[FRAME_LENGTH];
+    int fill;
+    bool hunting;
+    SDS011Frame current;
+
+    /**
+     * @brief Discard the first buffered byte and realign on the next header
+     */
+    void shift();
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "sds011_stream.h"
+#include "device_lookup.h"
 #include <string>
 #include <vector>
 
@@ -13,19 +15,14 @@ class SDS011Reader {
 private:
     int serial_fd;
     std::string port_name;
-    
-    // SDS011 Protocol constants
-    static const unsigned char HEADER = 0xAA;
-    static const unsigned char TAIL = 0xAB;
-    static const unsigned char CMD_ID = 0xC0;
-    static const int DATA_LENGTH = 10;
+    DeviceId device;        // identity of port_name, followed when the link is lost
+    SDS011Stream stream;
     
     /**
-     * @brief Read a raw packet from the sensor
-     * @param packet Vector to store the received packet
-     * @return true if a valid packet was received, false otherwise
+     * @brief Open and configure a device node for port_name
+     * @param reportErrors Print failures to stderr
      */
-    bool readPacket(std::vector<unsigned char>& packet);
+    bool openPort(const std::string& path, bool reportErrors);
     
 public:
     /**
@@ -49,9 +46,58 @@ public:
      * @brief Read PM2.5 and PM10 data from the sensor
      * @param pm25 Reference to store PM2.5 value (µg/m³)
      * @param pm10 Reference to store PM10 value (µg/m³)
+     * @param arrivalNs If given, receives the SampleClock::nowNs() stamp of the
+     *        frame's last byte
+     * 
+     * If the port disappeared (e.g. the USB adapter was reset), one attempt is
+     * made to reopen the same adapter, which may have a new device name.
      * @return true if data was successfully read, false otherwise
      */
-    bool readPM25Data(float& pm25, float& pm10);
+    bool readPM25Data(float& pm25, float& pm10, uint64_t* arrivalNs = nullptr);
+    
+    /**
+     * @brief Read one frame without retrying
+     * @param frame Decoded frame on success
+     * @return true if a frame was decoded; false on timeout or end of stream
+     */
+    bool readFrame(SDS011Frame& frame);
+    
+    /**
+     * @brief Read frames from an already open descriptor instead of the port
+     * 
+     * Used by replay mode, which feeds a capture file through a pipe so the
+     * bytes take exactly the same path as serial input. Takes ownership of fd.
+     * @param fd Open descriptor (e.g. read end of a pipe)
+     */
+    void attach(int fd);
+    
+    /**
+     * @brief Reopen the sensor after its link was lost, at its current node
+     * @return false, quietly, while the adapter is not back
+     */
+    bool reopen();
+    
+    /**
+     * @brief True once the port reported an I/O error; see reopen()
+     */
+    bool isLinkLost() const { return stream.isLinkLost(); }
+    
+    /**
+     * @brief Descriptor to wait on for readFrame(), -1 while closed
+     */
+    int getFd() const { return serial_fd; }
+    
+    /**
+     * @brief True once an attached pipe or file has been fully consumed
+     */
+    bool isEndOfStream() const { return stream.atEndOfStream(); }
+    
+    /**
+     * @brief Tee raw bytes and decoded frames into a capture file
+     * @param path Capture file to create
+     * @return true if the file could be created
+     */
+    bool enableCapture(const std::string& path) { return stream.enableCapture(path); }
     
     /**
      * @brief Print raw packet data in hexadecimal format (for debugging)
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "sds011_protocol.h"
+#include "metrics.h"
+#include "raw_capture.h"
+#include "serial_port.h"
+#include <memory>
+#include <string>
+
+/**
+ * @brief Reads SDS011 frames from a file descriptor
+ *
+ * Owns the incremental parser and does the per-read instrumentation
+ * (metrics, trace events, optional raw capture) shared by SDS011Reader and
+ * SDS011Plugin. The descriptor itself stays owned by the caller.
+ */
+class SDS011Stream {
+private:
+    int fd;
+    SDS011FrameParser parser;
+    SensorMetrics* metrics;
+    uint16_t trace_id;
+    std::unique_ptr<RawCaptureWriter> capture;
+    bool end_of_stream;
+    bool link_lost;
+    bool eof_is_final;
+    bool poll_before_read;
+    uint64_t frame_start_ns;  // when the first byte of the frame in progress was delivered
+
+    bool decode(SDS011Frame& frame, bool pollFirst, int waitMs);
+
+public:
+    SDS011Stream();
+
+    /**
+     * @brief Attach to a descriptor
+     * @param descriptor Open serial port or pipe
+     * @param sensorId Identifier used for metrics and trace events
+     * @param profile Read strategy the descriptor was configured with
+     */
+    void bind(int descriptor, const std::string& sensorId,
+              SerialIOProfile profile = SerialIOProfile::Timed);
+
+    /**
+     * @brief Detach from the descriptor and drop any partial frame
+     */
+    void unbind();
+
+    /**
+     * @brief Read until one valid frame is decoded
+     *
+     * Only the bytes still missing from the frame in progress are requested
+     * from the kernel, so bytes of the next frame are never consumed early.
+     * @return true if a frame was decoded; false on timeout, error or end of stream
+     */
+    bool readFrame(SDS011Frame& frame);
+
+    /**
+     * @brief Decode a frame from the bytes that have already arrived, never waiting
+     *
+     * For event-driven callers: a partial frame stays in the parser until the
+     * descriptor is readable again.
+     * @return true if a frame was completed
+     */
+    bool readAvailable(SDS011Frame& frame);
+
+    /**
+     * @brief True once read() reported end of file (pipes and replay only)
+     */
+    bool atEndOfStream() const { return end_of_stream; }
+
+    /**
+     * @brief True once read() failed with an error other than a timeout or
+     *        interruption, as it does after the device disappeared
+     */
+    bool isLinkLost() const { return link_lost; }
+
+    /**
+     * @brief Tee every received byte and decoded frame into a capture file
+     * @return true if the capture file could be created
+     */
+    bool enableCapture(const std::string& path);
+};
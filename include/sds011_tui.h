@@ -1,5 +1,7 @@
 #pragma once
 
+#include "tdigest.h"
+#include "aqi_engine.h"
 #include <chrono>
 #include <deque>
 #include <string>
@@ -12,9 +14,10 @@ struct SensorReading {
     std::chrono::system_clock::time_point timestamp;
     float pm25;
     float pm10;
+    AQIResult aqi;      // NowCast index right after this reading
     
-    SensorReading(float p25, float p10) 
-        : timestamp(std::chrono::system_clock::now()), pm25(p25), pm10(p10) {}
+    SensorReading(float p25, float p10, std::chrono::system_clock::time_point ts)
+        : timestamp(ts), pm25(p25), pm10(p10) {}
 };
 
 /**
@@ -29,10 +32,14 @@ private:
     WINDOW* headerWin;
     WINDOW* dataWin;
     WINDOW* statsWin;
+    WINDOW* percentileWin;
     WINDOW* statusWin;
     
     std::deque<SensorReading> readings;
     static const size_t MAX_READINGS = 100;
+    TDigest pm25Digest;     // every reading since start (or the last clear)
+    TDigest pm10Digest;
+    AQIEngine aqiEngine;
     
     int maxY, maxX;
     
@@ -51,6 +58,11 @@ private:
      */
     void updateStatsWindow();
     
+    /**
+     * @brief Update the P50/P90/P98 window
+     */
+    void updatePercentileWindow();
+    
     /**
      * @brief Update the status window
      */
@@ -62,6 +74,11 @@ public:
      */
     SDS011TUI();
     
+    /**
+     * @brief Select the AQI scale used for colours and quality labels
+     */
+    void setAQIStandard(AQIStandard standard) { aqiEngine.setStandard(standard); }
+    
     /**
      * @brief Destructor - cleans up ncurses resources
      */
@@ -88,8 +105,10 @@ public:
      * @brief Add a new sensor reading to the display
      * @param pm25 PM2.5 value in µg/m³
      * @param pm10 PM10 value in µg/m³
+     * @param timestamp When the reading was taken
      */
-    void addReading(float pm25, float pm10);
+    void addReading(float pm25, float pm10,
+                    std::chrono::system_clock::time_point timestamp = std::chrono::system_clock::now());
     
     /**
      * @brief Display an error message
@@ -103,8 +122,14 @@ public:
     void clearData();
     
     /**
-     * @brief Handle user input
+     * @brief Handle every key waiting on stdin; returns at once if there is none
      * @return 1 if user wants to quit, 0 otherwise
      */
     int handleInput();
+    
+    /**
+     * @brief Adopt the terminal's new size (on SIGWINCH taken by an EventLoop,
+     *        which ncurses then never sees)
+     */
+    void resize();
 };
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "reading_history.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief What the records of a segment file are
+ */
+enum class SegmentKind : uint32_t {
+    Raw = 0,    // one SegmentRecord per reading
+    Minute = 1, // one AggregateRecord per minute
+    Hour = 2    // one AggregateRecord per hour
+};
+
+/**
+ * @brief One reading as stored in a raw segment (24 bytes, native byte order)
+ */
+struct SegmentRecord {
+    int64_t timestamp_ms;
+    uint16_t pm25_raw;          // deci-µg/m³, as in HistoryRow
+    uint16_t pm10_raw;
+    uint16_t pm25_corrected_raw;
+    uint16_t pm10_corrected_raw;
+    uint8_t humidity;
+    uint8_t flags;              // every ReadingFlags bit, outlier verdicts included
+    uint8_t reserved[6];
+
+    static SegmentRecord fromRow(const HistoryRow& row);
+    HistoryRow toRow() const;
+};
+
+/**
+ * @brief The readings of one minute or hour, as stored in aggregate segments (64 bytes)
+ *
+ * Sums are of the corrected values in deci-µg/m³ with outliers left out, so
+ * the mean and standard deviation of any span follow from merging records.
+ * min is 0xFFFF and max 0 for a pollutant without readings.
+ */
+struct AggregateRecord {
+    int64_t start_ms;           // start of the minute or hour
+    uint32_t readings;          // every reading in it, outliers included
+    uint32_t count[2];          // readings summed for PM2.5 / PM10
+    uint16_t min[2];
+    uint16_t max[2];
+    uint8_t flags;              // GapBefore and HumidityCorrected if any reading had them
+    uint8_t reserved[3];
+    double sum[2];
+    double sumSquares[2];
+
+    static AggregateRecord empty(int64_t startMs);
+    void add(const SegmentRecord& record);
+    void merge(const AggregateRecord& other);
+
+    /**
+     * @brief Mean in µg/m³ of pollutant 0 (PM2.5) or 1 (PM10), 0 without readings
+     */
+    double mean(int pollutant) const;
+    double stddev(int pollutant) const;
+};
+
+/**
+ * @brief Catalog entry of one segment file
+ */
+struct SegmentInfo {
+    std::string sensor;
+    std::string path;           // relative to the store directory
+    SegmentKind kind;
+    int64_t minTimestamp;       // first and last record
+    int64_t maxTimestamp;
+    uint64_t records;
+    bool sealed;                // complete, with its index written after the records
+
+    SegmentInfo() : kind(SegmentKind::Raw), minTimestamp(0), maxTimestamp(0), records(0), sealed(false) {}
+};
+
+/**
+ * @brief What a range query read
+ */
+struct SegmentQueryStats {
+    size_t segments;            // segment files opened
+    size_t blocks;              // index blocks read
+    uint64_t bytes;
+
+    SegmentQueryStats() : segments(0), blocks(0), bytes(0) {}
+};
+
+/**
+ * @brief Persistent per-sensor reading log in time-indexed segment files
+ *
+ * Each sensor has a directory of segment files named after their kind and
+ * first record. A segment is a 64-byte header followed by fixed-size
+ * records in time order; every blockRecords records form a block. Once a
+ * raw segment holds segmentRecords readings it is sealed: the first
+ * timestamp of every block (the sparse index) is written after the records,
+ * the header gets the segment's time range and record count, and the
+ * segment is added to the catalog file, which lists every sealed segment
+ * with its min/max time. Changes are appended to the catalog as lines
+ * adding or dropping a segment, after the mutex is released, and open()
+ * rewrites it compactly.
+ *
+ * A range query finds the first segment that reaches the start time by a
+ * binary search over the catalog, then the first block that can hold it by
+ * a binary search over that segment's index, and reads forward from there
+ * until the end time. The cost is O(log segments + log blocks) plus the
+ * blocks in range, however long the log is.
+ *
+ * Raw segments may later be rolled up into minute and hour aggregate
+ * segments (see StoreCompactor): writeSegment() writes a sealed segment
+ * aside and replace() swaps it into the catalog for its source. Each kind
+ * is a separate tier with its own queries.
+ *
+ * The open segment of each sensor keeps its index in memory. After a crash
+ * it is recovered on open(): a torn last record is cut off and the index is
+ * rebuilt from the first timestamp of each block. Segments missing from the
+ * catalog are added from their headers.
+ *
+ * Timestamps of a sensor must not go backwards; an earlier one is stored as
+ * the latest so far. Every method takes the store's mutex, so a compactor
+ * thread can work alongside the writer; sealed segment files never change
+ * once written and can be read without it.
+ */
+class SegmentStore {
+public:
+    static const uint32_t DEFAULT_BLOCK_RECORDS = 256;         // 6 KB raw blocks
+    static const uint64_t DEFAULT_SEGMENT_RECORDS = 86400;     // a day at 1 Hz, about 2 MB
+    static const uint64_t HEADER_BYTES = 64;
+    static const int KIND_COUNT = 3;
+
+private:
+    struct Segment {
+        SegmentInfo info;
+        uint32_t blockRecords;              // from the segment's header
+        std::vector<int64_t> index;         // first timestamp of each block; loaded lazily once sealed
+
+        Segment() : blockRecords(DEFAULT_BLOCK_RECORDS) {}
+    };
+
+    struct Series {
+        std::string directory;              // relative to the store directory
+        std::vector<Segment> tiers[KIND_COUNT]; // by SegmentKind, in time order; only the last raw one may be open
+        int fd;                             // open raw segment, -1 if the last one is sealed
+        std::vector<SegmentRecord> buffer;  // appended, not yet written
+        int64_t lastTimestamp;
+
+        Series() : fd(-1), lastTimestamp(INT64_MIN) {}
+    };
+
+    mutable std::mutex mutex;
+    std::string directory;
+    uint32_t blockRecords;
+    uint64_t segmentRecords;
+    std::map<std::string, Series> series;
+
+    void closeLocked();
+    size_t loadCatalog(std::map<std::string, SegmentInfo>& catalog) const;
+    bool writeCatalog() const;
+    bool appendCatalog(const std::string& lines) const;
+    static std::string catalogLine(const SegmentInfo& info);
+    bool recover(Series& entry, Segment& segment, bool last);
+    bool makeDirectory(Series& entry, const std::string& sensor);
+    bool startSegment(Series& entry, const std::string& sensor, int64_t timestampMs);
+    bool writeBuffer(Series& entry);
+    bool seal(Series& entry, Segment& segment);
+    bool loadIndex(Segment& segment) const;
+    template <typename Record, typename Fn>
+    void scan(Series& entry, SegmentKind kind, int64_t fromMs, int64_t toMs, SegmentQueryStats* stats, Fn fn);
+
+public:
+    SegmentStore();
+    ~SegmentStore();
+    SegmentStore(const SegmentStore&) = delete;
+    SegmentStore& operator=(const SegmentStore&) = delete;
+
+    /**
+     * @brief Open or create a store, recovering open segments
+     * @param path Store directory, created if missing
+     * @param blockRecords Readings per index entry for new segments
+     * @param segmentRecords Readings per segment before it is sealed
+     * @return false if the directory cannot be created or read
+     */
+    bool open(const std::string& path, uint32_t blockRecords = DEFAULT_BLOCK_RECORDS,
+              uint64_t segmentRecords = DEFAULT_SEGMENT_RECORDS);
+
+    /**
+     * @brief Write and sync what is buffered; open segments stay open
+     */
+    void close();
+
+    bool isOpen() const;
+
+    /**
+     * @brief Store directory; fixed between open() and close()
+     */
+    std::string getDirectory() const;
+
+    /**
+     * @brief Append a reading to a sensor's log; buffered until flush()
+     * @return false if a segment could not be created or written
+     */
+    bool append(const std::string& sensor, const HistoryRow& row);
+
+    /**
+     * @brief Write every buffered reading (no sync; sealing a segment syncs it)
+     */
+    bool flush();
+
+    /**
+     * @brief flush() and fdatasync() every open segment
+     */
+    bool sync();
+
+    /**
+     * @brief The open segment of every sensor, with its current length
+     */
+    std::vector<SegmentInfo> openSegments() const;
+
+    /**
+     * @brief Cut open segments back to a state known to be on disk
+     *
+     * An open segment listed in durable is truncated to the listed length;
+     * one not listed was started after that state and is deleted. Sealed
+     * segments are kept. Used with a write-ahead log, which holds what
+     * came after.
+     * @param durable openSegments() as of the last sync()
+     */
+    bool rollback(const std::vector<SegmentInfo>& durable);
+
+    /**
+     * @brief Timestamp of a sensor's latest reading, INT64_MIN without any
+     */
+    int64_t lastTimestamp(const std::string& sensor) const;
+
+    /**
+     * @brief Readings of a sensor with fromMs <= timestamp < toMs, in time order
+     * @param out Rows are appended
+     * @param stats Optional: what the query had to read
+     * @param limit Most rows to append; the scan stops there
+     * @return Number of rows appended
+     */
+    size_t query(const std::string& sensor, int64_t fromMs, int64_t toMs, std::vector<HistoryRow>& out,
+                 SegmentQueryStats* stats = nullptr, size_t limit = SIZE_MAX);
+
+    /**
+     * @brief Minute or hour aggregates of a sensor starting in [fromMs, toMs)
+     *
+     * A bucket split across two segments comes back as one record.
+     * @param limit Most records to append; the last one appended is complete
+     * @return Number of records appended
+     */
+    size_t queryAggregates(const std::string& sensor, SegmentKind kind, int64_t fromMs, int64_t toMs,
+                           std::vector<AggregateRecord>& out, SegmentQueryStats* stats = nullptr,
+                           size_t limit = SIZE_MAX);
+
+    /**
+     * @brief Sensors with at least one segment
+     */
+    std::vector<std::string> sensorIds() const;
+
+    /**
+     * @brief Catalog of a sensor's segments of one kind, oldest first, the open one included
+     */
+    std::vector<SegmentInfo> segments(const std::string& sensor, SegmentKind kind = SegmentKind::Raw) const;
+
+    /**
+     * @brief Every sealed segment of every sensor and kind
+     */
+    std::vector<SegmentInfo> sealedSegments() const;
+
+    /**
+     * @brief Bytes used by all segment files
+     */
+    uint64_t sizeOnDisk() const;
+
+    /**
+     * @brief Write the compacted form of a sealed segment, not in the catalog yet
+     *
+     * The file is named after the source's, so redoing a compaction
+     * interrupted by a crash rewrites the same file.
+     * @param records count records of recordSize(kind) bytes, in time order
+     * @param info Receives the new segment's catalog entry
+     */
+    bool writeSegment(const SegmentInfo& source, SegmentKind kind, const void* records, uint64_t count,
+                      SegmentInfo& info);
+
+    /**
+     * @brief Swap a sealed segment for another in the catalog and delete its file
+     * @param replacement Segment from writeSegment(), or null to only delete
+     * @return false if the segment is not (or no longer) in the catalog
+     */
+    bool replace(const SegmentInfo& segment, const SegmentInfo* replacement);
+
+    static size_t recordSize(SegmentKind kind);
+    static uint64_t segmentBytes(const SegmentInfo& info);
+
+    /**
+     * @brief "raw", "minute" or "hour"
+     */
+    static const char* kindName(SegmentKind kind);
+    static bool parseKind(const std::string& name, SegmentKind& kind);
+
+    /**
+     * @brief Sensor id as a directory name: bytes other than [A-Za-z0-9._-] become %XX
+     */
+    static std::string encodeName(const std::string& sensor);
+    static std::string decodeName(const std::string& name);
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+#include "sensor_plugin.h"
+#include "tdigest.h"
+#include "aqi_engine.h"
+#include "reading_history.h"
+#include "outlier_filter.h"
+#include "humidity_correction.h"
+#include "sensor_health.h"
+#include "io_backend.h"
+#include "alert_engine.h"
+#include "segment_store.h"
+#include "store_compactor.h"
+#include "write_ahead_log.h"
+#include "metrics.h"
+#include "reading_bus.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief One reading as stored, persisted and streamed by the daemon
+ */
+struct DaemonReading {
+    std::string sensor;
+    int64_t timestamp_ms;   // Unix time in milliseconds
+    float pm25;
+    float pm10;
+    float rh;               // joined humidity, -1 if not corrected
+    float pm25_corrected;   // equal to pm25/pm10 when not corrected
+    float pm10_corrected;
+    uint8_t flags;          // ReadingFlags known at acquisition (GapBefore); not sent or stored
+
+    DaemonReading() : timestamp_ms(0), pm25(0.0f), pm10(0.0f), rh(-1.0f), pm25_corrected(0.0f), pm10_corrected(0.0f),
+                      flags(0) {}
+    DaemonReading(const std::string& s, int64_t ts, float p25, float p10)
+        : sensor(s), timestamp_ms(ts), pm25(p25), pm10(p10), rh(-1.0f), pm25_corrected(p25), pm10_corrected(p10),
+          flags(0) {}
+
+    bool isCorrected() const { return rh >= 0.0f; }
+
+    /**
+     * @brief Control protocol form: "DATA <sensor> <unix_ms> <pm25> <pm10>",
+     *        followed by " <rh> <pm25_corrected> <pm10_corrected>" when corrected
+     */
+    std::string toLine() const;
+
+    /**
+     * @brief Parse a line produced by toLine()
+     * @return false if the line is not a DATA line
+     */
+    static bool fromLine(const std::string& line, DaemonReading& reading);
+};
+
+/**
+ * @brief Options for headless operation
+ */
+struct DaemonConfig {
+    std::string socket_path;
+    std::string data_file;              // CSV log, empty to disable persistence
+    std::string store_directory;        // SegmentStore for HISTORY, empty to disable
+    std::string export_dir;             // where EXPORT writes its files, empty to disable
+    RetentionPolicy retention;          // roll-up and expiry of the store
+    WalConfig wal;                      // group commit through <store_directory>/wal
+    std::vector<std::string> ports;     // sensors to acquire from
+    size_t window_size;                 // readings served per sensor by QUERY
+    AQIStandard aqi_standard;
+    FilterConfig filter;                // outlier stage applied to every sensor
+    std::string humidity_source;        // RH file or FIFO, empty to disable correction
+    HumidityModel humidity;
+    IoBackendKind io_backend;           // how the data file is written
+    std::vector<AlertRule> alert_rules;
+    std::string alert_sink;             // file, FIFO or unix:PATH for alert events; empty for stdout
+
+    DaemonConfig() : socket_path("/tmp/sensor_reader.sock"), data_file("sensor_readings.csv"),
+                     window_size(3600), aqi_standard(AQIStandard::USEPA), io_backend(IoBackendKind::Auto) {}
+};
+
+/**
+ * @brief Headless multi-sensor acquisition with a Unix-domain control socket
+ *
+ * One acquisition thread per port reads through an SDS011Plugin and publishes
+ * each reading into a per-sensor window, the data file and every subscribed
+ * client. The control thread (run()) serves a line protocol:
+ *
+ *   SENSORS                    -> SENSOR <id> <connected|waiting> <count> <health> <missed> ... OK
+ *   BUS                        -> BUS <id> <consumer> <policy> <delivered> <dropped> <skipped> <lag> <max_lag> ... OK
+ *   QUERY <id|*> <seconds>     -> DATA lines from the recent window ... OK
+ *   SUBSCRIBE <id|*>           -> OK, then DATA lines as readings arrive
+ *   UNSUBSCRIBE                -> OK
+ *   QUANTILES <id|*> [q ...]   -> QUANTILE <id|*> <q> <pm25> <pm10> ... OK
+ *   AQI <id|*>                 -> AQI <id> <std> <nowcast> <24h> <category> ... OK
+ *   ALERTS                     -> ALERT <rule> <sensor> <since_ms> <value> ... OK
+ *   HISTORY <id|*> <from> <to> [tier]
+ *                              -> DATA lines from the segment store, Unix ms range, or BUCKET
+ *                                 lines for the minute or hour tier ... OK
+ *   EXPORT <file> <id|*> [<from> <to>]
+ *                              -> EXPORTED <rows> <file>, the in-memory histories as an
+ *                                 Arrow IPC file in export_dir ... OK
+ *   METRICS                    -> Prometheus text ... OK
+ *   PING                       -> OK
+ *
+ * Acquisition threads only decode and broadcast: each sensor has a
+ * ReadingBus, and the control thread is one of its consumers (DropOldest,
+ * so a slow client never holds up sampling). Other consumers attach with
+ * subscribe() and choose their own backpressure policy.
+ *
+ * Each acquisition thread tracks its sensor's health: a stalled or unplugged
+ * sensor is closed and reopened with exponential backoff, and the first
+ * reading after lost frames is marked ReadingFlags::GapBefore in the history.
+ *
+ * Data file lines are collected while the control thread sleeps and written
+ * as one batch followed by fdatasync() when it wakes, through an IoBackend:
+ * with io_uring the write and the sync are linked and never block the thread.
+ * With a write-ahead log the batch grows until the log's group commit is
+ * due, so all sensors share one log sync and one data file sync per
+ * interval, and a crash loses at most that interval.
+ *
+ * With a store directory, every recorded reading is also appended to a
+ * SegmentStore, flags included, so HISTORY can answer any time range from
+ * disk with a seek instead of a scan, read a bounded number of rows per
+ * piece of the reply. A retention policy starts a
+ * StoreCompactor that rolls old raw segments up into minute and hour
+ * aggregates and expires them, at idle priority.
+ *
+ * Alert rules are evaluated on every recorded reading that is not an
+ * outlier, on the corrected values; firing and clearing events go to the
+ * alert sink as "ALERT FIRING|CLEARED ..." lines.
+ *
+ * With a humidity source, readings are corrected before they are recorded;
+ * digests and AQI use the corrected values, the history keeps both.
+ *
+ * QUANTILES defaults to P50/P90/P98; "*" merges the per-sensor digests into
+ * a fleet-wide estimate. Errors are reported as "ERR <message>". Clients can
+ * come and go at any time without disturbing sampling.
+ *
+ * Long replies (QUERY, HISTORY) are produced a piece at a time as the client reads
+ * them, each piece copied out under the lock, and the client's next command
+ * waits until the reply is complete. EXPORT copies the selected rows under the
+ * lock and writes the file on a worker thread; its reply waits for the write. A client is only dropped for not
+ * reading subscription traffic; live readings that arrive during a reply
+ * are held and sent after its OK.
+ */
+class SensorDaemon {
+private:
+    struct SensorState {
+        std::string port;
+        ReadingHistory history; // at least window_size readings, columnar
+        FilterPipeline filter;
+        TDigest pm25Digest;     // all non-outlier readings, including those loaded at start
+        TDigest pm10Digest;
+        AQIEngine aqi;
+        bool connected;
+        HealthState health;     // snapshot of the acquisition thread's tracker
+        uint64_t missedFrames;
+
+        SensorState() : connected(false), health(HealthState::Connecting), missedFrames(0) {}
+    };
+
+    // The control thread's cursor into one sensor's bus
+    struct BusReader {
+        std::string port;
+        std::unique_ptr<BusConsumer> consumer;
+        SensorMetrics* metrics;
+    };
+
+    /**
+     * @brief Appends the next piece of a long reply; false once the reply, OK or ERR included, is complete
+     */
+    typedef std::function<bool(std::string& out)> ReplyCursor;
+
+    // Where a streamed QUERY or HISTORY reply continues
+    struct ReplyPosition {
+        std::string filter;     // sensor id or "*"
+        std::string sensor;     // sensor being sent, empty before the first
+        int64_t startMs;        // start of the range for every sensor
+        int64_t toMs;           // end of a HISTORY range, exclusive
+        SegmentKind kind;       // HISTORY tier
+        int64_t fromMs;         // timestamp of the next row of this sensor
+        size_t sent;            // rows at fromMs already sent
+
+        ReplyPosition() : startMs(0), toMs(0), kind(SegmentKind::Raw), fromMs(0), sent(0) {}
+    };
+
+    // An EXPORT being written by its worker thread
+    struct ExportJob;
+
+    struct Client {
+        int fd;
+        std::string input;
+        std::string output;     // ready to send
+        ReplyCursor reply;      // rest of a long reply; later commands wait for it
+        std::string held;       // subscription lines that arrived during the reply
+        bool subscribed;
+        std::string filter;     // sensor id or "*"
+
+        Client() : fd(-1), subscribed(false) {}
+    };
+
+    DaemonConfig config;
+    std::mutex mutex;                                   // guards sensors, humidity, alerts, pending, pendingLog, pendingRows
+    std::map<std::string, SensorState> sensors;
+    HumidityCorrector humidity;                         // shared by all sensors of the site
+    AlertEngine alerts;                                 // guarded by mutex, like sensors
+    std::unique_ptr<AlertSink> alertSink;               // null: events go to stdout
+    std::vector<DaemonReading> pending;                 // published, not yet streamed
+    std::string pendingLog;                             // data file lines not yet handed to io
+    std::vector<std::pair<std::string, HistoryRow>> pendingRows;  // not yet appended to the store
+    SegmentStore store;                                 // control thread and compactor
+    std::unique_ptr<StoreCompactor> compactor;          // with a retention policy
+    WriteAheadLog wal;                                  // control thread only; open with config.wal
+    std::unique_ptr<IoBackend> io;                      // control thread only
+    int dataFd;
+    std::map<std::string, std::unique_ptr<ReadingBus>> buses;     // one per port, fixed after start()
+    std::vector<BusReader> busReaders;                  // control thread only
+    std::vector<std::thread> acquisitionThreads;
+    std::vector<std::pair<std::shared_ptr<ExportJob>, std::thread>> exports;  // control thread; joined once done
+    std::vector<Client> clients;
+    int listenFd;
+    int wakePipe[2];
+    std::atomic<bool> stopRequested;
+
+    static const size_t MAX_CLIENT_BACKLOG = 1 << 20;   // subscription bytes before a client that stopped reading is dropped
+    static const size_t REPLY_PIECE_BYTES = 64 * 1024;  // produced at a time for a long reply
+
+    void acquire(const std::string& port);
+    void loadHistory();
+    SensorState& stateFor(const std::string& sensor);
+    HistoryRow record(const DaemonReading& reading);
+    void ingest(const DaemonReading& reading);
+    void drainBuses();
+    size_t windowStart(const SensorState& state) const;
+    void writeQuantiles(std::ostream& out);
+    void wake();
+    void acceptClient();
+    bool readClient(Client& client);
+    void handleInput(Client& client);
+    bool flushClient(Client& client);
+    void handleCommand(Client& client, const std::string& line);
+    bool queryPiece(ReplyPosition& position, std::string& out);
+    bool historyPiece(ReplyPosition& position, std::string& out);
+    void reapExports(bool all);
+    void dispatchPending();
+    bool recoverWal();
+    void persistPending(bool force = false);
+    void closeClients();
+
+public:
+    explicit SensorDaemon(const DaemonConfig& cfg);
+    ~SensorDaemon();
+
+    /**
+     * @brief Open the data file, bind the control socket and start acquisition
+     * @return false if the socket could not be created
+     */
+    bool start();
+
+    /**
+     * @brief Serve the control socket until stop() or g_running is cleared
+     */
+    void run();
+
+    /**
+     * @brief Ask run() to return; safe to call from any thread
+     */
+    void stop();
+
+    /**
+     * @brief Record a reading and stream it to subscribers
+     *
+     * Readings from the daemon's own ports arrive through their buses; this
+     * lets other sources feed the daemon as well. Safe from any thread.
+     */
+    void publish(const DaemonReading& reading);
+
+    /**
+     * @brief Attach a consumer to a port's reading bus (after start())
+     * @return null for a port the daemon does not acquire from
+     */
+    std::unique_ptr<BusConsumer> subscribe(const std::string& port, BusPolicy policy);
+};
+
+/**
+ * @brief Minimal line-oriented client for the daemon control socket
+ */
+class ControlClient {
+private:
+    int fd;
+    std::string buffer;
+
+public:
+    ControlClient();
+    ~ControlClient();
+
+    bool connect(const std::string& socketPath);
+    void disconnect();
+    bool isConnected() const { return fd >= 0; }
+    int getFd() const { return fd; }
+
+    /**
+     * @brief Send one command line (newline appended)
+     */
+    bool send(const std::string& line);
+
+    /**
+     * @brief Read one line
+     * @param line Receives the line without its newline
+     * @param timeoutMs How long to wait for data, 0 to only use what is buffered
+     *        or immediately readable, -1 to wait indefinitely
+     * @return true if a full line was read
+     */
+    bool readLine(std::string& line, int timeoutMs);
+};
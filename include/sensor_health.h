@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Link state of one sensor
+ */
+enum class HealthState {
+    Connecting,     // not open yet, or waiting for the next reconnect attempt
+    Healthy,        // frames arrive at the expected cadence
+    Degraded,       // frames arrive, but late or with frequent checksum errors
+    Stalled         // open, but silent for too long; should be reopened
+};
+
+/**
+ * @brief Tuning of the health tracker
+ */
+struct HealthConfig {
+    uint64_t initialCadenceNs;      // assumed interval until enough frames were seen
+    double gapFactor;               // an interval above this many cadences is a gap
+    double stallFactor;             // silent for this many cadences means stalled...
+    uint64_t minStallNs;            // ...but never sooner than this
+    double degradedErrorRate;       // checksum errors per frame attempt
+    uint64_t initialBackoffNs;      // first reconnect delay, doubled per failed attempt
+    uint64_t maxBackoffNs;
+
+    HealthConfig() : initialCadenceNs(1000000000ULL), gapFactor(2.5), stallFactor(5.0),
+                     minStallNs(3000000000ULL), degradedErrorRate(0.1),
+                     initialBackoffNs(500000000ULL), maxBackoffNs(60000000000ULL) {}
+};
+
+/**
+ * @brief Per-sensor health state machine
+ *
+ * Fed with monotonic times (SampleClock::nowNs()) of frames, checksum
+ * failures and connection attempts. It learns the sensor's cadence from the
+ * intervals between frames, counts the frames missed in gaps, and decides
+ * when a silent sensor counts as stalled and when the next reconnect attempt
+ * is due. Reconnect delays double after every failed attempt, up to
+ * maxBackoffNs, so a dead sensor costs a few wake-ups a minute.
+ *
+ * Not thread-safe; each sensor's acquisition loop owns its tracker.
+ */
+class SensorHealth {
+private:
+    HealthConfig config;
+    bool connected;
+    uint64_t connectedAtNs;
+    uint64_t lastGoodNs;        // 0 before the first frame
+    uint64_t cadenceNs;
+    uint32_t intervalsSeen;
+    bool gapPending;            // the next frame follows a reconnect
+    uint64_t missed;
+    uint64_t lastChecksumTotal;
+    double goodWeight;          // decayed frame and error counts for the error rate
+    double errorWeight;
+    uint32_t failedAttempts;
+    uint64_t nextAttemptNs;
+    uint64_t reconnects;
+
+    void scheduleRetry(uint64_t nowNs);
+
+public:
+    explicit SensorHealth(const HealthConfig& cfg = HealthConfig());
+
+    /**
+     * @brief Forget everything, e.g. when another sensor is selected
+     */
+    void reset();
+
+    void onConnected(uint64_t nowNs);
+
+    /**
+     * @brief Opening the sensor failed; the next attempt is backed off
+     */
+    void onConnectFailed(uint64_t nowNs);
+
+    /**
+     * @brief The link was closed after an error or a stall
+     */
+    void onDisconnected(uint64_t nowNs);
+
+    /**
+     * @brief A device node appeared (e.g. after USB re-enumeration); the next
+     *        reconnect attempt is due now instead of after the backoff
+     */
+    void onDeviceAdded(uint64_t nowNs);
+    
+    /**
+     * @brief A valid frame arrived
+     * @return Frames missed since the previous one (0 if none); a frame after
+     *         a reconnect counts at least one
+     */
+    uint32_t onFrame(uint64_t arrivalNs);
+
+    /**
+     * @brief Report the sensor's cumulative checksum failure counter
+     */
+    void observeChecksumFailures(uint64_t total);
+
+    HealthState state(uint64_t nowNs) const;
+    bool isConnected() const { return connected; }
+
+    /**
+     * @brief True when disconnected and the backoff delay has passed
+     */
+    bool reconnectDue(uint64_t nowNs) const { return !connected && nowNs >= nextAttemptNs; }
+
+    uint64_t getNextAttemptNs() const { return nextAttemptNs; }
+    uint64_t getCadenceNs() const { return cadenceNs; }
+    uint64_t getMissedFrames() const { return missed; }
+    uint64_t getLastGoodNs() const { return lastGoodNs; }
+    uint32_t getFailedAttempts() const { return failedAttempts; }
+    uint64_t getReconnects() const { return reconnects; }
+    double checksumErrorRate() const;
+
+    /**
+     * @brief Earliest time state() can change without a new event: the next
+     *        reconnect attempt, or when silence turns degraded or stalled
+     *
+     * Lets an event loop sleep until then instead of re-checking periodically.
+     */
+    uint64_t nextChangeNs(uint64_t nowNs) const;
+    
+    /**
+     * @brief Silence after which a connected sensor counts as stalled
+     */
+    uint64_t stallAfterNs() const;
+
+    static const char* stateName(HealthState state);
+};
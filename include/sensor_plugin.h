@@ -47,6 +47,14 @@ public:
      */
     virtual std::unique_ptr<SensorData> readData() = 0;
     
+    /**
+     * @brief Read data from input that has already arrived, never waiting
+     *
+     * For event loops woken by getFd(): a partial frame is kept until the
+     * descriptor is readable again. Plugins without a descriptor just read.
+     */
+    virtual std::unique_ptr<SensorData> readAvailableData() { return readData(); }
+    
     /**
      * @brief Get the current port
      */
@@ -73,4 +81,29 @@ public:
      * @brief Cleanup resources
      */
     virtual void cleanup() = 0;
+    
+    /**
+     * @brief Tee raw input into a capture file for later replay
+     * @param path Capture file to create
+     * @return true if supported and the file could be created
+     */
+    virtual bool enableCapture(const std::string& path) { (void)path; return false; }
+    
+    /**
+     * @brief True once the device reported an I/O error (e.g. it was unplugged);
+     *        it has to be cleaned up and initialized again
+     */
+    virtual bool isLinkLost() const { return false; }
+    
+    /**
+     * @brief Descriptor that turns readable when readData() has input, so an
+     *        event loop can wait for it; -1 if the plugin can only be polled
+     */
+    virtual int getFd() const { return -1; }
+    
+    /**
+     * @brief Device node actually open; differs from getCurrentPort() once the
+     *        sensor was found again under a new name after re-enumeration
+     */
+    virtual std::string getDevicePath() const { return getCurrentPort(); }
 };
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief How reads on a serial port wait for data
+ */
+enum class SerialIOProfile {
+    Timed,          // VMIN=0, VTIME=5: read returns on the first bytes or after 0.5 s
+    FrameBlocking,  // poll, then VMIN=10 so one read() returns a whole frame
+    Poll,           // O_NONBLOCK + poll(), read whatever has arrived
+    LowLatency      // Poll plus ASYNC_LOW_LATENCY on FTDI/CH340 style adapters
+};
+
+/**
+ * @brief Serial port setup shared by SDS011Reader and SDS011Plugin
+ *
+ * Profiles are chosen per port (with a process-wide default) so each USB
+ * adapter can be tuned separately from the command line.
+ */
+namespace SerialPort {
+    /**
+     * @brief Configure 9600 8N1 raw mode and the read strategy of a profile
+     * @param fd Open serial port descriptor
+     * @param profile Read strategy to apply
+     * @return true if the terminal attributes were applied
+     */
+    bool configure(int fd, SerialIOProfile profile);
+
+    /**
+     * @brief Whether reads must be preceded by poll() for this profile
+     */
+    bool usesPoll(SerialIOProfile profile);
+
+    /**
+     * @brief How long a poll()-based read waits for the first byte
+     */
+    int pollTimeoutMs();
+
+    /**
+     * @brief Short name of a profile ("timed", "frame", "poll", "lowlatency")
+     */
+    const char* profileName(SerialIOProfile profile);
+
+    /**
+     * @brief Parse a profile name
+     * @return false if the name is unknown
+     */
+    bool parseProfile(const std::string& name, SerialIOProfile& profile);
+
+    /**
+     * @brief Select the profile for a port
+     * @param port Device path, or empty to change the default for all ports
+     */
+    void setProfile(const std::string& port, SerialIOProfile profile);
+
+    /**
+     * @brief Profile configured for a port (falls back to the default)
+     */
+    SerialIOProfile profileFor(const std::string& port);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "segment_store.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief How long each tier of a SegmentStore is kept, and how big it may grow
+ *
+ * Parsed from a spec such as "raw=7d,minute=365d,hour=0,size=2G,rate=4M"
+ * or "off"; unspecified keys keep their defaults. The keys are:
+ *   raw       age after which raw segments are rolled up into minute ones
+ *   minute    age after which minute segments are rolled up into hour ones
+ *   hour      age after which hour segments are deleted
+ *   size      bytes of segments to keep; the oldest are deleted beyond it
+ *   rate      bytes per second the compactor may read and write
+ *   interval  time between passes
+ * Ages and the interval take an s, m, h or d suffix (seconds without one),
+ * sizes a K, M or G suffix. 0 keeps a tier forever, lifts the size limit
+ * or the rate limit.
+ */
+struct RetentionPolicy {
+    bool enabled;
+    int64_t rawMs;
+    int64_t minuteMs;
+    int64_t hourMs;
+    uint64_t maxBytes;
+    uint64_t rateBytes;
+    int64_t intervalMs;
+
+    RetentionPolicy() : enabled(false), rawMs(7 * 86400000LL), minuteMs(365 * 86400000LL), hourMs(0),
+                        maxBytes(0), rateBytes(4 << 20), intervalMs(60000) {}
+
+    /**
+     * @brief Parse a retention spec; any spec but "off" enables retention
+     * @return false on unknown keys or invalid values
+     */
+    static bool parse(const std::string& spec, RetentionPolicy& policy);
+
+    std::string toString() const;
+};
+
+/**
+ * @brief What the compactor has done since it was created
+ */
+struct CompactionStats {
+    uint64_t passes;
+    uint64_t compacted;         // segments rolled up into a coarser tier
+    uint64_t deleted;           // segments removed by age or size
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t throttledNs;       // time spent waiting for the rate limit
+
+    CompactionStats() : passes(0), compacted(0), deleted(0), bytesRead(0), bytesWritten(0), throttledNs(0) {}
+};
+
+/**
+ * @brief Background roll-up and retention of a SegmentStore
+ *
+ * Each pass rolls sealed raw segments older than the raw age into minute
+ * segments and minute segments older than the minute age into hour
+ * segments, one segment at a time: the source is read straight from its
+ * immutable file, its aggregates are written aside and synced, and
+ * SegmentStore::replace() swaps them in. Hour segments past their age are
+ * deleted, and then the oldest sealed segments of any tier until the store
+ * fits its size limit.
+ *
+ * The compactor must never hold up acquisition. It runs on its own thread
+ * at SCHED_IDLE CPU priority and in the idle I/O class on Linux, reads in
+ * small chunks paced by a token bucket of rateBytes per second, and takes
+ * the store's mutex only to look up a directory and to swap the catalog.
+ */
+class StoreCompactor {
+private:
+    SegmentStore& store;
+    RetentionPolicy policy;
+    std::thread worker;
+    std::mutex mutex;                   // guards stopping, for the condition variable
+    std::condition_variable wakeUp;
+    bool stopping;
+    std::atomic<uint64_t> passes;
+    std::atomic<uint64_t> compacted;
+    std::atomic<uint64_t> deleted;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> throttledNs;
+    double tokens;                      // bytes the compactor may still move without waiting
+    std::chrono::steady_clock::time_point lastRefill;
+
+    void run();
+    bool throttle(uint64_t bytes);
+    bool compact(const SegmentInfo& segment, SegmentKind target);
+    template <typename Record, typename Fn>
+    bool readSegment(const SegmentInfo& segment, Fn fn);
+
+public:
+    StoreCompactor(SegmentStore& segmentStore, const RetentionPolicy& retention);
+    ~StoreCompactor();
+    StoreCompactor(const StoreCompactor&) = delete;
+    StoreCompactor& operator=(const StoreCompactor&) = delete;
+
+    /**
+     * @brief Start the background thread; a pass runs at once, then every interval
+     */
+    void start();
+
+    /**
+     * @brief Stop the thread, interrupting a pass between two chunks
+     */
+    void stop();
+
+    /**
+     * @brief Run one pass on the calling thread
+     * @param nowMs Unix time the ages are measured from
+     * @return Number of segments compacted or deleted
+     */
+    size_t runOnce(int64_t nowMs);
+
+    CompactionStats stats() const;
+};
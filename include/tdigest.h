@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Mergeable streaming quantile sketch (merging t-digest)
+ *
+ * Values are buffered and periodically merged into at most ~compression
+ * centroids, sized so that the tails (P98, P99) stay accurate while the
+ * middle of the distribution is summarised coarsely. Storage is reserved up
+ * front, so add() never allocates and memory does not grow with the number
+ * of samples. Digests from several sensors can be merged into a fleet-wide
+ * one without access to the raw values.
+ */
+class TDigest {
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+
+        bool operator<(const Centroid& other) const { return mean < other.mean; }
+    };
+
+    double compression;
+    std::vector<Centroid> centroids;    // merged, sorted by mean
+    std::vector<Centroid> buffer;       // unmerged input
+    std::vector<Centroid> scratch;      // reused during compress()
+    size_t bufferLimit;
+    double totalWeight;                 // merged and buffered
+    double minValue;
+    double maxValue;
+
+    /**
+     * @brief Merge the buffer into the centroid list
+     */
+    void compress();
+
+    /**
+     * @brief Scale function k1: keeps centroids small near q = 0 and q = 1
+     */
+    double scale(double q) const;
+
+    void append(const Centroid& centroid);
+
+public:
+    /**
+     * @brief Constructor
+     * @param compression Accuracy/size trade-off; the digest keeps roughly
+     *        this many centroids
+     */
+    explicit TDigest(double compression = 100.0);
+
+    /**
+     * @brief Add a sample
+     */
+    void add(double value, double weight = 1.0);
+
+    /**
+     * @brief Fold another digest into this one
+     */
+    void merge(const TDigest& other);
+
+    /**
+     * @brief Estimate a quantile
+     * @param q Quantile in [0, 1], e.g. 0.98 for P98
+     * @return Estimated value, 0 if the digest is empty
+     */
+    double quantile(double q);
+
+    /**
+     * @brief Total weight (number of samples with unit weights)
+     */
+    double count() const { return totalWeight; }
+
+    double min() const { return minValue; }
+    double max() const { return maxValue; }
+
+    /**
+     * @brief Number of centroids after merging pending input
+     */
+    size_t centroidCount();
+
+    /**
+     * @brief Forget all samples
+     */
+    void reset();
+};
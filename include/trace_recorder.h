@@ -0,0 +1,141 @@
+#pragma once
+
+#include "sample_clock.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Event types recorded by the trace recorder
+ */
+enum class TraceEvent : uint16_t {
+    ReadStart = 1,      // about to call read() on a sensor fd
+    ReadEnd = 2,        // read() returned, arg = bytes received (-1 on error)
+    FrameAccepted = 3,  // valid frame decoded, arg = raw PM2.5 value
+    FrameRejected = 4,  // frame dropped, arg = TraceRejectReason
+    RedrawStart = 5,    // TUI redraw begins
+    RedrawEnd = 6       // TUI redraw finished
+};
+
+/**
+ * @brief Why a frame was rejected (argument of TraceEvent::FrameRejected)
+ */
+enum class TraceRejectReason : uint32_t {
+    ShortRead = 1,
+    BadHeader = 2,
+    BadChecksum = 3
+};
+
+/**
+ * @brief One fixed-size binary trace record (16 bytes)
+ */
+struct TraceRecord {
+    uint64_t timestamp_ns;  // MetricsRegistry::nowNs() clock
+    uint16_t event;         // TraceEvent
+    uint16_t sensor;        // id from TraceRecorder::sensorId()
+    uint32_t arg;
+};
+
+/**
+ * @brief Single-writer ring of trace records owned by one thread
+ *
+ * The owning thread is the only writer of head; the flusher thread is the
+ * only user of tail. If the writer laps the flusher, the oldest records are
+ * lost and counted as dropped instead of blocking the sensor loop. The slot
+ * at head is being written until head moves past it, so at most CAPACITY - 1
+ * records are ever readable. A thread sets retired when it exits, and the
+ * flusher frees the buffer once it has drained it.
+ */
+struct TraceBuffer {
+    static const size_t CAPACITY = 1 << 14;  // records, must be a power of two
+
+    TraceRecord records[CAPACITY];
+    std::atomic<uint64_t> head;
+    std::atomic<bool> retired;
+    uint64_t tail;
+    uint32_t threadId;
+
+    TraceBuffer() : head(0), retired(false), tail(0), threadId(0) {}
+};
+
+/**
+ * @brief Low-overhead binary event tracer for the sensor loop
+ *
+ * When disabled, record() is a single relaxed load. When enabled, each thread
+ * appends into its own lock-free TraceBuffer and a background thread drains
+ * all buffers into a compact binary file every 100 ms.
+ */
+class TraceRecorder {
+private:
+    static std::atomic<bool> enabled;
+    static thread_local TraceBuffer* localBuffer;
+
+    /**
+     * @brief Allocate and register the calling thread's buffer, retired when the thread exits
+     */
+    static TraceBuffer* attachThread();
+
+    static uint64_t nowNs() {
+        return SampleClock::nowNs();
+    }
+
+public:
+    /**
+     * @brief Start recording into the given file
+     * @param path Output file (truncated)
+     * @return true if the file could be opened
+     */
+    static bool start(const std::string& path);
+
+    /**
+     * @brief Stop recording, flush remaining events and close the file
+     */
+    static void stop();
+
+    /**
+     * @brief Check whether a trace session is active
+     */
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Record an event on the calling thread
+     */
+    static void record(TraceEvent event, uint16_t sensor, uint32_t arg = 0) {
+        if (!enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        TraceBuffer* buffer = localBuffer ? localBuffer : attachThread();
+        uint64_t head = buffer->head.load(std::memory_order_relaxed);
+        TraceRecord& slot = buffer->records[head & (TraceBuffer::CAPACITY - 1)];
+        slot.timestamp_ns = nowNs();
+        slot.event = static_cast<uint16_t>(event);
+        slot.sensor = sensor;
+        slot.arg = arg;
+        buffer->head.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Get a compact id for a sensor name, registering it on first use
+     */
+    static uint16_t sensorId(const std::string& name);
+
+    /**
+     * @brief Convert a binary trace file to Chrome trace event JSON
+     * @param inputPath Binary trace written by start()/stop()
+     * @param outputPath JSON file loadable by chrome://tracing or Perfetto
+     * @return true on success
+     */
+    static bool convertToChromeJson(const std::string& inputPath, const std::string& outputPath);
+};
+
+/**
+ * @brief Stops the trace session when leaving scope
+ */
+class ScopedTraceSession {
+public:
+    ScopedTraceSession() {}
+    ~ScopedTraceSession() { TraceRecorder::stop(); }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "reading_history.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Aggregate of one chart column
+ */
+struct TrendPoint {
+    uint32_t count;
+    double mean;
+    double min;
+    double max;
+
+    TrendPoint() : count(0), mean(0.0), min(0.0), max(0.0) {}
+};
+
+/**
+ * @brief Multi-resolution time buckets for trend charts
+ *
+ * Every reading is added to one bucket per level (1 s, 10 s, 1 min, 5 min and
+ * 30 min wide), each level being a ring that covers from 15 minutes up to a
+ * week. A chart over any span reads the finest level that covers it with at
+ * most MAX_BUCKETS_PER_COLUMN buckets per screen column, so drawing costs
+ * O(columns) however many readings the span holds.
+ */
+class TrendBuckets {
+public:
+    static const int LEVELS = 5;
+    static const size_t MAX_BUCKETS_PER_COLUMN = 8;
+
+private:
+    struct Bucket {
+        int64_t slot;           // timestamp / width, -1 when unused
+        uint32_t count;
+        double sum[2];
+        float min[2];
+        float max[2];
+    };
+
+    struct Level {
+        int64_t widthMs;
+        std::vector<Bucket> ring;
+    };
+
+    Level levels[LEVELS];
+
+    const Level& levelFor(int64_t spanMs, size_t columns) const;
+
+    /**
+     * @brief Call fn(bucket, column) for every live bucket in (endMs - spanMs, endMs]
+     */
+    template <typename Fn>
+    void forEachBucket(const Level& level, int64_t endMs, int64_t spanMs, size_t columns, Fn fn) const;
+
+public:
+    TrendBuckets();
+
+    /**
+     * @brief Add a reading; O(LEVELS)
+     */
+    void add(int64_t timestampMs, float pm25, float pm10);
+
+    void reset();
+
+    /**
+     * @brief Bucket width used to draw spanMs over a number of columns
+     */
+    int64_t resolutionMs(int64_t spanMs, size_t columns) const;
+
+    /**
+     * @brief Per-column aggregates of the span ending at endMs
+     * @param points Resized to columns; columns without data have count 0
+     */
+    void series(HistoryColumn column, int64_t endMs, int64_t spanMs, size_t columns,
+                std::vector<TrendPoint>& points) const;
+
+    /**
+     * @brief Distribution of the span ending at endMs over [0, maxValue)
+     *
+     * Built from the same buckets as series(): each bucket adds its count at
+     * its mean, so the shape is that of the chart's resolution. Values at or
+     * above maxValue land in the last bin.
+     */
+    void histogram(HistoryColumn column, int64_t endMs, int64_t spanMs, size_t columns,
+                   double maxValue, std::vector<uint32_t>& bins) const;
+};
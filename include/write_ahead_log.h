@@ -0,0 +1,184 @@
+#pragma once
+
+#include "reading_history.h"
+#include "segment_store.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Group-commit settings of the write-ahead log
+ *
+ * Parsed from a spec such as "interval=1s,size=64K,checkpoint=16M" or
+ * "off"; unspecified keys keep their defaults. The keys are:
+ *   interval    longest time a reading waits for its commit (s or ms suffix,
+ *               seconds without one); 0 commits every batch at once
+ *   size        buffered bytes that trigger a commit before the interval
+ *   checkpoint  log size after which the store is synced and the log restarts
+ * Sizes take a K, M or G suffix.
+ */
+struct WalConfig {
+    bool enabled;
+    int64_t intervalMs;
+    uint64_t flushBytes;
+    uint64_t checkpointBytes;
+
+    WalConfig() : enabled(false), intervalMs(1000), flushBytes(64 * 1024), checkpointBytes(16 * 1024 * 1024) {}
+
+    /**
+     * @brief Parse a write-ahead log spec; any spec but "off" enables it
+     * @return false on unknown keys or invalid values
+     */
+    static bool parse(const std::string& spec, WalConfig& config);
+
+    std::string toString() const;
+};
+
+/**
+ * @brief What open() found in an existing log
+ */
+struct WalRecovery {
+    bool checkpointed;                  // the log starts with a checkpoint
+    std::vector<SegmentInfo> checkpoint;    // open segments synced at that checkpoint
+    std::vector<std::pair<std::string, HistoryRow>> rows;   // committed after it, in order
+    size_t blocks;                      // valid blocks read
+    uint64_t tornBytes;                 // cut off after the last valid block
+
+    WalRecovery() : checkpointed(false), blocks(0), tornBytes(0) {}
+};
+
+/**
+ * @brief Counters of a write-ahead log since it was opened
+ */
+struct WalStats {
+    uint64_t commits;
+    uint64_t records;
+    uint64_t bytes;                     // written, block headers and checkpoints included
+    uint64_t checkpoints;
+
+    WalStats() : commits(0), records(0), bytes(0), checkpoints(0) {}
+};
+
+/**
+ * @brief Checksummed group-commit log in front of a SegmentStore
+ *
+ * Readings of all sensors are buffered by append() and written by commit()
+ * as one block followed by one fdatasync(), so a whole interval of readings
+ * costs one sync instead of one each. A block is a 32-byte header (magic,
+ * kind, sequence number, payload size, record count, CRC-32C of header and
+ * payload) followed by the sensor names used in it and 24-byte records.
+ *
+ * The store's own writes stay unsynced. Once the log outgrows the
+ * checkpoint size the store is synced and checkpoint() starts a new log
+ * whose first block lists the open segments and their synced lengths.
+ * Recovery is then bounded by the log, not the store: open() reads blocks
+ * in order and stops at the first one with a bad magic, size, sequence or
+ * checksum, which is a torn write, and cuts the file there. The caller
+ * rolls the store back to the checkpoint (SegmentStore::rollback()) and
+ * re-appends the rows committed after it.
+ *
+ * Not thread-safe; the daemon uses it from its control thread only.
+ */
+class WriteAheadLog {
+public:
+    static const uint32_t BLOCK_HEADER_BYTES = 32;
+
+private:
+    // One reading in a block: a HistoryRow and the index of its sensor's name
+    struct Record {
+        int64_t timestamp_ms;
+        uint16_t pm25_raw;
+        uint16_t pm10_raw;
+        uint16_t pm25_corrected_raw;
+        uint16_t pm10_corrected_raw;
+        uint8_t humidity;
+        uint8_t flags;
+        uint16_t sensor;
+        uint32_t reserved;
+    };
+
+    std::string path;
+    WalConfig config;
+    int fd;
+    uint64_t fileBytes;
+    uint64_t sequence;                  // of the next block
+    std::map<std::string, uint16_t> names;  // sensors in the buffered block
+    std::string nameTable;
+    std::vector<Record> records;
+    uint64_t firstBufferedNs;           // SampleClock time of the oldest buffered reading, 0 if none
+    WalStats counters;
+
+    bool writeBlock(int target, uint32_t kind, const std::string& payload, uint32_t count, uint64_t offset);
+
+public:
+    WriteAheadLog();
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * @brief Open or create a log, reading back what it holds
+     * @param recovery Receives the checkpoint and the rows committed after it
+     * @return false if the file cannot be opened or truncated
+     */
+    bool open(const std::string& file, const WalConfig& cfg, WalRecovery& recovery);
+
+    /**
+     * @brief Commit what is buffered and close the file
+     */
+    void close();
+
+    bool isOpen() const { return fd >= 0; }
+
+    /**
+     * @brief Buffer a reading for the next commit
+     * @param nowNs SampleClock::nowNs(), which starts the interval of the first buffered reading
+     */
+    void append(const std::string& sensor, const HistoryRow& row, uint64_t nowNs);
+
+    /**
+     * @brief Whether buffered readings have waited the interval or fill the size
+     */
+    bool due(uint64_t nowNs) const;
+
+    /**
+     * @brief Milliseconds until due() turns true, -1 with nothing buffered
+     */
+    int64_t msUntilDue(uint64_t nowNs) const;
+
+    size_t buffered() const { return records.size(); }
+
+    /**
+     * @brief Write the buffered readings as one block and fdatasync() it
+     * @return false on a write or sync error; the readings stay buffered
+     */
+    bool commit();
+
+    /**
+     * @brief Start a new log after the store was synced
+     *
+     * The new log is written aside, synced and renamed over the old one, and
+     * the directory is synced, so a crash leaves one of the two complete and
+     * the new one stays once this returns true.
+     * @param synced SegmentStore::openSegments() right after SegmentStore::sync()
+     * @return false if the new log or the directory could not be synced
+     */
+    bool checkpoint(const std::vector<SegmentInfo>& synced);
+
+    /**
+     * @brief Bytes in the log file
+     */
+    uint64_t size() const { return fileBytes; }
+
+    bool needsCheckpoint() const { return fileBytes >= config.checkpointBytes; }
+
+    WalStats stats() const { return counters; }
+
+    /**
+     * @brief CRC-32C (Castagnoli) of a buffer, continuing from crc
+     */
+    static uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+};
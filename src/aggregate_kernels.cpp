@@ -0,0 +1,275 @@
+#include "aggregate_kernels.h"
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+void ColumnSummary::merge(const ColumnSummary& other) {
+    if (other.count == 0) return;
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+namespace {
+    ColumnSummary makeSummary(size_t count, double sum, double minValue, double maxValue) {
+        ColumnSummary summary;
+        if (count > 0) {
+            summary.count = count;
+            summary.sum = sum;
+            summary.min = minValue;
+            summary.max = maxValue;
+        }
+        return summary;
+    }
+
+    // Scalar versions: also used for the tails the vector loops leave over
+    ColumnSummary scalarU16(const uint16_t* data, size_t count) {
+        if (count == 0) return ColumnSummary();
+        uint64_t sum = 0;
+        uint16_t lo = data[0], hi = data[0];
+        for (size_t i = 0; i < count; ++i) {
+            sum += data[i];
+            lo = std::min(lo, data[i]);
+            hi = std::max(hi, data[i]);
+        }
+        return makeSummary(count, static_cast<double>(sum), lo, hi);
+    }
+
+    ColumnSummary scalarFloat(const float* data, size_t count) {
+        if (count == 0) return ColumnSummary();
+        double sum = 0.0;
+        float lo = data[0], hi = data[0];
+        for (size_t i = 0; i < count; ++i) {
+            sum += data[i];
+            lo = std::min(lo, data[i]);
+            hi = std::max(hi, data[i]);
+        }
+        return makeSummary(count, sum, lo, hi);
+    }
+
+#ifdef KERNELS_X86
+    // u32 lanes take two values per iteration; flush to u64 well before they can overflow
+    const size_t U16_FLUSH_ITERATIONS = 16384;
+
+    __attribute__((target("sse2")))
+    ColumnSummary sse2U16(const uint16_t* data, size_t count) {
+        const size_t vectors = count / 8;
+        if (vectors == 0) return scalarU16(data, count);
+
+        // SSE2 only has signed 16-bit min/max; flipping the top bit maps unsigned order onto it
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i vmin = _mm_set1_epi16(0x7FFF);
+        __m128i vmax = _mm_set1_epi16(static_cast<short>(0x8000));
+        __m128i sum64 = zero;
+
+        size_t i = 0;
+        while (i < vectors) {
+            size_t end = std::min(vectors, i + U16_FLUSH_ITERATIONS);
+            __m128i sum32 = zero;
+            for (; i < end; ++i) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 8));
+                __m128i biased = _mm_xor_si128(v, bias);
+                vmin = _mm_min_epi16(vmin, biased);
+                vmax = _mm_max_epi16(vmax, biased);
+                sum32 = _mm_add_epi32(sum32, _mm_add_epi32(_mm_unpacklo_epi16(v, zero),
+                                                           _mm_unpackhi_epi16(v, zero)));
+            }
+            sum64 = _mm_add_epi64(sum64, _mm_add_epi64(_mm_unpacklo_epi32(sum32, zero),
+                                                       _mm_unpackhi_epi32(sum32, zero)));
+        }
+
+        alignas(16) uint16_t mins[8], maxs[8];
+        alignas(16) uint64_t sums[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(mins), _mm_xor_si128(vmin, bias));
+        _mm_store_si128(reinterpret_cast<__m128i*>(maxs), _mm_xor_si128(vmax, bias));
+        _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum64);
+
+        uint16_t lo = *std::min_element(mins, mins + 8);
+        uint16_t hi = *std::max_element(maxs, maxs + 8);
+        ColumnSummary summary = makeSummary(vectors * 8, static_cast<double>(sums[0] + sums[1]), lo, hi);
+        summary.merge(scalarU16(data + vectors * 8, count - vectors * 8));
+        return summary;
+    }
+
+    __attribute__((target("avx2")))
+    ColumnSummary avx2U16(const uint16_t* data, size_t count) {
+        const size_t vectors = count / 16;
+        if (vectors == 0) return scalarU16(data, count);
+
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i vmin = _mm256_set1_epi16(static_cast<short>(0xFFFF));
+        __m256i vmax = zero;
+        __m256i sum64 = zero;
+
+        size_t i = 0;
+        while (i < vectors) {
+            size_t end = std::min(vectors, i + U16_FLUSH_ITERATIONS);
+            __m256i sum32 = zero;
+            for (; i < end; ++i) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 16));
+                vmin = _mm256_min_epu16(vmin, v);
+                vmax = _mm256_max_epu16(vmax, v);
+                sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(_mm256_unpacklo_epi16(v, zero),
+                                                                 _mm256_unpackhi_epi16(v, zero)));
+            }
+            sum64 = _mm256_add_epi64(sum64, _mm256_add_epi64(_mm256_unpacklo_epi32(sum32, zero),
+                                                             _mm256_unpackhi_epi32(sum32, zero)));
+        }
+
+        alignas(32) uint16_t mins[16], maxs[16];
+        alignas(32) uint64_t sums[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(mins), vmin);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), sum64);
+
+        uint16_t lo = *std::min_element(mins, mins + 16);
+        uint16_t hi = *std::max_element(maxs, maxs + 16);
+        ColumnSummary summary = makeSummary(vectors * 16, static_cast<double>(sums[0] + sums[1] + sums[2] + sums[3]),
+                                            lo, hi);
+        summary.merge(scalarU16(data + vectors * 16, count - vectors * 16));
+        return summary;
+    }
+
+    __attribute__((target("sse2")))
+    ColumnSummary sse2Float(const float* data, size_t count) {
+        const size_t vectors = count / 4;
+        if (vectors == 0) return scalarFloat(data, count);
+
+        __m128 vmin = _mm_set1_ps(data[0]);
+        __m128 vmax = vmin;
+        // Sums are kept in double so millions of samples do not lose precision
+        __m128d sumLow = _mm_setzero_pd();
+        __m128d sumHigh = _mm_setzero_pd();
+
+        for (size_t i = 0; i < vectors; ++i) {
+            __m128 v = _mm_loadu_ps(data + i * 4);
+            vmin = _mm_min_ps(vmin, v);
+            vmax = _mm_max_ps(vmax, v);
+            sumLow = _mm_add_pd(sumLow, _mm_cvtps_pd(v));
+            sumHigh = _mm_add_pd(sumHigh, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+
+        alignas(16) float mins[4], maxs[4];
+        alignas(16) double sums[2];
+        _mm_store_ps(mins, vmin);
+        _mm_store_ps(maxs, vmax);
+        _mm_store_pd(sums, _mm_add_pd(sumLow, sumHigh));
+
+        ColumnSummary summary = makeSummary(vectors * 4, sums[0] + sums[1],
+                                            *std::min_element(mins, mins + 4),
+                                            *std::max_element(maxs, maxs + 4));
+        summary.merge(scalarFloat(data + vectors * 4, count - vectors * 4));
+        return summary;
+    }
+
+    __attribute__((target("avx2")))
+    ColumnSummary avx2Float(const float* data, size_t count) {
+        const size_t vectors = count / 8;
+        if (vectors == 0) return scalarFloat(data, count);
+
+        __m256 vmin = _mm256_set1_ps(data[0]);
+        __m256 vmax = vmin;
+        __m256d sumLow = _mm256_setzero_pd();
+        __m256d sumHigh = _mm256_setzero_pd();
+
+        for (size_t i = 0; i < vectors; ++i) {
+            __m256 v = _mm256_loadu_ps(data + i * 8);
+            vmin = _mm256_min_ps(vmin, v);
+            vmax = _mm256_max_ps(vmax, v);
+            sumLow = _mm256_add_pd(sumLow, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+            sumHigh = _mm256_add_pd(sumHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+        }
+
+        alignas(32) float mins[8], maxs[8];
+        alignas(32) double sums[4];
+        _mm256_store_ps(mins, vmin);
+        _mm256_store_ps(maxs, vmax);
+        _mm256_store_pd(sums, _mm256_add_pd(sumLow, sumHigh));
+
+        ColumnSummary summary = makeSummary(vectors * 8, sums[0] + sums[1] + sums[2] + sums[3],
+                                            *std::min_element(mins, mins + 8),
+                                            *std::max_element(maxs, maxs + 8));
+        summary.merge(scalarFloat(data + vectors * 8, count - vectors * 8));
+        return summary;
+    }
+#endif
+
+    KernelIsa detectIsa() {
+#ifdef KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return KernelIsa::AVX2;
+        if (__builtin_cpu_supports("sse2")) return KernelIsa::SSE2;
+#endif
+        return KernelIsa::Scalar;
+    }
+
+    std::atomic<int>& selectedIsa() {
+        static std::atomic<int> isa(static_cast<int>(detectIsa()));
+        return isa;
+    }
+}
+
+namespace AggregateKernels {
+    KernelIsa activeIsa() {
+        return static_cast<KernelIsa>(selectedIsa().load(std::memory_order_relaxed));
+    }
+
+    bool isSupported(KernelIsa isa) {
+        return static_cast<int>(isa) <= static_cast<int>(detectIsa());
+    }
+
+    bool forceIsa(KernelIsa isa) {
+        if (!isSupported(isa)) {
+            return false;
+        }
+        selectedIsa().store(static_cast<int>(isa), std::memory_order_relaxed);
+        return true;
+    }
+
+    const char* isaName(KernelIsa isa) {
+        switch (isa) {
+            case KernelIsa::Scalar: return "scalar";
+            case KernelIsa::SSE2: return "sse2";
+            case KernelIsa::AVX2: return "avx2";
+        }
+        return "scalar";
+    }
+
+    ColumnSummary summarizeU16With(KernelIsa isa, const uint16_t* data, size_t count) {
+        switch (isa) {
+#ifdef KERNELS_X86
+            case KernelIsa::AVX2: return avx2U16(data, count);
+            case KernelIsa::SSE2: return sse2U16(data, count);
+#endif
+            default: return scalarU16(data, count);
+        }
+    }
+
+    ColumnSummary summarizeFloatWith(KernelIsa isa, const float* data, size_t count) {
+        switch (isa) {
+#ifdef KERNELS_X86
+            case KernelIsa::AVX2: return avx2Float(data, count);
+            case KernelIsa::SSE2: return sse2Float(data, count);
+#endif
+            default: return scalarFloat(data, count);
+        }
+    }
+
+    ColumnSummary summarizeU16(const uint16_t* data, size_t count) {
+        return summarizeU16With(activeIsa(), data, count);
+    }
+
+    ColumnSummary summarizeFloat(const float* data, size_t count) {
+        return summarizeFloatWith(activeIsa(), data, count);
+    }
+}
@@ -0,0 +1,407 @@
+#include "alert_engine.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    bool parseSeconds(const std::string& text, int64_t& ms) {
+        char* end = nullptr;
+        double seconds = std::strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !(seconds >= 0.0)) {
+            return false;
+        }
+        ms = static_cast<int64_t>(seconds * 1000.0 + 0.5);
+        return true;
+    }
+
+    std::string formatSeconds(int64_t ms) {
+        std::ostringstream oss;
+        oss << static_cast<double>(ms) / 1000.0;
+        return oss.str();
+    }
+
+    const char* conditionName(AlertCondition condition) {
+        switch (condition) {
+            case AlertCondition::Above: return "above";
+            case AlertCondition::Below: return "below";
+            case AlertCondition::Rise: return "rise";
+        }
+        return "above";
+    }
+
+    // Above and rise fire upwards, below fires downwards
+    bool triggers(AlertCondition condition, double value, double level) {
+        return condition == AlertCondition::Below ? value < level : value > level;
+    }
+}
+
+// AlertRule implementation
+bool AlertRule::parse(const std::string& spec, AlertRule& rule) {
+    AlertRule result;
+    int conditions = 0;
+    bool hasClear = false;
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string text = item.substr(equals + 1);
+
+        if (key == "name") {
+            if (text.empty() || text.find_first_of(" \t") != std::string::npos) return false;
+            result.name = text;
+        } else if (key == "sensor") {
+            if (text.empty()) return false;
+            result.sensor = text;
+        } else if (key == "metric") {
+            if (text != "pm25" && text != "pm10") return false;
+            result.pm10 = (text == "pm10");
+        } else if (key == "window") {
+            if (!parseSeconds(text, result.windowMs)) return false;
+        } else if (key == "for") {
+            if (!parseSeconds(text, result.forMs)) return false;
+        } else if (key == "clear-for") {
+            if (!parseSeconds(text, result.clearForMs)) return false;
+        } else {
+            char* end = nullptr;
+            double value = std::strtod(text.c_str(), &end);
+            if (text.empty() || *end != '\0' || !std::isfinite(value)) {
+                return false;
+            }
+            if (key == "above" || key == "below" || key == "rise") {
+                result.condition = key == "above" ? AlertCondition::Above
+                                 : key == "below" ? AlertCondition::Below : AlertCondition::Rise;
+                result.threshold = value;
+                conditions++;
+            } else if (key == "clear") {
+                result.clearLevel = value;
+                hasClear = true;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    if (result.name.empty() || conditions != 1) {
+        return false;
+    }
+    if (result.condition == AlertCondition::Rise && result.windowMs <= 0) {
+        return false;
+    }
+    if (!hasClear) {
+        result.clearLevel = result.threshold;
+    } else if (triggers(result.condition, result.clearLevel, result.threshold)) {
+        // A clear level past the threshold would clear and re-fire on every reading
+        return false;
+    }
+
+    rule = result;
+    return true;
+}
+
+bool AlertRule::loadFile(const std::string& path, std::vector<AlertRule>& rules) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        return false;
+    }
+    std::vector<AlertRule> result;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            continue;
+        }
+        size_t last = line.find_last_not_of(" \t\r");
+        AlertRule rule;
+        if (!parse(line.substr(first, last - first + 1), rule)) {
+            return false;
+        }
+        result.push_back(rule);
+    }
+    rules.insert(rules.end(), result.begin(), result.end());
+    return true;
+}
+
+std::string AlertRule::toString() const {
+    std::ostringstream oss;
+    oss << "name=" << name << "," << conditionName(condition) << "=" << threshold
+        << ",metric=" << (pm10 ? "pm10" : "pm25") << ",sensor=" << sensor
+        << ",window=" << formatSeconds(windowMs) << ",for=" << formatSeconds(forMs)
+        << ",clear=" << clearLevel << ",clear-for=" << formatSeconds(clearForMs);
+    return oss.str();
+}
+
+// AlertEvent implementation
+std::string AlertEvent::toLine() const {
+    std::ostringstream oss;
+    oss << "ALERT " << (firing ? "FIRING " : "CLEARED ") << rule << " " << sensor << " " << timestamp_ms << " "
+        << value << " " << threshold;
+    return oss.str();
+}
+
+// AlertEngine implementation
+void AlertEngine::setRules(const std::vector<AlertRule>& ruleSet) {
+    rules = ruleSet;
+    sensors.clear();
+}
+
+AlertEngine::SensorAlerts& AlertEngine::compile(const std::string& sensor) {
+    auto it = sensors.find(sensor);
+    if (it != sensors.end()) {
+        return it->second;
+    }
+
+    SensorAlerts& alerts = sensors[sensor];
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const AlertRule& rule = rules[i];
+        if (rule.sensor != "*" && rule.sensor != sensor) {
+            continue;
+        }
+        RuleState state;
+        state.rule = i;
+        state.window = -1;
+        state.phase = Phase::Idle;
+        state.sinceMs = 0;
+        state.firedMs = 0;
+        state.lastValue = 0.0;
+        if (rule.windowMs > 0) {
+            // Rules over the same metric and span share one window
+            for (size_t w = 0; w < alerts.windows.size(); ++w) {
+                if (alerts.windows[w].pm10 == rule.pm10 && alerts.windows[w].windowMs == rule.windowMs) {
+                    state.window = static_cast<int>(w);
+                }
+            }
+            if (state.window < 0) {
+                Window window;
+                window.pm10 = rule.pm10;
+                window.windowMs = rule.windowMs;
+                window.sum = 0.0;
+                alerts.windows.push_back(window);
+                state.window = static_cast<int>(alerts.windows.size() - 1);
+            }
+        }
+        alerts.states.push_back(state);
+    }
+    return alerts;
+}
+
+bool AlertEngine::evaluate(const AlertRule& rule, const SensorAlerts& alerts, const RuleState& state, float reading,
+                           double& value) const {
+    if (state.window < 0) {
+        value = reading;
+        return true;
+    }
+    const Window& window = alerts.windows[state.window];
+    if (window.samples.empty()) {
+        return false;
+    }
+    if (rule.condition == AlertCondition::Rise) {
+        // A lone sample has not risen
+        value = static_cast<double>(window.samples.back().second) - window.samples.front().second;
+    } else {
+        value = window.sum / static_cast<double>(window.samples.size());
+    }
+    return true;
+}
+
+void AlertEngine::process(const std::string& sensor, int64_t timestampMs, float pm25, float pm10,
+                          std::vector<AlertEvent>& events) {
+    if (rules.empty()) {
+        return;
+    }
+    SensorAlerts& alerts = compile(sensor);
+
+    for (Window& window : alerts.windows) {
+        float reading = window.pm10 ? pm10 : pm25;
+        if (std::isnan(reading)) {
+            continue;
+        }
+        window.samples.push_back(std::make_pair(timestampMs, reading));
+        window.sum += reading;
+        while (window.samples.front().first < timestampMs - window.windowMs) {
+            window.sum -= window.samples.front().second;
+            window.samples.pop_front();
+        }
+        if (window.samples.size() == 1) {
+            window.sum = window.samples.front().second;  // no drift once the window empties
+        }
+    }
+
+    for (RuleState& state : alerts.states) {
+        const AlertRule& rule = rules[state.rule];
+        float reading = rule.pm10 ? pm10 : pm25;
+        double value = 0.0;
+        if (std::isnan(reading) || !evaluate(rule, alerts, state, reading, value)) {
+            continue;
+        }
+        state.lastValue = value;
+
+        bool fire = triggers(rule.condition, value, rule.threshold);
+        bool clear = !triggers(rule.condition, value, rule.clearLevel);
+        bool changed = false;
+        switch (state.phase) {
+            case Phase::Idle:
+                if (fire) {
+                    state.phase = Phase::Pending;
+                    state.sinceMs = timestampMs;
+                }
+                break;
+            case Phase::Pending:
+                if (!fire) {
+                    state.phase = Phase::Idle;
+                }
+                break;
+            case Phase::Firing:
+                if (clear) {
+                    state.phase = Phase::Clearing;
+                    state.sinceMs = timestampMs;
+                }
+                break;
+            case Phase::Clearing:
+                if (!clear) {
+                    state.phase = Phase::Firing;
+                }
+                break;
+        }
+        if (state.phase == Phase::Pending && timestampMs - state.sinceMs >= rule.forMs) {
+            state.phase = Phase::Firing;
+            state.firedMs = timestampMs;
+            changed = true;
+        } else if (state.phase == Phase::Clearing && timestampMs - state.sinceMs >= rule.clearForMs) {
+            state.phase = Phase::Idle;
+            changed = true;
+        }
+
+        if (changed) {
+            AlertEvent event;
+            event.rule = rule.name;
+            event.sensor = sensor;
+            event.firing = (state.phase == Phase::Firing);
+            event.timestamp_ms = timestampMs;
+            event.value = value;
+            event.threshold = event.firing ? rule.threshold : rule.clearLevel;
+            events.push_back(event);
+        }
+    }
+}
+
+std::vector<AlertEngine::ActiveAlert> AlertEngine::active() const {
+    std::vector<ActiveAlert> result;
+    for (const auto& entry : sensors) {
+        for (const RuleState& state : entry.second.states) {
+            if (state.phase != Phase::Firing && state.phase != Phase::Clearing) {
+                continue;
+            }
+            ActiveAlert alert;
+            alert.rule = rules[state.rule].name;
+            alert.sensor = entry.first;
+            alert.sinceMs = state.firedMs;
+            alert.value = state.lastValue;
+            result.push_back(alert);
+        }
+    }
+    return result;
+}
+
+// AlertSink implementation
+AlertSink::AlertSink() : kind(Kind::File), fd(-1), dropped(0) {}
+
+AlertSink::~AlertSink() {
+    disconnect();
+}
+
+bool AlertSink::open(const std::string& target) {
+    disconnect();
+    path = target;
+    kind = Kind::File;
+    if (path.compare(0, 5, "unix:") == 0) {
+        path = path.substr(5);
+        kind = Kind::Socket;
+    } else {
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0) {
+            if (S_ISFIFO(info.st_mode)) kind = Kind::Fifo;
+            if (S_ISSOCK(info.st_mode)) kind = Kind::Socket;
+        }
+    }
+    if (kind == Kind::Fifo) {
+        // A FIFO reader that goes away must not kill the daemon with SIGPIPE
+        signal(SIGPIPE, SIG_IGN);
+    }
+    // FIFO readers and socket listeners may turn up later
+    return connect() || kind != Kind::File;
+}
+
+bool AlertSink::connect() {
+    if (fd >= 0) {
+        return true;
+    }
+    if (kind == Kind::Socket) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            disconnect();
+            return false;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    } else if (kind == Kind::Fifo) {
+        // ENXIO until somebody has the FIFO open for reading
+        fd = ::open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    } else {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    return fd >= 0;
+}
+
+void AlertSink::disconnect() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool AlertSink::write(const AlertEvent& event) {
+    if (!connect()) {
+        dropped++;
+        return false;
+    }
+    std::string line = event.toLine() + "\n";
+    ssize_t n = (kind == Kind::Socket) ? send(fd, line.data(), line.size(), MSG_NOSIGNAL)
+                                       : ::write(fd, line.data(), line.size());
+    if (n == static_cast<ssize_t>(line.size())) {
+        return true;
+    }
+    dropped++;
+    // A full pipe or socket keeps its reader; a partial line or a gone reader does not
+    if (n != 0 && !(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+        disconnect();
+    }
+    return false;
+}
@@ -1,4 +1,5 @@
 #include "app_utils.h"
+#include <cstdlib>
 #include <iostream>
 #include <signal.h>
 #include <sstream>
@@ -19,6 +20,46 @@ namespace AppUtils {
         std::cout << "  Options:" << std::endl;
         std::cout << "    --no-tui    Disable TUI mode and use console output" << std::endl;
         std::cout << "    --legacy    Use legacy single-sensor mode instead of interactive" << std::endl;
+        std::cout << "    --trace FILE           Record a binary event trace of the sensor loop" << std::endl;
+        std::cout << "    --trace-json IN OUT    Convert a binary trace to Chrome trace JSON and exit" << std::endl;
+        std::cout << "    --capture FILE         Tee raw serial bytes with arrival times to FILE" << std::endl;
+        std::cout << "    --history-file FILE    Keep the interactive history in a memory-mapped ring in FILE," << std::endl;
+        std::cout << "                           re-attached on restart" << std::endl;
+        std::cout << "    --export-arrow FILE    Write the --history-file ring as an Arrow IPC file and exit" << std::endl;
+        std::cout << "    --export-filter SPEC   Limit the export: from=MS,to=MS,sensor=ID (any subset)" << std::endl;
+        std::cout << "    --replay FILE          Feed a capture through the frame parser and report" << std::endl;
+        std::cout << "    --replay-speed MODE    Replay pacing: real (default) or max" << std::endl;
+        std::cout << "    --io-profile [PORT=]NAME  Serial read strategy: timed (default), frame, poll" << std::endl;
+        std::cout << "                           or lowlatency; without PORT it applies to all ports" << std::endl;
+        std::cout << "    --probe-io N           Read N frames with each I/O profile and compare latency" << std::endl;
+        std::cout << "    --daemon               Run headless: acquire, persist and serve the control socket" << std::endl;
+        std::cout << "    --sensor PORT          Sensor port for --daemon (repeatable, default: discover)" << std::endl;
+        std::cout << "    --socket PATH          Control socket (default: /tmp/sensor_reader.sock)" << std::endl;
+        std::cout << "    --data-file PATH       Daemon reading log (default: sensor_readings.csv)" << std::endl;
+        std::cout << "    --store DIR            Daemon segment store with a time index, for HISTORY" << std::endl;
+        std::cout << "    --export-dir DIR       Directory EXPORT writes its files into (default: EXPORT off)" << std::endl;
+        std::cout << "    --retention SPEC       Roll up and expire the store: raw=7d,minute=365d,hour=0," << std::endl;
+        std::cout << "                           size=0,rate=4M,interval=60s (any subset; 0 = keep)" << std::endl;
+        std::cout << "    --wal SPEC             Group-commit write-ahead log for the store: interval=1s," << std::endl;
+        std::cout << "                           size=64K,checkpoint=16M (any subset)" << std::endl;
+        std::cout << "    --io-backend NAME      How the daemon writes its log: auto (default), uring" << std::endl;
+        std::cout << "                           or epoll" << std::endl;
+        std::cout << "    --alert SPEC           Daemon alert rule: name=high,above=35,window=300,for=600," << std::endl;
+        std::cout << "                           clear=25,clear-for=300 (repeatable; below= or rise=)" << std::endl;
+        std::cout << "    --alert-rules FILE     Alert rules, one spec per line" << std::endl;
+        std::cout << "    --alert-sink PATH      Write alert events to a file, FIFO or unix:SOCKET" << std::endl;
+        std::cout << "                           (default: standard output)" << std::endl;
+        std::cout << "    --attach               Show a running daemon's readings in the TUI" << std::endl;
+        std::cout << "    --aqi-standard STD     AQI scale for colours: us (default), in or uk" << std::endl;
+        std::cout << "    --filter SPEC          Outlier filter: off, or window=15,threshold=3,min=5," << std::endl;
+        std::cout << "                           rate=0,ceiling=999.9 (any subset; rate 0 = no limit)" << std::endl;
+        std::cout << "    --humidity PATH        Correct PM for humidity read from a file or FIFO of" << std::endl;
+        std::cout << "                           \"<unix_time> <rh>\" or \"<rh>\" lines" << std::endl;
+        std::cout << "    --humidity-model SPEC  Growth model: kappa25=0.4,kappa10=0.35,max-rh=95," << std::endl;
+        std::cout << "                           max-age=900 (seconds; any subset)" << std::endl;
+        std::cout << "    --bench NAME           Run a built-in benchmark (kernels, history," << std::endl;
+        std::cout << "                           chart, filter, humidity, io, bus, alerts, segments," << std::endl;
+        std::cout << "                           compaction, wal, arrow or all)" << std::endl;
         std::cout << "    -h, --help  Show this help message" << std::endl;
 #ifdef MACOS
         std::cout << "  serial_port: Serial port device (default: /dev/cu.usbserial)" << std::endl;
@@ -32,6 +73,8 @@ namespace AppUtils {
         std::cout << "    r          Refresh sensor list" << std::endl;
         std::cout << "    b          Back to sensor selection" << std::endl;
         std::cout << "    c          Clear collected data" << std::endl;
+        std::cout << "    g          Show or hide the trend chart" << std::endl;
+        std::cout << "    t          Cycle the chart span (5m, 1h, 6h, 24h, 7d)" << std::endl;
         std::cout << "    q          Quit the program" << std::endl;
         std::cout << std::endl;
         std::cout << "  Examples:" << std::endl;
@@ -43,15 +86,18 @@ namespace AppUtils {
         std::cout << "    " << program_name << " --legacy /dev/ttyUSB1  # Legacy TUI mode with custom port" << std::endl;
 #endif
         std::cout << "    " << program_name << " --no-tui           # Console mode with default port" << std::endl;
+        std::cout << "    " << program_name << " --daemon --sensor /dev/ttyUSB0 --sensor /dev/ttyUSB1" << std::endl;
+        std::cout << "    " << program_name << " --attach /dev/ttyUSB1  # Watch one daemon sensor, 'q' detaches" << std::endl;
     }
     
-    bool parseArguments(int argc, char* argv[], std::string& serial_port, bool& use_tui) {
+    bool parseArguments(int argc, char* argv[], AppOptions& options) {
 #ifdef MACOS
-        serial_port = "/dev/cu.usbserial";
+        options.serial_port = "/dev/cu.usbserial";
 #else
-        serial_port = "/dev/ttyUSB0";
+        options.serial_port = "/dev/ttyUSB0";
 #endif
-        use_tui = true;
+        options.use_tui = true;
+        options.use_interactive = true;
         
         bool found_port = false;
         
@@ -62,13 +108,171 @@ namespace AppUtils {
                 printUsage(argv[0]);
                 return false;
             } else if (arg == "--no-tui") {
-                use_tui = false;
+                options.use_tui = false;
             } else if (arg == "--legacy") {
-                // Legacy flag handled in main()
-                continue;
+                options.use_interactive = false;
+            } else if (arg == "--trace") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--trace requires a file name" << std::endl;
+                    return false;
+                }
+                options.trace_file = argv[++i];
+            } else if (arg == "--trace-json") {
+                if (i + 2 >= argc) {
+                    std::cerr << "--trace-json requires an input and an output file" << std::endl;
+                    return false;
+                }
+                options.trace_json_input = argv[++i];
+                options.trace_json_output = argv[++i];
+            } else if (arg == "--capture") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--capture requires a file name" << std::endl;
+                    return false;
+                }
+                options.capture_file = argv[++i];
+            } else if (arg == "--history-file") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--history-file requires a file name" << std::endl;
+                    return false;
+                }
+                options.history_file = argv[++i];
+            } else if (arg == "--export-arrow") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--export-arrow requires a file name" << std::endl;
+                    return false;
+                }
+                options.export_file = argv[++i];
+            } else if (arg == "--export-filter") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                if (!ArrowExportFilter::parse(spec, options.export_filter)) {
+                    std::cerr << "Invalid --export-filter spec: " << spec << std::endl;
+                    return false;
+                }
+            } else if (arg == "--replay") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--replay requires a capture file" << std::endl;
+                    return false;
+                }
+                options.replay_file = argv[++i];
+            } else if (arg == "--replay-speed") {
+                std::string mode = (i + 1 < argc) ? argv[++i] : "";
+                if (mode != "real" && mode != "max") {
+                    std::cerr << "--replay-speed must be 'real' or 'max'" << std::endl;
+                    return false;
+                }
+                options.replay_real_time = (mode == "real");
+            } else if (arg == "--io-profile") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                size_t eq = spec.rfind('=');
+                std::string port = (eq == std::string::npos) ? "" : spec.substr(0, eq);
+                std::string name = (eq == std::string::npos) ? spec : spec.substr(eq + 1);
+                SerialIOProfile profile;
+                if (!SerialPort::parseProfile(name, profile)) {
+                    std::cerr << "--io-profile must be timed, frame, poll or lowlatency" << std::endl;
+                    return false;
+                }
+                options.io_profiles.push_back(std::make_pair(port, profile));
+            } else if (arg == "--probe-io") {
+                int frames = (i + 1 < argc) ? std::atoi(argv[++i]) : 0;
+                if (frames <= 0) {
+                    std::cerr << "--probe-io requires a positive frame count" << std::endl;
+                    return false;
+                }
+                options.probe_frames = frames;
+            } else if (arg == "--aqi-standard") {
+                std::string name = (i + 1 < argc) ? argv[++i] : "";
+                if (!AQIEngine::parseStandard(name, options.aqi_standard)) {
+                    std::cerr << "--aqi-standard must be us, in or uk" << std::endl;
+                    return false;
+                }
+            } else if (arg == "--filter") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                if (!FilterConfig::parse(spec, options.filter)) {
+                    std::cerr << "Invalid --filter spec: " << spec << std::endl;
+                    return false;
+                }
+            } else if (arg == "--retention") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                if (!RetentionPolicy::parse(spec, options.retention)) {
+                    std::cerr << "Invalid --retention spec: " << spec << std::endl;
+                    return false;
+                }
+            } else if (arg == "--wal") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                if (!WalConfig::parse(spec, options.wal)) {
+                    std::cerr << "Invalid --wal spec: " << spec << std::endl;
+                    return false;
+                }
+            } else if (arg == "--humidity") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--humidity requires a file or FIFO" << std::endl;
+                    return false;
+                }
+                options.humidity_source = argv[++i];
+            } else if (arg == "--humidity-model") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                if (!HumidityModel::parse(spec, options.humidity_model)) {
+                    std::cerr << "Invalid --humidity-model spec: " << spec << std::endl;
+                    return false;
+                }
+            } else if (arg == "--io-backend") {
+                std::string name = (i + 1 < argc) ? argv[++i] : "";
+                if (!IoBackend::parseKind(name, options.io_backend)) {
+                    std::cerr << "Unknown --io-backend: " << name << " (auto, uring or epoll)" << std::endl;
+                    return false;
+                }
+            } else if (arg == "--alert") {
+                std::string spec = (i + 1 < argc) ? argv[++i] : "";
+                AlertRule rule;
+                if (!AlertRule::parse(spec, rule)) {
+                    std::cerr << "Invalid --alert spec: " << spec << std::endl;
+                    return false;
+                }
+                options.alert_rules.push_back(rule);
+            } else if (arg == "--alert-rules") {
+                std::string path = (i + 1 < argc) ? argv[++i] : "";
+                if (!AlertRule::loadFile(path, options.alert_rules)) {
+                    std::cerr << "Cannot load --alert-rules " << path << ": missing file or invalid rule" << std::endl;
+                    return false;
+                }
+            } else if (arg == "--alert-sink") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--alert-sink requires a file, FIFO or socket" << std::endl;
+                    return false;
+                }
+                options.alert_sink = argv[++i];
+            } else if (arg == "--bench") {
+                if (i + 1 >= argc) {
+                    std::cerr << "--bench requires a benchmark name" << std::endl;
+                    return false;
+                }
+                options.benchmark = argv[++i];
+            } else if (arg == "--daemon") {
+                options.daemon_mode = true;
+            } else if (arg == "--attach") {
+                options.attach = true;
+            } else if (arg == "--sensor" || arg == "--socket" || arg == "--data-file" || arg == "--store" ||
+                       arg == "--export-dir") {
+                if (i + 1 >= argc) {
+                    std::cerr << arg << " requires a value" << std::endl;
+                    return false;
+                }
+                std::string value = argv[++i];
+                if (arg == "--sensor") {
+                    options.sensor_ports.push_back(value);
+                } else if (arg == "--socket") {
+                    options.socket_path = value;
+                } else if (arg == "--store") {
+                    options.store_directory = value;
+                } else if (arg == "--export-dir") {
+                    options.export_dir = value;
+                } else {
+                    options.data_file = value;
+                }
             } else if (!found_port && arg[0] != '-') {
                 // This is the serial port argument
-                serial_port = arg;
+                options.serial_port = arg;
+                options.port_specified = true;
                 found_port = true;
             }
         }
@@ -92,4 +296,18 @@ namespace AppUtils {
         
         return str;
     }
+
+    std::string formatDuration(uint64_t ns) {
+        std::ostringstream oss;
+        if (ns < 1000) {
+            oss << ns << "ns";
+        } else if (ns < 1000000) {
+            oss << std::fixed << std::setprecision(ns < 10000 ? 2 : 1) << ns / 1e3 << "us";
+        } else if (ns < 1000000000) {
+            oss << std::fixed << std::setprecision(ns < 10000000 ? 2 : 1) << ns / 1e6 << "ms";
+        } else {
+            oss << std::fixed << std::setprecision(2) << ns / 1e9 << "s";
+        }
+        return oss.str();
+    }
 }
@@ -0,0 +1,273 @@
+#include "aqi_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // US EPA, PM2.5 breakpoints as revised in 2024
+    const AQIBreakpoint US_PM25[] = {
+        {0.0, 9.0, 0, 50, 0, "Good"},
+        {9.1, 35.4, 51, 100, 1, "Moderate"},
+        {35.5, 55.4, 101, 150, 2, "Unhealthy for Sensitive Groups"},
+        {55.5, 125.4, 151, 200, 3, "Unhealthy"},
+        {125.5, 225.4, 201, 300, 4, "Very Unhealthy"},
+        {225.5, 325.4, 301, 500, 5, "Hazardous"},
+    };
+    const AQIBreakpoint US_PM10[] = {
+        {0, 54, 0, 50, 0, "Good"},
+        {55, 154, 51, 100, 1, "Moderate"},
+        {155, 254, 101, 150, 2, "Unhealthy for Sensitive Groups"},
+        {255, 354, 151, 200, 3, "Unhealthy"},
+        {355, 424, 201, 300, 4, "Very Unhealthy"},
+        {425, 604, 301, 500, 5, "Hazardous"},
+    };
+
+    // India CPCB National AQI
+    const AQIBreakpoint IN_PM25[] = {
+        {0, 30, 0, 50, 0, "Good"},
+        {31, 60, 51, 100, 1, "Satisfactory"},
+        {61, 90, 101, 200, 2, "Moderate"},
+        {91, 120, 201, 300, 3, "Poor"},
+        {121, 250, 301, 400, 4, "Very Poor"},
+        {251, 380, 401, 500, 5, "Severe"},
+    };
+    const AQIBreakpoint IN_PM10[] = {
+        {0, 50, 0, 50, 0, "Good"},
+        {51, 100, 51, 100, 1, "Satisfactory"},
+        {101, 250, 101, 200, 2, "Moderate"},
+        {251, 350, 201, 300, 3, "Poor"},
+        {351, 430, 301, 400, 4, "Very Poor"},
+        {431, 800, 401, 500, 5, "Severe"},
+    };
+
+    // UK DAQI: banded, the index is the band number
+    const AQIBreakpoint UK_PM25[] = {
+        {0, 11, 1, 1, 0, "Low"}, {12, 23, 2, 2, 0, "Low"}, {24, 35, 3, 3, 0, "Low"},
+        {36, 41, 4, 4, 1, "Moderate"}, {42, 47, 5, 5, 1, "Moderate"}, {48, 53, 6, 6, 1, "Moderate"},
+        {54, 58, 7, 7, 3, "High"}, {59, 64, 8, 8, 3, "High"}, {65, 70, 9, 9, 3, "High"},
+        {71, 1e9, 10, 10, 4, "Very High"},
+    };
+    const AQIBreakpoint UK_PM10[] = {
+        {0, 16, 1, 1, 0, "Low"}, {17, 33, 2, 2, 0, "Low"}, {34, 50, 3, 3, 0, "Low"},
+        {51, 58, 4, 4, 1, "Moderate"}, {59, 66, 5, 5, 1, "Moderate"}, {67, 75, 6, 6, 1, "Moderate"},
+        {76, 83, 7, 7, 3, "High"}, {84, 91, 8, 8, 3, "High"}, {92, 100, 9, 9, 3, "High"},
+        {101, 1e9, 10, 10, 4, "Very High"},
+    };
+
+    struct Table {
+        const AQIBreakpoint* rows;
+        size_t size;
+        double resolution;      // concentrations are truncated to this step
+    };
+
+    template <size_t N>
+    Table makeTable(const AQIBreakpoint (&rows)[N], double resolution) {
+        return Table{rows, N, resolution};
+    }
+
+    Table tableFor(AQIStandard standard, Pollutant pollutant) {
+        bool pm25 = (pollutant == Pollutant::PM25);
+        switch (standard) {
+            case AQIStandard::IndiaNAQI:
+                return pm25 ? makeTable(IN_PM25, 1.0) : makeTable(IN_PM10, 1.0);
+            case AQIStandard::UKDAQI:
+                return pm25 ? makeTable(UK_PM25, 1.0) : makeTable(UK_PM10, 1.0);
+            case AQIStandard::USEPA:
+            default:
+                return pm25 ? makeTable(US_PM25, 0.1) : makeTable(US_PM10, 1.0);
+        }
+    }
+
+    AQIResult worse(const AQIResult& a, const AQIResult& b) {
+        if (!a.valid) return b;
+        if (!b.valid) return a;
+        return (b.index > a.index) ? b : a;
+    }
+}
+
+AQIEngine::AQIEngine(AQIStandard value) : standard(value) {
+    reset();
+}
+
+void AQIEngine::reset() {
+    for (HourBucket& bucket : buckets) {
+        bucket.hour = -1;
+        bucket.sum[0] = bucket.sum[1] = 0.0;
+        bucket.count = 0;
+    }
+    latestHour = -1;
+    windowSum[0] = windowSum[1] = 0.0;
+    windowCount = 0;
+    hoursWithData = 0;
+}
+
+void AQIEngine::clearBucket(HourBucket& bucket) {
+    if (bucket.hour >= 0 && bucket.count > 0) {
+        windowSum[0] -= bucket.sum[0];
+        windowSum[1] -= bucket.sum[1];
+        windowCount -= bucket.count;
+        hoursWithData--;
+    }
+    bucket.hour = -1;
+    bucket.sum[0] = bucket.sum[1] = 0.0;
+    bucket.count = 0;
+}
+
+void AQIEngine::addReading(int64_t unixSeconds, float pm25, float pm10) {
+    int64_t hour = unixSeconds / 3600;
+
+    if (hour > latestHour) {
+        // Recycle the buckets of hours that fell out of the window; at most 24
+        int64_t first = (latestHour < 0) ? hour : std::max(latestHour + 1, hour - HOURS + 1);
+        for (int64_t h = first; h <= hour; ++h) {
+            clearBucket(bucketFor(h));
+        }
+        latestHour = hour;
+    } else if (hour <= latestHour - HOURS) {
+        return; // Too old for the window
+    }
+
+    HourBucket& bucket = bucketFor(hour);
+    if (bucket.hour != hour) {
+        clearBucket(bucket);
+        bucket.hour = hour;
+    }
+    if (bucket.count == 0) {
+        hoursWithData++;
+    }
+
+    bucket.sum[0] += pm25;
+    bucket.sum[1] += pm10;
+    bucket.count++;
+    windowSum[0] += pm25;
+    windowSum[1] += pm10;
+    windowCount++;
+}
+
+const AQIEngine::HourBucket* AQIEngine::bucketAt(int64_t hour) const {
+    const HourBucket& bucket = buckets[((hour % HOURS) + HOURS) % HOURS];
+    return (bucket.hour == hour && bucket.count > 0) ? &bucket : nullptr;
+}
+
+double AQIEngine::nowCast(Pollutant pollutant, bool& provisional) const {
+    int column = (pollutant == Pollutant::PM25) ? 0 : 1;
+    double averages[NOWCAST_HOURS];
+    bool present[NOWCAST_HOURS];
+    double minAvg = 0.0, maxAvg = 0.0;
+    int recent = 0;
+    bool any = false;
+
+    for (int i = 0; i < NOWCAST_HOURS; ++i) {
+        const HourBucket* bucket = (latestHour < 0) ? nullptr : bucketAt(latestHour - i);
+        present[i] = (bucket != nullptr);
+        if (!present[i]) continue;
+
+        averages[i] = bucket->sum[column] / bucket->count;
+        minAvg = any ? std::min(minAvg, averages[i]) : averages[i];
+        maxAvg = any ? std::max(maxAvg, averages[i]) : averages[i];
+        any = true;
+        if (i < 3) recent++;
+    }
+
+    provisional = (recent < 2);
+    if (!any) {
+        return -1.0;
+    }
+
+    // Weight factor: steady air looks back 12 h, changing air mostly at the last hours
+    double weight = (maxAvg > 0.0) ? std::max(minAvg / maxAvg, 0.5) : 1.0;
+    double numerator = 0.0, denominator = 0.0, factor = 1.0;
+    for (int i = 0; i < NOWCAST_HOURS; ++i, factor *= weight) {
+        if (present[i]) {
+            numerator += factor * averages[i];
+            denominator += factor;
+        }
+    }
+    return numerator / denominator;
+}
+
+double AQIEngine::mean24h(Pollutant pollutant) const {
+    if (windowCount == 0) {
+        return -1.0;
+    }
+    return windowSum[(pollutant == Pollutant::PM25) ? 0 : 1] / windowCount;
+}
+
+AQIResult AQIEngine::nowCastAQI() const {
+    bool provisional25 = true, provisional10 = true;
+    double pm25 = nowCast(Pollutant::PM25, provisional25);
+    double pm10 = nowCast(Pollutant::PM10, provisional10);
+
+    AQIResult result = worse(classify(standard, Pollutant::PM25, pm25),
+                             classify(standard, Pollutant::PM10, pm10));
+    result.provisional = provisional25;
+    return result;
+}
+
+AQIResult AQIEngine::dailyAQI() const {
+    AQIResult result = worse(classify(standard, Pollutant::PM25, mean24h(Pollutant::PM25)),
+                             classify(standard, Pollutant::PM10, mean24h(Pollutant::PM10)));
+    // 75% of the hours, as for regulatory daily means
+    result.provisional = (hoursWithData < 18);
+    return result;
+}
+
+AQIResult AQIEngine::classify(AQIStandard standard, Pollutant pollutant, double concentration) {
+    AQIResult result;
+    if (concentration < 0.0) {
+        return result;
+    }
+
+    Table table = tableFor(standard, pollutant);
+    double c = std::floor(concentration / table.resolution + 1e-9) * table.resolution;
+
+    const AQIBreakpoint* row = &table.rows[table.size - 1];
+    for (size_t i = 0; i < table.size; ++i) {
+        if (c <= table.rows[i].concentrationHigh) {
+            row = &table.rows[i];
+            break;
+        }
+    }
+
+    // Values between rows or beyond the table are clamped to the row's range
+    double clamped = std::min(std::max(c, row->concentrationLow), row->concentrationHigh);
+    double span = row->concentrationHigh - row->concentrationLow;
+    double index = row->indexLow;
+    if (span > 0.0) {
+        index += (row->indexHigh - row->indexLow) * (clamped - row->concentrationLow) / span;
+    }
+
+    result.index = static_cast<int>(std::lround(index));
+    result.level = row->level;
+    result.category = row->category;
+    result.concentration = concentration;
+    result.valid = true;
+    result.provisional = false;
+    return result;
+}
+
+int AQIEngine::colorPair(int level) {
+    if (level <= 0) return 1;   // Green
+    if (level == 1) return 2;   // Yellow
+    if (level <= 3) return 3;   // Red
+    return 6;                   // Magenta for very unhealthy and worse
+}
+
+const char* AQIEngine::standardName(AQIStandard standard) {
+    switch (standard) {
+        case AQIStandard::USEPA: return "us";
+        case AQIStandard::IndiaNAQI: return "in";
+        case AQIStandard::UKDAQI: return "uk";
+    }
+    return "us";
+}
+
+bool AQIEngine::parseStandard(const std::string& name, AQIStandard& standard) {
+    static const AQIStandard ALL[] = {AQIStandard::USEPA, AQIStandard::IndiaNAQI, AQIStandard::UKDAQI};
+    for (AQIStandard candidate : ALL) {
+        if (name == standardName(candidate)) {
+            standard = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,494 @@
+#include "arrow_export.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    const char ARROW_MAGIC[6] = {'A', 'R', 'R', 'O', 'W', '1'};
+    const int16_t METADATA_V5 = 4;
+    const int64_t SENSOR_DICTIONARY = 0;
+
+    // Union tags of Message.header and Field.type in the Arrow schema files
+    const uint8_t HEADER_SCHEMA = 1;
+    const uint8_t HEADER_DICTIONARY_BATCH = 2;
+    const uint8_t HEADER_RECORD_BATCH = 3;
+    const uint8_t TYPE_INT = 2;
+    const uint8_t TYPE_FLOATING_POINT = 3;
+    const uint8_t TYPE_UTF8 = 5;
+    const uint8_t TYPE_TIMESTAMP = 10;
+
+    struct FieldNode {
+        int64_t length;
+        int64_t nullCount;
+    };
+
+    struct BufferSpan {
+        int64_t offset;
+        int64_t length;
+    };
+
+    size_t padTo8(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    /**
+     * A FlatBuffers object to be serialised: a table, a string, a vector of
+     * tables or a vector of 8-byte aligned structs. Just enough of the format
+     * for the Arrow metadata, written front to back: parents first, children
+     * after them, so every offset points forward as the format requires.
+     */
+    struct FlatNode {
+        enum Kind { Table, String, Tables, Structs };
+
+        struct Field {
+            uint16_t id;
+            std::string scalar;             // inline value, empty for a child
+            std::shared_ptr<FlatNode> child;
+        };
+
+        Kind kind;
+        std::vector<Field> fields;          // Table
+        std::string bytes;                  // String text, Structs elements
+        uint32_t count;                     // Structs
+        std::vector<std::shared_ptr<FlatNode>> items;   // Tables
+
+        explicit FlatNode(Kind k) : kind(k), count(0) {}
+
+        template <typename T>
+        FlatNode& add(uint16_t id, T value) {
+            Field field = {id, std::string(reinterpret_cast<const char*>(&value), sizeof(value)), nullptr};
+            fields.push_back(field);
+            return *this;
+        }
+
+        FlatNode& add(uint16_t id, const std::shared_ptr<FlatNode>& child) {
+            Field field = {id, std::string(), child};
+            fields.push_back(field);
+            return *this;
+        }
+    };
+    typedef std::shared_ptr<FlatNode> FlatRef;
+
+    FlatRef table() {
+        return FlatRef(new FlatNode(FlatNode::Table));
+    }
+
+    FlatRef string(const std::string& text) {
+        FlatRef node(new FlatNode(FlatNode::String));
+        node->bytes = text;
+        return node;
+    }
+
+    FlatRef tables(const std::vector<FlatRef>& items) {
+        FlatRef node(new FlatNode(FlatNode::Tables));
+        node->items = items;
+        return node;
+    }
+
+    template <typename T>
+    FlatRef structs(const std::vector<T>& items) {
+        static_assert(sizeof(T) % 8 == 0, "struct vectors hold 8-byte aligned structs");
+        FlatRef node(new FlatNode(FlatNode::Structs));
+        node->bytes.assign(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+        node->count = static_cast<uint32_t>(items.size());
+        return node;
+    }
+
+    void pad(std::string& out, size_t alignment, size_t skew = 0) {
+        while ((out.size() + skew) % alignment != 0) out.push_back('\0');
+    }
+
+    void patch(std::string& out, size_t at, size_t target) {
+        uint32_t offset = static_cast<uint32_t>(target - at);
+        memcpy(&out[at], &offset, sizeof(offset));
+    }
+
+    template <typename T>
+    void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // Serialise a node at the end of out and return its position
+    size_t serialize(std::string& out, const FlatNode& node) {
+        if (node.kind == FlatNode::String) {
+            pad(out, 4);
+            size_t at = out.size();
+            put(out, static_cast<uint32_t>(node.bytes.size()));
+            out += node.bytes;
+            out.push_back('\0');
+            return at;
+        }
+        if (node.kind == FlatNode::Structs) {
+            // The length prefix sits right before the 8-byte aligned elements
+            pad(out, 8, 4);
+            size_t at = out.size();
+            put(out, node.count);
+            out += node.bytes;
+            return at;
+        }
+        if (node.kind == FlatNode::Tables) {
+            pad(out, 4);
+            size_t at = out.size();
+            put(out, static_cast<uint32_t>(node.items.size()));
+            out.append(node.items.size() * sizeof(uint32_t), '\0');
+            for (size_t i = 0; i < node.items.size(); ++i) {
+                size_t slot = at + sizeof(uint32_t) * (i + 1);
+                patch(out, slot, serialize(out, *node.items[i]));
+            }
+            return at;
+        }
+
+        // Table: fields by decreasing size after the vtable offset, so each is naturally aligned
+        std::vector<const FlatNode::Field*> order;
+        uint16_t slots = 0;
+        for (const FlatNode::Field& field : node.fields) {
+            order.push_back(&field);
+            slots = std::max<uint16_t>(slots, static_cast<uint16_t>(field.id + 1));
+        }
+        std::stable_sort(order.begin(), order.end(), [](const FlatNode::Field* a, const FlatNode::Field* b) {
+            size_t sizeA = a->child ? sizeof(uint32_t) : a->scalar.size();
+            size_t sizeB = b->child ? sizeof(uint32_t) : b->scalar.size();
+            return sizeA > sizeB;
+        });
+        std::vector<uint16_t> vtable(2 + slots, 0);
+        std::vector<uint16_t> position(node.fields.size(), 0);
+        size_t inlineBytes = sizeof(int32_t);
+        for (const FlatNode::Field* field : order) {
+            size_t size = field->child ? sizeof(uint32_t) : field->scalar.size();
+            inlineBytes = (inlineBytes + size - 1) / size * size;
+            position[field - node.fields.data()] = static_cast<uint16_t>(inlineBytes);
+            vtable[2 + field->id] = static_cast<uint16_t>(inlineBytes);
+            inlineBytes += size;
+        }
+        vtable[0] = static_cast<uint16_t>(vtable.size() * sizeof(uint16_t));
+        vtable[1] = static_cast<uint16_t>(inlineBytes);
+
+        pad(out, 2);
+        size_t vtableAt = out.size();
+        out.append(reinterpret_cast<const char*>(vtable.data()), vtable.size() * sizeof(uint16_t));
+        pad(out, 8);
+        size_t at = out.size();
+        put(out, static_cast<int32_t>(at - vtableAt));
+        out.append(inlineBytes - sizeof(int32_t), '\0');
+        for (size_t i = 0; i < node.fields.size(); ++i) {
+            if (!node.fields[i].child) {
+                memcpy(&out[at + position[i]], node.fields[i].scalar.data(), node.fields[i].scalar.size());
+            }
+        }
+        for (size_t i = 0; i < node.fields.size(); ++i) {
+            if (node.fields[i].child) {
+                patch(out, at + position[i], serialize(out, *node.fields[i].child));
+            }
+        }
+        return at;
+    }
+
+    // A finished buffer: root offset, the objects, padded to 8 bytes
+    std::string finish(const FlatRef& root) {
+        std::string out(sizeof(uint32_t), '\0');
+        patch(out, 0, serialize(out, *root));
+        pad(out, 8);
+        return out;
+    }
+
+    FlatRef intType(int32_t bitWidth, bool isSigned) {
+        FlatRef type = table();
+        type->add(0, bitWidth).add(1, static_cast<uint8_t>(isSigned));
+        return type;
+    }
+
+    FlatRef field(const std::string& name, uint8_t typeTag, const FlatRef& type, const FlatRef& dictionary = nullptr) {
+        FlatRef node = table();
+        node->add(0, string(name)).add(1, static_cast<uint8_t>(0)).add(2, typeTag).add(3, type);
+        if (dictionary) node->add(4, dictionary);
+        node->add(5, tables(std::vector<FlatRef>()));
+        return node;
+    }
+
+    FlatRef schema() {
+        FlatRef timestamp = table();
+        timestamp->add(0, static_cast<int16_t>(1)).add(1, string("UTC"));     // MILLISECOND
+        FlatRef dictionary = table();
+        dictionary->add(0, SENSOR_DICTIONARY).add(1, intType(16, true)).add(2, static_cast<uint8_t>(0));
+        FlatRef single = table();
+        single->add(0, static_cast<int16_t>(1));                              // SINGLE
+        FlatRef singleToo = table();
+        singleToo->add(0, static_cast<int16_t>(1));
+
+        std::vector<FlatRef> fields;
+        fields.push_back(field("timestamp", TYPE_TIMESTAMP, timestamp));
+        fields.push_back(field("sensor", TYPE_UTF8, table(), dictionary));
+        fields.push_back(field("pm25", TYPE_FLOATING_POINT, single));
+        fields.push_back(field("pm10", TYPE_FLOATING_POINT, singleToo));
+        fields.push_back(field("flags", TYPE_INT, intType(8, false)));
+
+        FlatRef node = table();
+        node->add(0, static_cast<int16_t>(0)).add(1, tables(fields));      // little endian
+        return node;
+    }
+
+    FlatRef recordBatch(int64_t length, const std::vector<FieldNode>& nodes, const std::vector<BufferSpan>& buffers) {
+        FlatRef node = table();
+        node->add(0, length).add(1, structs(nodes)).add(2, structs(buffers));
+        return node;
+    }
+
+    std::string message(uint8_t headerType, const FlatRef& header, int64_t bodyLength) {
+        FlatRef node = table();
+        node->add(0, METADATA_V5).add(1, headerType).add(2, header).add(3, bodyLength);
+        return finish(node);
+    }
+
+    bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
+
+// ArrowExportFilter implementation
+bool ArrowExportFilter::parse(const std::string& spec, ArrowExportFilter& filter) {
+    ArrowExportFilter result;
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string text = item.substr(equals + 1);
+
+        if (key == "from" || key == "to") {
+            char* end = nullptr;
+            long long value = std::strtoll(text.c_str(), &end, 10);
+            if (text.empty() || *end != '\0') return false;
+            (key == "from" ? result.fromMs : result.toMs) = value;
+        } else if (key == "sensor" && !text.empty()) {
+            result.sensors.push_back(text);
+        } else {
+            return false;
+        }
+    }
+    if (result.fromMs >= result.toMs) {
+        return false;
+    }
+
+    filter = result;
+    return true;
+}
+
+bool ArrowExportFilter::includes(const std::string& sensor) const {
+    return sensors.empty() || std::find(sensors.begin(), sensors.end(), sensor) != sensors.end();
+}
+
+// ArrowWriter implementation
+ArrowWriter::ArrowWriter() : fd(-1), flushed(0), rowCount(0) {}
+
+ArrowWriter::~ArrowWriter() {
+    discard();
+}
+
+bool ArrowWriter::open(const std::string& file, const std::vector<std::string>& sensorIds) {
+    discard();
+    if (sensorIds.size() > 0x7FFF) {
+        std::cerr << "Cannot export more than 32767 sensors" << std::endl;
+        return false;
+    }
+    path = file;
+    fd = ::open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create " << path << ".tmp: " << strerror(errno) << std::endl;
+        return false;
+    }
+    sensors = sensorIds;
+    buffer.clear();
+    flushed = 0;
+    dictionaries.clear();
+    batches.clear();
+    rowCount = 0;
+
+    // File magic, padded to 8 bytes, then the schema message as in a stream
+    buffer.append(ARROW_MAGIC, sizeof(ARROW_MAGIC));
+    buffer.append(2, '\0');
+    std::vector<Block> unlisted;
+    appendMessage(message(HEADER_SCHEMA, schema(), 0), unlisted, 0);
+
+    // The sensor ids: one utf8 column of offsets and characters
+    std::vector<int32_t> offsets(1, 0);
+    std::string characters;
+    for (const std::string& id : sensors) {
+        characters += id;
+        offsets.push_back(static_cast<int32_t>(characters.size()));
+    }
+    size_t offsetBytes = offsets.size() * sizeof(int32_t);
+    std::vector<FieldNode> nodes(1, FieldNode{static_cast<int64_t>(sensors.size()), 0});
+    std::vector<BufferSpan> spans;
+    spans.push_back(BufferSpan{0, 0});
+    spans.push_back(BufferSpan{0, static_cast<int64_t>(offsetBytes)});
+    spans.push_back(BufferSpan{static_cast<int64_t>(padTo8(offsetBytes)), static_cast<int64_t>(characters.size())});
+    int64_t bodyLength = static_cast<int64_t>(padTo8(offsetBytes) + padTo8(characters.size()));
+
+    FlatRef dictionary = table();
+    dictionary->add(0, SENSOR_DICTIONARY)
+        .add(1, recordBatch(static_cast<int64_t>(sensors.size()), nodes, spans))
+        .add(2, static_cast<uint8_t>(0));
+    appendMessage(message(HEADER_DICTIONARY_BATCH, dictionary, bodyLength), dictionaries, bodyLength);
+    buffer.append(reinterpret_cast<const char*>(offsets.data()), offsetBytes);
+    buffer.append(padTo8(offsetBytes) - offsetBytes, '\0');
+    buffer += characters;
+    buffer.append(padTo8(characters.size()) - characters.size(), '\0');
+    return true;
+}
+
+void ArrowWriter::appendMessage(const std::string& metadata, std::vector<Block>& blocks, int64_t bodyLength) {
+    // Continuation marker and metadata length, then the metadata; the body follows
+    Block block;
+    block.offset = static_cast<int64_t>(bytes());
+    block.metaDataLength = static_cast<int32_t>(2 * sizeof(int32_t) + metadata.size());
+    block.padding = 0;
+    block.bodyLength = bodyLength;
+    blocks.push_back(block);
+    put(buffer, static_cast<int32_t>(-1));
+    put(buffer, static_cast<int32_t>(metadata.size()));
+    buffer += metadata;
+}
+
+void ArrowWriter::appendBatch(uint16_t sensor, const ReadingHistory::Chunk& chunk, size_t begin, size_t end) {
+    const size_t rows = end - begin;
+    const size_t sizes[] = {sizeof(int64_t), sizeof(int16_t), sizeof(float), sizeof(float), sizeof(uint8_t)};
+    std::vector<FieldNode> nodes;
+    std::vector<BufferSpan> spans;
+    int64_t bodyLength = 0;
+    for (size_t size : sizes) {
+        nodes.push_back(FieldNode{static_cast<int64_t>(rows), 0});
+        spans.push_back(BufferSpan{bodyLength, 0});                   // no validity bitmap: nothing is null
+        spans.push_back(BufferSpan{bodyLength, static_cast<int64_t>(rows * size)});
+        bodyLength += static_cast<int64_t>(padTo8(rows * size));
+    }
+    appendMessage(message(HEADER_RECORD_BATCH, recordBatch(static_cast<int64_t>(rows), nodes, spans), bodyLength),
+                  batches, bodyLength);
+
+    // The body is laid out in place: straight copies, a fill and two scaled columns
+    size_t at = buffer.size();
+    buffer.resize(at + static_cast<size_t>(bodyLength), '\0');
+    char* body = &buffer[at];
+    memcpy(body, chunk.timestamp_ms + begin, rows * sizeof(int64_t));
+    body += padTo8(rows * sizeof(int64_t));
+
+    int16_t index = static_cast<int16_t>(sensor);
+    int16_t* indices = reinterpret_cast<int16_t*>(body);
+    std::fill(indices, indices + rows, index);
+    body += padTo8(rows * sizeof(int16_t));
+
+    const uint16_t* columns[] = {chunk.pm25_raw + begin, chunk.pm10_raw + begin};
+    for (const uint16_t* raw : columns) {
+        float* values = reinterpret_cast<float*>(body);
+        for (size_t i = 0; i < rows; ++i) {
+            values[i] = raw[i] / 10.0f;
+        }
+        body += padTo8(rows * sizeof(float));
+    }
+    memcpy(body, chunk.flags + begin, rows);
+    rowCount += rows;
+}
+
+bool ArrowWriter::flush() {
+    if (!writeAll(fd, buffer.data(), buffer.size())) {
+        std::cerr << "Error writing " << path << ".tmp: " << strerror(errno) << std::endl;
+        return false;
+    }
+    flushed += buffer.size();
+    buffer.clear();
+    return true;
+}
+
+bool ArrowWriter::write(uint16_t sensor, const ReadingHistory& history, int64_t fromMs, int64_t toMs) {
+    if (fd < 0 || sensor >= sensors.size()) {
+        return false;
+    }
+    size_t first = history.lowerBound(fromMs);
+    size_t last = (toMs == INT64_MAX) ? history.size() : history.lowerBound(toMs);
+    bool ok = true;
+    history.forEachSlice(first, last > first ? last - first : 0,
+                         [&](const ReadingHistory::Chunk& chunk, size_t begin, size_t end) {
+        if (!ok) return;
+        appendBatch(sensor, chunk, begin, end);
+        if (buffer.size() >= FLUSH_BYTES) ok = flush();
+    });
+    return ok;
+}
+
+bool ArrowWriter::close() {
+    if (fd < 0) {
+        return false;
+    }
+
+    // End of stream, then the footer listing every message, its length and the magic again
+    put(buffer, static_cast<int32_t>(-1));
+    put(buffer, static_cast<int32_t>(0));
+    FlatRef footer = table();
+    footer->add(0, METADATA_V5).add(1, schema()).add(2, structs(dictionaries)).add(3, structs(batches));
+    std::string metadata = finish(footer);
+    buffer += metadata;
+    put(buffer, static_cast<int32_t>(metadata.size()));
+    buffer.append(ARROW_MAGIC, sizeof(ARROW_MAGIC));
+
+    bool ok = flush();
+    ok = (::close(fd) == 0) && ok;
+    fd = -1;
+    if (!ok || rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        std::cerr << "Error finishing " << path << ": " << strerror(errno) << std::endl;
+        unlink((path + ".tmp").c_str());
+        return false;
+    }
+    return true;
+}
+
+void ArrowWriter::discard() {
+    if (fd < 0) {
+        return;
+    }
+    ::close(fd);
+    fd = -1;
+    unlink((path + ".tmp").c_str());
+}
+
+bool ArrowWriter::exportHistories(const std::string& file,
+                                  const std::vector<std::pair<std::string, const ReadingHistory*>>& histories,
+                                  const ArrowExportFilter& filter, uint64_t* rows) {
+    std::vector<std::pair<std::string, const ReadingHistory*>> selected;
+    std::vector<std::string> ids;
+    for (const auto& entry : histories) {
+        if (filter.includes(entry.first)) {
+            selected.push_back(entry);
+            ids.push_back(entry.first);
+        }
+    }
+
+    ArrowWriter writer;
+    if (!writer.open(file, ids)) {
+        return false;
+    }
+    for (size_t i = 0; i < selected.size(); ++i) {
+        if (!writer.write(static_cast<uint16_t>(i), *selected[i].second, filter.fromMs, filter.toMs)) {
+            return false;
+        }
+    }
+    if (rows) {
+        *rows = writer.rows();
+    }
+    return writer.close();
+}
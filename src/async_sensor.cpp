@@ -0,0 +1,176 @@
+#include "async_sensor.h"
+
+#ifdef ENABLE_COROUTINES
+
+#include "sample_clock.h"
+#include "serial_port.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+Scheduler::WaitAwaiter::WaitAwaiter(Scheduler& owner, int fd, uint64_t deadlineNs) : scheduler(owner) {
+    wait.fd = fd;
+    wait.deadlineNs = deadlineNs;
+    wait.timedOut = false;
+}
+
+Scheduler::Scheduler(EventLoop& events) : loop(events) {
+    timerId = loop.addTimer([this]() { expireDeadlines(); });
+}
+
+Scheduler::~Scheduler() {
+    // Suspended frames are destroyed with their tasks; nothing may wake them after
+    for (const auto& input : inputs) {
+        loop.unwatch(input.first);
+    }
+    inputs.clear();
+    deadlines.clear();
+    loop.disarmTimer(timerId);
+    tasks.clear();
+}
+
+void Scheduler::spawn(Task<> task) {
+    ready.push_back(task.coroutine());
+    tasks.push_back(std::move(task));
+}
+
+void Scheduler::suspend(Wait& wait) {
+    if (wait.deadlineNs != 0) {
+        wait.timer = deadlines.insert(std::make_pair(wait.deadlineNs, &wait));
+    }
+    if (wait.fd >= 0) {
+        int fd = wait.fd;
+        inputs[fd] = &wait;
+        loop.watchReadable(fd, [this, fd]() {
+            auto it = inputs.find(fd);
+            if (it != inputs.end()) {
+                wake(*it->second, false);
+            }
+        });
+    }
+}
+
+void Scheduler::wake(Wait& wait, bool timedOut) {
+    if (wait.fd >= 0) {
+        loop.unwatch(wait.fd);
+        inputs.erase(wait.fd);
+    }
+    if (wait.deadlineNs != 0) {
+        deadlines.erase(wait.timer);
+    }
+    wait.timedOut = timedOut;
+    ready.push_back(wait.handle);
+}
+
+void Scheduler::expireDeadlines() {
+    uint64_t now = SampleClock::nowNs();
+    while (!deadlines.empty() && deadlines.begin()->first <= now) {
+        wake(*deadlines.begin()->second, true);
+    }
+}
+
+void Scheduler::resumeReady() {
+    // Resumed coroutines may make others ready; those run in the same round
+    while (!ready.empty()) {
+        std::vector<std::coroutine_handle<>> batch;
+        batch.swap(ready);
+        for (std::coroutine_handle<> handle : batch) {
+            handle.resume();
+        }
+    }
+}
+
+void Scheduler::run() {
+    while (true) {
+        resumeReady();
+        for (auto it = tasks.begin(); it != tasks.end();) {
+            if (!it->done()) {
+                ++it;
+                continue;
+            }
+            Task<> finished = std::move(*it);
+            it = tasks.erase(it);
+            finished.await_resume();
+        }
+        if (tasks.empty()) {
+            return;
+        }
+
+        if (deadlines.empty()) {
+            loop.disarmTimer(timerId);
+        } else {
+            loop.armTimer(timerId, deadlines.begin()->first);
+        }
+        loop.runOnce();
+    }
+}
+
+Scheduler::WaitAwaiter Scheduler::sleepUntil(uint64_t deadlineNs) {
+    // A deadline already past still yields to the other coroutines
+    return WaitAwaiter(*this, -1, deadlineNs ? deadlineNs : 1);
+}
+
+Scheduler::WaitAwaiter Scheduler::sleepFor(std::chrono::nanoseconds duration) {
+    return sleepUntil(SampleClock::nowNs() + static_cast<uint64_t>(std::max<int64_t>(duration.count(), 0)));
+}
+
+Scheduler::WaitAwaiter Scheduler::readable(int fd, uint64_t deadlineNs) {
+    return WaitAwaiter(*this, fd, deadlineNs);
+}
+
+AsyncSensor::AsyncSensor(Scheduler& owner) : scheduler(owner), fd(-1), ownsFd(false) {}
+
+AsyncSensor::~AsyncSensor() {
+    close();
+}
+
+bool AsyncSensor::open(const std::string& port) {
+    close();
+    int descriptor = ::open(port.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (descriptor < 0) {
+        return false;
+    }
+    if (!SerialPort::configure(descriptor, SerialIOProfile::Poll)) {
+        ::close(descriptor);
+        return false;
+    }
+    fd = descriptor;
+    ownsFd = true;
+    stream.bind(fd, port, SerialIOProfile::Poll);
+    return true;
+}
+
+void AsyncSensor::attach(int descriptor, const std::string& sensorId) {
+    close();
+    fd = descriptor;
+    ownsFd = false;
+    stream.bind(fd, sensorId, SerialIOProfile::Poll);
+}
+
+void AsyncSensor::close() {
+    stream.unbind();
+    if (fd >= 0 && ownsFd) {
+        ::close(fd);
+    }
+    fd = -1;
+    ownsFd = false;
+}
+
+Task<std::optional<SDS011Frame>> AsyncSensor::nextFrame(std::chrono::nanoseconds timeout) {
+    uint64_t deadline = SampleClock::nowNs() + static_cast<uint64_t>(std::max<int64_t>(timeout.count(), 0));
+    SDS011Frame frame;
+    while (fd >= 0) {
+        if (stream.readAvailable(frame)) {
+            co_return frame;
+        }
+        if (stream.isLinkLost() || stream.atEndOfStream()) {
+            break;
+        }
+        if (!co_await scheduler.readable(fd, deadline)) {
+            break;
+        }
+    }
+    co_return std::nullopt;
+}
+
+#endif
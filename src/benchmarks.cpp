@@ -0,0 +1,1099 @@
+#include "benchmarks.h"
+#include "aggregate_kernels.h"
+#include "sds011_plugin.h"
+#include "reading_history.h"
+#include "trend_buckets.h"
+#include "outlier_filter.h"
+#include "humidity_correction.h"
+#include "io_backend.h"
+#include "reading_bus.h"
+#include "alert_engine.h"
+#include "segment_store.h"
+#include "store_compactor.h"
+#include "write_ahead_log.h"
+#include "arrow_export.h"
+#include "metrics.h"
+#include "sds011_protocol.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Best of several runs, in nanoseconds per element
+    template <typename Fn>
+    double bestNsPerElement(size_t elements, int repeats, Fn fn) {
+        double best = 0.0;
+        for (int r = 0; r < repeats; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (r == 0 || ns < best) best = ns;
+        }
+        return best / elements;
+    }
+
+    // Keeps results alive so the compiler cannot drop the work
+    volatile double benchmarkSink;
+
+    void printRow(std::ostream& out, const std::string& name, double nsPerElement, double baseline) {
+        out << "  " << std::left << std::setw(28) << name << std::right
+            << std::setw(10) << std::fixed << std::setprecision(3) << nsPerElement << " ns"
+            << std::setw(10) << std::setprecision(1) << baseline / nsPerElement << "x" << std::endl;
+    }
+
+    // Delete a store directory: the catalog and one directory of segments per sensor
+    void removeStoreDirectory(const std::string& directory) {
+        if (DIR* dir = opendir(directory.c_str())) {
+            while (struct dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name == "." || name == "..") continue;
+                std::string child = directory + "/" + name;
+                if (DIR* sub = opendir(child.c_str())) {
+                    while (struct dirent* file = readdir(sub)) {
+                        std::string fileName = file->d_name;
+                        if (fileName != "." && fileName != "..") unlink((child + "/" + fileName).c_str());
+                    }
+                    closedir(sub);
+                    rmdir(child.c_str());
+                } else {
+                    unlink(child.c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(directory.c_str());
+    }
+
+    void benchKernels(std::ostream& out) {
+        const size_t N = 1 << 20;
+        const int REPEATS = 15;
+
+        // A day and a half of 1 Hz readings with a slow drift and noise
+        std::vector<uint16_t> raw(N);
+        std::vector<float> values(N);
+        uint32_t seed = 1;
+        for (size_t i = 0; i < N; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            raw[i] = static_cast<uint16_t>(80 + (i / 600) % 400 + (seed >> 24));
+            values[i] = raw[i] / 10.0f;
+        }
+
+        // What updateStatsWindow iterates over: one heap object per reading
+        std::deque<std::unique_ptr<SensorData>> objects;
+        for (size_t i = 0; i < N; ++i) {
+            objects.push_back(std::unique_ptr<SensorData>(new SDS011Data(values[i], values[i])));
+        }
+
+        out << "Aggregation kernels: min/max/sum over " << N << " samples (active: "
+            << AggregateKernels::isaName(AggregateKernels::activeIsa()) << ")" << std::endl;
+        out << "  " << std::left << std::setw(28) << "implementation" << std::right
+            << std::setw(13) << "per sample" << std::setw(11) << "speedup" << std::endl;
+
+        double baseline = bestNsPerElement(N, REPEATS, [&]() {
+            const SDS011Data* first = dynamic_cast<const SDS011Data*>(objects[0].get());
+            float sum = 0, lo = first->pm25, hi = first->pm25;
+            for (const auto& reading : objects) {
+                const SDS011Data* data = dynamic_cast<const SDS011Data*>(reading.get());
+                if (data) {
+                    sum += data->pm25;
+                    lo = std::min(lo, data->pm25);
+                    hi = std::max(hi, data->pm25);
+                }
+            }
+            benchmarkSink = sum + lo + hi;
+        });
+        printRow(out, "deque<SensorData> loop", baseline, baseline);
+
+        const KernelIsa ISAS[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2};
+        for (KernelIsa isa : ISAS) {
+            if (!AggregateKernels::isSupported(isa)) continue;
+            double ns = bestNsPerElement(N, REPEATS, [&]() {
+                benchmarkSink = AggregateKernels::summarizeFloatWith(isa, values.data(), N).sum;
+            });
+            printRow(out, std::string("float column, ") + AggregateKernels::isaName(isa), ns, baseline);
+        }
+        for (KernelIsa isa : ISAS) {
+            if (!AggregateKernels::isSupported(isa)) continue;
+            double ns = bestNsPerElement(N, REPEATS, [&]() {
+                benchmarkSink = AggregateKernels::summarizeU16With(isa, raw.data(), N).sum;
+            });
+            printRow(out, std::string("uint16 column, ") + AggregateKernels::isaName(isa), ns, baseline);
+        }
+    }
+
+    void benchHistory(std::ostream& out) {
+        const size_t N = 1 << 20;
+        const int REPEATS = 5;
+        const int64_t START_MS = 1700000000000LL;
+
+        out << "Reading history: " << N << " readings, object deque vs columnar chunks" << std::endl;
+        out << "  " << std::left << std::setw(28) << "operation" << std::right
+            << std::setw(13) << "per reading" << std::setw(11) << "speedup" << std::endl;
+
+        // Append: the deque pays one heap allocation per reading
+        std::deque<std::unique_ptr<SensorData>> objects;
+        double objectAppend = bestNsPerElement(N, REPEATS, [&]() {
+            objects.clear();
+            for (size_t i = 0; i < N; ++i) {
+                objects.push_back(std::unique_ptr<SensorData>(new SDS011Data(i % 500 / 10.0f, i % 700 / 10.0f)));
+            }
+        });
+        printRow(out, "append, deque<SensorData>", objectAppend, objectAppend);
+
+        // Steady state of a long run: the history is full and recycles its oldest chunk
+        ReadingHistory ring(N / 4);
+        int64_t nextMs = START_MS;
+        double columnAppend = bestNsPerElement(N, REPEATS, [&]() {
+            int64_t timestampMs = nextMs;
+            for (size_t i = 0; i < N; ++i, timestampMs += 1000) {
+                ring.append(timestampMs, static_cast<uint16_t>(i % 500), static_cast<uint16_t>(i % 700));
+            }
+            nextMs = timestampMs;
+        });
+        printRow(out, "append, ReadingHistory", columnAppend, objectAppend);
+
+        ReadingHistory history(N);
+        for (size_t i = 0; i < N; ++i) {
+            history.append(START_MS + static_cast<int64_t>(i) * 1000,
+                           static_cast<uint16_t>(i % 500), static_cast<uint16_t>(i % 700));
+        }
+
+        // Summary of one column over everything
+        double objectScan = bestNsPerElement(N, REPEATS, [&]() {
+            double sum = 0.0;
+            for (const auto& reading : objects) {
+                const SDS011Data* data = dynamic_cast<const SDS011Data*>(reading.get());
+                if (data) sum += data->pm25;
+            }
+            benchmarkSink = sum;
+        });
+        printRow(out, "summary, deque<SensorData>", objectScan, objectScan);
+
+        double columnScan = bestNsPerElement(N, REPEATS, [&]() {
+            benchmarkSink = history.summarize(HistoryColumn::PM25, 0, history.size()).sum;
+        });
+        printRow(out, "summary, ReadingHistory", columnScan, objectScan);
+
+        // Finding the start of "the last hour": linear scan vs binary search, per lookup
+        const int LINEAR_LOOKUPS = 20;
+        const int LOOKUPS = 100000;
+        double linearSeek = bestNsPerElement(LINEAR_LOOKUPS, REPEATS, [&]() {
+            size_t total = 0;
+            for (int q = 0; q < LINEAR_LOOKUPS; ++q) {
+                int64_t cutoff = START_MS + static_cast<int64_t>((q * 52433ULL) % N) * 1000;
+                size_t i = 0;
+                while (i < N && history.at(i).timestamp_ms < cutoff) ++i;
+                total += i;
+            }
+            benchmarkSink = static_cast<double>(total);
+        });
+        printRow(out, "seek, linear scan", linearSeek, linearSeek);
+
+        double binarySeek = bestNsPerElement(LOOKUPS, REPEATS, [&]() {
+            size_t total = 0;
+            for (int q = 0; q < LOOKUPS; ++q) {
+                total += history.lowerBound(START_MS + static_cast<int64_t>((q * 52433ULL) % N) * 1000);
+            }
+            benchmarkSink = static_cast<double>(total);
+        });
+        printRow(out, "seek, lowerBound", binarySeek, linearSeek);
+
+        out << "  " << sizeof(ReadingHistory::Chunk) / static_cast<double>(ReadingHistory::CHUNK_ROWS)
+            << " bytes per reading in the columns" << std::endl;
+
+        // Warm restart: parse and replay a text log, or re-attach a ring file
+        std::string log;
+        char line[64];
+        for (size_t i = 0; i < N; ++i) {
+            int length = snprintf(line, sizeof(line), "%lld,%.1f,%.1f\n",
+                                  static_cast<long long>(START_MS + static_cast<int64_t>(i) * 1000),
+                                  (i % 500) / 10.0, (i % 700) / 10.0);
+            log.append(line, static_cast<size_t>(length));
+        }
+        auto start = std::chrono::steady_clock::now();
+        ReadingHistory replayed(N);
+        for (const char* cursor = log.c_str(); *cursor;) {
+            char* end = nullptr;
+            long long timestampMs = std::strtoll(cursor, &end, 10);
+            float pm25 = std::strtof(end + 1, &end);
+            float pm10 = std::strtof(end + 1, &end);
+            replayed.append(timestampMs, pm25, pm10);
+            cursor = end + 1;
+        }
+        double replayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        char ringTemplate[] = "/tmp/sensor_reader_bench_ring.XXXXXX";
+        int ringFd = mkstemp(ringTemplate);
+        if (ringFd < 0) {
+            out << "  cannot create a file in /tmp" << std::endl;
+            return;
+        }
+        close(ringFd);
+        if (!history.attach(ringTemplate, "bench")) {
+            unlink(ringTemplate);
+            return;
+        }
+        history.detach();   // the process that wrote the ring is gone when it restarts
+        start = std::chrono::steady_clock::now();
+        ReadingHistory attached(N);
+        attached.attach(ringTemplate, "bench");
+        double attachMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        benchmarkSink = static_cast<double>(attached.size() + replayed.size());
+        out << "  restart with " << attached.size() << " readings: replay of a text log " << std::fixed
+            << std::setprecision(1) << replayMs << " ms, re-attach of a ring file " << std::setprecision(3)
+            << attachMs << " ms" << std::endl;
+        unlink(ringTemplate);
+    }
+
+    void benchChart(std::ostream& out) {
+        const int64_t START_MS = 1700000000000LL;
+        const int64_t DAY_MS = 24 * 3600 * 1000LL;
+        const size_t COLUMNS = 160;
+        const int REPEATS = 20;
+
+        ReadingHistory history(24 * 3600);
+        TrendBuckets trend;
+        for (int64_t t = 0; t < DAY_MS; t += 1000) {
+            float pm25 = static_cast<float>(10 + (t / 60000) % 40);
+            history.append(START_MS + t, pm25, pm25 * 1.5f);
+            trend.add(START_MS + t, pm25, pm25 * 1.5f);
+        }
+        int64_t endMs = START_MS + DAY_MS - 1;
+
+        out << "Chart redraw: one PM2.5 series over " << COLUMNS << " columns, "
+            << history.size() << " readings of 1 Hz data" << std::endl;
+        out << "  " << std::left << std::setw(28) << "span / source" << std::right
+            << std::setw(13) << "per redraw" << std::setw(11) << "speedup" << std::endl;
+
+        const int64_t spans[] = {3600 * 1000LL, DAY_MS};
+        const char* labels[] = {"1h", "24h"};
+        for (int s = 0; s < 2; ++s) {
+            int64_t spanMs = spans[s];
+            std::vector<TrendPoint> points;
+
+            // Without buckets: walk every reading in the span
+            double scan = bestNsPerElement(1, REPEATS, [&]() {
+                points.assign(COLUMNS, TrendPoint());
+                int64_t startMs = endMs - spanMs;
+                for (size_t i = history.lowerBound(startMs); i < history.size(); ++i) {
+                    HistoryRow row = history.at(i);
+                    size_t column = std::min<size_t>(COLUMNS - 1, (row.timestamp_ms - startMs) * COLUMNS / spanMs);
+                    points[column].mean += row.pm25();
+                    points[column].count++;
+                }
+                benchmarkSink = points[0].mean;
+            });
+            printRow(out, std::string(labels[s]) + ", scan of history", scan, scan);
+
+            double bucketed = bestNsPerElement(1, REPEATS, [&]() {
+                trend.series(HistoryColumn::PM25, endMs, spanMs, COLUMNS, points);
+                benchmarkSink = points[0].mean;
+            });
+            printRow(out, std::string(labels[s]) + ", trend buckets", bucketed, scan);
+        }
+    }
+
+    void benchFilter(std::ostream& out) {
+        const size_t N = 1 << 18;
+        const int REPEATS = 5;
+        const int64_t START_MS = 1700000000000LL;
+
+        // Noisy 1 Hz readings with a 999.9 spike every ~500 samples
+        std::vector<float> pm25(N), pm10(N);
+        uint32_t seed = 7;
+        for (size_t i = 0; i < N; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            pm25[i] = 8.0f + (i / 900) % 30 + (seed >> 24) / 64.0f;
+            pm10[i] = pm25[i] * 1.4f;
+            if (seed % 500 == 0) pm25[i] = 999.9f;
+        }
+
+        out << "Outlier filter: per reading, PM2.5 and PM10, " << N << " readings" << std::endl;
+        out << "  " << std::left << std::setw(28) << "configuration" << std::right
+            << std::setw(13) << "per reading" << std::setw(11) << "flagged" << std::endl;
+
+        const char* specs[] = {"ceiling=999.9,window=0", "window=7", "window=15", "window=15,rate=50", "window=31",
+                               "window=63"};
+        for (const char* spec : specs) {
+            FilterConfig config;
+            FilterConfig::parse(spec, config);
+            FilterPipeline pipeline(config);
+            size_t flagged = 0;
+            double ns = bestNsPerElement(N, REPEATS, [&]() {
+                pipeline.reset();
+                flagged = 0;
+                for (size_t i = 0; i < N; ++i) {
+                    flagged += pipeline.process(START_MS + static_cast<int64_t>(i) * 1000, pm25[i], pm10[i]) ? 1 : 0;
+                }
+            });
+            out << "  " << std::left << std::setw(28) << spec << std::right
+                << std::setw(10) << std::fixed << std::setprecision(1) << ns << " ns"
+                << std::setw(11) << flagged << std::endl;
+        }
+    }
+
+    void benchHumidity(std::ostream& out) {
+        const int REPEATS = 5;
+        const int64_t START_MS = 1700000000000LL;
+        const int64_t RH_PERIOD_MS = 60 * 1000;     // one humidity sample a minute
+
+        out << "Humidity join: 1 Hz readings against a minute-resolution RH stream" << std::endl;
+        out << "  " << std::left << std::setw(28) << "stream length" << std::right
+            << std::setw(13) << "per reading" << std::endl;
+
+        // The streaming join keeps the same cost however long the stream runs
+        const struct {
+            const char* name;
+            size_t seconds;
+        } lengths[] = {{"1 hour", 3600}, {"24 hours", 24 * 3600}, {"7 days", 7 * 24 * 3600}};
+        double streamingNs = 0.0;
+        for (const auto& length : lengths) {
+            HumidityCorrector corrector;
+            corrector.configure("", HumidityModel());
+            double ns = bestNsPerElement(length.seconds, REPEATS, [&]() {
+                double sum = 0.0;
+                for (size_t i = 0; i < length.seconds; ++i) {
+                    int64_t t = START_MS + static_cast<int64_t>(i) * 1000;
+                    if (t % RH_PERIOD_MS == 0) {
+                        corrector.addHumidity(t, 60.0f + static_cast<float>((i / 60) % 35));
+                    }
+                    sum += corrector.apply(t, 12.0f, 18.0f).pm25;
+                }
+                benchmarkSink = sum;
+            });
+            streamingNs = ns;
+            out << "  " << std::left << std::setw(28) << length.name << std::right
+                << std::setw(10) << std::fixed << std::setprecision(1) << ns << " ns" << std::endl;
+        }
+
+        // For comparison: searching the whole humidity log for every reading
+        const size_t LOG_SAMPLES = 7 * 24 * 60;
+        const size_t LINEAR_LOOKUPS = 2000;
+        std::vector<int64_t> log(LOG_SAMPLES);
+        for (size_t i = 0; i < LOG_SAMPLES; ++i) {
+            log[i] = START_MS + static_cast<int64_t>(i) * RH_PERIOD_MS;
+        }
+        double ns = bestNsPerElement(LINEAR_LOOKUPS, REPEATS, [&]() {
+            size_t total = 0;
+            for (size_t q = 0; q < LINEAR_LOOKUPS; ++q) {
+                int64_t t = log[LOG_SAMPLES - 1] - static_cast<int64_t>(q) * 1000;
+                size_t match = 0;
+                for (size_t i = 0; i < LOG_SAMPLES && log[i] <= t; ++i) match = i;
+                total += match;
+            }
+            benchmarkSink = static_cast<double>(total);
+        });
+        out << "  " << std::left << std::setw(28) << "scan of 7-day RH log" << std::right
+            << std::setw(10) << std::fixed << std::setprecision(1) << ns << " ns"
+            << "  (" << std::setprecision(0) << ns / streamingNs << "x)" << std::endl;
+    }
+
+    // A valid SDS011 measurement frame, as a sensor would send it
+    std::vector<unsigned char> makeFrame(uint16_t pm25Raw, uint16_t pm10Raw) {
+        std::vector<unsigned char> frame = {
+            0xAA, 0xC0,
+            static_cast<unsigned char>(pm25Raw & 0xFF), static_cast<unsigned char>(pm25Raw >> 8),
+            static_cast<unsigned char>(pm10Raw & 0xFF), static_cast<unsigned char>(pm10Raw >> 8),
+            0x12, 0x34, 0x00, 0xAB
+        };
+        unsigned char checksum = 0;
+        for (int i = 2; i < 8; ++i) checksum += frame[i];
+        frame[8] = checksum;
+        return frame;
+    }
+
+    // CPU time of the whole process, including io_uring's kernel workers
+    double processCpuMs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+    }
+
+    void benchIo(std::ostream& out) {
+        const int SENSORS = 1000;
+        const int ROUNDS = 100;     // one round is one second of 1 Hz sensors
+
+        // Each sensor needs a pipe, so both ends count against the descriptor limit
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < 2 * SENSORS + 64) {
+            limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, 2 * SENSORS + 64);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        out << "I/O backends: " << SENSORS << " sensors at 1 Hz for " << ROUNDS
+            << " s, CSV line per frame, one fdatasync per second" << std::endl;
+        out << "  " << std::left << std::setw(28) << "backend" << std::right
+            << std::setw(13) << "syscalls/s" << std::setw(13) << "per frame" << std::setw(13) << "CPU ms/s" << std::endl;
+
+        const IoBackendKind KINDS[] = {IoBackendKind::Readiness, IoBackendKind::IoUring};
+        for (IoBackendKind kind : KINDS) {
+            std::unique_ptr<IoBackend> backend = IoBackend::create(kind);
+            if (kind == IoBackendKind::IoUring && std::string(backend->name()) != "io_uring") {
+                out << "  " << std::left << std::setw(28) << "io_uring" << "unavailable on this kernel" << std::endl;
+                continue;
+            }
+
+            char logPath[] = "/tmp/sensor_reader_bench_io.XXXXXX";
+            int logFd = mkstemp(logPath);
+            if (logFd < 0) {
+                out << "  cannot create a log file in /tmp" << std::endl;
+                return;
+            }
+            fcntl(logFd, F_SETFL, O_APPEND);
+            unlink(logPath);
+
+            std::vector<int> writeEnds;
+            std::vector<int> readEnds;
+            std::vector<SDS011FrameParser> parsers(SENSORS);
+            uint64_t frames = 0;
+            for (int i = 0; i < SENSORS; ++i) {
+                int ends[2];
+                if (pipe(ends) != 0) {
+                    out << "  not enough descriptors for " << SENSORS << " sensors" << std::endl;
+                    break;
+                }
+                fcntl(ends[0], F_SETFL, O_NONBLOCK);
+                readEnds.push_back(ends[0]);
+                writeEnds.push_back(ends[1]);
+                IoBackend* io = backend.get();
+                backend->addReader(ends[0], [&, i, io, logFd](const unsigned char* data, ssize_t length) {
+                    for (ssize_t b = 0; b < length; ++b) {
+                        if (parsers[i].push(data[b]) == SDS011FrameParser::FrameReady) {
+                            char line[64];
+                            int n = snprintf(line, sizeof(line), "%d,%.1f,%.1f\n", i, parsers[i].frame().pm25(),
+                                             parsers[i].frame().pm10());
+                            io->queueWrite(logFd, line, static_cast<size_t>(n), true);
+                            frames++;
+                        }
+                    }
+                });
+            }
+
+            // Only the backend's side is measured, not the simulated sensors' writes
+            uint64_t syscalls = backend->stats().syscalls;
+            double cpuMs = 0.0;
+            for (int round = 0; round < ROUNDS && writeEnds.size() == static_cast<size_t>(SENSORS); ++round) {
+                std::vector<unsigned char> frame = makeFrame(static_cast<uint16_t>(100 + round), 200);
+                for (int fd : writeEnds) {
+                    ssize_t ignored = write(fd, frame.data(), frame.size());
+                    (void)ignored;
+                }
+                double start = processCpuMs();
+                uint64_t target = static_cast<uint64_t>(round + 1) * SENSORS;
+                while (frames < target) {
+                    backend->runOnce(-1);
+                }
+                backend->drainWrites();
+                cpuMs += processCpuMs() - start;
+            }
+            syscalls = backend->stats().syscalls - syscalls;
+
+            out << "  " << std::left << std::setw(28) << backend->name() << std::right << std::fixed
+                << std::setw(13) << std::setprecision(0) << static_cast<double>(syscalls) / ROUNDS
+                << std::setw(13) << std::setprecision(2) << static_cast<double>(syscalls) / std::max<uint64_t>(frames, 1)
+                << std::setw(13) << std::setprecision(1) << cpuMs / ROUNDS << std::endl;
+
+            backend.reset();
+            for (size_t i = 0; i < readEnds.size(); ++i) {
+                close(readEnds[i]);
+                close(writeEnds[i]);
+            }
+            close(logFd);
+        }
+    }
+
+    void benchBus(std::ostream& out) {
+        const uint64_t N = 1 << 20;
+
+        out << "Reading bus: " << N << " readings from one producer, capacity " << ReadingBus::DEFAULT_CAPACITY
+            << std::endl;
+
+        // A storage-like consumer that keeps up, one that pauses now and then, and a display
+        struct Consumer {
+            const char* role;
+            BusPolicy policy;
+            int pauseEvery;         // readings between 1 ms pauses, 0 for none
+            std::unique_ptr<BusConsumer> cursor;
+        };
+        Consumer consumers[] = {
+            {"storage", BusPolicy::Block, 0, nullptr},
+            {"exporter (stalls)", BusPolicy::DropOldest, 50000, nullptr},
+            {"display", BusPolicy::Sample, 1, nullptr},
+        };
+
+        for (int attached = 0; attached <= 1; ++attached) {
+            ReadingBus bus;
+            std::atomic<bool> done(false);
+            std::vector<std::thread> threads;
+            if (attached) {
+                for (Consumer& consumer : consumers) {
+                    consumer.cursor = bus.subscribe(consumer.policy);
+                    BusConsumer* cursor = consumer.cursor.get();
+                    int pauseEvery = consumer.pauseEvery;
+                    threads.emplace_back([cursor, pauseEvery, &done]() {
+                        BusReading reading;
+                        uint64_t seen = 0;
+                        while (true) {
+                            bool finished = done.load(std::memory_order_acquire);
+                            if (!cursor->poll(reading)) {
+                                if (finished) return;
+                                std::this_thread::yield();
+                                continue;
+                            }
+                            if (pauseEvery && ++seen % pauseEvery == 0) {
+                                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                            }
+                        }
+                    });
+                }
+            }
+
+            BusReading reading;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < N; ++i) {
+                reading.timestamp_ms = static_cast<int64_t>(i);
+                reading.pm25 = static_cast<float>(i % 500);
+                bus.publish(reading);
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            done.store(true, std::memory_order_release);
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+
+            out << "  " << (attached ? "3 consumers" : "no consumers") << ": " << std::fixed << std::setprecision(1)
+                << ns / N << " ns per publish, " << bus.stalls() << " stalls" << std::endl;
+            if (!attached) {
+                continue;
+            }
+
+            out << "  " << std::left << std::setw(20) << "consumer" << std::setw(13) << "policy" << std::right
+                << std::setw(11) << "delivered" << std::setw(10) << "dropped" << std::setw(10) << "skipped"
+                << std::setw(9) << "max lag" << std::endl;
+            for (Consumer& consumer : consumers) {
+                BusConsumerStats stats = consumer.cursor->stats();
+                out << "  " << std::left << std::setw(20) << consumer.role << std::setw(13)
+                    << ReadingBus::policyName(consumer.policy) << std::right << std::setw(11) << stats.delivered
+                    << std::setw(10) << stats.dropped << std::setw(10) << stats.skipped << std::setw(9)
+                    << stats.maxLag << std::endl;
+                consumer.cursor.reset();
+            }
+        }
+    }
+
+    void benchAlerts(std::ostream& out) {
+        const int SENSORS = 200;
+        const int SECONDS = 600;
+        const int64_t START_MS = 1700000000000LL;
+
+        // Fleet-wide rules over windows up to an hour, plus one rule per sensor
+        std::vector<AlertRule> rules;
+        const char* fleet[] = {
+            "name=pm25_now,above=55", "name=pm25_5m,above=35,window=300,for=600,clear=25",
+            "name=pm25_15m,above=35,window=900", "name=pm25_1h,above=25,window=3600,clear=20",
+            "name=pm10_1h,above=50,window=3600,metric=pm10", "name=spike,rise=30,window=60",
+            "name=drop,below=1,window=300,for=900",
+        };
+        for (const char* spec : fleet) {
+            AlertRule rule;
+            AlertRule::parse(spec, rule);
+            rules.push_back(rule);
+        }
+        std::vector<std::string> names;
+        for (int s = 0; s < SENSORS; ++s) {
+            names.push_back("sensor" + std::to_string(s));
+            AlertRule rule;
+            AlertRule::parse("name=local" + std::to_string(s) + ",above=45,window=600,sensor=" + names.back(), rule);
+            rules.push_back(rule);
+        }
+
+        // One hour of history first, so every window is full
+        std::vector<float> pm25(SENSORS * (3600 + SECONDS));
+        uint32_t seed = 11;
+        for (float& value : pm25) {
+            seed = seed * 1664525 + 1013904223;
+            value = 20.0f + (seed >> 24) / 8.0f;
+        }
+
+        out << "Alert rules: " << rules.size() << " rules, " << SENSORS << " sensors at 1 Hz, windows up to 1 h"
+            << std::endl;
+        out << "  " << std::left << std::setw(28) << "evaluation" << std::right << std::setw(13) << "per reading"
+            << std::setw(9) << "events" << std::endl;
+
+        AlertEngine engine;
+        engine.setRules(rules);
+        std::vector<AlertEvent> events;
+        size_t index = 0;
+        for (int t = 0; t < 3600; ++t) {
+            for (int s = 0; s < SENSORS; ++s, ++index) {
+                engine.process(names[s], START_MS + t * 1000LL, pm25[index], pm25[index] * 1.5f, events);
+            }
+        }
+        size_t warmup = events.size();
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 3600; t < 3600 + SECONDS; ++t) {
+            for (int s = 0; s < SENSORS; ++s, ++index) {
+                engine.process(names[s], START_MS + t * 1000LL, pm25[index], pm25[index] * 1.5f, events);
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        out << "  " << std::left << std::setw(28) << "incremental" << std::right << std::setw(10) << std::fixed
+            << std::setprecision(1) << ns / (SENSORS * SECONDS) << " ns" << std::setw(9) << events.size() - warmup
+            << std::endl;
+
+        // The same windows recomputed from each sensor's reading deque, as the stats code does
+        std::vector<std::deque<std::pair<int64_t, float>>> recent(SENSORS);
+        index = 0;
+        for (int t = 0; t < 3600; ++t) {
+            for (int s = 0; s < SENSORS; ++s, ++index) {
+                recent[s].push_back(std::make_pair(START_MS + t * 1000LL, pm25[index]));
+            }
+        }
+        double checksum = 0.0;
+        const int RESCAN_SECONDS = 20;
+        start = std::chrono::steady_clock::now();
+        for (int t = 3600; t < 3600 + RESCAN_SECONDS; ++t) {
+            for (int s = 0; s < SENSORS; ++s, ++index) {
+                int64_t now = START_MS + t * 1000LL;
+                recent[s].push_back(std::make_pair(now, pm25[index]));
+                recent[s].pop_front();
+                for (const AlertRule& rule : rules) {
+                    if (rule.sensor != "*" && rule.sensor != names[s]) continue;
+                    double sum = 0.0;
+                    size_t count = 0;
+                    for (auto it = recent[s].rbegin(); it != recent[s].rend() && it->first >= now - rule.windowMs; ++it) {
+                        sum += it->second;
+                        count++;
+                    }
+                    checksum += count ? sum / count : 0.0;
+                }
+            }
+        }
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        out << "  " << std::left << std::setw(28) << "rescan of the window" << std::right << std::setw(10)
+            << std::fixed << std::setprecision(1) << ns / (SENSORS * RESCAN_SECONDS) << " ns" << std::setw(9)
+            << "-" << std::endl;
+        benchmarkSink = checksum;
+    }
+
+    void benchSegments(std::ostream& out) {
+        const int64_t YEAR_S = 365LL * 24 * 3600;
+        const int64_t START_MS = 1700000000000LL;
+        const int QUERIES = 200;
+        const int SCANS = 3;
+        const std::string SENSOR = "/dev/ttyUSB0";
+
+        char dirTemplate[] = "/tmp/sensor_reader_bench_store.XXXXXX";
+        if (!mkdtemp(dirTemplate)) {
+            out << "  cannot create a directory in /tmp" << std::endl;
+            return;
+        }
+        std::string directory = dirTemplate;
+
+        // Sensors have separate segments, so a fleet of 100 multiplies the disk used, not a query's cost
+        out << "Segment store: a year of 1 Hz readings from one sensor (" << YEAR_S / 1000000.0
+            << " M rows, 24 B each), one-hour range queries, page cache warm" << std::endl;
+        SegmentStore store;
+        if (!store.open(directory)) {
+            out << "  cannot open a store in " << directory << std::endl;
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        uint32_t seed = 3;
+        for (int64_t t = 0; t < YEAR_S; ++t) {
+            seed = seed * 1664525 + 1013904223;
+            uint16_t pm = static_cast<uint16_t>(50 + (seed >> 25));
+            HistoryRow row;
+            row.timestamp_ms = START_MS + t * 1000;
+            row.pm25_raw = row.pm25_corrected_raw = pm;
+            row.pm10_raw = row.pm10_corrected_raw = static_cast<uint16_t>(pm + 40);
+            row.humidity = HistoryRow::HUMIDITY_UNKNOWN;
+            row.flags = 0;
+            store.append(SENSOR, row);
+        }
+        store.flush();
+        double appendNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::vector<SegmentInfo> segments = store.segments(SENSOR);
+        out << "  append: " << std::fixed << std::setprecision(1) << appendNs / YEAR_S << " ns per reading, "
+            << segments.size() << " segments" << std::endl;
+
+        out << "  " << std::left << std::setw(28) << "range query" << std::right << std::setw(13) << "per query"
+            << std::setw(13) << "read" << std::setw(9) << "rows" << std::endl;
+
+        std::vector<HistoryRow> rows;
+        SegmentQueryStats stats;
+        size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < QUERIES; ++q) {
+            seed = seed * 1664525 + 1013904223;
+            int64_t from = START_MS + static_cast<int64_t>(seed % (YEAR_S - 3600)) * 1000;
+            rows.clear();
+            found += store.query(SENSOR, from, from + 3600 * 1000, rows, &stats);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        out << "  " << std::left << std::setw(28) << "catalog + block index" << std::right << std::setw(10)
+            << std::setprecision(1) << ns / QUERIES / 1000.0 << " us" << std::setw(10)
+            << stats.bytes / QUERIES / 1024.0 << " KB" << std::setw(9) << found / QUERIES << std::endl;
+
+        // What a log without an index has to do: read from its start up to the range
+        std::vector<SegmentRecord> buffer(65536);
+        uint64_t scanned = 0;
+        found = 0;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < SCANS; ++q) {
+            seed = seed * 1664525 + 1013904223;
+            int64_t from = START_MS + static_cast<int64_t>(seed % (YEAR_S - 3600)) * 1000;
+            int64_t to = from + 3600 * 1000;
+            bool done = false;
+            for (size_t s = 0; s < segments.size() && !done; ++s) {
+                int fd = open((directory + "/" + segments[s].path).c_str(), O_RDONLY | O_CLOEXEC);
+                uint64_t remaining = segments[s].records;
+                if (fd < 0 || lseek(fd, 64, SEEK_SET) < 0) break;
+                while (remaining > 0 && !done) {
+                    size_t count = static_cast<size_t>(std::min<uint64_t>(buffer.size(), remaining));
+                    ssize_t n = read(fd, buffer.data(), count * sizeof(SegmentRecord));
+                    if (n <= 0) break;
+                    count = static_cast<size_t>(n) / sizeof(SegmentRecord);
+                    scanned += static_cast<uint64_t>(n);
+                    remaining -= count;
+                    for (size_t i = 0; i < count; ++i) {
+                        if (buffer[i].timestamp_ms >= to) {
+                            done = true;
+                            break;
+                        }
+                        if (buffer[i].timestamp_ms >= from) found++;
+                    }
+                }
+                close(fd);
+            }
+        }
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        out << "  " << std::left << std::setw(28) << "scan from the start" << std::right << std::setw(10)
+            << ns / SCANS / 1000.0 << " us" << std::setw(10) << scanned / SCANS / 1024.0 << " KB" << std::setw(9)
+            << found / SCANS << std::endl;
+
+        store.close();
+        removeStoreDirectory(directory);
+    }
+
+    void benchCompaction(std::ostream& out) {
+        const int SENSORS = 4;
+        const int64_t DAYS = 14;
+        const int64_t START_MS = 1700000000000LL;
+        const int64_t NOW_MS = START_MS + (DAYS + 1) * 86400000LL;
+        const int TICK_US = 1000;           // a 1 kHz acquisition loop
+        const int TICKS = 3000;
+
+        out << "Store compaction: " << SENSORS << " sensors x " << DAYS << " days at 1 Hz ("
+            << SENSORS * DAYS * 86400 * sizeof(SegmentRecord) / 1e6 << " MB raw, hourly segments) rolled up while a "
+            << 1000000 / TICK_US << " Hz loop appends to the store" << std::endl;
+        out << "  " << std::left << std::setw(28) << "compactor" << std::right << std::setw(9) << "wake p50"
+            << std::setw(9) << "p99" << std::setw(9) << "p99.9" << std::setw(9) << "max" << std::setw(12)
+            << "append p99" << std::setw(9) << "max" << std::setw(11) << "compacted" << std::endl;
+
+        enum Mode { None, Idle, Unthrottled };
+        const struct { Mode mode; const char* name; } MODES[] = {
+            {None, "none"},
+            {Idle, "idle priority, 4 MB/s"},
+            {Unthrottled, "same priority, unthrottled"},
+        };
+        for (const auto& run : MODES) {
+            char dirTemplate[] = "/tmp/sensor_reader_bench_compaction.XXXXXX";
+            if (!mkdtemp(dirTemplate)) {
+                out << "  cannot create a directory in /tmp" << std::endl;
+                return;
+            }
+            std::string directory = dirTemplate;
+            SegmentStore store;
+            if (!store.open(directory, SegmentStore::DEFAULT_BLOCK_RECORDS, 3600)) {
+                out << "  cannot open a store in " << directory << std::endl;
+                return;
+            }
+
+            HistoryRow row;
+            row.humidity = HistoryRow::HUMIDITY_UNKNOWN;
+            row.flags = 0;
+            uint32_t seed = 5;
+            if (run.mode != None) {
+                for (int s = 0; s < SENSORS; ++s) {
+                    std::string sensor = "sensor" + std::to_string(s);
+                    for (int64_t t = 0; t < DAYS * 86400; ++t) {
+                        seed = seed * 1664525 + 1013904223;
+                        row.timestamp_ms = START_MS + t * 1000;
+                        row.pm25_raw = row.pm25_corrected_raw = static_cast<uint16_t>(50 + (seed >> 25));
+                        row.pm10_raw = row.pm10_corrected_raw = static_cast<uint16_t>(row.pm25_raw + 40);
+                        store.append(sensor, row);
+                    }
+                }
+                store.flush();
+            }
+
+            RetentionPolicy policy;
+            RetentionPolicy::parse(run.mode == Idle ? "raw=1d,minute=0,rate=4M" : "raw=1d,minute=0,rate=0", policy);
+            StoreCompactor compactor(store, policy);
+            std::thread unthrottled;
+            if (run.mode == Idle) {
+                compactor.start();
+            } else if (run.mode == Unthrottled) {
+                unthrottled = std::thread([&compactor, NOW_MS]() { compactor.runOnce(NOW_MS); });
+            }
+
+            // The loop the compactor must not disturb: wake on time, append, flush now and then
+            LatencyHistogram wake, append;
+            auto next = std::chrono::steady_clock::now();
+            for (int tick = 0; tick < TICKS; ++tick) {
+                next += std::chrono::microseconds(TICK_US);
+                std::this_thread::sleep_until(next);
+                auto woke = std::chrono::steady_clock::now();
+                wake.record(std::chrono::duration_cast<std::chrono::nanoseconds>(woke - next).count());
+
+                row.timestamp_ms = NOW_MS + tick;
+                store.append("live", row);
+                if (tick % 100 == 99) store.flush();
+                append.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - woke).count());
+            }
+            compactor.stop();
+            if (unthrottled.joinable()) unthrottled.join();
+
+            CompactionStats stats = compactor.stats();
+            out << "  " << std::left << std::setw(28) << run.name << std::right << std::fixed
+                << std::setprecision(0);
+            for (double percentile : {50.0, 99.0, 99.9}) {
+                out << std::setw(6) << wake.valueAtPercentile(percentile) / 1000.0 << " us";
+            }
+            out << std::setw(6) << wake.max() / 1000.0 << " us" << std::setw(9)
+                << append.valueAtPercentile(99.0) / 1000.0 << " us" << std::setw(6) << append.max() / 1000.0 << " us"
+                << std::setw(8) << std::setprecision(1) << stats.bytesRead / 1e6 << " MB" << std::endl;
+
+            store.close();
+            removeStoreDirectory(directory);
+        }
+    }
+
+    void benchWal(std::ostream& out) {
+        const int SENSORS = 100;
+        const uint64_t TICK_NS = 10000000;  // 100 sensors at 1 Hz: a reading every 10 ms
+
+        char dirTemplate[] = "/tmp/sensor_reader_bench_wal.XXXXXX";
+        if (!mkdtemp(dirTemplate)) {
+            out << "  cannot create a directory in /tmp" << std::endl;
+            return;
+        }
+        std::string directory = dirTemplate;
+        std::string file = directory + "/wal";
+        std::vector<std::string> sensors;
+        for (int s = 0; s < SENSORS; ++s) {
+            sensors.push_back("/dev/serial/by-id/usb-sensor" + std::to_string(s));
+        }
+        HistoryRow row;
+        row.humidity = HistoryRow::HUMIDITY_UNKNOWN;
+        row.flags = 0;
+
+        out << "Write-ahead log: " << SENSORS << " sensors at 1 Hz, each commit synced to " << directory << std::endl;
+        out << "  " << std::left << std::setw(28) << "commit" << std::right << std::setw(14) << "per reading"
+            << std::setw(9) << "syncs" << std::setw(14) << "bytes/reading" << std::endl;
+
+        const struct { const char* name; const char* spec; int readings; } MODES[] = {
+            {"every reading", "interval=0,checkpoint=1G", 2000},
+            {"group, interval=100ms", "interval=100ms,checkpoint=1G", 20000},
+            {"group, interval=1s", "interval=1s,checkpoint=1G", 60000},
+        };
+        for (const auto& mode : MODES) {
+            WalConfig config;
+            WalConfig::parse(mode.spec, config);
+            WriteAheadLog wal;
+            WalRecovery recovery;
+            unlink(file.c_str());
+            if (!wal.open(file, config, recovery)) {
+                out << "  cannot open " << file << std::endl;
+                return;
+            }
+            uint32_t seed = 11;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < mode.readings; ++i) {
+                seed = seed * 1664525 + 1013904223;
+                uint64_t now = (i + 1) * TICK_NS;
+                row.timestamp_ms = 1700000000000LL + static_cast<int64_t>(now / 1000000);
+                row.pm25_raw = row.pm25_corrected_raw = static_cast<uint16_t>(50 + (seed >> 25));
+                row.pm10_raw = row.pm10_corrected_raw = static_cast<uint16_t>(row.pm25_raw + 40);
+                wal.append(sensors[i % SENSORS], row, now);
+                if (wal.due(now)) wal.commit();
+            }
+            wal.commit();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            WalStats stats = wal.stats();
+            out << "  " << std::left << std::setw(28) << mode.name << std::right << std::fixed << std::setprecision(0)
+                << std::setw(11) << ns / mode.readings << " ns" << std::setw(9) << stats.commits << std::setw(14)
+                << std::setprecision(1) << static_cast<double>(stats.bytes) / mode.readings << std::endl;
+        }
+
+        // Recovery reads only the log, so it costs the unflushed tail, never the store
+        out << "  " << std::left << std::setw(28) << "recovery (open + replay)" << std::right << std::setw(14)
+            << "time" << std::setw(9) << "blocks" << std::setw(14) << "rows" << std::endl;
+        for (uint64_t bytes : {1ULL << 20, 16ULL << 20}) {
+            WalConfig config;
+            WalConfig::parse("interval=1s,checkpoint=1G", config);
+            unlink(file.c_str());
+            {
+                WriteAheadLog wal;
+                WalRecovery recovery;
+                if (!wal.open(file, config, recovery)) {
+                    out << "  cannot open " << file << std::endl;
+                    return;
+                }
+                for (uint64_t i = 0; wal.size() < bytes; ++i) {
+                    row.timestamp_ms = 1700000000000LL + static_cast<int64_t>(i * 10);
+                    wal.append(sensors[i % SENSORS], row, (i + 1) * TICK_NS);
+                    if (wal.due((i + 1) * TICK_NS)) wal.commit();
+                }
+            }
+            WriteAheadLog wal;
+            WalRecovery recovery;
+            auto start = std::chrono::steady_clock::now();
+            wal.open(file, config, recovery);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            out << "  " << std::left << std::setw(28) << (std::to_string(bytes >> 20) + " MB log") << std::right
+                << std::setw(11) << std::setprecision(1) << ms << " ms" << std::setw(9) << recovery.blocks
+                << std::setw(14) << recovery.rows.size() << std::endl;
+            benchmarkSink = static_cast<double>(recovery.rows.size());
+        }
+
+        unlink(file.c_str());
+        rmdir(directory.c_str());
+    }
+
+    void benchArrow(std::ostream& out) {
+        const int SENSORS = 4;
+        const size_t ROWS = 1 << 22;        // per sensor, about 48 days at 1 Hz
+        const int REPEATS = 3;
+        const int64_t START_MS = 1700000000000LL;
+
+        std::vector<std::unique_ptr<ReadingHistory>> owned;
+        std::vector<std::pair<std::string, const ReadingHistory*>> histories;
+        uint32_t seed = 17;
+        for (int s = 0; s < SENSORS; ++s) {
+            owned.push_back(std::unique_ptr<ReadingHistory>(new ReadingHistory(ROWS)));
+            for (size_t i = 0; i < ROWS; ++i) {
+                seed = seed * 1664525 + 1013904223;
+                uint16_t pm = static_cast<uint16_t>(50 + (seed >> 25));
+                owned.back()->append(START_MS + static_cast<int64_t>(i) * 1000, pm, static_cast<uint16_t>(pm + 40),
+                                     static_cast<uint8_t>((seed >> 8) % 64 == 0));
+            }
+            histories.push_back(std::make_pair("/dev/ttyUSB" + std::to_string(s), owned.back().get()));
+        }
+
+        char fileTemplate[] = "/tmp/sensor_reader_bench_arrow.XXXXXX";
+        int fd = mkstemp(fileTemplate);
+        if (fd < 0) {
+            out << "  cannot create a file in /tmp" << std::endl;
+            return;
+        }
+        close(fd);
+        std::string file = fileTemplate;
+
+        out << "Arrow IPC export: " << SENSORS << " sensors x " << ROWS << " readings from ReadingHistory to "
+            << file << " (page cache)" << std::endl;
+        out << "  " << std::left << std::setw(28) << "export" << std::right << std::setw(10) << "rows"
+            << std::setw(13) << "time" << std::setw(14) << "rows/s" << std::setw(12) << "MB/s" << std::endl;
+
+        const struct { const char* name; const char* spec; } CASES[] = {
+            {"all sensors, all time", ""},
+            {"one sensor, one day", "from=1700864000000,to=1700950400000,sensor=/dev/ttyUSB1"},
+        };
+        for (const auto& run : CASES) {
+            ArrowExportFilter filter;
+            ArrowExportFilter::parse(run.spec, filter);
+            uint64_t rows = 0;
+            double best = 0.0;
+            for (int r = 0; r < REPEATS; ++r) {
+                auto start = std::chrono::steady_clock::now();
+                ArrowWriter::exportHistories(file, histories, filter, &rows);
+                double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (r == 0 || s < best) best = s;
+            }
+            struct stat info;
+            double megabytes = (stat(file.c_str(), &info) == 0) ? info.st_size / 1e6 : 0.0;
+            out << "  " << std::left << std::setw(28) << run.name << std::right << std::setw(10) << rows
+                << std::fixed << std::setprecision(2) << std::setw(10) << best * 1000.0 << " ms" << std::setw(12)
+                << std::setprecision(1) << rows / best / 1e6 << " M" << std::setw(12) << megabytes / best
+                << std::endl;
+        }
+
+        // What parsing console output or CSV has to undo: one formatted line per reading
+        const size_t TEXT_ROWS = 1 << 20;
+        std::string text;
+        char line[96];
+        auto start = std::chrono::steady_clock::now();
+        histories[0].second->forEachSlice(0, TEXT_ROWS, [&](const ReadingHistory::Chunk& chunk, size_t begin,
+                                                           size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                int length = snprintf(line, sizeof(line), "%lld,%s,%.1f,%.1f,%u\n",
+                                      static_cast<long long>(chunk.timestamp_ms[i]), histories[0].first.c_str(),
+                                      chunk.pm25_raw[i] / 10.0, chunk.pm10_raw[i] / 10.0, chunk.flags[i]);
+                text.append(line, static_cast<size_t>(length));
+            }
+        });
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        out << "  " << std::left << std::setw(28) << "CSV lines, for reference" << std::right << std::setw(10)
+            << TEXT_ROWS << std::setw(10) << std::setprecision(2) << s * 1000.0 << " ms" << std::setw(12)
+            << std::setprecision(1) << TEXT_ROWS / s / 1e6 << " M" << std::setw(12) << text.size() / 1e6 / s
+            << std::endl;
+        benchmarkSink = static_cast<double>(text.size());
+        unlink(file.c_str());
+    }
+
+    struct Entry {
+        const char* name;
+        void (*fn)(std::ostream&);
+    };
+
+    const Entry BENCHMARKS[] = {
+        {"kernels", benchKernels},
+        {"history", benchHistory},
+        {"chart", benchChart},
+        {"filter", benchFilter},
+        {"humidity", benchHumidity},
+        {"io", benchIo},
+        {"bus", benchBus},
+        {"alerts", benchAlerts},
+        {"segments", benchSegments},
+        {"compaction", benchCompaction},
+        {"wal", benchWal},
+        {"arrow", benchArrow},
+    };
+}
+
+namespace Benchmarks {
+    std::vector<std::string> names() {
+        std::vector<std::string> result;
+        for (const Entry& entry : BENCHMARKS) {
+            result.push_back(entry.name);
+        }
+        return result;
+    }
+
+    bool run(const std::string& name, std::ostream& out) {
+        bool found = false;
+        for (const Entry& entry : BENCHMARKS) {
+            if (name == "all" || name == entry.name) {
+                entry.fn(out);
+                out << std::endl;
+                found = true;
+            }
+        }
+        return found;
+    }
+}
@@ -0,0 +1,139 @@
+#include "capture_replayer.h"
+#include "sds011_reader.h"
+#include "app_utils.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+
+CaptureReplayer::CaptureReplayer(const std::string& capturePath, bool paceRealTime)
+    : path(capturePath), realTime(paceRealTime) {}
+
+bool CaptureReplayer::load() {
+    RawCaptureReader reader;
+    if (!reader.open(path)) {
+        return false;
+    }
+
+    chunks.clear();
+    expected.clear();
+
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (record.type == CaptureRecord::Bytes) {
+            chunks.push_back(record);
+        } else if (record.type == CaptureRecord::Frame && record.payload.size() == 4) {
+            uint32_t pm25 = record.payload[0] | (record.payload[1] << 8);
+            uint32_t pm10 = record.payload[2] | (record.payload[3] << 8);
+            expected.push_back(pm25 | (pm10 << 16));
+        }
+    }
+
+    return true;
+}
+
+void CaptureReplayer::feed(int fd, uint64_t& bytesWritten) const {
+    if (chunks.empty()) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t origin = chunks.front().timestamp_ns;
+
+    for (const CaptureRecord& chunk : chunks) {
+        if (realTime) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(chunk.timestamp_ns - origin));
+        }
+
+        size_t offset = 0;
+        while (offset < chunk.payload.size()) {
+            ssize_t written = write(fd, chunk.payload.data() + offset, chunk.payload.size() - offset);
+            if (written <= 0) {
+                return; // Reader went away
+            }
+            offset += written;
+            bytesWritten += written;
+        }
+
+        if (!g_running) {
+            return;
+        }
+    }
+}
+
+bool CaptureReplayer::run(ReplayReport& report) {
+    report = ReplayReport();
+    report.framesRecorded = expected.size();
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Error creating replay pipe" << std::endl;
+        return false;
+    }
+
+    // A reader that stops early must not kill us with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    SDS011Reader reader("replay:" + path);
+    reader.attach(fds[0]);
+
+    uint64_t bytesWritten = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::thread feeder([this, &fds, &bytesWritten]() {
+        feed(fds[1], bytesWritten);
+        close(fds[1]);
+    });
+
+    SDS011Frame frame;
+    while (g_running) {
+        if (!reader.readFrame(frame)) {
+            if (reader.isEndOfStream()) {
+                break;
+            }
+            continue;
+        }
+
+        uint64_t index = report.framesDecoded++;
+        uint32_t value = frame.pm25_raw | (static_cast<uint32_t>(frame.pm10_raw) << 16);
+        if (index >= expected.size() || expected[index] != value) {
+            report.mismatches++;
+            if (report.firstDivergence < 0) {
+                report.firstDivergence = static_cast<int64_t>(index);
+            }
+        }
+    }
+
+    // Closing the read end unblocks the feeder if we stopped early
+    reader.attach(-1);
+    feeder.join();
+
+    report.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report.bytes = bytesWritten;
+    if (report.framesDecoded < report.framesRecorded && report.firstDivergence < 0) {
+        report.firstDivergence = static_cast<int64_t>(report.framesDecoded);
+    }
+    return g_running;
+}
+
+void CaptureReplayer::printReport(const ReplayReport& report, std::ostream& out) {
+    out << "Replay summary" << std::endl;
+    out << "==============" << std::endl;
+    out << "Bytes replayed:   " << report.bytes << std::endl;
+    out << "Frames recorded:  " << report.framesRecorded << std::endl;
+    out << "Frames decoded:   " << report.framesDecoded << std::endl;
+    out << "Elapsed:          " << std::fixed << std::setprecision(3) << report.elapsedSeconds << " s" << std::endl;
+    out << "Throughput:       " << std::fixed << std::setprecision(0) << report.framesPerSecond()
+        << " frames/s" << std::endl;
+
+    if (report.mismatches == 0 && report.framesDecoded == report.framesRecorded) {
+        out << "Decode matches the recording" << std::endl;
+    } else {
+        out << "DIVERGENCE: " << report.mismatches << " differing frame(s)";
+        if (report.firstDivergence >= 0) {
+            out << ", first at frame " << report.firstDivergence;
+        }
+        out << std::endl;
+    }
+}
@@ -0,0 +1,182 @@
+#include "device_lookup.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef LINUX
+#include <sys/inotify.h>
+#endif
+
+namespace {
+    std::string rootDir;    // prepended to /dev and /sys, empty for the real system
+
+    std::string resolvePath(const std::string& path) {
+        char* resolved = realpath(path.c_str(), nullptr);
+        if (!resolved) {
+            return std::string();
+        }
+        std::string result(resolved);
+        free(resolved);
+        return result;
+    }
+
+    std::string baseName(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return (slash == std::string::npos) ? path : path.substr(slash + 1);
+    }
+
+    std::string parentDir(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return (slash == std::string::npos || slash == 0) ? std::string() : path.substr(0, slash);
+    }
+
+    bool exists(const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    std::string readAttribute(const std::string& path) {
+        std::ifstream file(path);
+        std::string value;
+        std::getline(file, value);
+        while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+            value.pop_back();
+        }
+        return value;
+    }
+
+    std::vector<std::string> listDir(const std::string& path) {
+        std::vector<std::string> names;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            return names;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') {
+                names.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+        return names;
+    }
+
+    // Key of a tty by kernel name ("ttyUSB0"), empty unless it sits on a USB device
+    std::string keyOf(const std::string& ttyName) {
+        std::string dir = resolvePath(rootDir + "/sys/class/tty/" + ttyName + "/device");
+        std::string sysRoot = rootDir + "/sys";
+        std::string interface;
+        while (!dir.empty() && dir != sysRoot) {
+            if (exists(dir + "/idVendor")) {
+                std::string serial = readAttribute(dir + "/serial");
+                std::string key = serial.empty()
+                    ? "usb-path-" + baseName(dir)
+                    : "usb-" + readAttribute(dir + "/idVendor") + ":" + readAttribute(dir + "/idProduct") + "-" + serial;
+                // Multi-port adapters share the USB device; the interface tells the ports apart
+                return interface.empty() ? key : key + ":" + interface;
+            }
+            std::string name = baseName(dir);
+            size_t colon = name.find(':');
+            if (colon != std::string::npos) {
+                interface = name.substr(colon + 1);
+            }
+            dir = parentDir(dir);
+        }
+        return std::string();
+    }
+}
+
+namespace DeviceLookup {
+    DeviceId identify(const std::string& path) {
+        DeviceId id;
+#ifdef LINUX
+        std::string node = resolvePath(path);
+        if (node.empty()) {
+            return id;
+        }
+        id.key = keyOf(baseName(node));
+        if (id.key.empty()) {
+            return id;
+        }
+
+        std::string byIdDir = rootDir + "/dev/serial/by-id";
+        for (const std::string& name : listDir(byIdDir)) {
+            if (resolvePath(byIdDir + "/" + name) == node) {
+                id.byIdPath = byIdDir + "/" + name;
+                break;
+            }
+        }
+#else
+        (void)path;
+#endif
+        return id;
+    }
+
+    std::string locate(const DeviceId& id) {
+        if (id.empty()) {
+            return std::string();
+        }
+
+        // udev's link is the cheap answer; checked against sysfs in case it is stale
+        if (!id.byIdPath.empty()) {
+            std::string node = resolvePath(id.byIdPath);
+            if (!node.empty() && keyOf(baseName(node)) == id.key) {
+                return node;
+            }
+        }
+
+        for (const std::string& name : listDir(rootDir + "/sys/class/tty")) {
+            std::string node = rootDir + "/dev/" + name;
+            if (keyOf(name) == id.key && exists(node)) {
+                return node;
+            }
+        }
+        return std::string();
+    }
+
+    void setRoot(const std::string& root) {
+        // Absolute, so it can be compared with the resolved paths
+        std::string resolved = resolvePath(root);
+        rootDir = resolved.empty() ? root : resolved;
+    }
+}
+
+DeviceWatcher::DeviceWatcher() : inotify_fd(-1) {
+#ifdef LINUX
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Nodes are created by devtmpfs, then udev fixes their permissions
+    if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, (rootDir + "/dev").c_str(), IN_CREATE | IN_ATTRIB) < 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+#endif
+}
+
+DeviceWatcher::~DeviceWatcher() {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+}
+
+bool DeviceWatcher::wait(int timeoutMs) {
+    if (inotify_fd < 0) {
+        // No notifications; callers still get their pacing
+        if (timeoutMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        }
+        return false;
+    }
+
+    struct pollfd pfd = {inotify_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+    char events[4096];
+    while (read(inotify_fd, events, sizeof(events)) > 0) {
+    }
+    return true;
+}
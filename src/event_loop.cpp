@@ -0,0 +1,232 @@
+#include "event_loop.h"
+#include "sample_clock.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef LINUX
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#ifndef LINUX
+namespace {
+    // Self-pipe for platforms without signalfd; written from the signal handler
+    int signalPipe[2] = {-1, -1};
+
+    void forwardSignal(int signal) {
+        unsigned char byte = static_cast<unsigned char>(signal);
+        ssize_t ignored = write(signalPipe[1], &byte, 1);
+        (void)ignored;
+    }
+}
+#endif
+
+EventLoop::EventLoop() : signal_fd(-1), wakeups(0) {
+    sigemptyset(&previousMask);
+}
+
+EventLoop::~EventLoop() {
+    for (const Timer& timer : timers) {
+        if (timer.fd >= 0) {
+            close(timer.fd);
+        }
+    }
+    if (signal_fd < 0) {
+        return;
+    }
+#ifdef LINUX
+    close(signal_fd);
+    pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+#else
+    for (int signal : signalNumbers) {
+        ::signal(signal, SIG_DFL);
+    }
+    close(signalPipe[0]);
+    close(signalPipe[1]);
+    signalPipe[0] = signalPipe[1] = -1;
+#endif
+}
+
+bool EventLoop::watchSignals(const std::vector<int>& signals, SignalHandler handler) {
+    if (signal_fd >= 0) {
+        return false;
+    }
+    signalHandler = handler;
+    signalNumbers = signals;
+
+#ifdef LINUX
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int signal : signals) {
+        sigaddset(&mask, signal);
+    }
+    if (pthread_sigmask(SIG_BLOCK, &mask, &previousMask) != 0) {
+        return false;
+    }
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+        return false;
+    }
+#else
+    if (signalPipe[0] >= 0 || pipe(signalPipe) != 0) {
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(signalPipe[i], F_SETFL, fcntl(signalPipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(signalPipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    for (int signal : signals) {
+        ::signal(signal, forwardSignal);
+    }
+    signal_fd = signalPipe[0];
+#endif
+    return true;
+}
+
+void EventLoop::dispatchSignals() {
+#ifdef LINUX
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+        signalHandler(static_cast<int>(info.ssi_signo));
+    }
+#else
+    unsigned char byte;
+    while (read(signal_fd, &byte, 1) == 1) {
+        signalHandler(byte);
+    }
+#endif
+}
+
+void EventLoop::watchReadable(int fd, Handler handler) {
+    if (fd >= 0) {
+        readers[fd] = handler;
+    }
+}
+
+void EventLoop::unwatch(int fd) {
+    readers.erase(fd);
+}
+
+int EventLoop::addTimer(Handler handler) {
+    Timer timer;
+    timer.fd = -1;
+#ifdef LINUX
+    timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#endif
+    timer.deadlineNs = 0;
+    timer.handler = handler;
+    timers.push_back(timer);
+    return static_cast<int>(timers.size() - 1);
+}
+
+void EventLoop::armTimer(int id, uint64_t deadlineNs) {
+    Timer& timer = timers[id];
+    // 0 means disarmed, so a deadline long past still fires at once
+    timer.deadlineNs = deadlineNs ? deadlineNs : 1;
+#ifdef LINUX
+    if (timer.fd >= 0) {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = static_cast<time_t>(timer.deadlineNs / 1000000000ULL);
+        spec.it_value.tv_nsec = static_cast<long>(timer.deadlineNs % 1000000000ULL);
+        timerfd_settime(timer.fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+#endif
+}
+
+void EventLoop::disarmTimer(int id) {
+    Timer& timer = timers[id];
+    timer.deadlineNs = 0;
+#ifdef LINUX
+    if (timer.fd >= 0) {
+        struct itimerspec spec = {};
+        timerfd_settime(timer.fd, 0, &spec, nullptr);
+    }
+#endif
+}
+
+int EventLoop::runOnce(int timeoutMs) {
+    // Slots: the signal descriptor, armed timerfds, then readers
+    std::vector<struct pollfd> fds;
+    std::vector<int> timerSlots;
+    if (signal_fd >= 0) {
+        fds.push_back({signal_fd, POLLIN, 0});
+    }
+
+    uint64_t now = SampleClock::nowNs();
+    for (size_t i = 0; i < timers.size(); ++i) {
+        const Timer& timer = timers[i];
+        if (timer.deadlineNs == 0) {
+            continue;
+        }
+        if (timer.fd >= 0) {
+            fds.push_back({timer.fd, POLLIN, 0});
+            timerSlots.push_back(static_cast<int>(i));
+        } else {
+            // No timerfd: shorten the wait to the deadline, rounded up
+            int untilMs = (timer.deadlineNs > now) ? static_cast<int>((timer.deadlineNs - now + 999999) / 1000000) : 0;
+            if (timeoutMs < 0 || untilMs < timeoutMs) {
+                timeoutMs = untilMs;
+            }
+        }
+    }
+    size_t firstReader = fds.size();
+    for (const auto& entry : readers) {
+        fds.push_back({entry.first, POLLIN, 0});
+    }
+
+    int ready = poll(fds.data(), fds.size(), timeoutMs);
+    wakeups++;
+    if (ready < 0) {
+        return 0;   // EINTR: the caller loops
+    }
+
+    int handled = 0;
+    size_t slot = 0;
+    if (signal_fd >= 0) {
+        if (fds[slot].revents & POLLIN) {
+            dispatchSignals();
+            handled++;
+        }
+        slot++;
+    }
+
+    now = SampleClock::nowNs();
+    for (int index : timerSlots) {
+        Timer& timer = timers[index];
+        uint64_t expirations;
+        // Re-arming from an earlier handler resets a pending expiry
+        if ((fds[slot++].revents & POLLIN) && timer.deadlineNs != 0 &&
+            read(timer.fd, &expirations, sizeof(expirations)) == static_cast<ssize_t>(sizeof(expirations))) {
+            timer.deadlineNs = 0;
+            Handler handler = timer.handler;
+            handler();
+            handled++;
+        }
+    }
+    for (size_t i = 0; i < timers.size(); ++i) {
+        Timer& timer = timers[i];
+        if (timer.fd < 0 && timer.deadlineNs != 0 && timer.deadlineNs <= now) {
+            timer.deadlineNs = 0;
+            Handler handler = timer.handler;
+            handler();
+            handled++;
+        }
+    }
+
+    for (size_t i = firstReader; i < fds.size(); ++i) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))) {
+            continue;
+        }
+        // An earlier handler may have unwatched or replaced this descriptor
+        auto it = readers.find(fds[i].fd);
+        if (it == readers.end()) {
+            continue;
+        }
+        Handler handler = it->second;
+        handler();
+        handled++;
+    }
+    return handled;
+}
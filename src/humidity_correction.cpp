@@ -0,0 +1,237 @@
+#include "humidity_correction.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    // Longest line kept while waiting for its newline
+    const size_t MAX_LINE = 256;
+
+    int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool parseNumber(const std::string& text, double& value) {
+        char* end = nullptr;
+        value = std::strtod(text.c_str(), &end);
+        return !text.empty() && *end == '\0';
+    }
+
+    /**
+     * @brief Parse "<time> <rh>", "<time>,<rh>" or "<rh>"
+     * @return false if malformed; true with timestampMs -1 for blank and comment lines
+     */
+    bool parseHumidityLine(std::string line, int64_t& timestampMs, float& rh) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream iss(line);
+        std::string fields[3];
+        size_t count = 0;
+        while (count < 3 && iss >> fields[count]) count++;
+
+        timestampMs = -1;
+        if (count == 0 || fields[0][0] == '#') return true;
+        if (count > 2) return false;
+
+        double value;
+        if (!parseNumber(fields[count - 1], value) || value < 0.0 || value > 100.0) return false;
+        rh = static_cast<float>(value);
+
+        if (count == 1) {
+            timestampMs = nowMs();
+            return true;
+        }
+        double time;
+        if (!parseNumber(fields[0], time) || time < 0.0) return false;
+        // Anything below 1e11 cannot be milliseconds of this century
+        timestampMs = static_cast<int64_t>(time < 1e11 ? time * 1000.0 : time);
+        return true;
+    }
+}
+
+// HumidityModel implementation
+double HumidityModel::growthFactor(double kappa, double rh) const {
+    rh = std::min(rh, maxRH);
+    if (rh <= 0.0 || kappa <= 0.0) {
+        return 1.0;
+    }
+    return 1.0 + (kappa / 1.65) / (100.0 / rh - 1.0);
+}
+
+bool HumidityModel::parse(const std::string& spec, HumidityModel& model) {
+    HumidityModel result;
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        double value;
+        if (!parseNumber(item.substr(equals + 1), value) || value < 0.0) {
+            return false;
+        }
+
+        if (key == "kappa") {
+            result.kappa25 = result.kappa10 = value;
+        } else if (key == "kappa25") {
+            result.kappa25 = value;
+        } else if (key == "kappa10") {
+            result.kappa10 = value;
+        } else if (key == "max-rh") {
+            if (value <= 0.0 || value >= 100.0) return false;
+            result.maxRH = value;
+        } else if (key == "max-age") {
+            result.maxAgeMs = static_cast<int64_t>(value * 1000.0);
+        } else {
+            return false;
+        }
+    }
+
+    model = result;
+    return true;
+}
+
+// HumidityJoin implementation
+HumidityJoin::HumidityJoin() {
+    clear();
+}
+
+void HumidityJoin::clear() {
+    head = 0;
+    count = 0;
+}
+
+void HumidityJoin::addSample(int64_t timestampMs, float rh) {
+    // Older than everything a full ring holds: it could never be the latest match
+    if (count == CAPACITY && timestampMs < at(0).timestampMs) {
+        return;
+    }
+
+    if (count == CAPACITY) {
+        head = (head + 1) % CAPACITY;
+        count--;
+    }
+
+    // Usually appended at the end; a late sample is moved back into place
+    size_t position = count++;
+    while (position > 0 && at(position - 1).timestampMs > timestampMs) {
+        samples[(head + position) % CAPACITY] = at(position - 1);
+        position--;
+    }
+    Sample& sample = samples[(head + position) % CAPACITY];
+    sample.timestampMs = timestampMs;
+    sample.rh = rh;
+}
+
+bool HumidityJoin::lookup(int64_t timestampMs, int64_t maxAgeMs, float& rh) const {
+    for (size_t i = count; i > 0; --i) {
+        const Sample& sample = at(i - 1);
+        if (sample.timestampMs <= timestampMs) {
+            if (timestampMs - sample.timestampMs > maxAgeMs) {
+                return false;
+            }
+            rh = sample.rh;
+            return true;
+        }
+    }
+    return false;
+}
+
+// HumidityFeed implementation
+HumidityFeed::HumidityFeed() : fd(-1), malformedLines(0) {}
+
+HumidityFeed::~HumidityFeed() {
+    close();
+}
+
+bool HumidityFeed::open(const std::string& source) {
+    close();
+    // Non-blocking so that opening a FIFO does not wait for a writer
+    fd = ::open(source.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Cannot open humidity source " << source << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    path = source;
+    return true;
+}
+
+void HumidityFeed::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+}
+
+size_t HumidityFeed::poll(HumidityJoin& join) {
+    if (fd < 0) {
+        return 0;
+    }
+
+    // EOF only means no writer or nothing appended yet; keep the descriptor
+    char chunk[4096];
+    ssize_t n;
+    while ((n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.append(chunk, n);
+    }
+
+    size_t added = 0;
+    size_t start = 0;
+    size_t newline;
+    while ((newline = buffer.find('\n', start)) != std::string::npos) {
+        int64_t timestampMs;
+        float rh = 0.0f;
+        if (!parseHumidityLine(buffer.substr(start, newline - start), timestampMs, rh)) {
+            malformedLines++;
+        } else if (timestampMs >= 0) {
+            join.addSample(timestampMs, rh);
+            added++;
+        }
+        start = newline + 1;
+    }
+    buffer.erase(0, start);
+    if (buffer.size() > MAX_LINE) {
+        malformedLines++;
+        buffer.clear();
+    }
+    return added;
+}
+
+// HumidityCorrector implementation
+bool HumidityCorrector::configure(const std::string& source, const HumidityModel& settings) {
+    model = settings;
+    join.clear();
+    feed.close();
+    enabled = source.empty() || feed.open(source);
+    return enabled;
+}
+
+CorrectedReading HumidityCorrector::apply(int64_t timestampMs, float pm25, float pm10) {
+    CorrectedReading result;
+    result.pm25 = pm25;
+    result.pm10 = pm10;
+    result.rh = -1.0f;
+    result.corrected = false;
+    if (!enabled) {
+        return result;
+    }
+
+    feed.poll(join);
+    float rh;
+    if (join.lookup(timestampMs, model.maxAgeMs, rh)) {
+        result.pm25 = static_cast<float>(pm25 / model.growthFactor(model.kappa25, rh));
+        result.pm10 = static_cast<float>(pm10 / model.growthFactor(model.kappa10, rh));
+        result.rh = rh;
+        result.corrected = true;
+    }
+    return result;
+}
@@ -1,16 +1,53 @@
 #include "interactive_tui.h"
 #include "sds011_plugin.h"
 #include "app_utils.h"
+#include "trace_recorder.h"
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <sstream>
-#include <thread>
+#include <clocale>
+#include <cstring>
+#include <ctime>
+#include <langinfo.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+    // Chart spans cycled with 't'
+    const struct {
+        int64_t spanMs;
+        const char* label;
+    } CHART_SPANS[] = {
+        {5 * 60 * 1000LL, "5m"},
+        {60 * 60 * 1000LL, "1h"},
+        {6 * 60 * 60 * 1000LL, "6h"},
+        {24 * 60 * 60 * 1000LL, "24h"},
+        {7 * 24 * 60 * 60 * 1000LL, "7d"},
+    };
+    const size_t CHART_SPAN_COUNT = sizeof(CHART_SPANS) / sizeof(CHART_SPANS[0]);
+    
+    // Eighths of a cell, empty to full; ASCII stand-ins for non-UTF-8 terminals
+    const char* const BLOCKS[] = {" ", "\u2581", "\u2582", "\u2583", "\u2584", "\u2585", "\u2586", "\u2587", "\u2588"};
+    const char* const ASCII_BLOCKS[] = {" ", ".", ".", ":", ":", "=", "=", "#", "#"};
+    
+    std::string formatDuration(int64_t ms) {
+        char text[32];
+        if (ms >= 3600000) snprintf(text, sizeof(text), "%lldh", static_cast<long long>(ms / 3600000));
+        else if (ms >= 60000) snprintf(text, sizeof(text), "%lldm", static_cast<long long>(ms / 60000));
+        else snprintf(text, sizeof(text), "%llds", static_cast<long long>(ms / 1000));
+        return text;
+    }
+}
 
 InteractiveTUI::InteractiveTUI() 
     : mainWin(nullptr), headerWin(nullptr), menuWin(nullptr), 
-      dataWin(nullptr), statsWin(nullptr), statusWin(nullptr),
-      currentSensor(nullptr), inSensorMode(false) {
+      dataWin(nullptr), statsWin(nullptr), percentileWin(nullptr), statusWin(nullptr), debugWin(nullptr),
+      chartWin(nullptr), currentSensor(nullptr), outlierCount(0), inSensorMode(false), showDebugPanel(false),
+      showChart(false), chartSpan(1), unicodeBlocks(false),
+      watchedSensorFd(-1), healthTimer(-1), quitRequested(false), sensorMetrics(nullptr) {
     
     // Register available sensor plugins
     registry.registerPlugin(std::unique_ptr<SensorPlugin>(new SDS011Plugin()));
@@ -21,6 +58,10 @@ InteractiveTUI::~InteractiveTUI() {
 }
 
 bool InteractiveTUI::initialize() {
+    // Multibyte output for the chart blocks; numbers keep the C locale
+    setlocale(LC_CTYPE, "");
+    unicodeBlocks = (strcmp(nl_langinfo(CODESET), "UTF-8") == 0);
+    
     // Initialize ncurses
     mainWin = initscr();
     if (mainWin == nullptr) {
@@ -32,7 +73,7 @@ bool InteractiveTUI::initialize() {
     noecho();
     keypad(stdscr, TRUE);
     curs_set(0);
-    timeout(100);
+    nodelay(stdscr, TRUE);  // getch never waits; run() waits for stdin instead
     
     // Initialize colors
     if (has_colors()) {
@@ -59,13 +100,17 @@ void InteractiveTUI::createWindows() {
         // Sensor monitoring layout
         dataWin = newwin(maxY - 8, maxX, 3, 0);
         statsWin = newwin(3, maxX / 2, maxY - 5, maxX / 2);
+        percentileWin = newwin(3, maxX / 2, maxY - 5, 0);
         statusWin = newwin(2, maxX, maxY - 2, 0);
         
         scrollok(dataWin, TRUE);
         
         box(dataWin, 0, 0);
         box(statsWin, 0, 0);
+        box(percentileWin, 0, 0);
         box(statusWin, 0, 0);
+        
+        placeOverlayWindows();
     } else {
         // Menu layout
         menuWin = newwin(maxY - 5, maxX, 3, 0);
@@ -79,28 +124,118 @@ void InteractiveTUI::createWindows() {
 }
 
 void InteractiveTUI::run() {
-    while (true) {
-        if (inSensorMode && currentSensor) {
-            showSensorData();
-            if (handleSensorInput() == 1) {
-                break;
-            }
-            
-            // Try to read sensor data
-            auto data = currentSensor->readData();
-            if (data) {
-                addReading(std::move(data));
+    // Sleeps until a key, a signal, a frame, a device change or a health
+    // deadline arrives, and redraws only after one of them
+    events.watchSignals({SIGINT, SIGTERM, SIGWINCH}, [this](int signal) {
+        if (signal == SIGWINCH) {
+            // ncurses never sees the blocked signal; hand it the new size
+            struct winsize ws;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) {
+                resizeterm(ws.ws_row, ws.ws_col);
             }
-            
+            ungetch(KEY_RESIZE);
+            processInput();
         } else {
-            showSensorMenu();
-            if (handleMenuInput() == 1) {
-                break;
-            }
+            quitRequested = true;
+        }
+    });
+    events.watchReadable(STDIN_FILENO, [this]() { processInput(); });
+    events.watchReadable(deviceWatcher.fd(), [this]() {
+        // The menu rescans when it is redrawn; a lost sensor is retried at once
+        if (deviceWatcher.wait(0) && inSensorMode && currentSensor) {
+            health.onDeviceAdded(SampleClock::nowNs());
+            serviceSensor(false);
+        }
+    });
+    healthTimer = events.addTimer([this]() { serviceSensor(false); });
+    
+    redraw();
+    while (!quitRequested) {
+        watchSensor();
+        if (events.runOnce() > 0) {
+            redraw();
+        }
+    }
+}
+
+void InteractiveTUI::processInput() {
+    int ch;
+    while (!quitRequested && (ch = getch()) != ERR) {
+        int result = (inSensorMode && currentSensor) ? handleSensorInput(ch) : handleMenuInput(ch);
+        if (result == 1) {
+            quitRequested = true;
         }
-        
-        refresh();
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+void InteractiveTUI::redraw() {
+    if (inSensorMode && currentSensor) {
+        showSensorData();
+    } else {
+        showSensorMenu();
+    }
+    refresh();
+}
+
+void InteractiveTUI::watchSensor() {
+    bool active = inSensorMode && currentSensor;
+    int fd = (active && health.isConnected()) ? currentSensor->getFd() : -1;
+    if (fd != watchedSensorFd) {
+        events.unwatch(watchedSensorFd);
+        events.watchReadable(fd, [this]() { serviceSensor(true); });
+        watchedSensorFd = fd;
+    }
+    
+    if (!active) {
+        events.disarmTimer(healthTimer);
+        return;
+    }
+    uint64_t now = SampleClock::nowNs();
+    uint64_t deadline = health.nextChangeNs(now);
+    if (health.isConnected() && fd < 0) {
+        // A plugin without a descriptor can only be polled
+        deadline = std::min<uint64_t>(deadline, now + 100000000ULL);
+    }
+    events.armTimer(healthTimer, deadline);
+}
+
+void InteractiveTUI::serviceSensor(bool readable) {
+    // A key handled in the same round may have left the sensor screen
+    if (!inSensorMode || !currentSensor) {
+        return;
+    }
+    
+    uint64_t now = SampleClock::nowNs();
+    if (!health.isConnected()) {
+        if (!health.reconnectDue(now)) {
+            return;
+        }
+        if (!currentSensor->initialize(sensorPort)) {
+            health.onConnectFailed(SampleClock::nowNs());
+            return;
+        }
+        if (!captureFile.empty()) {
+            currentSensor->enableCapture(captureFile);
+        }
+        health.onConnected(SampleClock::nowNs());
+        if (sensorMetrics) sensorMetrics->reconnects.fetch_add(1, std::memory_order_relaxed);
+        return;     // frames are read once the new descriptor is readable
+    }
+    
+    if (readable || currentSensor->getFd() < 0) {
+        // Only what has arrived: waiting for the rest of a frame would hold up keys and signals
+        auto data = currentSensor->readAvailableData();
+        if (data) {
+            addReading(std::move(data));
+        }
+        if (sensorMetrics) {
+            health.observeChecksumFailures(sensorMetrics->checksumFailures.load(std::memory_order_relaxed));
+        }
+    }
+    
+    if (currentSensor->isLinkLost() || health.state(SampleClock::nowNs()) == HealthState::Stalled) {
+        currentSensor->cleanup();
+        health.onDisconnected(SampleClock::nowNs());
     }
 }
 
@@ -110,6 +245,9 @@ void InteractiveTUI::showSensorMenu() {
         inSensorMode = false;
         if (dataWin) { delwin(dataWin); dataWin = nullptr; }
         if (statsWin) { delwin(statsWin); statsWin = nullptr; }
+        if (percentileWin) { delwin(percentileWin); percentileWin = nullptr; }
+        if (debugWin) { delwin(debugWin); debugWin = nullptr; }
+        if (chartWin) { delwin(chartWin); chartWin = nullptr; }
         createWindows();
     }
     
@@ -226,16 +364,58 @@ void InteractiveTUI::showSensorData() {
     mvwprintw(headerWin, 1, 2, "%s - %s", 
              currentSensor->getTypeName().c_str(), 
              currentSensor->getDescription().c_str());
-    mvwprintw(headerWin, 2, 2, "Port: %s | Press 'b' to go back, 'c' to clear data, 'q' to quit", 
-             currentSensor->getCurrentPort().c_str());
+    // The sensor keeps its name when its adapter comes back under another node
+    std::string device = currentSensor->getDevicePath();
+    std::string port = (device.empty() || device == sensorPort) ? sensorPort : sensorPort + " (now " + device + ")";
+    // With a ring file, clearing empties the file too
+    mvwprintw(headerWin, 2, 2, "Port: %s | Press 'b' to go back, 'c' to clear data%s, 'g' for charts, 'q' to quit", 
+             port.c_str(), history.attached() ? " and its file" : "");
     if (has_colors()) {
         wattroff(headerWin, COLOR_PAIR(4) | A_BOLD);
     }
+    
+    // Current NowCast and 24 h index, '*' while the averaging periods are not yet covered
+    AQIResult now = aqiEngine.nowCastAQI();
+    if (now.valid) {
+        AQIResult daily = aqiEngine.dailyAQI();
+        char summary[96];
+        int length = snprintf(summary, sizeof(summary), "AQI(%s) %d%s %s | 24h %d%s",
+                              AQIEngine::standardName(aqiEngine.getStandard()),
+                              now.index, now.provisional ? "*" : "", now.category,
+                              daily.index, daily.provisional ? "*" : "");
+        if (length > 0 && length < maxX - 4) {
+            int colorPair = AQIEngine::colorPair(now.level);
+            if (has_colors()) {
+                wattron(headerWin, COLOR_PAIR(colorPair) | A_BOLD);
+            }
+            mvwprintw(headerWin, 1, maxX - length - 2, "%s", summary);
+            if (has_colors()) {
+                wattroff(headerWin, COLOR_PAIR(colorPair) | A_BOLD);
+            }
+        }
+    }
     wrefresh(headerWin);
     
-    updateDataWindow();
-    updateStatsWindow();
-    updateStatusWindow();
+    {
+        ScopedLatency timer(sensorMetrics ? &sensorMetrics->render : nullptr);
+        TraceRecorder::record(TraceEvent::RedrawStart, 0);
+        updateDataWindow();
+        updateStatsWindow();
+        updatePercentileWindow();
+        updateStatusWindow();
+        updateDebugWindow();
+        updateChartWindow();
+        TraceRecorder::record(TraceEvent::RedrawEnd, 0);
+    }
+    
+    // Everything queued so far is now on screen
+    if (sensorMetrics) {
+        uint64_t now = MetricsRegistry::nowNs();
+        for (uint64_t decodedAt : pendingRender) {
+            sensorMetrics->queueWait.record(now - decodedAt);
+        }
+    }
+    pendingRender.clear();
 }
 
 void InteractiveTUI::updateDataWindow() {
@@ -269,18 +449,38 @@ void InteractiveTUI::updateDataWindow() {
     int maxLines = maxY - 11;
     
     for (auto it = readings.rbegin(); it != readings.rend() && line < maxLines; ++it, ++line) {
-        int colorPair = currentSensor->getColorCode(**it);
-        std::string quality = currentSensor->getQualityDescription(**it);
+        const RecentReading& reading = *it;
+        // Sensors the AQI engine understands are coloured by their NowCast index
+        int colorPair = reading.aqi.valid ? AQIEngine::colorPair(reading.aqi.level)
+                                          : currentSensor->getColorCode(*reading.data);
+        std::string quality = reading.aqi.valid ? reading.aqi.category
+                                                : currentSensor->getQualityDescription(*reading.data);
+        attr_t attributes = COLOR_PAIR(colorPair);
+        uint8_t outlier = reading.flags & (ReadingFlags::OutlierPM25 | ReadingFlags::OutlierPM10);
+        if (outlier) {
+            // Shown, but not part of any statistic
+            const char* which = (outlier == (ReadingFlags::OutlierPM25 | ReadingFlags::OutlierPM10)) ? "PM2.5, PM10"
+                              : (outlier & ReadingFlags::OutlierPM25) ? "PM2.5" : "PM10";
+            quality = std::string("Outlier (") + which + "), excluded";
+            attributes |= A_DIM;
+        }
         
         if (has_colors()) {
-            wattron(dataWin, COLOR_PAIR(colorPair));
+            wattron(dataWin, attributes);
         }
         
-        std::string displayStr = (*it)->getDisplayString() + "   " + quality;
+        // Frames were lost right before this reading
+        std::string displayStr = ((reading.flags & ReadingFlags::GapBefore) ? "[gap] " : "") +
+                                 reading.data->getDisplayString() + "   " + quality;
+        const CorrectedReading& correction = reading.correction;
+        if (correction.corrected) {
+            displayStr += "   RH " + AppUtils::formatFloat(correction.rh, 0) + "% -> " +
+                          AppUtils::formatFloat(correction.pm25) + " / " + AppUtils::formatFloat(correction.pm10);
+        }
         mvwprintw(dataWin, line, 2, "%s", displayStr.c_str());
         
         if (has_colors()) {
-            wattroff(dataWin, COLOR_PAIR(colorPair));
+            wattroff(dataWin, attributes);
         }
     }
     
@@ -296,46 +496,150 @@ void InteractiveTUI::updateStatsWindow() {
     if (has_colors()) {
         wattron(statsWin, COLOR_PAIR(4) | A_BOLD);
     }
-    mvwprintw(statsWin, 0, 2, "Statistics (last %zu readings)", readings.size());
+    if (outlierCount > 0) {
+        mvwprintw(statsWin, 0, 2, "Statistics (%zu readings, %zu outliers excluded)", history.size(), outlierCount);
+    } else {
+        mvwprintw(statsWin, 0, 2, "Statistics (%zu readings)", history.size());
+    }
     if (has_colors()) {
         wattroff(statsWin, COLOR_PAIR(4) | A_BOLD);
     }
     
-    // Calculate statistics (for SDS011 data)
-    if (!readings.empty()) {
-        const SDS011Data* first = dynamic_cast<const SDS011Data*>(readings[0].get());
-        if (first) {
-            float sumPM25 = 0, sumPM10 = 0;
-            float minPM25 = first->pm25, maxPM25 = first->pm25;
-            float minPM10 = first->pm10, maxPM10 = first->pm10;
-            
-            for (const auto& reading : readings) {
-                const SDS011Data* data = dynamic_cast<const SDS011Data*>(reading.get());
-                if (data) {
-                    sumPM25 += data->pm25;
-                    sumPM10 += data->pm10;
-                    minPM25 = std::min(minPM25, data->pm25);
-                    maxPM25 = std::max(maxPM25, data->pm25);
-                    minPM10 = std::min(minPM10, data->pm10);
-                    maxPM10 = std::max(maxPM10, data->pm10);
-                }
+    // Calculate statistics (for SDS011 data); the corrected columns equal the
+    // raw ones wherever humidity correction did not apply
+    if (!history.empty()) {
+        ColumnSummary pm25 = history.summarizeAll(HistoryColumn::PM25Corrected);
+        ColumnSummary pm10 = history.summarizeAll(HistoryColumn::PM10Corrected);
+        
+        mvwprintw(statsWin, 1, 2, "PM2.5: Avg %s Min %s Max %s", 
+                  AppUtils::formatFloat(pm25.mean()).c_str(),
+                  AppUtils::formatFloat(pm25.min).c_str(),
+                  AppUtils::formatFloat(pm25.max).c_str());
+        mvwprintw(statsWin, 2, 2, "PM10:  Avg %s Min %s Max %s", 
+                  AppUtils::formatFloat(pm10.mean()).c_str(),
+                  AppUtils::formatFloat(pm10.min).c_str(),
+                  AppUtils::formatFloat(pm10.max).c_str());
+    }
+    
+    wrefresh(statsWin);
+}
+
+void InteractiveTUI::updatePercentileWindow() {
+    if (!percentileWin || pm25Digest.count() == 0) return;
+    
+    wclear(percentileWin);
+    box(percentileWin, 0, 0);
+    
+    if (has_colors()) {
+        wattron(percentileWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    mvwprintw(percentileWin, 0, 2, "Percentiles (%.0f readings)", pm25Digest.count());
+    if (has_colors()) {
+        wattroff(percentileWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    
+    mvwprintw(percentileWin, 1, 2, "PM2.5: P50 %s P90 %s P98 %s",
+              AppUtils::formatFloat(pm25Digest.quantile(0.50)).c_str(),
+              AppUtils::formatFloat(pm25Digest.quantile(0.90)).c_str(),
+              AppUtils::formatFloat(pm25Digest.quantile(0.98)).c_str());
+    mvwprintw(percentileWin, 2, 2, "PM10:  P50 %s P90 %s P98 %s",
+              AppUtils::formatFloat(pm10Digest.quantile(0.50)).c_str(),
+              AppUtils::formatFloat(pm10Digest.quantile(0.90)).c_str(),
+              AppUtils::formatFloat(pm10Digest.quantile(0.98)).c_str());
+    
+    wrefresh(percentileWin);
+}
+
+void InteractiveTUI::updateChartWindow() {
+    if (!chartWin) return;
+    
+    wclear(chartWin);
+    box(chartWin, 0, 0);
+    
+    const int LABEL = 7;
+    const int HIST_ROWS = 4;
+    size_t columns = static_cast<size_t>(maxX - LABEL - 3);
+    int64_t spanMs = CHART_SPANS[chartSpan].spanMs;
+    int64_t endMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const char* const* blocks = unicodeBlocks ? BLOCKS : ASCII_BLOCKS;
+    
+    std::vector<TrendPoint> pm25, pm10;
+    trend.series(HistoryColumn::PM25, endMs, spanMs, columns, pm25);
+    trend.series(HistoryColumn::PM10, endMs, spanMs, columns, pm10);
+    
+    double max25 = 0.0, max10 = 0.0;
+    for (size_t i = 0; i < columns; ++i) {
+        if (pm25[i].count) max25 = std::max(max25, pm25[i].mean);
+        if (pm10[i].count) max10 = std::max(max10, pm10[i].mean);
+    }
+    
+    if (has_colors()) {
+        wattron(chartWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    mvwprintw(chartWin, 0, 2, "Trend %s, %s per bucket ('t' span, 'g' hide) | peak PM2.5 %s PM10 %s",
+              CHART_SPANS[chartSpan].label, formatDuration(trend.resolutionMs(spanMs, columns)).c_str(),
+              AppUtils::formatFloat(max25).c_str(), AppUtils::formatFloat(max10).c_str());
+    if (has_colors()) {
+        wattroff(chartWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    
+    // One sparkline per pollutant, coloured by the AQI category of each column
+    const struct {
+        const char* label;
+        Pollutant pollutant;
+        const std::vector<TrendPoint>* points;
+        double max;
+    } rows[] = {{"PM2.5", Pollutant::PM25, &pm25, max25}, {"PM10", Pollutant::PM10, &pm10, max10}};
+    for (int r = 0; r < 2; ++r) {
+        mvwprintw(chartWin, 1 + r, 2, "%-*s", LABEL - 1, rows[r].label);
+        wmove(chartWin, 1 + r, LABEL + 1);
+        for (size_t i = 0; i < columns; ++i) {
+            const TrendPoint& point = (*rows[r].points)[i];
+            if (point.count == 0 || rows[r].max <= 0.0) {
+                waddstr(chartWin, blocks[0]);
+                continue;
             }
-            
-            float avgPM25 = sumPM25 / readings.size();
-            float avgPM10 = sumPM10 / readings.size();
-            
-            mvwprintw(statsWin, 1, 2, "PM2.5: Avg %s Min %s Max %s", 
-                      AppUtils::formatFloat(avgPM25).c_str(),
-                      AppUtils::formatFloat(minPM25).c_str(),
-                      AppUtils::formatFloat(maxPM25).c_str());
-            mvwprintw(statsWin, 2, 2, "PM10:  Avg %s Min %s Max %s", 
-                      AppUtils::formatFloat(avgPM10).c_str(),
-                      AppUtils::formatFloat(minPM10).c_str(),
-                      AppUtils::formatFloat(maxPM10).c_str());
+            int level = 1 + static_cast<int>(point.mean / rows[r].max * 7.0 + 0.5);
+            int colorPair = AQIEngine::colorPair(
+                AQIEngine::classify(aqiEngine.getStandard(), rows[r].pollutant, point.mean).level);
+            if (has_colors()) wattron(chartWin, COLOR_PAIR(colorPair));
+            waddstr(chartWin, blocks[std::min(level, 8)]);
+            if (has_colors()) wattroff(chartWin, COLOR_PAIR(colorPair));
+        }
+    }
+    std::string ago = "-" + std::string(CHART_SPANS[chartSpan].label);
+    mvwprintw(chartWin, 3, LABEL + 1, "%s", ago.c_str());
+    mvwprintw(chartWin, 3, LABEL + 1 + static_cast<int>(columns) - 3, "now");
+    
+    // PM2.5 distribution over the same span, one bin per column
+    std::vector<uint32_t> bins(columns);
+    trend.histogram(HistoryColumn::PM25, endMs, spanMs, columns, max25 > 0.0 ? max25 * 1.0001 : 1.0, bins);
+    uint32_t tallest = bins.empty() ? 0 : *std::max_element(bins.begin(), bins.end());
+    mvwprintw(chartWin, 4, 2, "PM2.5");
+    mvwprintw(chartWin, 5, 2, "dist.");
+    for (int r = 0; r < HIST_ROWS; ++r) {
+        wmove(chartWin, 4 + r, LABEL + 1);
+        for (size_t i = 0; i < columns; ++i) {
+            int eighths = tallest ? static_cast<int>(static_cast<uint64_t>(bins[i]) * HIST_ROWS * 8 / tallest) : 0;
+            int fill = std::max(0, std::min(8, eighths - (HIST_ROWS - 1 - r) * 8));
+            if (fill == 0) {
+                waddstr(chartWin, blocks[0]);
+                continue;
+            }
+            double binCenter = (i + 0.5) * max25 / columns;
+            int colorPair = AQIEngine::colorPair(
+                AQIEngine::classify(aqiEngine.getStandard(), Pollutant::PM25, binCenter).level);
+            if (has_colors()) wattron(chartWin, COLOR_PAIR(colorPair));
+            waddstr(chartWin, blocks[fill]);
+            if (has_colors()) wattroff(chartWin, COLOR_PAIR(colorPair));
         }
     }
+    std::string top = AppUtils::formatFloat(max25) + " ug/m3";
+    mvwprintw(chartWin, 4 + HIST_ROWS, LABEL + 1, "0");
+    mvwprintw(chartWin, 4 + HIST_ROWS, LABEL + 1 + static_cast<int>(columns - top.size()), "%s", top.c_str());
     
-    wrefresh(statsWin);
+    wrefresh(chartWin);
 }
 
 void InteractiveTUI::updateStatusWindow() {
@@ -344,28 +648,116 @@ void InteractiveTUI::updateStatusWindow() {
     wclear(statusWin);
     box(statusWin, 0, 0);
     
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto tm = *std::localtime(&time_t);
+    uint64_t nowNs = SampleClock::nowNs();
+    HealthState state = health.state(nowNs);
+    int colorPair = (state == HealthState::Healthy) ? 5 : (state == HealthState::Degraded) ? 2 : 3;
     
     if (has_colors()) {
-        wattron(statusWin, COLOR_PAIR(5));
+        wattron(statusWin, COLOR_PAIR(colorPair));
+    }
+    
+    // Wall-clock times rather than ages: the screen is only redrawn on events
+    auto clockTime = [](uint64_t monotonicNs) {
+        std::time_t t = std::chrono::system_clock::to_time_t(SampleClock::toSystemTime(monotonicNs));
+        char text[16];
+        std::strftime(text, sizeof(text), "%H:%M:%S", std::localtime(&t));
+        return std::string(text);
+    };
+    if (!health.isConnected()) {
+        mvwprintw(statusWin, 1, 2, "Status: Disconnected | Reconnecting at %s (attempt %u) | Missed frames: %llu | Total readings: %zu",
+                 clockTime(health.getNextAttemptNs()).c_str(), health.getFailedAttempts() + 1,
+                 static_cast<unsigned long long>(health.getMissedFrames()), readings.size());
+    } else {
+        uint64_t lastGood = health.getLastGoodNs();
+        std::string last = lastGood ? clockTime(lastGood) : "never";
+        mvwprintw(statusWin, 1, 2, "Status: %s | Last frame: %s | Cadence: %.2f s | Missed frames: %llu | CRC errors: %.1f%% | Total readings: %zu",
+                 SensorHealth::stateName(state), last.c_str(), health.getCadenceNs() / 1e9,
+                 static_cast<unsigned long long>(health.getMissedFrames()), health.checksumErrorRate() * 100.0,
+                 readings.size());
     }
     
-    mvwprintw(statusWin, 1, 2, "Status: Active | Last update: %02d:%02d:%02d | Total readings: %zu",
-             tm.tm_hour, tm.tm_min, tm.tm_sec, readings.size());
-    
     if (has_colors()) {
-        wattroff(statusWin, COLOR_PAIR(5));
+        wattroff(statusWin, COLOR_PAIR(colorPair));
     }
     
     wrefresh(statusWin);
 }
 
-int InteractiveTUI::handleMenuInput() {
+void InteractiveTUI::updateDebugWindow() {
+    if (!debugWin || !sensorMetrics) return;
+    
+    wclear(debugWin);
+    box(debugWin, 0, 0);
+    
+    if (has_colors()) {
+        wattron(debugWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    mvwprintw(debugWin, 0, 2, "Pipeline metrics ('D' to hide)");
+    mvwprintw(debugWin, 1, 2, "%-12s %10s %10s %10s %10s %10s",
+              "Stage", "Count", "P50", "P90", "P99", "Max");
+    if (has_colors()) {
+        wattroff(debugWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    
+    struct Row {
+        const char* name;
+        const LatencyHistogram* histogram;
+    };
+    const Row rows[] = {
+        {"read()", &sensorMetrics->readSyscall},
+        {"parse", &sensorMetrics->frameParse},
+        {"assembly", &sensorMetrics->frameAssembly},
+        {"queue wait", &sensorMetrics->queueWait},
+        {"render", &sensorMetrics->render},
+    };
+    
+    int line = 2;
+    for (const Row& row : rows) {
+        mvwprintw(debugWin, line++, 2, "%-12s %10llu %10s %10s %10s %10s",
+                  row.name,
+                  static_cast<unsigned long long>(row.histogram->count()),
+                  AppUtils::formatDuration(row.histogram->valueAtPercentile(50)).c_str(),
+                  AppUtils::formatDuration(row.histogram->valueAtPercentile(90)).c_str(),
+                  AppUtils::formatDuration(row.histogram->valueAtPercentile(99)).c_str(),
+                  AppUtils::formatDuration(row.histogram->max()).c_str());
+    }
+    
+    uint64_t frames = sensorMetrics->framesAccepted.load();
+    mvwprintw(debugWin, line++, 2, "Bytes: %llu  Frames: %llu  Timeouts: %llu  I/O: %s, %.1f reads/frame",
+              static_cast<unsigned long long>(sensorMetrics->bytesRead.load()),
+              static_cast<unsigned long long>(frames),
+              static_cast<unsigned long long>(sensorMetrics->readTimeouts.load()),
+              sensorMetrics->ioProfile.load(),
+              frames ? static_cast<double>(sensorMetrics->readCalls.load()) / frames : 0.0);
+    mvwprintw(debugWin, line++, 2, "Checksum failures: %llu  Resync events: %llu",
+              static_cast<unsigned long long>(sensorMetrics->checksumFailures.load()),
+              static_cast<unsigned long long>(sensorMetrics->resyncEvents.load()));
+    
+    wrefresh(debugWin);
+}
+
+void InteractiveTUI::toggleDebugPanel() {
+    showDebugPanel = !showDebugPanel;
+    placeOverlayWindows();
+}
+
+void InteractiveTUI::placeOverlayWindows() {
+    if (debugWin) { delwin(debugWin); debugWin = nullptr; }
+    if (chartWin) { delwin(chartWin); chartWin = nullptr; }
+    
+    if (showDebugPanel && maxY >= 21) {
+        // Overlays the lower part of the data window
+        debugWin = newwin(11, maxX, maxY - 16, 0);
+    }
+    // Overlays the upper part; only when it does not collide with the debug panel
+    if (showChart && maxY >= (debugWin ? 29 : 18) && maxX >= 40) {
+        chartWin = newwin(10, maxX, 3, 0);
+    }
+}
+
+int InteractiveTUI::handleMenuInput(int ch) {
     static int selectedIndex = 0;
     
-    int ch = getch();
     switch (ch) {
         case 'q':
         case 'Q':
@@ -412,8 +804,7 @@ int InteractiveTUI::handleMenuInput() {
     return 0;
 }
 
-int InteractiveTUI::handleSensorInput() {
-    int ch = getch();
+int InteractiveTUI::handleSensorInput(int ch) {
     switch (ch) {
         case 'q':
         case 'Q':
@@ -424,17 +815,38 @@ int InteractiveTUI::handleSensorInput() {
             // Go back to menu
             inSensorMode = false;
             currentSensor.reset();
+            history.detach();       // the ring file keeps the sensor's history for later
             clearData();
             if (dataWin) { delwin(dataWin); dataWin = nullptr; }
             if (statsWin) { delwin(statsWin); statsWin = nullptr; }
+            if (percentileWin) { delwin(percentileWin); percentileWin = nullptr; }
+            if (debugWin) { delwin(debugWin); debugWin = nullptr; }
+            if (chartWin) { delwin(chartWin); chartWin = nullptr; }
             createWindows();
             break;
             
         case 'c':
         case 'C':
+            // Deliberately destructive: an attached ring file is emptied as well, unlike 'b'
             clearData();
             break;
             
+        case 'D':
+            // Hidden diagnostics panel
+            toggleDebugPanel();
+            break;
+            
+        case 'g':
+        case 'G':
+            showChart = !showChart;
+            placeOverlayWindows();
+            break;
+            
+        case 't':
+        case 'T':
+            chartSpan = (chartSpan + 1) % CHART_SPAN_COUNT;
+            break;
+            
         case KEY_RESIZE:
             getmaxyx(stdscr, maxY, maxX);
             createWindows();
@@ -456,12 +868,94 @@ bool InteractiveTUI::selectSensor(const SensorInfo& info) {
         return false;
     }
     
+    if (!captureFile.empty() && !currentSensor->enableCapture(captureFile)) {
+        showError("Failed to start capture to " + captureFile);
+    }
+    
+    sensorMetrics = &MetricsRegistry::instance().forSensor(info.port);
+    sensorPort = info.port;
+    health.reset();
+    health.onConnected(SampleClock::nowNs());
     clearData();
+    if (!historyFile.empty()) {
+        if (history.attach(historyFile, info.port)) {
+            restoreFromHistory();
+        } else {
+            showError("History file " + historyFile + " is in use or unusable; history kept in memory only");
+        }
+    }
     return true;
 }
 
+void InteractiveTUI::restoreFromHistory() {
+    // The columns are back as they were; only the derived views are recomputed from them
+    const uint8_t OUTLIER = ReadingFlags::OutlierPM25 | ReadingFlags::OutlierPM10;
+    const size_t recent = history.size() > MAX_READINGS ? history.size() - MAX_READINGS : 0;
+    size_t index = 0;
+    history.forEachSlice(0, history.size(), [&](const ReadingHistory::Chunk& chunk, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row, ++index) {
+            uint8_t flags = chunk.flags[row];
+            float pm25 = chunk.pm25_corrected_raw[row] / 10.0f;
+            float pm10 = chunk.pm10_corrected_raw[row] / 10.0f;
+            if (flags & OUTLIER) outlierCount++;
+            if (!(flags & ReadingFlags::OutlierPM25)) pm25Digest.add(pm25);
+            if (!(flags & ReadingFlags::OutlierPM10)) pm10Digest.add(pm10);
+            if (!(flags & OUTLIER)) {
+                aqiEngine.addReading(chunk.timestamp_ms[row] / 1000, pm25, pm10);
+                trend.add(chunk.timestamp_ms[row], pm25, pm10);
+            }
+            if (index < recent) continue;
+            
+            std::unique_ptr<SDS011Data> data(new SDS011Data(chunk.pm25_raw[row] / 10.0f, chunk.pm10_raw[row] / 10.0f));
+            data->timestamp = std::chrono::system_clock::time_point(std::chrono::milliseconds(chunk.timestamp_ms[row]));
+            CorrectedReading correction = CorrectedReading();
+            correction.pm25 = pm25;
+            correction.pm10 = pm10;
+            correction.corrected = (flags & ReadingFlags::HumidityCorrected) != 0;
+            correction.rh = correction.corrected ? chunk.humidity[row] : -1.0f;
+            readings.emplace_back(std::move(data), aqiEngine.nowCastAQI(), flags, correction);
+        }
+    });
+}
+
 void InteractiveTUI::addReading(std::unique_ptr<SensorData> data) {
-    readings.push_back(std::move(data));
+    const SDS011Data* sds = dynamic_cast<const SDS011Data*>(data.get());
+    uint8_t flags = 0;
+    CorrectedReading correction = CorrectedReading();
+    AQIResult aqi;
+    if (sds) {
+        pendingRender.push_back(sds->monotonic_ns);
+        int64_t timestampMs = sds->unixMs();
+        
+        // Outliers are kept in the history but feed none of the aggregates
+        flags = filter.process(timestampMs, sds->pm25, sds->pm10);
+        if (flags) {
+            outlierCount++;
+            if (sensorMetrics) sensorMetrics->outliers.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        // The filter judges the sensor's values, the aggregates use the corrected ones
+        correction = humidity.apply(timestampMs, sds->pm25, sds->pm10);
+        if (!(flags & ReadingFlags::OutlierPM25)) pm25Digest.add(correction.pm25);
+        if (!(flags & ReadingFlags::OutlierPM10)) pm10Digest.add(correction.pm10);
+        if (!flags) {
+            aqiEngine.addReading(std::chrono::system_clock::to_time_t(sds->timestamp), correction.pm25, correction.pm10);
+            trend.add(timestampMs, correction.pm25, correction.pm10);
+        }
+        aqi = aqiEngine.nowCastAQI();
+        
+        uint8_t rowFlags = flags;
+        uint32_t missed = health.onFrame(sds->monotonic_ns);
+        if (missed) {
+            rowFlags |= ReadingFlags::GapBefore;
+            if (sensorMetrics) sensorMetrics->missedFrames.fetch_add(missed, std::memory_order_relaxed);
+        }
+        history.append(ReadingHistory::makeRow(timestampMs, sds->pm25, sds->pm10, correction.pm25, correction.pm10,
+                                               correction.rh, rowFlags));
+        flags = rowFlags;
+    }
+    
+    readings.emplace_back(std::move(data), aqi, flags, correction);
     
     // Keep only the last MAX_READINGS
     if (readings.size() > MAX_READINGS) {
@@ -490,6 +984,14 @@ void InteractiveTUI::showError(const std::string& message) {
 
 void InteractiveTUI::clearData() {
     readings.clear();
+    pm25Digest.reset();
+    pm10Digest.reset();
+    aqiEngine.reset();
+    history.clear();
+    trend.reset();
+    filter.reset();
+    outlierCount = 0;
+    pendingRender.clear();
 }
 
 void InteractiveTUI::cleanup() {
@@ -497,7 +999,10 @@ void InteractiveTUI::cleanup() {
     if (menuWin) delwin(menuWin);
     if (dataWin) delwin(dataWin);
     if (statsWin) delwin(statsWin);
+    if (percentileWin) delwin(percentileWin);
     if (statusWin) delwin(statusWin);
+    if (debugWin) delwin(debugWin);
+    if (chartWin) delwin(chartWin);
     
     if (currentSensor) {
         currentSensor->cleanup();
@@ -0,0 +1,646 @@
+#include "io_backend.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#ifdef LINUX
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    const size_t READ_CHUNK = 256;
+
+    /**
+     * @brief Writes queued for one descriptor, submitted as one batch
+     */
+    struct WriteBatch {
+        std::string data;
+        bool sync;
+
+        WriteBatch() : sync(false) {}
+    };
+
+    // Readiness: epoll on Linux, poll() elsewhere
+    class ReadinessBackend : public IoBackend {
+    private:
+        int epoll_fd;
+        std::map<int, ReadHandler> readers;
+        std::map<int, WriteBatch> queued;
+
+        void flushWrites() {
+            for (auto& entry : queued) {
+                WriteBatch& batch = entry.second;
+                size_t done = 0;
+                while (done < batch.data.size()) {
+                    ssize_t n = write(entry.first, batch.data.data() + done, batch.data.size() - done);
+                    counters.syscalls++;
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        counters.writeErrors++;
+                        break;
+                    }
+                    done += static_cast<size_t>(n);
+                    counters.bytesWritten += static_cast<uint64_t>(n);
+                }
+                if (batch.sync && done == batch.data.size()) {
+                    counters.syscalls++;
+#ifdef LINUX
+                    bool synced = (fdatasync(entry.first) == 0);
+#else
+                    bool synced = (fsync(entry.first) == 0);
+#endif
+                    if (synced) {
+                        counters.syncs++;
+                    } else {
+                        counters.writeErrors++;
+                    }
+                }
+            }
+            queued.clear();
+        }
+
+        // One read() per ready descriptor; level-triggered, so leftovers come back
+        bool service(int fd) {
+            auto it = readers.find(fd);
+            if (it == readers.end()) {
+                return false;
+            }
+            unsigned char chunk[READ_CHUNK];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            counters.syscalls++;
+            int error = errno;
+            if (n < 0 && (error == EAGAIN || error == EWOULDBLOCK || error == EINTR)) {
+                return false;
+            }
+            ReadHandler handler = it->second;
+            if (n <= 0) {
+                removeReader(fd);
+                n = (n < 0) ? -error : 0;
+            } else {
+                counters.readCompletions++;
+                counters.bytesRead += static_cast<uint64_t>(n);
+            }
+            handler(chunk, n);
+            return true;
+        }
+
+    public:
+        ReadinessBackend() : epoll_fd(-1) {
+#ifdef LINUX
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+        }
+
+        ~ReadinessBackend() {
+            drainWrites();
+            if (epoll_fd >= 0) {
+                close(epoll_fd);
+            }
+        }
+
+        const char* name() const override { return epoll_fd >= 0 ? "epoll" : "poll"; }
+        int fd() const override { return epoll_fd; }
+
+        bool addReader(int fd, ReadHandler handler) override {
+            if (fd < 0) {
+                return false;
+            }
+#ifdef LINUX
+            if (epoll_fd >= 0) {
+                struct epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                int op = readers.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+                counters.syscalls++;
+                if (epoll_ctl(epoll_fd, op, fd, &event) != 0) {
+                    return false;
+                }
+            }
+#endif
+            readers[fd] = handler;
+            return true;
+        }
+
+        void removeReader(int fd) override {
+            if (!readers.erase(fd)) {
+                return;
+            }
+#ifdef LINUX
+            if (epoll_fd >= 0) {
+                counters.syscalls++;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+#endif
+        }
+
+        void queueWrite(int fd, const void* data, size_t length, bool sync) override {
+            WriteBatch& batch = queued[fd];
+            batch.data.append(static_cast<const char*>(data), length);
+            batch.sync = batch.sync || sync;
+        }
+
+        int runOnce(int timeoutMs) override {
+            flushWrites();
+
+            int handled = 0;
+#ifdef LINUX
+            if (epoll_fd >= 0) {
+                struct epoll_event events[256];
+                int ready = epoll_wait(epoll_fd, events, 256, timeoutMs);
+                counters.syscalls++;
+                for (int i = 0; i < ready; ++i) {
+                    handled += service(events[i].data.fd) ? 1 : 0;
+                }
+                return handled;
+            }
+#endif
+            std::vector<struct pollfd> fds;
+            for (const auto& entry : readers) {
+                fds.push_back({entry.first, POLLIN, 0});
+            }
+            int ready = poll(fds.data(), fds.size(), timeoutMs);
+            counters.syscalls++;
+            for (size_t i = 0; ready > 0 && i < fds.size(); ++i) {
+                if (fds[i].revents) {
+                    handled += service(fds[i].fd) ? 1 : 0;
+                }
+            }
+            return handled;
+        }
+
+        void drainWrites() override { flushWrites(); }
+    };
+
+#ifdef LINUX
+    // IORING_OP_READ_MULTISHOT (Linux 6.7) is newer than some installed kernel headers
+    const uint8_t OP_READ_MULTISHOT = 49;
+
+    const unsigned SQ_ENTRIES = 1024;
+    const unsigned CQ_ENTRIES = 8192;
+    const unsigned BUFFER_COUNT = 4096;     // provided buffers shared by all multishot reads
+    const uint16_t BUFFER_GROUP = 0;
+
+    // user_data: operation in the top byte, reader or batch id below
+    enum Operation : uint64_t { ReadOp = 1, WriteOp = 2, SyncOp = 3, CancelOp = 4, ProvideOp = 5 };
+
+    uint64_t tag(Operation op, uint64_t id) { return (static_cast<uint64_t>(op) << 56) | id; }
+
+    int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    unsigned loadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+    void storeRelease(unsigned* p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+    class UringBackend : public IoBackend {
+    private:
+        struct Reader {
+            int fd;
+            ReadHandler handler;
+            bool removed;
+            bool multishotArmed;                // outstanding request is a multishot read
+            std::vector<unsigned char> buffer;  // single-shot reads only
+
+            Reader() : fd(-1), removed(false), multishotArmed(false) {}
+        };
+
+        struct InFlight {
+            int fd;
+            WriteBatch batch;
+            int completions;    // CQEs still expected: the write, and the linked sync
+        };
+
+        int ring_fd;
+        void* sqRing;
+        size_t sqRingSize;
+        void* cqRing;
+        size_t cqRingSize;
+        struct io_uring_sqe* sqes;
+        size_t sqesSize;
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned* sqArray;
+        unsigned sqMask;
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned cqMask;
+        struct io_uring_cqe* cqes;
+        unsigned toSubmit;
+
+        unsigned char* bufferPool;  // null when multishot reads are unavailable
+        bool multishot;
+
+        std::map<uint64_t, Reader> readers;
+        std::map<int, uint64_t> readerIds;
+        uint64_t nextId;
+        std::map<int, WriteBatch> queued;
+        std::map<uint64_t, InFlight> inFlight;
+        std::map<int, uint64_t> batchOf;        // fd -> batch in flight; one at a time keeps order
+
+        struct io_uring_sqe* nextSqe() {
+            if (*sqTail - loadAcquire(sqHead) >= sqMask + 1) {
+                submit(0, 0);
+            }
+            unsigned tail = *sqTail;
+            unsigned index = tail & sqMask;
+            struct io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            return sqe;
+        }
+
+        void pushSqe() {
+            storeRelease(sqTail, *sqTail + 1);
+            toSubmit++;
+        }
+
+        int submit(unsigned minComplete, int timeoutMs) {
+            unsigned flags = 0;
+            struct __kernel_timespec ts;
+            struct io_uring_getevents_arg arg = {};
+            const void* argp = nullptr;
+            size_t argSize = 0;
+            if (minComplete > 0) {
+                flags |= IORING_ENTER_GETEVENTS;
+                if (timeoutMs >= 0) {
+                    ts.tv_sec = timeoutMs / 1000;
+                    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000LL;
+                    arg.sigmask_sz = _NSIG / 8;
+                    arg.ts = reinterpret_cast<uint64_t>(&ts);
+                    flags |= IORING_ENTER_EXT_ARG;
+                    argp = &arg;
+                    argSize = sizeof(arg);
+                }
+            }
+            if (toSubmit == 0 && minComplete == 0) {
+                return 0;
+            }
+            int submitted = ioUringEnter(ring_fd, toSubmit, minComplete, flags, argp, argSize);
+            counters.syscalls++;
+            if (submitted >= 0) {
+                toSubmit -= std::min<unsigned>(toSubmit, static_cast<unsigned>(submitted));
+            }
+            return submitted;
+        }
+
+        void armRead(uint64_t id, Reader& reader) {
+            struct io_uring_sqe* sqe = nextSqe();
+            sqe->fd = reader.fd;
+            sqe->off = static_cast<uint64_t>(-1);   // file position; ports have none
+            sqe->user_data = tag(ReadOp, id);
+            reader.multishotArmed = multishot;
+            if (multishot) {
+                sqe->opcode = OP_READ_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = BUFFER_GROUP;
+            } else {
+                reader.buffer.resize(READ_CHUNK);
+                sqe->opcode = IORING_OP_READ;
+                sqe->addr = reinterpret_cast<uint64_t>(reader.buffer.data());
+                sqe->len = static_cast<uint32_t>(reader.buffer.size());
+            }
+            pushSqe();
+        }
+
+        // Hand buffers [bid, bid + count) back to the kernel; rides along with the next submit
+        void provideBuffers(uint16_t bid, unsigned count) {
+            struct io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+            sqe->fd = static_cast<int>(count);
+            sqe->addr = reinterpret_cast<uint64_t>(bufferPool + static_cast<size_t>(bid) * READ_CHUNK);
+            sqe->len = READ_CHUNK;
+            sqe->off = bid;
+            sqe->buf_group = BUFFER_GROUP;
+            sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            sqe->user_data = tag(ProvideOp, bid);
+            pushSqe();
+        }
+
+        void submitWrites() {
+            for (auto it = queued.begin(); it != queued.end();) {
+                int fd = it->first;
+                if (batchOf.count(fd)) {
+                    ++it;   // the previous batch for this file is still being written
+                    continue;
+                }
+                uint64_t id = nextId++;
+                InFlight& flight = inFlight[id];
+                flight.fd = fd;
+                flight.batch.data.swap(it->second.data);
+                flight.batch.sync = it->second.sync;
+                flight.completions = flight.batch.sync ? 2 : 1;
+                batchOf[fd] = id;
+                it = queued.erase(it);
+
+                struct io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = fd;
+                sqe->off = static_cast<uint64_t>(-1);
+                sqe->addr = reinterpret_cast<uint64_t>(flight.batch.data.data());
+                sqe->len = static_cast<uint32_t>(flight.batch.data.size());
+                sqe->user_data = tag(WriteOp, id);
+                if (flight.batch.sync) {
+                    // The sync only starts once the write has completed in full
+                    sqe->flags = IOSQE_IO_LINK;
+                    pushSqe();
+                    sqe = nextSqe();
+                    sqe->opcode = IORING_OP_FSYNC;
+                    sqe->fd = fd;
+                    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                    sqe->user_data = tag(SyncOp, id);
+                }
+                pushSqe();
+            }
+        }
+
+        void completeWrite(uint64_t id, bool isSync, int result) {
+            auto it = inFlight.find(id);
+            if (it == inFlight.end()) {
+                return;
+            }
+            InFlight& flight = it->second;
+            if (!isSync) {
+                size_t written = result > 0 ? static_cast<size_t>(result) : 0;
+                counters.bytesWritten += written;
+                if (result < 0) {
+                    counters.writeErrors++;
+                } else if (written < flight.batch.data.size()) {
+                    // Short write: the linked sync is cancelled, resend the rest with it
+                    WriteBatch& rest = queued[flight.fd];
+                    rest.data.insert(0, flight.batch.data, written, std::string::npos);
+                    rest.sync = rest.sync || flight.batch.sync;
+                }
+            } else if (result == 0) {
+                counters.syncs++;
+            } else if (result != -ECANCELED) {
+                counters.writeErrors++;
+            }
+            if (--flight.completions == 0) {
+                batchOf.erase(flight.fd);
+                inFlight.erase(it);
+            }
+        }
+
+        // Returns true if a handler ran
+        bool completeRead(uint64_t id, const struct io_uring_cqe& cqe) {
+            bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            bool more = multishot && (cqe.flags & IORING_CQE_F_MORE);
+
+            auto it = readers.find(id);
+            if (it == readers.end()) {
+                if (hasBuffer) provideBuffers(bid, 1);
+                return false;
+            }
+            Reader& reader = it->second;
+            bool ran = false;
+
+            if (cqe.res > 0) {
+                const unsigned char* data = hasBuffer ? bufferPool + static_cast<size_t>(bid) * READ_CHUNK
+                                                      : reader.buffer.data();
+                counters.readCompletions++;
+                counters.bytesRead += static_cast<uint64_t>(cqe.res);
+                if (!reader.removed) {
+                    ReadHandler handler = reader.handler;
+                    handler(data, cqe.res);
+                    ran = true;
+                }
+                if (hasBuffer) provideBuffers(bid, 1);
+            } else if (reader.multishotArmed && (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)) {
+                // Kernel without multishot reads: re-arm with plain reads from now on
+                multishot = false;
+            } else if (cqe.res != -ENOBUFS && !reader.removed) {
+                // End of file or an error ends the reader; ENOBUFS only means the group
+                // ran dry, and the buffers go back ahead of the re-arm
+                ReadHandler handler = reader.handler;
+                readerIds.erase(reader.fd);
+                readers.erase(it);
+                handler(nullptr, cqe.res);
+                return true;
+            }
+
+            // A terminated request must be re-armed or, once cancelled, forgotten
+            it = readers.find(id);
+            if (it == readers.end() || more) {
+                return ran;
+            }
+            if (it->second.removed) {
+                readers.erase(it);
+            } else {
+                armRead(id, it->second);
+            }
+            return ran;
+        }
+
+        int reap() {
+            int handled = 0;
+            unsigned head = *cqHead;
+            while (true) {
+                unsigned tail = loadAcquire(cqTail);
+                if (head == tail) {
+                    break;
+                }
+                while (head != tail) {
+                    struct io_uring_cqe cqe = cqes[head & cqMask];
+                    head++;
+                    // Handlers may queue more work; release the slot first
+                    storeRelease(cqHead, head);
+                    uint64_t id = cqe.user_data & ((1ULL << 56) - 1);
+                    switch (static_cast<Operation>(cqe.user_data >> 56)) {
+                        case ReadOp:
+                            handled += completeRead(id, cqe) ? 1 : 0;
+                            break;
+                        case WriteOp:
+                            completeWrite(id, false, cqe.res);
+                            break;
+                        case SyncOp:
+                            completeWrite(id, true, cqe.res);
+                            break;
+                        case CancelOp:
+                        case ProvideOp:
+                            break;
+                    }
+                }
+            }
+            return handled;
+        }
+
+
+    public:
+        UringBackend() : ring_fd(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+                         sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqesSize(0), sqHead(nullptr),
+                         sqTail(nullptr), sqArray(nullptr), sqMask(0), cqHead(nullptr), cqTail(nullptr), cqMask(0),
+                         cqes(nullptr), toSubmit(0), bufferPool(nullptr), multishot(false), nextId(1) {}
+
+        ~UringBackend() {
+            if (ring_fd >= 0) {
+                // Finish the writes, whose buffers the kernel still uses; input is dropped
+                readers.clear();
+                readerIds.clear();
+                drainWrites();
+                close(ring_fd);
+            }
+            delete[] bufferPool;
+            if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        }
+
+        /**
+         * @brief Create the ring; false if the kernel lacks io_uring or a needed feature
+         */
+        bool open() {
+            struct io_uring_params params = {};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = CQ_ENTRIES;
+            ring_fd = ioUringSetup(SQ_ENTRIES, &params);
+            counters.syscalls++;
+            if (ring_fd < 0) {
+                return false;
+            }
+            // Writes at the file position, no dropped completions, and waits with a timeout
+            const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS |
+                                    IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+            if ((params.features & needed) != needed) {
+                return false;
+            }
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED) {
+                return false;
+            }
+            cqRing = sqRing;
+            sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED) {
+                return false;
+            }
+
+            char* sq = static_cast<char*>(sqRing);
+            sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            char* cq = static_cast<char*>(cqRing);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            // Multishot reads take their buffers from a group the kernel hands out; the
+            // group is filled by IORING_OP_PROVIDE_BUFFERS, which unlike registered
+            // buffer rings works on every kernel that has multishot reads
+            bufferPool = new unsigned char[BUFFER_COUNT * READ_CHUNK];
+            provideBuffers(0, BUFFER_COUNT);
+            multishot = true;
+            return true;
+        }
+
+        const char* name() const override { return "io_uring"; }
+        int fd() const override { return ring_fd; }
+
+        bool addReader(int fd, ReadHandler handler) override {
+            if (fd < 0) {
+                return false;
+            }
+            removeReader(fd);
+            uint64_t id = nextId++;
+            Reader& reader = readers[id];
+            reader.fd = fd;
+            reader.handler = handler;
+            readerIds[fd] = id;
+            armRead(id, reader);
+            return true;
+        }
+
+        void removeReader(int fd) override {
+            auto it = readerIds.find(fd);
+            if (it == readerIds.end()) {
+                return;
+            }
+            uint64_t id = it->second;
+            readerIds.erase(it);
+            readers[id].removed = true;
+            // The read's final completion (-ECANCELED) erases the reader
+            struct io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = tag(ReadOp, id);
+            sqe->user_data = tag(CancelOp, id);
+            pushSqe();
+        }
+
+        void queueWrite(int fd, const void* data, size_t length, bool sync) override {
+            WriteBatch& batch = queued[fd];
+            batch.data.append(static_cast<const char*>(data), length);
+            batch.sync = batch.sync || sync;
+        }
+
+        int runOnce(int timeoutMs) override {
+            submitWrites();
+            int handled = reap();
+            if (handled > 0 || timeoutMs == 0) {
+                submit(0, 0);
+                return handled + reap();
+            }
+            submit(1, timeoutMs);
+            return reap();
+        }
+
+        void drainWrites() override {
+            while (true) {
+                submitWrites();
+                if (inFlight.empty() && queued.empty()) {
+                    return;
+                }
+                if (submit(1, -1) < 0 && errno != EINTR && errno != ETIME) {
+                    return;
+                }
+                reap();
+            }
+        }
+    };
+#endif
+}
+
+std::unique_ptr<IoBackend> IoBackend::create(IoBackendKind kind) {
+#ifdef LINUX
+    if (kind != IoBackendKind::Readiness) {
+        std::unique_ptr<UringBackend> uring(new UringBackend());
+        if (uring->open()) {
+            return std::unique_ptr<IoBackend>(uring.release());
+        }
+    }
+#else
+    (void)kind;
+#endif
+    return std::unique_ptr<IoBackend>(new ReadinessBackend());
+}
+
+bool IoBackend::parseKind(const std::string& name, IoBackendKind& kind) {
+    if (name == "auto") {
+        kind = IoBackendKind::Auto;
+    } else if (name == "epoll" || name == "poll") {
+        kind = IoBackendKind::Readiness;
+    } else if (name == "uring" || name == "io_uring") {
+        kind = IoBackendKind::IoUring;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -2,11 +2,26 @@
 #include "sds011_tui.h"
 #include "interactive_tui.h"
 #include "app_utils.h"
+#include "trace_recorder.h"
+#include "capture_replayer.h"
+#include "metrics.h"
+#include "serial_port.h"
+#include "sensor_daemon.h"
+#include "sensor_registry.h"
+#include "sds011_plugin.h"
+#include "benchmarks.h"
+#include "sample_clock.h"
+#include "sensor_health.h"
+#include "device_lookup.h"
+#include "event_loop.h"
+#include "arrow_export.h"
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <chrono>
 #include <thread>
 #include <signal.h>
+#include <unistd.h>
 
 /**
  * @brief Console mode implementation
@@ -35,11 +50,11 @@ void runConsoleMode(SDS011Reader& sensor, const std::string& serial_port) {
     int reading_count = 0;
     while (g_running) {
         float pm25, pm10;
+        uint64_t arrivalNs = 0;
         
-        if (sensor.readPM25Data(pm25, pm10)) {
-            // Get current timestamp
-            auto now = std::chrono::system_clock::now();
-            auto time_t = std::chrono::system_clock::to_time_t(now);
+        if (sensor.readPM25Data(pm25, pm10, &arrivalNs)) {
+            // When the frame arrived, not when the retries and sleeps let us print it
+            auto time_t = std::chrono::system_clock::to_time_t(SampleClock::toSystemTime(arrivalNs));
             auto tm = *std::localtime(&time_t);
             
             // Print formatted data
@@ -70,9 +85,11 @@ void runConsoleMode(SDS011Reader& sensor, const std::string& serial_port) {
  * @brief TUI mode implementation
  * @param sensor The SDS011 sensor reader instance
  * @param serial_port The serial port being used
+ * @param standard AQI scale for colour coding
  */
-void runTUIMode(SDS011Reader& sensor, const std::string& serial_port) {
+void runTUIMode(SDS011Reader& sensor, const std::string& serial_port, AQIStandard standard) {
     SDS011TUI tui;
+    tui.setAQIStandard(standard);
     if (!tui.initialize()) {
         std::cerr << "Failed to initialize TUI. Falling back to console mode." << std::endl;
         runConsoleMode(sensor, serial_port);
@@ -81,52 +98,373 @@ void runTUIMode(SDS011Reader& sensor, const std::string& serial_port) {
     
     tui.drawHeader(serial_port);
     
-    // Main reading loop with TUI
-    while (g_running) {
-        float pm25, pm10;
-        
-        if (sensor.readPM25Data(pm25, pm10)) {
-            tui.addReading(pm25, pm10);
+    // One loop for keys, signals, frames and reconnects; it sleeps until one arrives
+    EventLoop events;
+    SensorHealth health;
+    DeviceWatcher devices;
+    bool quit = false;
+    health.onConnected(SampleClock::nowNs());
+    
+    events.watchSignals({SIGINT, SIGTERM, SIGWINCH}, [&](int signal) {
+        if (signal == SIGWINCH) {
+            tui.resize();
         } else {
-            tui.showError("Failed to read valid data from sensor");
+            quit = true;
+        }
+    });
+    events.watchReadable(STDIN_FILENO, [&]() {
+        if (tui.handleInput() == 1) {
+            quit = true;
+        }
+    });
+    events.watchReadable(devices.fd(), [&]() {
+        if (devices.wait(0)) {
+            health.onDeviceAdded(SampleClock::nowNs());
+        }
+    });
+    int healthTimer = events.addTimer([]() {});
+    
+    int watchedFd = -1;
+    auto readSensor = [&]() {
+        SDS011Frame frame;
+        if (sensor.readFrame(frame)) {
+            health.onFrame(frame.arrival_ns);
+            tui.addReading(frame.pm25(), frame.pm10(), SampleClock::toSystemTime(frame.arrival_ns));
+        }
+    };
+    
+    while (!quit) {
+        uint64_t now = SampleClock::nowNs();
+        if (health.isConnected() && (sensor.isLinkLost() || health.state(now) == HealthState::Stalled)) {
+            health.onDisconnected(now);
+            tui.showError("Sensor not responding, reconnecting...");
+        }
+        if (!health.isConnected() && health.reconnectDue(now)) {
+            if (sensor.reopen()) {
+                health.onConnected(now);
+            } else {
+                health.onConnectFailed(now);
+            }
         }
         
-        // Handle user input
+        int fd = health.isConnected() ? sensor.getFd() : -1;
+        if (fd != watchedFd) {
+            events.unwatch(watchedFd);
+            events.watchReadable(fd, readSensor);
+            watchedFd = fd;
+        }
+        events.armTimer(healthTimer, health.nextChangeNs(now));
+        events.runOnce();
+    }
+}
+
+/**
+ * @brief Headless daemon mode implementation
+ * @param options Parsed command line options
+ * @return Process exit code
+ */
+int runDaemonMode(const AppOptions& options) {
+    DaemonConfig config;
+    config.socket_path = options.socket_path;
+    config.data_file = options.data_file;
+    config.store_directory = options.store_directory;
+    config.export_dir = options.export_dir;
+    config.retention = options.retention;
+    config.wal = options.wal;
+    config.aqi_standard = options.aqi_standard;
+    config.filter = options.filter;
+    config.humidity_source = options.humidity_source;
+    config.humidity = options.humidity_model;
+    config.io_backend = options.io_backend;
+    config.alert_rules = options.alert_rules;
+    config.alert_sink = options.alert_sink;
+    config.ports = options.sensor_ports;
+    if (options.port_specified) {
+        config.ports.push_back(options.serial_port);
+    }
+    
+    if (config.ports.empty()) {
+        SensorRegistry registry;
+        registry.registerPlugin(std::unique_ptr<SensorPlugin>(new SDS011Plugin()));
+        for (const SensorInfo& info : registry.discoverSensors()) {
+            if (info.available) {
+                config.ports.push_back(info.port);
+            }
+        }
+        if (config.ports.empty()) {
+            std::cerr << "No sensors found; use --sensor PORT" << std::endl;
+            return 1;
+        }
+    }
+    
+    SensorDaemon daemon(config);
+    if (!daemon.start()) {
+        return 1;
+    }
+    daemon.run();
+    std::cout << "Daemon stopped" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Attach the legacy TUI to a running daemon
+ * @param options Parsed command line options
+ * @return Process exit code
+ */
+int runAttachMode(const AppOptions& options) {
+    ControlClient client;
+    if (!client.connect(options.socket_path)) {
+        std::cerr << "Cannot connect to daemon at " << options.socket_path << std::endl;
+        return 1;
+    }
+    
+    // Without an explicit port, follow the first sensor the daemon knows about
+    std::string sensor = options.port_specified ? options.serial_port : "";
+    std::string line;
+    if (sensor.empty()) {
+        client.send("SENSORS");
+        while (client.readLine(line, 2000) && line != "OK") {
+            std::istringstream iss(line);
+            std::string tag, id;
+            if (iss >> tag >> id && tag == "SENSOR" && sensor.empty()) {
+                sensor = id;
+            }
+        }
+        if (sensor.empty()) {
+            std::cerr << "Daemon has no sensors" << std::endl;
+            return 1;
+        }
+    }
+    
+    if (!client.send("SUBSCRIBE " + sensor) || !client.readLine(line, 2000) || line != "OK") {
+        std::cerr << "Daemon refused subscription to " << sensor << std::endl;
+        return 1;
+    }
+    
+    SDS011TUI tui;
+    tui.setAQIStandard(options.aqi_standard);
+    if (!tui.initialize()) {
+        std::cerr << "Failed to initialize TUI" << std::endl;
+        return 1;
+    }
+    tui.drawHeader(sensor + " (daemon)");
+    
+    // Leaving only closes our connection; the daemon keeps sampling
+    EventLoop events;
+    bool quit = false;
+    events.watchSignals({SIGINT, SIGTERM, SIGWINCH}, [&](int signal) {
+        if (signal == SIGWINCH) {
+            tui.resize();
+        } else {
+            quit = true;
+        }
+    });
+    events.watchReadable(STDIN_FILENO, [&]() {
         if (tui.handleInput() == 1) {
-            break; // User pressed 'q'
+            quit = true;
+        }
+    });
+    int socketFd = client.getFd();
+    events.watchReadable(socketFd, [&]() {
+        while (client.readLine(line, 0)) {
+            DaemonReading reading;
+            if (DaemonReading::fromLine(line, reading)) {
+                tui.addReading(reading.pm25, reading.pm10,
+                               std::chrono::system_clock::time_point(std::chrono::milliseconds(reading.timestamp_ms)));
+            }
+        }
+        if (!client.isConnected()) {
+            events.unwatch(socketFd);
+            tui.showError("Lost connection to daemon");
         }
+    });
+    
+    while (!quit) {
+        events.runOnce();
+    }
+    return 0;
+}
+
+/**
+ * @brief Export a history ring file as an Arrow IPC file
+ * @param options Parsed options with history_file, export_file and export_filter set
+ * @return Process exit code
+ */
+int runArrowExport(const AppOptions& options) {
+    if (options.history_file.empty()) {
+        std::cerr << "--export-arrow reads the history ring given with --history-file" << std::endl;
+        return 1;
+    }
+    
+    // Read into memory: the ring may belong to a running TUI, which keeps writing it
+    ReadingHistory history;
+    std::string sensor;
+    if (!history.load(options.history_file, &sensor)) {
+        return 1;
+    }
+    
+    std::vector<std::pair<std::string, const ReadingHistory*>> histories;
+    histories.push_back(std::make_pair(sensor, &history));
+    uint64_t rows = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (!ArrowWriter::exportHistories(options.export_file, histories, options.export_filter, &rows)) {
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Exported " << rows << " readings of " << (sensor.empty() ? "unnamed sensor" : sensor) << " to "
+              << options.export_file << " in " << std::fixed << std::setprecision(1) << ms << " ms" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Read the same sensor with every serial I/O profile and compare latency
+ * @param serial_port The serial port to probe
+ * @param frames Number of frames to collect per profile
+ * @return true if every profile could open the port
+ */
+bool runIOProfileProbe(const std::string& serial_port, int frames) {
+    static const SerialIOProfile PROFILES[] = {
+        SerialIOProfile::Timed, SerialIOProfile::FrameBlocking,
+        SerialIOProfile::Poll, SerialIOProfile::LowLatency
+    };
+    
+    std::cout << "Probing serial I/O profiles on " << serial_port
+              << " (" << frames << " frames each)" << std::endl;
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(12) << "Profile" << std::right
+              << std::setw(8) << "Frames"
+              << std::setw(12) << "Asm P50"
+              << std::setw(12) << "Asm P99"
+              << std::setw(12) << "read() P50"
+              << std::setw(12) << "Reads/frame"
+              << std::setw(10) << "Timeouts" << std::endl;
+    std::cout << std::string(78, '-') << std::endl;
+    
+    SerialIOProfile original = SerialPort::profileFor(serial_port);
+    SensorMetrics& metrics = MetricsRegistry::instance().forSensor(serial_port);
+    bool ok = true;
+    
+    for (SerialIOProfile profile : PROFILES) {
+        if (!g_running) break;
         
-        // Wait before next reading
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        SerialPort::setProfile(serial_port, profile);
+        SDS011Reader sensor(serial_port);
+        if (!sensor.initialize()) {
+            ok = false;
+            break;
+        }
+        metrics.reset();
+        
+        SDS011Frame frame;
+        int collected = 0;
+        int attempts = 0;
+        while (g_running && collected < frames && attempts < frames * 3) {
+            attempts++;
+            if (sensor.readFrame(frame)) {
+                collected++;
+            }
+        }
+        
+        uint64_t accepted = metrics.framesAccepted.load();
+        double readsPerFrame = accepted ? static_cast<double>(metrics.readCalls.load()) / accepted : 0.0;
+        std::cout << std::left << std::setw(12) << SerialPort::profileName(profile) << std::right
+                  << std::setw(8) << collected
+                  << std::setw(12) << AppUtils::formatDuration(metrics.frameAssembly.valueAtPercentile(50))
+                  << std::setw(12) << AppUtils::formatDuration(metrics.frameAssembly.valueAtPercentile(99))
+                  << std::setw(12) << AppUtils::formatDuration(metrics.readSyscall.valueAtPercentile(50))
+                  << std::setw(12) << std::fixed << std::setprecision(1) << readsPerFrame
+                  << std::setw(10) << metrics.readTimeouts.load() << std::endl;
     }
+    
+    SerialPort::setProfile(serial_port, original);
+    std::cout << std::endl;
+    std::cout << "Asm = first byte of a frame returned by read() until the frame is decoded" << std::endl;
+    return ok;
 }
 
 int main(int argc, char* argv[]) {
-    std::string serial_port;
-    bool use_tui;
-    bool use_interactive = true;
+    AppOptions options;
     
     // Parse command line arguments
-    if (!AppUtils::parseArguments(argc, argv, serial_port, use_tui)) {
+    if (!AppUtils::parseArguments(argc, argv, options)) {
         return 0; // Help was displayed
     }
     
-    // Check for legacy mode flag
-    for (int i = 1; i < argc; ++i) {
-        if (std::string(argv[i]) == "--legacy") {
-            use_interactive = false;
-            break;
+    const std::string& serial_port = options.serial_port;
+    bool use_tui = options.use_tui;
+    bool use_interactive = options.use_interactive;
+    
+    for (const auto& entry : options.io_profiles) {
+        SerialPort::setProfile(entry.first, entry.second);
+    }
+    
+    // Offline trace conversion does not touch any sensor
+    if (!options.trace_json_input.empty()) {
+        return TraceRecorder::convertToChromeJson(options.trace_json_input,
+                                                  options.trace_json_output) ? 0 : 1;
+    }
+    
+    if (!options.benchmark.empty()) {
+        if (!Benchmarks::run(options.benchmark, std::cout)) {
+            std::cerr << "Unknown benchmark '" << options.benchmark << "'; available:";
+            for (const std::string& name : Benchmarks::names()) {
+                std::cerr << " " << name;
+            }
+            std::cerr << " all" << std::endl;
+            return 1;
         }
+        return 0;
+    }
+    
+    if (!options.export_file.empty()) {
+        return runArrowExport(options);
+    }
+    
+    ScopedTraceSession traceSession;
+    if (!options.trace_file.empty() && !TraceRecorder::start(options.trace_file)) {
+        return 1;
     }
     
     // Set up signal handlers for graceful shutdown
     signal(SIGINT, AppUtils::signalHandler);
     signal(SIGTERM, AppUtils::signalHandler);
     
+    if (!options.replay_file.empty()) {
+        CaptureReplayer replayer(options.replay_file, options.replay_real_time);
+        if (!replayer.load()) {
+            return 1;
+        }
+        
+        ReplayReport report;
+        bool completed = replayer.run(report);
+        CaptureReplayer::printReport(report, std::cout);
+        return (completed && report.mismatches == 0) ? 0 : 1;
+    }
+    
+    if (options.daemon_mode) {
+        return runDaemonMode(options);
+    }
+    
+    if (options.attach) {
+        return runAttachMode(options);
+    }
+    
+    if (options.probe_frames > 0) {
+        return runIOProfileProbe(serial_port, options.probe_frames) ? 0 : 1;
+    }
+    
     if (use_interactive && use_tui) {
         // New interactive mode
         std::cout << "Initializing interactive TUI..." << std::endl;
         InteractiveTUI interactive;
+        interactive.setCaptureFile(options.capture_file);
+        interactive.setHistoryFile(options.history_file);
+        interactive.setAQIStandard(options.aqi_standard);
+        interactive.setFilterConfig(options.filter);
+        if (!options.humidity_source.empty() &&
+            !interactive.setHumiditySource(options.humidity_source, options.humidity_model)) {
+            return 1;
+        }
         if (!interactive.initialize()) {
             std::cerr << "Failed to initialize interactive TUI. Falling back to legacy mode." << std::endl;
             use_interactive = false;
@@ -150,9 +488,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if (!options.capture_file.empty() && !sensor.enableCapture(options.capture_file)) {
+        return 1;
+    }
+    
     // Run in appropriate mode
     if (use_tui) {
-        runTUIMode(sensor, serial_port);
+        runTUIMode(sensor, serial_port, options.aqi_standard);
     } else {
         runConsoleMode(sensor, serial_port);
     }
@@ -0,0 +1,243 @@
+#include "metrics.h"
+#include "sample_clock.h"
+#include <chrono>
+#include <limits>
+
+// LatencyHistogram implementation
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+int LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<int>(value);
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > MAX_MAGNITUDE) {
+        return BUCKET_COUNT - 1;
+    }
+
+    int shift = msb - SUB_BUCKET_BITS;
+    int sub = static_cast<int>(value >> shift);   // in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+    return (shift + 1) * SUB_BUCKETS + (sub - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<uint64_t>(index);
+    }
+
+    int shift = index / SUB_BUCKETS - 1;
+    uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS + SUB_BUCKETS);
+    return sub << shift;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = minValue.load(std::memory_order_relaxed);
+    while (value < current &&
+           !minValue.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+
+    current = maxValue.load(std::memory_order_relaxed);
+    while (value > current &&
+           !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::min() const {
+    return count() == 0 ? 0 : minValue.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+}
+
+uint64_t LatencyHistogram::valueAtPercentile(double percentile) const {
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+
+    uint64_t target = static_cast<uint64_t>(percentile / 100.0 * n + 0.5);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            // Report the bucket midpoint, clamped to the observed range
+            uint64_t low = bucketLowerBound(i);
+            uint64_t high = (i + 1 < BUCKET_COUNT) ? bucketLowerBound(i + 1) : low + 1;
+            uint64_t value = low + (high - low) / 2;
+            if (value > max()) value = max();
+            if (value < min()) value = min();
+            return value;
+        }
+    }
+
+    return max();
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    minValue.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+// SensorMetrics implementation
+SensorMetrics::SensorMetrics() : ioProfile("none") {
+    reset();
+}
+
+void SensorMetrics::reset() {
+    readSyscall.reset();
+    frameParse.reset();
+    frameAssembly.reset();
+    queueWait.reset();
+    render.reset();
+
+    readCalls.store(0, std::memory_order_relaxed);
+    bytesRead.store(0, std::memory_order_relaxed);
+    framesAccepted.store(0, std::memory_order_relaxed);
+    checksumFailures.store(0, std::memory_order_relaxed);
+    resyncEvents.store(0, std::memory_order_relaxed);
+    readTimeouts.store(0, std::memory_order_relaxed);
+    outliers.store(0, std::memory_order_relaxed);
+    missedFrames.store(0, std::memory_order_relaxed);
+    reconnects.store(0, std::memory_order_relaxed);
+    busDropped.store(0, std::memory_order_relaxed);
+}
+
+// MetricsRegistry implementation
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+SensorMetrics& MetricsRegistry::forSensor(const std::string& sensorId) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::unique_ptr<SensorMetrics>& entry = sensors[sensorId];
+    if (!entry) {
+        entry.reset(new SensorMetrics());
+    }
+    return *entry;
+}
+
+std::vector<std::pair<std::string, const SensorMetrics*>> MetricsRegistry::list() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<std::pair<std::string, const SensorMetrics*>> result;
+    for (const auto& pair : sensors) {
+        result.push_back(std::make_pair(pair.first, pair.second.get()));
+    }
+    return result;
+}
+
+namespace {
+    std::string sensorLabel(const std::string& sensor) {
+        return "sensor=\"" + sensor + "\"";
+    }
+
+    void writeHistogram(std::ostream& out, const char* name, const std::string& labels,
+                        const LatencyHistogram& histogram) {
+        static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+        for (double q : QUANTILES) {
+            out << name << "{" << labels << ",quantile=\"" << q << "\"} "
+                << histogram.valueAtPercentile(q * 100.0) / 1e9 << "\n";
+        }
+        out << name << "_sum{" << labels << "} " << histogram.sumOfValues() / 1e9 << "\n";
+        out << name << "_count{" << labels << "} " << histogram.count() << "\n";
+    }
+
+    void writeCounter(std::ostream& out, const char* name, const std::string& sensor,
+                      const std::atomic<uint64_t>& counter) {
+        out << name << "{" << sensorLabel(sensor) << "} "
+            << counter.load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+void MetricsRegistry::exportText(std::ostream& out) const {
+    auto entries = list();
+
+    out << "# TYPE sensor_read_syscall_seconds summary\n";
+    for (const auto& entry : entries) {
+        writeHistogram(out, "sensor_read_syscall_seconds", sensorLabel(entry.first), entry.second->readSyscall);
+    }
+    out << "# TYPE sensor_frame_parse_seconds summary\n";
+    for (const auto& entry : entries) {
+        writeHistogram(out, "sensor_frame_parse_seconds", sensorLabel(entry.first), entry.second->frameParse);
+    }
+    out << "# TYPE sensor_frame_assembly_seconds summary\n";
+    for (const auto& entry : entries) {
+        std::string labels = sensorLabel(entry.first) + ",profile=\"" + entry.second->ioProfile.load() + "\"";
+        writeHistogram(out, "sensor_frame_assembly_seconds", labels, entry.second->frameAssembly);
+    }
+    out << "# TYPE sensor_queue_wait_seconds summary\n";
+    for (const auto& entry : entries) {
+        writeHistogram(out, "sensor_queue_wait_seconds", sensorLabel(entry.first), entry.second->queueWait);
+    }
+    out << "# TYPE sensor_render_seconds summary\n";
+    for (const auto& entry : entries) {
+        writeHistogram(out, "sensor_render_seconds", sensorLabel(entry.first), entry.second->render);
+    }
+
+    out << "# TYPE sensor_read_calls_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_read_calls_total", entry.first, entry.second->readCalls);
+    }
+    out << "# TYPE sensor_bytes_read_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_bytes_read_total", entry.first, entry.second->bytesRead);
+    }
+    out << "# TYPE sensor_frames_accepted_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_frames_accepted_total", entry.first, entry.second->framesAccepted);
+    }
+    out << "# TYPE sensor_checksum_failures_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_checksum_failures_total", entry.first, entry.second->checksumFailures);
+    }
+    out << "# TYPE sensor_resync_events_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_resync_events_total", entry.first, entry.second->resyncEvents);
+    }
+    out << "# TYPE sensor_read_timeouts_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_read_timeouts_total", entry.first, entry.second->readTimeouts);
+    }
+    out << "# TYPE sensor_outliers_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_outliers_total", entry.first, entry.second->outliers);
+    }
+    out << "# TYPE sensor_missed_frames_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_missed_frames_total", entry.first, entry.second->missedFrames);
+    }
+    out << "# TYPE sensor_reconnects_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_reconnects_total", entry.first, entry.second->reconnects);
+    }
+    out << "# TYPE sensor_bus_dropped_total counter\n";
+    for (const auto& entry : entries) {
+        writeCounter(out, "sensor_bus_dropped_total", entry.first, entry.second->busDropped);
+    }
+}
+
+uint64_t MetricsRegistry::nowNs() {
+    return SampleClock::nowNs();
+}
@@ -0,0 +1,203 @@
+#include "outlier_filter.h"
+#include "reading_history.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+// FilterConfig implementation
+bool FilterConfig::parse(const std::string& spec, FilterConfig& config) {
+    FilterConfig result;
+    if (spec == "off" || spec == "none") {
+        result.enabled = false;
+        config = result;
+        return true;
+    }
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string text = item.substr(equals + 1);
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || value < 0.0) {
+            return false;
+        }
+
+        if (key == "window") {
+            if (value > HampelFilter::MAX_WINDOW || value != std::floor(value)) return false;
+            result.window = static_cast<size_t>(value);
+        } else if (key == "threshold") {
+            result.threshold = value;
+        } else if (key == "min") {
+            result.minDeviation = static_cast<float>(value);
+        } else if (key == "rate") {
+            result.maxRatePerSecond = static_cast<float>(value);
+        } else if (key == "ceiling") {
+            result.ceiling = static_cast<float>(value);
+        } else {
+            return false;
+        }
+    }
+
+    config = result;
+    return true;
+}
+
+std::string FilterConfig::toString() const {
+    if (!enabled) {
+        return "off";
+    }
+    std::ostringstream oss;
+    oss << "window=" << window << ",threshold=" << threshold << ",min=" << minDeviation
+        << ",rate=" << maxRatePerSecond << ",ceiling=" << ceiling;
+    return oss.str();
+}
+
+// CeilingFilter implementation
+bool CeilingFilter::inspect(int64_t, float value) {
+    return ceiling > 0.0f && value >= ceiling;
+}
+
+// HampelFilter implementation
+const size_t HampelFilter::MAX_WINDOW;
+
+HampelFilter::HampelFilter(size_t windowSize, double thresholdMads, float minimumDeviation)
+    : window(std::min(std::max<size_t>(windowSize, 1), MAX_WINDOW)), threshold(thresholdMads),
+      minDeviation(minimumDeviation) {
+    reset();
+}
+
+void HampelFilter::reset() {
+    count = 0;
+    next = 0;
+}
+
+bool HampelFilter::inspect(int64_t, float value) {
+    bool outlier = false;
+
+    // Judge against the previous samples once at least half a window is known
+    if (count > window / 2) {
+        size_t middle = count / 2;
+        float median = (count % 2) ? sorted[middle] : 0.5f * (sorted[middle - 1] + sorted[middle]);
+
+        // Deviations grow outwards from the median on both sides of the sorted window;
+        // merging the two sides finds the middle one without sorting them
+        size_t right = std::lower_bound(sorted, sorted + count, median) - sorted;
+        size_t left = right;
+        float mad = 0.0f;
+        for (size_t taken = 0; taken <= middle; ++taken) {
+            bool useLeft = (right == count) ||
+                           (left > 0 && median - sorted[left - 1] <= sorted[right] - median);
+            mad = useLeft ? median - sorted[--left] : sorted[right++] - median;
+        }
+        double limit = std::max(threshold * 1.4826 * mad, static_cast<double>(minDeviation));
+        outlier = std::fabs(value - median) > limit;
+    }
+
+    // Slide the window: the new sample takes the oldest one's place in the
+    // sorted copy and is moved left or right until the order holds again
+    size_t position;
+    if (count == window) {
+        position = std::lower_bound(sorted, sorted + count, arrivals[next]) - sorted;
+    } else {
+        position = count++;
+    }
+    while (position > 0 && sorted[position - 1] > value) {
+        sorted[position] = sorted[position - 1];
+        position--;
+    }
+    while (position + 1 < count && sorted[position + 1] < value) {
+        sorted[position] = sorted[position + 1];
+        position++;
+    }
+    sorted[position] = value;
+    arrivals[next] = value;
+    if (++next == window) next = 0;
+
+    return outlier;
+}
+
+// RateOfChangeFilter implementation
+RateOfChangeFilter::RateOfChangeFilter(float maxRate, float minimumDeviation, size_t reanchor)
+    : maxRatePerSecond(maxRate), minDeviation(minimumDeviation), reanchorAfter(std::max<size_t>(reanchor, 1)) {
+    reset();
+}
+
+void RateOfChangeFilter::reset() {
+    hasLast = false;
+    lastTimestampMs = 0;
+    lastValue = 0.0f;
+    rejected = 0;
+}
+
+bool RateOfChangeFilter::inspect(int64_t timestampMs, float value) {
+    if (hasLast) {
+        // Readings closer than the sensor's 1 s cadence still get a full second's allowance
+        double seconds = std::max(1.0, (timestampMs - lastTimestampMs) / 1000.0);
+        double change = std::fabs(value - lastValue);
+        if (change > minDeviation && change / seconds > maxRatePerSecond && ++rejected < reanchorAfter) {
+            return true;
+        }
+    }
+
+    hasLast = true;
+    lastTimestampMs = timestampMs;
+    lastValue = value;
+    rejected = 0;
+    return false;
+}
+
+// FilterPipeline implementation
+FilterPipeline::FilterPipeline(const FilterConfig& cfg) {
+    configure(cfg);
+}
+
+void FilterPipeline::configure(const FilterConfig& cfg) {
+    config = cfg;
+    for (auto& filters : channels) {
+        filters.clear();
+        if (!config.enabled) continue;
+
+        if (config.ceiling > 0.0f) {
+            filters.push_back(std::unique_ptr<SampleFilter>(new CeilingFilter(config.ceiling)));
+        }
+        if (config.window > 0) {
+            filters.push_back(std::unique_ptr<SampleFilter>(
+                new HampelFilter(config.window, config.threshold, config.minDeviation)));
+        }
+        if (config.maxRatePerSecond > 0.0f) {
+            size_t reanchor = std::max<size_t>(config.window / 2 + 1, 3);
+            filters.push_back(std::unique_ptr<SampleFilter>(
+                new RateOfChangeFilter(config.maxRatePerSecond, config.minDeviation, reanchor)));
+        }
+    }
+}
+
+uint8_t FilterPipeline::process(int64_t timestampMs, float pm25, float pm10) {
+    const float values[2] = {pm25, pm10};
+    const uint8_t bits[2] = {ReadingFlags::OutlierPM25, ReadingFlags::OutlierPM10};
+    uint8_t flags = 0;
+
+    for (int c = 0; c < 2; ++c) {
+        for (const auto& filter : channels[c]) {
+            if (filter->inspect(timestampMs, values[c])) {
+                flags |= bits[c];
+            }
+        }
+    }
+    return flags;
+}
+
+void FilterPipeline::reset() {
+    for (auto& filters : channels) {
+        for (const auto& filter : filters) {
+            filter->reset();
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include "raw_capture.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+    const char CAPTURE_MAGIC[8] = {'S', 'D', 'S', 'R', 'A', 'W', '0', '1'};
+
+    struct RecordHeader {
+        uint64_t timestamp_ns;
+        uint16_t type;
+        uint16_t length;
+        uint32_t reserved;
+    };
+}
+
+// RawCaptureWriter implementation
+bool RawCaptureWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error opening capture file: " << path << std::endl;
+        return false;
+    }
+
+    file.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    return true;
+}
+
+void RawCaptureWriter::writeRecord(uint64_t timestampNs, CaptureRecord::Type type,
+                                   const unsigned char* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) {
+        return;
+    }
+
+    RecordHeader header = {timestampNs, static_cast<uint16_t>(type),
+                           static_cast<uint16_t>(length), 0};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data), length);
+}
+
+void RawCaptureWriter::writeBytes(uint64_t timestampNs, const unsigned char* data, size_t length) {
+    if (length > 0) {
+        writeRecord(timestampNs, CaptureRecord::Bytes, data, length);
+    }
+}
+
+void RawCaptureWriter::writeFrame(uint64_t timestampNs, uint16_t pm25Raw, uint16_t pm10Raw) {
+    unsigned char payload[4] = {
+        static_cast<unsigned char>(pm25Raw & 0xFF), static_cast<unsigned char>(pm25Raw >> 8),
+        static_cast<unsigned char>(pm10Raw & 0xFF), static_cast<unsigned char>(pm10Raw >> 8)
+    };
+    writeRecord(timestampNs, CaptureRecord::Frame, payload, sizeof(payload));
+    
+    // Frames arrive about once a second; keep the file usable if we crash
+    std::lock_guard<std::mutex> lock(mutex);
+    file.flush();
+}
+
+void RawCaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file.is_open()) {
+        file.close();
+    }
+}
+
+// RawCaptureReader implementation
+bool RawCaptureReader::open(const std::string& path) {
+    file.open(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error opening capture file: " << path << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << "Not a capture file: " << path << std::endl;
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool RawCaptureReader::next(CaptureRecord& record) {
+    RecordHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    record.timestamp_ns = header.timestamp_ns;
+    record.type = static_cast<CaptureRecord::Type>(header.type);
+    record.payload.resize(header.length);
+    if (header.length > 0 &&
+        !file.read(reinterpret_cast<char*>(record.payload.data()), header.length)) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,193 @@
+#include "reading_bus.h"
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+static_assert(sizeof(BusReading) % sizeof(uint64_t) == 0, "BusReading must be a whole number of words");
+
+BusConsumer::~BusConsumer() {
+    bus->detach(slot);
+}
+
+bool BusConsumer::poll(BusReading& reading) {
+    ReadingBus::Cursor& cursor = bus->cursors[slot];
+    uint64_t position = cursor.position.load(std::memory_order_relaxed);
+
+    while (true) {
+        uint64_t head = bus->head.load(std::memory_order_acquire);
+        if (position >= head) {
+            return false;
+        }
+
+        uint64_t lag = head - position;
+        if (lag > cursor.maxLag.load(std::memory_order_relaxed)) {
+            cursor.maxLag.store(lag, std::memory_order_relaxed);
+        }
+        if (policy == BusPolicy::Sample && lag > 1) {
+            cursor.skipped.fetch_add(lag - 1, std::memory_order_relaxed);
+            position = head - 1;
+        } else if (lag > bus->capacity) {
+            // Lapped: the oldest readings we had not seen are gone
+            cursor.dropped.fetch_add(lag - bus->capacity, std::memory_order_relaxed);
+            position = head - bus->capacity;
+        }
+
+        // Seqlock read: the slot must hold this position before and after the copy
+        const ReadingBus::Slot& entry = bus->slots[position & bus->mask];
+        uint64_t expected = 2 * (position + 1);
+        if (entry.sequence.load(std::memory_order_acquire) != expected) {
+            continue;   // overwritten since head was read; look again
+        }
+        uint64_t words[ReadingBus::WORDS];
+        for (size_t i = 0; i < ReadingBus::WORDS; ++i) {
+            words[i] = entry.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.sequence.load(std::memory_order_relaxed) != expected) {
+            continue;
+        }
+
+        memcpy(&reading, words, sizeof(reading));
+        cursor.position.store(position + 1, std::memory_order_release);
+        cursor.delivered.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+BusConsumerStats BusConsumer::stats() const {
+    return bus->cursorStats(slot);
+}
+
+BusConsumerStats ReadingBus::cursorStats(int slot) const {
+    const Cursor& cursor = cursors[slot];
+    BusConsumerStats result;
+    result.consumer = slot;
+    result.policy = static_cast<BusPolicy>(cursor.policy.load(std::memory_order_relaxed));
+    result.delivered = cursor.delivered.load(std::memory_order_relaxed);
+    result.dropped = cursor.dropped.load(std::memory_order_relaxed);
+    result.skipped = cursor.skipped.load(std::memory_order_relaxed);
+    result.maxLag = cursor.maxLag.load(std::memory_order_relaxed);
+    uint64_t published = head.load(std::memory_order_acquire);
+    uint64_t position = cursor.position.load(std::memory_order_acquire);
+    result.lag = published > position ? published - position : 0;
+    return result;
+}
+
+std::vector<BusConsumerStats> ReadingBus::consumerStats() const {
+    std::lock_guard<std::mutex> lock(subscribeMutex);
+    std::vector<BusConsumerStats> result;
+    for (int i = 0; i < MAX_CONSUMERS; ++i) {
+        if (cursors[i].active.load(std::memory_order_relaxed)) {
+            result.push_back(cursorStats(i));
+        }
+    }
+    return result;
+}
+
+ReadingBus::ReadingBus(size_t capacityHint)
+    : capacity(1), head(0), blockingMask(0), stallCount(0) {
+    while (capacity < capacityHint) {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    slots.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].sequence.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& word : slots[i].words) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+    for (Cursor& cursor : cursors) {
+        cursor.active.store(false, std::memory_order_relaxed);
+        cursor.policy.store(0, std::memory_order_relaxed);
+        cursor.position.store(0, std::memory_order_relaxed);
+        cursor.delivered.store(0, std::memory_order_relaxed);
+        cursor.dropped.store(0, std::memory_order_relaxed);
+        cursor.skipped.store(0, std::memory_order_relaxed);
+        cursor.maxLag.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::unique_ptr<BusConsumer> ReadingBus::subscribe(BusPolicy policy) {
+    std::lock_guard<std::mutex> lock(subscribeMutex);
+    for (int i = 0; i < MAX_CONSUMERS; ++i) {
+        Cursor& cursor = cursors[i];
+        if (cursor.active.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        cursor.policy.store(static_cast<uint8_t>(policy), std::memory_order_relaxed);
+        cursor.position.store(head.load(std::memory_order_acquire), std::memory_order_relaxed);
+        cursor.delivered.store(0, std::memory_order_relaxed);
+        cursor.dropped.store(0, std::memory_order_relaxed);
+        cursor.skipped.store(0, std::memory_order_relaxed);
+        cursor.maxLag.store(0, std::memory_order_relaxed);
+        cursor.active.store(true, std::memory_order_release);
+        if (policy == BusPolicy::Block) {
+            blockingMask.fetch_or(1u << i, std::memory_order_release);
+        }
+        return std::unique_ptr<BusConsumer>(new BusConsumer(this, i, policy));
+    }
+    return std::unique_ptr<BusConsumer>();
+}
+
+void ReadingBus::detach(int slot) {
+    std::lock_guard<std::mutex> lock(subscribeMutex);
+    blockingMask.fetch_and(~(1u << slot), std::memory_order_release);
+    cursors[slot].active.store(false, std::memory_order_release);
+}
+
+void ReadingBus::waitForBlockingConsumers(uint64_t position) {
+    bool stalled = false;
+    int spins = 0;
+    while (true) {
+        uint32_t blocking = blockingMask.load(std::memory_order_acquire);
+        bool full = false;
+        for (int i = 0; blocking != 0; ++i, blocking >>= 1) {
+            if ((blocking & 1) &&
+                position - cursors[i].position.load(std::memory_order_acquire) >= capacity) {
+                full = true;
+                break;
+            }
+        }
+        if (!full) {
+            return;
+        }
+        if (!stalled) {
+            stallCount.fetch_add(1, std::memory_order_relaxed);
+            stalled = true;
+        }
+        // A consumer a ring behind is not catching up within a few spins
+        if (++spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+void ReadingBus::publish(const BusReading& reading) {
+    uint64_t position = head.load(std::memory_order_relaxed);
+    if (blockingMask.load(std::memory_order_relaxed) != 0) {
+        waitForBlockingConsumers(position);
+    }
+
+    uint64_t words[WORDS];
+    memcpy(words, &reading, sizeof(reading));
+    Slot& entry = slots[position & mask];
+    entry.sequence.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) {
+        entry.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    entry.sequence.store(2 * (position + 1), std::memory_order_release);
+    head.store(position + 1, std::memory_order_release);
+}
+
+const char* ReadingBus::policyName(BusPolicy policy) {
+    switch (policy) {
+        case BusPolicy::DropOldest: return "drop-oldest";
+        case BusPolicy::Block: return "block";
+        case BusPolicy::Sample: return "sample";
+    }
+    return "unknown";
+}
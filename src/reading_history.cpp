@@ -0,0 +1,446 @@
+#include "reading_history.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char RING_MAGIC[8] = {'S', 'D', 'S', 'R', 'I', 'N', 'G', '\0'};
+    const uint32_t RING_VERSION = 1;
+    const uint32_t SLOT_OFFSET = 4096;  // slots start on a page of their own
+
+    // First page of a ring file; chunks follow in slots of sizeof(Chunk) bytes
+    struct RingHeader {
+        char magic[8];
+        uint32_t version;           // bumped whenever the meaning of the layout changes
+        uint32_t slotOffset;
+        uint64_t chunkBytes;        // sizeof(Chunk) of the writer
+        uint64_t chunkRows;
+        uint64_t slots;
+        uint64_t first;             // slot of the oldest chunk
+        uint64_t count;             // chunks in use, from first on, wrapping around
+        char label[72];
+    };
+    static_assert(sizeof(RingHeader) == 128, "RingHeader is an on-disk format");
+
+    size_t chunksFor(size_t rows) {
+        return std::max<size_t>(1, (rows + ReadingHistory::CHUNK_ROWS - 1) / ReadingHistory::CHUNK_ROWS);
+    }
+
+    bool sameLayout(const RingHeader& header, uint64_t fileBytes) {
+        return memcmp(header.magic, RING_MAGIC, sizeof(RING_MAGIC)) == 0 && header.version == RING_VERSION &&
+               header.slotOffset == SLOT_OFFSET && header.chunkBytes == sizeof(ReadingHistory::Chunk) &&
+               header.chunkRows == ReadingHistory::CHUNK_ROWS && header.slots > 0 &&
+               fileBytes == SLOT_OFFSET + header.slots * sizeof(ReadingHistory::Chunk);
+    }
+
+    /**
+     * Chunks of a mapped ring, oldest first, or false if they cannot be a
+     * ring written by append(). An empty chunk in front is one that was
+     * being recycled when the writer stopped.
+     */
+    bool ringChunks(RingHeader& header, ReadingHistory::Chunk* slots, std::vector<ReadingHistory::Chunk*>& out) {
+        if (header.first >= header.slots || header.count > header.slots) {
+            return false;
+        }
+        while (header.count > 0 && slots[header.first].rows == 0) {
+            header.first = (header.first + 1) % header.slots;
+            header.count--;
+        }
+        out.clear();
+        for (uint64_t i = 0; i < header.count; ++i) {
+            ReadingHistory::Chunk* chunk = &slots[(header.first + i) % header.slots];
+            bool last = (i + 1 == header.count);
+            if (chunk->rows > ReadingHistory::CHUNK_ROWS || (!last && chunk->rows != ReadingHistory::CHUNK_ROWS)) {
+                return false;
+            }
+            out.push_back(chunk);
+        }
+
+        // The last chunk may have stopped between counting an outlier and its row
+        if (!out.empty()) {
+            ReadingHistory::Chunk& chunk = *out.back();
+            chunk.excluded[0] = chunk.excluded[1] = 0;
+            for (size_t row = 0; row < chunk.rows; ++row) {
+                if (chunk.flags[row] & ReadingFlags::OutlierPM25) chunk.excluded[0]++;
+                if (chunk.flags[row] & ReadingFlags::OutlierPM10) chunk.excluded[1]++;
+            }
+        }
+        return true;
+    }
+}
+
+struct ReadingHistory::RingFile {
+    std::string path;
+    std::string label;
+    RingHeader* header;
+    Chunk* slots;
+    size_t bytes;
+    int fd;                 // holds the exclusive lock of the writer, -1 for a reader's copy
+
+    RingFile(const std::string& file, const std::string& owner, void* base, size_t size, int lockedFd = -1)
+        : path(file), label(owner), header(static_cast<RingHeader*>(base)),
+          slots(reinterpret_cast<Chunk*>(static_cast<char*>(base) + SLOT_OFFSET)), bytes(size), fd(lockedFd) {}
+    ~RingFile() {
+        munmap(header, bytes);
+        if (fd >= 0) close(fd);
+    }
+};
+
+ReadingHistory::ReadingHistory(size_t capacityRows) : maxChunks(chunksFor(capacityRows)), totalRows(0) {}
+
+ReadingHistory::~ReadingHistory() = default;
+ReadingHistory::ReadingHistory(ReadingHistory&& other) = default;
+ReadingHistory& ReadingHistory::operator=(ReadingHistory&& other) = default;
+
+bool ReadingHistory::attach(const std::string& path, const std::string& label) {
+    detach();
+    std::string owner = label.substr(0, sizeof(RingHeader::label) - 1);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Cannot open history ring " << path << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    // One writer per ring: appends from two processes would interleave in the shared mapping
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "History ring " << path << " is in use by another process" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    RingHeader existing;
+    uint64_t fileBytes = static_cast<uint64_t>(info.st_size);
+    bool reusable = fileBytes >= sizeof(existing) && pread(fd, &existing, sizeof(existing), 0) ==
+                    static_cast<ssize_t>(sizeof(existing)) && sameLayout(existing, fileBytes);
+    if (reusable && strncmp(existing.label, owner.c_str(), sizeof(existing.label)) == 0) {
+        void* base = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            std::unique_ptr<RingFile> mapped(new RingFile(path, owner, base, fileBytes));
+            std::vector<Chunk*> found;
+            if (ringChunks(*mapped->header, mapped->slots, found)) {
+                if (existing.slots == maxChunks) {
+                    // Re-attached as it is: the rows are already where append() expects them
+                    mapped->fd = fd;
+                    chunks.clear();
+                    totalRows = 0;
+                    for (Chunk* chunk : found) {
+                        chunks.push_back(ChunkPtr(chunk, ChunkRelease(false)));
+                        totalRows += chunk->rows;
+                    }
+                    ring = std::move(mapped);
+                    return true;
+                }
+
+                // Another capacity: keep the newest chunks and lay the file out again
+                size_t keep = std::min(found.size(), maxChunks);
+                chunks.clear();
+                totalRows = 0;
+                for (size_t i = found.size() - keep; i < found.size(); ++i) {
+                    chunks.push_back(ChunkPtr(new Chunk(*found[i])));
+                    totalRows += found[i]->rows;
+                }
+            } else {
+                std::cerr << "History ring " << path << " is damaged, starting a new one" << std::endl;
+            }
+        }
+    } else if (fileBytes > 0 && !reusable) {
+        std::cerr << "History ring " << path << " has another layout, starting a new one" << std::endl;
+    }
+
+    // A new ring for the current capacity, holding the rows in memory
+    size_t bytes = SLOT_OFFSET + maxChunks * sizeof(Chunk);
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, 0) == 0 && ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map history ring " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    std::unique_ptr<RingFile> mapped(new RingFile(path, owner, base, bytes, fd));
+    RingHeader& header = *mapped->header;
+    memcpy(header.magic, RING_MAGIC, sizeof(RING_MAGIC));
+    header.version = RING_VERSION;
+    header.slotOffset = SLOT_OFFSET;
+    header.chunkBytes = sizeof(Chunk);
+    header.chunkRows = CHUNK_ROWS;
+    header.slots = maxChunks;
+    header.first = 0;
+    header.count = 0;
+    memset(header.label, 0, sizeof(header.label));
+    memcpy(header.label, owner.data(), owner.size());
+    for (ChunkPtr& chunk : chunks) {
+        Chunk* slot = new (&mapped->slots[header.count]) Chunk(*chunk);
+        chunk = ChunkPtr(slot, ChunkRelease(false));
+        header.count++;
+    }
+    ring = std::move(mapped);
+    return true;
+}
+
+void ReadingHistory::detach() {
+    if (!ring) {
+        return;
+    }
+    for (ChunkPtr& chunk : chunks) {
+        chunk = ChunkPtr(new Chunk(*chunk));
+    }
+    ring.reset();
+}
+
+bool ReadingHistory::load(const std::string& path, std::string* label) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    RingHeader header;
+    if (fd < 0 || fstat(fd, &info) != 0 || pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+        !sameLayout(header, static_cast<uint64_t>(info.st_size))) {
+        std::cerr << "Cannot read history ring " << path << ": " << (fd < 0 ? strerror(errno) : "not a ring file")
+                  << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    // A private mapping: the clean-up of ringChunks() stays out of the file
+    size_t bytes = static_cast<size_t>(info.st_size);
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map history ring " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    RingFile mapped(path, "", base, bytes);
+    std::vector<Chunk*> found;
+    if (!ringChunks(*mapped.header, mapped.slots, found)) {
+        std::cerr << "History ring " << path << " is damaged" << std::endl;
+        return false;
+    }
+
+    detach();
+    chunks.clear();
+    totalRows = 0;
+    maxChunks = static_cast<size_t>(mapped.header->slots);
+    for (Chunk* chunk : found) {
+        chunks.push_back(ChunkPtr(new Chunk(*chunk)));
+        totalRows += chunk->rows;
+    }
+    if (label) {
+        label->assign(mapped.header->label, strnlen(mapped.header->label, sizeof(mapped.header->label)));
+    }
+    return true;
+}
+
+void ReadingHistory::setCapacity(size_t capacityRows) {
+    maxChunks = chunksFor(capacityRows);
+    if (ring && ring->header->slots != maxChunks) {
+        std::string path = ring->path;
+        std::string label = ring->label;
+        detach();
+        setCapacity(capacityRows);
+        attach(path, label);
+        return;
+    }
+    while (chunks.size() > maxChunks) {
+        totalRows -= chunks.front()->rows;
+        chunks.pop_front();
+    }
+}
+
+ReadingHistory::Chunk* ReadingHistory::nextChunk() {
+    if (chunks.size() >= maxChunks) {
+        // Full: the oldest chunk becomes the newest
+        ChunkPtr chunk = std::move(chunks.front());
+        chunks.pop_front();
+        totalRows -= chunk->rows;
+        chunk->rows = 0;
+        chunk->excluded[0] = chunk->excluded[1] = 0;
+        if (ring) {
+            // Emptied before the header moves past it, so a reader never sees stale rows at the end
+            ring->header->first = (ring->header->first + 1) % ring->header->slots;
+        }
+        chunks.push_back(std::move(chunk));
+    } else if (ring) {
+        RingHeader& header = *ring->header;
+        Chunk* slot = new (&ring->slots[(header.first + header.count) % header.slots]) Chunk();
+        chunks.push_back(ChunkPtr(slot, ChunkRelease(false)));
+        header.count++;
+    } else {
+        chunks.push_back(ChunkPtr(new Chunk()));
+    }
+    return chunks.back().get();
+}
+
+void ReadingHistory::append(const HistoryRow& reading) {
+    Chunk& chunk = (chunks.empty() || chunks.back()->rows == CHUNK_ROWS) ? *nextChunk() : *chunks.back();
+
+    // The row count goes up last, so a ring file never counts a half-written row
+    size_t row = chunk.rows;
+    chunk.timestamp_ms[row] = reading.timestamp_ms;
+    chunk.pm25_raw[row] = reading.pm25_raw;
+    chunk.pm10_raw[row] = reading.pm10_raw;
+    chunk.pm25_corrected_raw[row] = reading.pm25_corrected_raw;
+    chunk.pm10_corrected_raw[row] = reading.pm10_corrected_raw;
+    chunk.humidity[row] = reading.humidity;
+    chunk.flags[row] = reading.flags;
+    if (reading.flags & ReadingFlags::OutlierPM25) chunk.excluded[0]++;
+    if (reading.flags & ReadingFlags::OutlierPM10) chunk.excluded[1]++;
+    chunk.rows = row + 1;
+    totalRows++;
+}
+
+void ReadingHistory::appendSlice(const Chunk& source, size_t begin, size_t end) {
+    while (begin < end) {
+        Chunk& chunk = (chunks.empty() || chunks.back()->rows == CHUNK_ROWS) ? *nextChunk() : *chunks.back();
+        size_t row = chunk.rows;
+        size_t n = std::min(end - begin, CHUNK_ROWS - row);
+
+        std::memcpy(chunk.timestamp_ms + row, source.timestamp_ms + begin, n * sizeof(int64_t));
+        std::memcpy(chunk.pm25_raw + row, source.pm25_raw + begin, n * sizeof(uint16_t));
+        std::memcpy(chunk.pm10_raw + row, source.pm10_raw + begin, n * sizeof(uint16_t));
+        std::memcpy(chunk.pm25_corrected_raw + row, source.pm25_corrected_raw + begin, n * sizeof(uint16_t));
+        std::memcpy(chunk.pm10_corrected_raw + row, source.pm10_corrected_raw + begin, n * sizeof(uint16_t));
+        std::memcpy(chunk.humidity + row, source.humidity + begin, n);
+        std::memcpy(chunk.flags + row, source.flags + begin, n);
+        if (begin == 0 && n == source.rows) {
+            chunk.excluded[0] += source.excluded[0];
+            chunk.excluded[1] += source.excluded[1];
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                if (source.flags[begin + i] & ReadingFlags::OutlierPM25) chunk.excluded[0]++;
+                if (source.flags[begin + i] & ReadingFlags::OutlierPM10) chunk.excluded[1]++;
+            }
+        }
+        // As in append(): the row count goes up last
+        chunk.rows = row + n;
+        totalRows += n;
+        begin += n;
+    }
+}
+
+void ReadingHistory::append(int64_t timestampMs, uint16_t pm25Raw, uint16_t pm10Raw, uint8_t flags) {
+    HistoryRow reading;
+    reading.timestamp_ms = timestampMs;
+    reading.pm25_raw = reading.pm25_corrected_raw = pm25Raw;
+    reading.pm10_raw = reading.pm10_corrected_raw = pm10Raw;
+    reading.humidity = HistoryRow::HUMIDITY_UNKNOWN;
+    reading.flags = flags;
+    append(reading);
+}
+
+void ReadingHistory::append(int64_t timestampMs, float pm25, float pm10, uint8_t flags) {
+    append(timestampMs, toRaw(pm25), toRaw(pm10), flags);
+}
+
+HistoryRow ReadingHistory::makeRow(int64_t timestampMs, float pm25, float pm10, float pm25Corrected,
+                                   float pm10Corrected, float rh, uint8_t flags) {
+    HistoryRow row;
+    row.timestamp_ms = timestampMs;
+    row.pm25_raw = toRaw(pm25);
+    row.pm10_raw = toRaw(pm10);
+    row.pm25_corrected_raw = toRaw(pm25Corrected);
+    row.pm10_corrected_raw = toRaw(pm10Corrected);
+    if (rh >= 0.0f) {
+        row.humidity = static_cast<uint8_t>(std::min(100.0f, rh) + 0.5f);
+        flags |= ReadingFlags::HumidityCorrected;
+    } else {
+        row.humidity = HistoryRow::HUMIDITY_UNKNOWN;
+    }
+    row.flags = flags;
+    return row;
+}
+
+uint16_t ReadingHistory::toRaw(float value) {
+    // Same deci-µg/m³ resolution as the sensor, clamped to the column range
+    float scaled = std::round(value * 10.0f);
+    return static_cast<uint16_t>(std::min(65535.0f, std::max(0.0f, scaled)));
+}
+
+void ReadingHistory::clear() {
+    chunks.clear();
+    totalRows = 0;
+    if (ring) {
+        ring->header->first = 0;
+        ring->header->count = 0;
+    }
+}
+
+HistoryRow ReadingHistory::at(size_t index) const {
+    const Chunk& chunk = *chunks[index / CHUNK_ROWS];
+    size_t row = index % CHUNK_ROWS;
+    HistoryRow result;
+    result.timestamp_ms = chunk.timestamp_ms[row];
+    result.pm25_raw = chunk.pm25_raw[row];
+    result.pm10_raw = chunk.pm10_raw[row];
+    result.pm25_corrected_raw = chunk.pm25_corrected_raw[row];
+    result.pm10_corrected_raw = chunk.pm10_corrected_raw[row];
+    result.humidity = chunk.humidity[row];
+    result.flags = chunk.flags[row];
+    return result;
+}
+
+size_t ReadingHistory::lowerBound(int64_t timestampMs) const {
+    // Last chunk whose first timestamp is < target; the answer is in it or right after it
+    size_t lo = 0, hi = chunks.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (chunks[mid]->timestamp_ms[0] < timestampMs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return 0;
+    }
+
+    const Chunk& chunk = *chunks[lo - 1];
+    const int64_t* position = std::lower_bound(chunk.timestamp_ms, chunk.timestamp_ms + chunk.rows, timestampMs);
+    return (lo - 1) * CHUNK_ROWS + (position - chunk.timestamp_ms);
+}
+
+ColumnSummary ReadingHistory::summarize(HistoryColumn column, size_t first, size_t count) const {
+    const int c = pollutantIndex(column);
+    const bool corrected = (column == HistoryColumn::PM25Corrected || column == HistoryColumn::PM10Corrected);
+    const uint8_t mask = ReadingFlags::outlierBit(column);
+    ColumnSummary summary;
+    forEachSlice(first, count, [&](const Chunk& chunk, size_t begin, size_t end) {
+        const uint16_t* values = corrected ? (c ? chunk.pm10_corrected_raw : chunk.pm25_corrected_raw)
+                                           : (c ? chunk.pm10_raw : chunk.pm25_raw);
+        if (chunk.excluded[c] == 0) {
+            summary.merge(AggregateKernels::summarizeU16(values + begin, end - begin));
+            return;
+        }
+
+        // Rare: this chunk holds outliers, skip them row by row
+        ColumnSummary masked;
+        for (size_t row = begin; row < end; ++row) {
+            if (chunk.flags[row] & mask) continue;
+            double value = values[row];
+            masked.min = masked.count ? std::min(masked.min, value) : value;
+            masked.max = masked.count ? std::max(masked.max, value) : value;
+            masked.sum += value;
+            masked.count++;
+        }
+        summary.merge(masked);
+    });
+    return summary;
+}
+
+ColumnSummary ReadingHistory::summarizeAll(HistoryColumn column) const {
+    ColumnSummary summary = summarize(column, 0, totalRows);
+    summary.sum /= 10.0;
+    summary.min /= 10.0;
+    summary.max /= 10.0;
+    return summary;
+}
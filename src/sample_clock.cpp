@@ -0,0 +1,51 @@
+#include "sample_clock.h"
+#include <atomic>
+
+namespace {
+    std::atomic<int64_t> offset(0);
+    std::atomic<uint64_t> syncedAtNs(0);    // monotonic time of the last measurement, 0 before the first
+
+    int64_t realtimeNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+}
+
+namespace SampleClock {
+    void resync() {
+        // Bracket a CLOCK_REALTIME read between two monotonic ones and keep the
+        // tightest of a few tries, so a preemption does not skew the offset
+        uint64_t bestWindow = 0;
+        int64_t bestOffset = 0;
+        uint64_t measuredAt = 0;
+        for (int attempt = 0; attempt < 3; ++attempt) {
+            uint64_t before = nowNs();
+            int64_t real = realtimeNs();
+            uint64_t after = nowNs();
+            if (attempt == 0 || after - before < bestWindow) {
+                bestWindow = after - before;
+                bestOffset = real - static_cast<int64_t>(before + (after - before) / 2);
+                measuredAt = after;
+            }
+        }
+        offset.store(bestOffset, std::memory_order_relaxed);
+        syncedAtNs.store(measuredAt, std::memory_order_release);
+    }
+
+    int64_t toUnixNs(uint64_t monotonicNs) {
+        uint64_t synced = syncedAtNs.load(std::memory_order_acquire);
+        if (synced == 0 || nowNs() - synced > RESYNC_INTERVAL_NS) {
+            // Concurrent callers may both measure; either result is valid
+            resync();
+        }
+        return static_cast<int64_t>(monotonicNs) + offset.load(std::memory_order_relaxed);
+    }
+
+    int64_t offsetNs() {
+        if (syncedAtNs.load(std::memory_order_acquire) == 0) {
+            resync();
+        }
+        return offset.load(std::memory_order_relaxed);
+    }
+}
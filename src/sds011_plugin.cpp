@@ -1,9 +1,10 @@
 #include "sds011_plugin.h"
 #include "app_utils.h"
+#include "serial_port.h"
+#include "aqi_engine.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
-#include <thread>
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -55,101 +56,71 @@ bool SDS011Plugin::initialize(const std::string& port) {
     cleanup(); // Close any existing connection
     
     current_port = port;
-    
-    // Open serial port
-    serial_fd = open(port.c_str(), O_RDONLY | O_NOCTTY | O_SYNC);
-    if (serial_fd < 0) {
-        return false;
+    if (port != bound_port) {
+        bound_port = port;
+        device = DeviceId();
     }
     
-    return configureSerialPort();
-}
-
-bool SDS011Plugin::configureSerialPort() {
-    struct termios tty;
-    if (tcgetattr(serial_fd, &tty) != 0) {
-        return false;
+    // Once the adapter is known, follow it to whatever node it has now rather
+    // than reopening the old name, which may belong to another adapter by now
+    std::string path = port;
+    if (!device.empty()) {
+        path = DeviceLookup::locate(device);
+        if (path.empty()) {
+            return false;
+        }
     }
     
-    // Set baud rate to 9600 (SDS011 default)
-    cfsetospeed(&tty, B9600);
-    cfsetispeed(&tty, B9600);
-    
-    // Configure 8N1 (8 data bits, no parity, 1 stop bit)
-    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
-    tty.c_iflag &= ~IGNBRK;                         // disable break processing
-    tty.c_lflag = 0;                                // no signaling chars, no echo,
-                                                    // no canonical processing
-    tty.c_oflag = 0;                                // no remapping, no delays
-    tty.c_cc[VMIN] = 0;                             // read doesn't block
-    tty.c_cc[VTIME] = 5;                            // 0.5 seconds read timeout
-    
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY);         // shut off xon/xoff ctrl
-    
-    tty.c_cflag |= (CLOCAL | CREAD);                // ignore modem controls,
-                                                    // enable reading
-    tty.c_cflag &= ~(PARENB | PARODD);              // shut off parity
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CRTSCTS;
-    
-    return (tcsetattr(serial_fd, TCSANOW, &tty) == 0);
-}
-
-bool SDS011Plugin::readPacket(std::vector<unsigned char>& packet) {
-    packet.clear();
-    packet.resize(DATA_LENGTH);
-    
-    // Read data from serial port
-    int bytes_read = read(serial_fd, packet.data(), DATA_LENGTH);
-    if (bytes_read != DATA_LENGTH) {
+    // Open serial port
+    serial_fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_SYNC);
+    if (serial_fd < 0) {
         return false;
     }
     
-    // Validate packet structure
-    if (packet[0] != HEADER || packet[9] != TAIL || packet[1] != CMD_ID) {
+    if (!configureSerialPort()) {
         return false;
     }
     
-    // Validate checksum
-    unsigned char checksum = 0;
-    for (int i = 2; i < 8; i++) {
-        checksum += packet[i];
-    }
-    
-    if (checksum != packet[8]) {
-        return false;
+    if (device.empty()) {
+        device = DeviceLookup::identify(path);
     }
+    device_path = path;
     
+    // Metrics, captures and history stay under the name the user chose
+    stream.bind(serial_fd, port, SerialPort::profileFor(port));
     return true;
 }
 
+bool SDS011Plugin::configureSerialPort() {
+    return SerialPort::configure(serial_fd, SerialPort::profileFor(current_port));
+}
+
 std::unique_ptr<SensorData> SDS011Plugin::readData() {
     if (serial_fd < 0) {
         return nullptr;
     }
     
-    std::vector<unsigned char> packet;
+    // One attempt: retrying, backing off and reconnecting is up to the caller's
+    // SensorHealth, so a silent sensor never holds the thread here
+    SDS011Frame frame;
+    if (!stream.readFrame(frame)) {
+        return nullptr;
+    }
     
-    // Try to read valid packet (may need multiple attempts)
-    for (int attempts = 0; attempts < 10; attempts++) {
-        if (readPacket(packet)) {
-            // Extract PM2.5 and PM10 values
-            // Data is in little-endian format
-            int pm25_raw = packet[2] | (packet[3] << 8);
-            int pm10_raw = packet[4] | (packet[5] << 8);
-            
-            // Convert to µg/m³ (divide by 10 as per SDS011 specification)
-            float pm25 = pm25_raw / 10.0f;
-            float pm10 = pm10_raw / 10.0f;
-            
-            return std::unique_ptr<SensorData>(new SDS011Data(pm25, pm10));
-        }
-        
-        // Small delay before retry
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Convert to µg/m³ (divide by 10 as per SDS011 specification), stamped when the frame arrived
+    return std::unique_ptr<SensorData>(new SDS011Data(frame.pm25(), frame.pm10(), frame.arrival_ns));
+}
+
+std::unique_ptr<SensorData> SDS011Plugin::readAvailableData() {
+    if (serial_fd < 0) {
+        return nullptr;
     }
     
-    return nullptr;
+    SDS011Frame frame;
+    if (!stream.readAvailable(frame)) {
+        return nullptr;
+    }
+    return std::unique_ptr<SensorData>(new SDS011Data(frame.pm25(), frame.pm10(), frame.arrival_ns));
 }
 
 std::vector<std::string> SDS011Plugin::getDisplayHeaders() const {
@@ -160,25 +131,24 @@ int SDS011Plugin::getColorCode(const SensorData& data) const {
     const SDS011Data* sds_data = dynamic_cast<const SDS011Data*>(&data);
     if (!sds_data) return 1;
     
-    // Color based on PM2.5 levels (WHO guidelines)
-    if (sds_data->pm25 <= 15.0) return 1; // Green (good)
-    if (sds_data->pm25 <= 25.0) return 2; // Yellow (moderate)
-    return 3; // Red (poor)
+    // Instantaneous reading against the US EPA PM2.5 table
+    AQIResult aqi = AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, sds_data->pm25);
+    return AQIEngine::colorPair(aqi.level);
 }
 
 std::string SDS011Plugin::getQualityDescription(const SensorData& data) const {
     const SDS011Data* sds_data = dynamic_cast<const SDS011Data*>(&data);
     if (!sds_data) return "Unknown";
     
-    if (sds_data->pm25 <= 15.0) return "Good";
-    if (sds_data->pm25 <= 25.0) return "Moderate";
-    return "Poor";
+    return AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, sds_data->pm25).category;
 }
 
 void SDS011Plugin::cleanup() {
+    stream.unbind();
     if (serial_fd >= 0) {
         close(serial_fd);
         serial_fd = -1;
     }
     current_port.clear();
+    device_path.clear();
 }
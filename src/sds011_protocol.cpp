@@ -0,0 +1,81 @@
+#include "sds011_protocol.h"
+#include <cstring>
+
+SDS011FrameParser::SDS011FrameParser() : fill(0), hunting(false) {
+    std::memset(&current, 0, sizeof(current));
+}
+
+SDS011FrameParser::Status SDS011FrameParser::push(unsigned char byte) {
+    buffer[fill++] = byte;
+
+    // Header byte, then command id
+    if (fill == 1 && byte != HEADER) {
+        fill = 0;
+        if (!hunting) {
+            hunting = true;
+            return Resync;
+        }
+        return NeedMore;
+    }
+    if (fill == 2 && byte != CMD_ID) {
+        shift();
+        if (!hunting) {
+            hunting = true;
+            return Resync;
+        }
+        return NeedMore;
+    }
+    if (fill < FRAME_LENGTH) {
+        return NeedMore;
+    }
+
+    hunting = false;
+    if (buffer[FRAME_LENGTH - 1] != TAIL) {
+        shift();
+        hunting = true;
+        return Resync;
+    }
+    if (!isValid(buffer)) {
+        shift();
+        return BadChecksum;
+    }
+
+    decode(buffer, current);
+    fill = 0;
+    return FrameReady;
+}
+
+void SDS011FrameParser::shift() {
+    // Look for the next header inside the bytes we already hold
+    int start = 1;
+    while (start < fill && buffer[start] != HEADER) {
+        start++;
+    }
+    fill -= start;
+    std::memmove(buffer, buffer + start, fill);
+
+    if (fill >= 2 && buffer[1] != CMD_ID) {
+        shift();
+    }
+}
+
+void SDS011FrameParser::decode(const unsigned char* bytes, SDS011Frame& out) {
+    // Data is in little-endian format
+    out.pm25_raw = static_cast<uint16_t>(bytes[2] | (bytes[3] << 8));
+    out.pm10_raw = static_cast<uint16_t>(bytes[4] | (bytes[5] << 8));
+    out.device_id = static_cast<uint16_t>(bytes[6] | (bytes[7] << 8));
+    std::memcpy(out.bytes, bytes, FRAME_LENGTH);
+    out.arrival_ns = 0;
+}
+
+bool SDS011FrameParser::isValid(const unsigned char* bytes) {
+    if (bytes[0] != HEADER || bytes[1] != CMD_ID || bytes[FRAME_LENGTH - 1] != TAIL) {
+        return false;
+    }
+
+    unsigned char checksum = 0;
+    for (int i = 2; i < 8; i++) {
+        checksum += bytes[i];
+    }
+    return checksum == bytes[8];
+}
@@ -1,9 +1,9 @@
 #include "sds011_reader.h"
+#include "serial_port.h"
 #include <iostream>
 #include <iomanip>
 #include <thread>
 #include <chrono>
-#include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
@@ -16,97 +16,80 @@ SDS011Reader::~SDS011Reader() {
     }
 }
 
-bool SDS011Reader::initialize() {
+bool SDS011Reader::openPort(const std::string& path, bool reportErrors) {
     // Open serial port
-    serial_fd = open(port_name.c_str(), O_RDONLY | O_NOCTTY | O_SYNC);
+    serial_fd = open(path.c_str(), O_RDONLY | O_NOCTTY | O_SYNC);
     if (serial_fd < 0) {
-        std::cerr << "Error opening serial port: " << port_name << std::endl;
+        if (reportErrors) std::cerr << "Error opening serial port: " << path << std::endl;
         return false;
     }
     
     // Configure serial port
-    struct termios tty;
-    if (tcgetattr(serial_fd, &tty) != 0) {
-        std::cerr << "Error getting terminal attributes" << std::endl;
+    SerialIOProfile profile = SerialPort::profileFor(port_name);
+    if (!SerialPort::configure(serial_fd, profile)) {
+        if (reportErrors) std::cerr << "Error setting terminal attributes" << std::endl;
         return false;
     }
     
-    // Set baud rate to 9600 (SDS011 default)
-    cfsetospeed(&tty, B9600);
-    cfsetispeed(&tty, B9600);
-    
-    // Configure 8N1 (8 data bits, no parity, 1 stop bit)
-    tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
-    tty.c_iflag &= ~IGNBRK;                         // disable break processing
-    tty.c_lflag = 0;                                // no signaling chars, no echo,
-                                                    // no canonical processing
-    tty.c_oflag = 0;                                // no remapping, no delays
-    tty.c_cc[VMIN] = 0;                             // read doesn't block
-    tty.c_cc[VTIME] = 5;                            // 0.5 seconds read timeout
-    
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY);         // shut off xon/xoff ctrl
-    
-    tty.c_cflag |= (CLOCAL | CREAD);                // ignore modem controls,
-                                                    // enable reading
-    tty.c_cflag &= ~(PARENB | PARODD);              // shut off parity
-    tty.c_cflag &= ~CSTOPB;
-    tty.c_cflag &= ~CRTSCTS;
-    
-    if (tcsetattr(serial_fd, TCSANOW, &tty) != 0) {
-        std::cerr << "Error setting terminal attributes" << std::endl;
-        return false;
-    }
-    
-    std::cout << "Serial port " << port_name << " initialized successfully" << std::endl;
+    stream.bind(serial_fd, port_name, profile);
     return true;
 }
 
-bool SDS011Reader::readPacket(std::vector<unsigned char>& packet) {
-    packet.clear();
-    packet.resize(DATA_LENGTH);
-    
-    // Read data from serial port
-    int bytes_read = read(serial_fd, packet.data(), DATA_LENGTH);
-    if (bytes_read != DATA_LENGTH) {
-        return false;
-    }
-    
-    // Validate packet structure
-    if (packet[0] != HEADER || packet[9] != TAIL || packet[1] != CMD_ID) {
+bool SDS011Reader::initialize() {
+    if (!openPort(port_name, true)) {
         return false;
     }
+    device = DeviceLookup::identify(port_name);
     
-    // Validate checksum
-    unsigned char checksum = 0;
-    for (int i = 2; i < 8; i++) {
-        checksum += packet[i];
-    }
-    
-    if (checksum != packet[8]) {
-        return false;
+    std::cout << "Serial port " << port_name << " initialized successfully (I/O profile: "
+              << SerialPort::profileName(SerialPort::profileFor(port_name)) << ")" << std::endl;
+    return true;
+}
+
+bool SDS011Reader::reopen() {
+    stream.unbind();
+    if (serial_fd >= 0) {
+        close(serial_fd);
+        serial_fd = -1;
     }
     
-    return true;
+    // Without an identity (not a USB adapter) the old name is all there is
+    std::string path = device.empty() ? port_name : DeviceLookup::locate(device);
+    return !path.empty() && openPort(path, false);
 }
 
-bool SDS011Reader::readPM25Data(float& pm25, float& pm10) {
-    std::vector<unsigned char> packet;
+bool SDS011Reader::readFrame(SDS011Frame& frame) {
+    // Straight from the stream, which keeps the arrival stamp
+    return stream.readFrame(frame);
+}
+
+bool SDS011Reader::readPM25Data(float& pm25, float& pm10, uint64_t* arrivalNs) {
+    if (stream.isLinkLost()) {
+        if (!reopen()) {
+            return false;
+        }
+        std::cerr << "Sensor " << port_name << " reconnected" << std::endl;
+    }
+    
+    SDS011Frame frame;
     
     // Try to read valid packet (may need multiple attempts)
     for (int attempts = 0; attempts < 10; attempts++) {
-        if (readPacket(packet)) {
-            // Extract PM2.5 and PM10 values
-            // Data is in little-endian format
-            int pm25_raw = packet[2] | (packet[3] << 8);
-            int pm10_raw = packet[4] | (packet[5] << 8);
-            
+        if (readFrame(frame)) {
             // Convert to µg/m³ (divide by 10 as per SDS011 specification)
-            pm25 = pm25_raw / 10.0f;
-            pm10 = pm10_raw / 10.0f;
+            pm25 = frame.pm25();
+            pm10 = frame.pm10();
+            if (arrivalNs) {
+                *arrivalNs = frame.arrival_ns;
+            }
             
             return true;
         }
         
+        if (stream.atEndOfStream() || stream.isLinkLost()) {
+            break;
+        }
+        
         // Small delay before retry
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
@@ -114,6 +97,14 @@ bool SDS011Reader::readPM25Data(float& pm25, float& pm10) {
     return false;
 }
 
+void SDS011Reader::attach(int fd) {
+    if (serial_fd >= 0) {
+        close(serial_fd);
+    }
+    serial_fd = fd;
+    stream.bind(serial_fd, port_name);
+}
+
 void SDS011Reader::printPacketHex(const std::vector<unsigned char>& packet) {
     std::cout << "Raw packet: ";
     for (size_t i = 0; i < packet.size(); i++) {
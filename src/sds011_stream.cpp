@@ -0,0 +1,153 @@
+#include "sds011_stream.h"
+#include "trace_recorder.h"
+#include <cerrno>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SDS011Stream::SDS011Stream()
+    : fd(-1), metrics(nullptr), trace_id(0), end_of_stream(false), link_lost(false), eof_is_final(false),
+      poll_before_read(false), frame_start_ns(0) {}
+
+void SDS011Stream::bind(int descriptor, const std::string& sensorId, SerialIOProfile profile) {
+    fd = descriptor;
+    metrics = &MetricsRegistry::instance().forSensor(sensorId);
+    metrics->ioProfile.store(SerialPort::profileName(profile), std::memory_order_relaxed);
+    trace_id = TraceRecorder::sensorId(sensorId);
+    poll_before_read = SerialPort::usesPoll(profile);
+    end_of_stream = false;
+    link_lost = false;
+    parser.reset();
+    
+    // A zero-byte read is a VTIME timeout on a tty but end of input on a pipe or file
+    struct stat st;
+    eof_is_final = (fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISREG(st.st_mode)));
+}
+
+void SDS011Stream::unbind() {
+    fd = -1;
+    parser.reset();
+}
+
+bool SDS011Stream::readFrame(SDS011Frame& frame) {
+    return decode(frame, poll_before_read, SerialPort::pollTimeoutMs());
+}
+
+bool SDS011Stream::readAvailable(SDS011Frame& frame) {
+    return decode(frame, true, 0);
+}
+
+bool SDS011Stream::decode(SDS011Frame& frame, bool pollFirst, int waitMs) {
+    if (fd < 0 || !metrics) {
+        return false;
+    }
+
+    unsigned char chunk[SDS011FrameParser::FRAME_LENGTH];
+    int consumed = 0;
+
+    // Give up after two frames' worth of bytes without a valid frame
+    while (consumed < 2 * SDS011FrameParser::FRAME_LENGTH) {
+        if (pollFirst) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, waitMs) <= 0) {
+                if (waitMs == 0) {
+                    return false;   // the rest has not arrived yet; not a timeout
+                }
+                metrics->readTimeouts.fetch_add(1, std::memory_order_relaxed);
+                TraceRecorder::record(TraceEvent::FrameRejected, trace_id,
+                                      static_cast<uint32_t>(TraceRejectReason::ShortRead));
+                return false;
+            }
+            if (!(pfd.revents & POLLIN) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                // A hung-up tty would otherwise keep returning empty reads at once;
+                // a closed pipe still drains its buffered bytes first
+                link_lost = !eof_is_final;
+                end_of_stream = eof_is_final;
+                return false;
+            }
+        }
+        
+        bool frameIdle = (parser.bytesNeeded() == SDS011FrameParser::FRAME_LENGTH);
+        ssize_t bytes_read;
+        {
+            ScopedLatency timer(&metrics->readSyscall);
+            TraceRecorder::record(TraceEvent::ReadStart, trace_id);
+            bytes_read = read(fd, chunk, parser.bytesNeeded());
+            TraceRecorder::record(TraceEvent::ReadEnd, trace_id, static_cast<uint32_t>(bytes_read));
+        }
+        metrics->readCalls.fetch_add(1, std::memory_order_relaxed);
+
+        if (bytes_read <= 0) {
+            if (bytes_read == 0 && eof_is_final) {
+                end_of_stream = true;
+            }
+            if (bytes_read == 0 && !eof_is_final) {
+                // An empty tty read is a VTIME timeout or a hangup; only poll() tells them apart
+                struct pollfd pfd = {fd, POLLIN, 0};
+                if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                    link_lost = true;
+                }
+            }
+            if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                link_lost = true;
+            }
+            metrics->readTimeouts.fetch_add(1, std::memory_order_relaxed);
+            TraceRecorder::record(TraceEvent::FrameRejected, trace_id,
+                                  static_cast<uint32_t>(TraceRejectReason::ShortRead));
+            return false;
+        }
+
+        // Taken as soon as read() returns, so a completed frame is stamped at its last byte
+        uint64_t now = MetricsRegistry::nowNs();
+        if (frameIdle) {
+            frame_start_ns = now;
+        }
+        metrics->bytesRead.fetch_add(bytes_read, std::memory_order_relaxed);
+        if (capture) {
+            capture->writeBytes(now, chunk, bytes_read);
+        }
+        consumed += bytes_read;
+
+        ScopedLatency timer(&metrics->frameParse);
+        for (ssize_t i = 0; i < bytes_read; ++i) {
+            switch (parser.push(chunk[i])) {
+                case SDS011FrameParser::FrameReady:
+                    frame = parser.frame();
+                    frame.arrival_ns = now;
+                    metrics->frameAssembly.record(MetricsRegistry::nowNs() - frame_start_ns);
+                    metrics->framesAccepted.fetch_add(1, std::memory_order_relaxed);
+                    TraceRecorder::record(TraceEvent::FrameAccepted, trace_id, frame.pm25_raw);
+                    if (capture) {
+                        capture->writeFrame(now, frame.pm25_raw, frame.pm10_raw);
+                    }
+                    return true;
+
+                case SDS011FrameParser::BadChecksum:
+                    metrics->checksumFailures.fetch_add(1, std::memory_order_relaxed);
+                    TraceRecorder::record(TraceEvent::FrameRejected, trace_id,
+                                          static_cast<uint32_t>(TraceRejectReason::BadChecksum));
+                    break;
+
+                case SDS011FrameParser::Resync:
+                    metrics->resyncEvents.fetch_add(1, std::memory_order_relaxed);
+                    TraceRecorder::record(TraceEvent::FrameRejected, trace_id,
+                                          static_cast<uint32_t>(TraceRejectReason::BadHeader));
+                    break;
+
+                case SDS011FrameParser::NeedMore:
+                    break;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool SDS011Stream::enableCapture(const std::string& path) {
+    capture.reset(new RawCaptureWriter());
+    if (!capture->open(path)) {
+        capture.reset();
+        return false;
+    }
+    return true;
+}
@@ -1,12 +1,15 @@
 #include "sds011_tui.h"
 #include "app_utils.h"
+#include "trace_recorder.h"
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <algorithm>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 SDS011TUI::SDS011TUI() : mainWin(nullptr), headerWin(nullptr), dataWin(nullptr), 
-                          statsWin(nullptr), statusWin(nullptr) {}
+                          statsWin(nullptr), percentileWin(nullptr), statusWin(nullptr) {}
 
 SDS011TUI::~SDS011TUI() {
     cleanup();
@@ -24,7 +27,7 @@ bool SDS011TUI::initialize() {
     noecho();           // Don't echo pressed keys
     keypad(stdscr, TRUE); // Enable special keys
     curs_set(0);        // Hide cursor
-    timeout(100);       // Non-blocking getch with 100ms timeout
+    nodelay(stdscr, TRUE); // getch never waits; the event loop waits for stdin
     
     // Check if colors are supported
     if (has_colors()) {
@@ -34,6 +37,7 @@ bool SDS011TUI::initialize() {
         init_pair(3, COLOR_RED, COLOR_BLACK);     // High values
         init_pair(4, COLOR_CYAN, COLOR_BLACK);    // Headers
         init_pair(5, COLOR_WHITE, COLOR_BLUE);    // Status bar
+        init_pair(6, COLOR_MAGENTA, COLOR_BLACK); // Very unhealthy values
     }
     
     getmaxyx(stdscr, maxY, maxX);
@@ -54,6 +58,9 @@ void SDS011TUI::createWindows() {
     // Statistics window (right side, bottom)
     statsWin = newwin(3, maxX / 2, maxY - 5, maxX / 2);
     
+    // Percentile window (left side, bottom)
+    percentileWin = newwin(3, maxX / 2, maxY - 5, 0);
+    
     // Status window (bottom 2 lines)
     statusWin = newwin(2, maxX, maxY - 2, 0);
     
@@ -64,6 +71,7 @@ void SDS011TUI::createWindows() {
     box(headerWin, 0, 0);
     box(dataWin, 0, 0);
     box(statsWin, 0, 0);
+    box(percentileWin, 0, 0);
     box(statusWin, 0, 0);
 }
 
@@ -71,6 +79,7 @@ void SDS011TUI::cleanup() {
     if (headerWin) delwin(headerWin);
     if (dataWin) delwin(dataWin);
     if (statsWin) delwin(statsWin);
+    if (percentileWin) delwin(percentileWin);
     if (statusWin) delwin(statusWin);
     
     if (mainWin) {
@@ -96,8 +105,14 @@ void SDS011TUI::drawHeader(const std::string& port) {
     wrefresh(headerWin);
 }
 
-void SDS011TUI::addReading(float pm25, float pm10) {
-    readings.emplace_back(pm25, pm10);
+void SDS011TUI::addReading(float pm25, float pm10, std::chrono::system_clock::time_point timestamp) {
+    readings.emplace_back(pm25, pm10, timestamp);
+    pm25Digest.add(pm25);
+    pm10Digest.add(pm10);
+    
+    SensorReading& reading = readings.back();
+    aqiEngine.addReading(std::chrono::system_clock::to_time_t(reading.timestamp), pm25, pm10);
+    reading.aqi = aqiEngine.nowCastAQI();
     
     // Keep only the last MAX_READINGS
     if (readings.size() > MAX_READINGS) {
@@ -105,9 +120,12 @@ void SDS011TUI::addReading(float pm25, float pm10) {
     }
     
     // Update display
+    TraceRecorder::record(TraceEvent::RedrawStart, 0);
     updateDataWindow();
     updateStatsWindow();
+    updatePercentileWindow();
     updateStatusWindow();
+    TraceRecorder::record(TraceEvent::RedrawEnd, 0);
 }
 
 void SDS011TUI::updateDataWindow() {
@@ -132,18 +150,9 @@ void SDS011TUI::updateDataWindow() {
         auto time_t = std::chrono::system_clock::to_time_t(it->timestamp);
         auto tm = *std::localtime(&time_t);
         
-        // Color based on PM2.5 levels (WHO guidelines)
-        int colorPair = 1; // Green (good)
-        std::string quality = "Good";
-        
-        if (it->pm25 > 15.0) {
-            colorPair = 2; // Yellow (moderate)
-            quality = "Moderate";
-        }
-        if (it->pm25 > 25.0) {
-            colorPair = 3; // Red (unhealthy)
-            quality = "Poor";
-        }
+        // Color from the NowCast AQI at the time of the reading
+        int colorPair = AQIEngine::colorPair(it->aqi.level);
+        std::string quality = it->aqi.category;
         
         if (has_colors()) {
             wattron(dataWin, COLOR_PAIR(colorPair));
@@ -206,6 +215,32 @@ void SDS011TUI::updateStatsWindow() {
     wrefresh(statsWin);
 }
 
+void SDS011TUI::updatePercentileWindow() {
+    if (pm25Digest.count() == 0) return;
+    
+    wclear(percentileWin);
+    box(percentileWin, 0, 0);
+    
+    if (has_colors()) {
+        wattron(percentileWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    mvwprintw(percentileWin, 0, 2, "Percentiles (%.0f readings)", pm25Digest.count());
+    if (has_colors()) {
+        wattroff(percentileWin, COLOR_PAIR(4) | A_BOLD);
+    }
+    
+    mvwprintw(percentileWin, 1, 2, "PM2.5: P50 %s P90 %s P98 %s",
+              AppUtils::formatFloat(pm25Digest.quantile(0.50)).c_str(),
+              AppUtils::formatFloat(pm25Digest.quantile(0.90)).c_str(),
+              AppUtils::formatFloat(pm25Digest.quantile(0.98)).c_str());
+    mvwprintw(percentileWin, 2, 2, "PM10:  P50 %s P90 %s P98 %s",
+              AppUtils::formatFloat(pm10Digest.quantile(0.50)).c_str(),
+              AppUtils::formatFloat(pm10Digest.quantile(0.90)).c_str(),
+              AppUtils::formatFloat(pm10Digest.quantile(0.98)).c_str());
+    
+    wrefresh(percentileWin);
+}
+
 void SDS011TUI::updateStatusWindow() {
     wclear(statusWin);
     box(statusWin, 0, 0);
@@ -221,6 +256,11 @@ void SDS011TUI::updateStatusWindow() {
     mvwprintw(statusWin, 1, 2, "Status: Running | Last update: %02d:%02d:%02d | Total readings: %zu",
              tm.tm_hour, tm.tm_min, tm.tm_sec, readings.size());
     
+    AQIResult aqi = aqiEngine.nowCastAQI();
+    if (aqi.valid) {
+        wprintw(statusWin, " | AQI %d%s %s", aqi.index, aqi.provisional ? "*" : "", aqi.category);
+    }
+    
     if (has_colors()) {
         wattroff(statusWin, COLOR_PAIR(5));
     }
@@ -247,36 +287,53 @@ void SDS011TUI::showError(const std::string& message) {
 
 void SDS011TUI::clearData() {
     readings.clear();
+    aqiEngine.reset();
+    pm25Digest.reset();
+    pm10Digest.reset();
     updateDataWindow();
     updateStatsWindow();
     updateStatusWindow();
 }
 
 int SDS011TUI::handleInput() {
-    int ch = getch();
-    switch (ch) {
-        case 'q':
-        case 'Q':
-            return 1; // Quit
-        case 'c':
-        case 'C':
-            clearData();
-            break;
-        case KEY_RESIZE:
-            // Handle terminal resize
-            getmaxyx(stdscr, maxY, maxX);
-            wresize(headerWin, 3, maxX);
-            wresize(dataWin, maxY - 8, maxX);
-            wresize(statsWin, 3, maxX / 2);
-            mvwin(statsWin, maxY - 5, maxX / 2);
-            wresize(statusWin, 2, maxX);
-            mvwin(statusWin, maxY - 2, 0);
+    int ch;
+    while ((ch = getch()) != ERR) {
+        switch (ch) {
+            case 'q':
+            case 'Q':
+                return 1; // Quit
+            case 'c':
+            case 'C':
+                clearData();
+                break;
+            case KEY_RESIZE:
+                // Handle terminal resize
+                getmaxyx(stdscr, maxY, maxX);
+                wresize(headerWin, 3, maxX);
+                wresize(dataWin, maxY - 8, maxX);
+                wresize(statsWin, 3, maxX / 2);
+                mvwin(statsWin, maxY - 5, maxX / 2);
+                wresize(percentileWin, 3, maxX / 2);
+                mvwin(percentileWin, maxY - 5, 0);
+                wresize(statusWin, 2, maxX);
+                mvwin(statusWin, maxY - 2, 0);
             
-            // Redraw everything
-            updateDataWindow();
-            updateStatsWindow();
-            updateStatusWindow();
-            break;
+                // Redraw everything
+                updateDataWindow();
+                updateStatsWindow();
+                updatePercentileWindow();
+                updateStatusWindow();
+                break;
+        }
     }
     return 0;
 }
+
+void SDS011TUI::resize() {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) {
+        resizeterm(ws.ws_row, ws.ws_col);
+    }
+    ungetch(KEY_RESIZE);
+    handleInput();
+}
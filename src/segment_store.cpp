@@ -0,0 +1,991 @@
+#include "segment_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(SegmentRecord) == 24, "SegmentRecord is an on-disk format");
+static_assert(sizeof(AggregateRecord) == 64, "AggregateRecord is an on-disk format");
+
+namespace {
+    const char SEGMENT_MAGIC[8] = {'S', 'D', 'S', 'S', 'E', 'G', '\r', '\n'};
+    const uint32_t SEGMENT_VERSION = 1;
+    const char* CATALOG_FILE = "catalog";
+    const size_t WRITE_BATCH = 2048;    // records buffered per sensor before a write
+    const size_t READ_BLOCKS = 16;      // blocks per read while scanning a range
+
+    struct SegmentHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t kind;
+        uint32_t recordSize;
+        uint32_t blockRecords;
+        uint64_t records;           // these four are set when the segment is sealed
+        int64_t minTimestamp;
+        int64_t maxTimestamp;
+        uint64_t indexOffset;       // 0 while the segment is open
+        uint8_t reserved[8];
+    };
+    static_assert(sizeof(SegmentHeader) == SegmentStore::HEADER_BYTES, "SegmentHeader is an on-disk format");
+
+    int64_t recordTime(const SegmentRecord& record) { return record.timestamp_ms; }
+    int64_t recordTime(const AggregateRecord& record) { return record.start_ms; }
+
+    bool writeAll(int fd, const void* data, size_t size, uint64_t offset) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool readAll(int fd, void* data, size_t size, uint64_t offset) {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0) {
+            ssize_t n = pread(fd, bytes, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    bool syncData(int fd) {
+#ifdef LINUX
+        return fdatasync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    // A created or renamed file only survives a power loss once its directory is synced too
+    bool syncDirectory(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        bool ok = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        return ok;
+    }
+
+    SegmentHeader makeHeader(SegmentKind kind, uint32_t blockRecords) {
+        SegmentHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SEGMENT_MAGIC, sizeof(header.magic));
+        header.version = SEGMENT_VERSION;
+        header.kind = static_cast<uint32_t>(kind);
+        header.recordSize = static_cast<uint32_t>(SegmentStore::recordSize(kind));
+        header.blockRecords = blockRecords;
+        return header;
+    }
+
+    bool readHeader(int fd, SegmentHeader& header) {
+        return readAll(fd, &header, sizeof(header), 0) && memcmp(header.magic, SEGMENT_MAGIC, 8) == 0 &&
+               header.version == SEGMENT_VERSION && header.kind < static_cast<uint32_t>(SegmentStore::KIND_COUNT) &&
+               header.recordSize == SegmentStore::recordSize(static_cast<SegmentKind>(header.kind)) &&
+               header.blockRecords > 0;
+    }
+
+    bool isDirectory(const std::string& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+
+    bool endsWith(const std::string& name, const char* suffix) {
+        size_t length = strlen(suffix);
+        return name.size() > length && name.compare(name.size() - length, length, suffix) == 0;
+    }
+
+    // Entries of a directory, sorted, without "." and ".."
+    std::vector<std::string> listDirectory(const std::string& path) {
+        std::vector<std::string> names;
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            return names;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    uint64_t blockCount(uint64_t records, uint32_t blockRecords) {
+        return (records + blockRecords - 1) / blockRecords;
+    }
+
+    std::string segmentName(SegmentKind kind, int64_t firstMs) {
+        char name[48];
+        snprintf(name, sizeof(name), "%s-%016lld.seg", SegmentStore::kindName(kind), static_cast<long long>(firstMs));
+        return name;
+    }
+}
+
+// SegmentRecord implementation
+SegmentRecord SegmentRecord::fromRow(const HistoryRow& row) {
+    SegmentRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp_ms = row.timestamp_ms;
+    record.pm25_raw = row.pm25_raw;
+    record.pm10_raw = row.pm10_raw;
+    record.pm25_corrected_raw = row.pm25_corrected_raw;
+    record.pm10_corrected_raw = row.pm10_corrected_raw;
+    record.humidity = row.humidity;
+    record.flags = row.flags;
+    return record;
+}
+
+HistoryRow SegmentRecord::toRow() const {
+    HistoryRow row;
+    row.timestamp_ms = timestamp_ms;
+    row.pm25_raw = pm25_raw;
+    row.pm10_raw = pm10_raw;
+    row.pm25_corrected_raw = pm25_corrected_raw;
+    row.pm10_corrected_raw = pm10_corrected_raw;
+    row.humidity = humidity;
+    row.flags = flags;
+    return row;
+}
+
+// AggregateRecord implementation
+AggregateRecord AggregateRecord::empty(int64_t startMs) {
+    AggregateRecord record;
+    memset(&record, 0, sizeof(record));
+    record.start_ms = startMs;
+    record.min[0] = record.min[1] = 0xFFFF;
+    return record;
+}
+
+void AggregateRecord::add(const SegmentRecord& record) {
+    const uint16_t values[2] = {record.pm25_corrected_raw, record.pm10_corrected_raw};
+    const uint8_t outliers[2] = {ReadingFlags::OutlierPM25, ReadingFlags::OutlierPM10};
+    readings++;
+    flags |= record.flags & (ReadingFlags::GapBefore | ReadingFlags::HumidityCorrected);
+    for (int p = 0; p < 2; ++p) {
+        if (record.flags & outliers[p]) continue;
+        double value = values[p];
+        count[p]++;
+        sum[p] += value;
+        sumSquares[p] += value * value;
+        min[p] = std::min(min[p], values[p]);
+        max[p] = std::max(max[p], values[p]);
+    }
+}
+
+void AggregateRecord::merge(const AggregateRecord& other) {
+    readings += other.readings;
+    flags |= other.flags;
+    for (int p = 0; p < 2; ++p) {
+        count[p] += other.count[p];
+        sum[p] += other.sum[p];
+        sumSquares[p] += other.sumSquares[p];
+        min[p] = std::min(min[p], other.min[p]);
+        max[p] = std::max(max[p], other.max[p]);
+    }
+}
+
+double AggregateRecord::mean(int pollutant) const {
+    return count[pollutant] ? sum[pollutant] / count[pollutant] / 10.0 : 0.0;
+}
+
+double AggregateRecord::stddev(int pollutant) const {
+    if (count[pollutant] == 0) {
+        return 0.0;
+    }
+    double mean = sum[pollutant] / count[pollutant];
+    double variance = sumSquares[pollutant] / count[pollutant] - mean * mean;
+    return std::sqrt(std::max(0.0, variance)) / 10.0;
+}
+
+// SegmentStore implementation
+SegmentStore::SegmentStore() : blockRecords(DEFAULT_BLOCK_RECORDS), segmentRecords(DEFAULT_SEGMENT_RECORDS) {}
+
+SegmentStore::~SegmentStore() {
+    close();
+}
+
+size_t SegmentStore::recordSize(SegmentKind kind) {
+    return kind == SegmentKind::Raw ? sizeof(SegmentRecord) : sizeof(AggregateRecord);
+}
+
+uint64_t SegmentStore::segmentBytes(const SegmentInfo& info) {
+    // The index adds another 8 bytes per block, a fraction of a percent
+    return HEADER_BYTES + info.records * recordSize(info.kind);
+}
+
+const char* SegmentStore::kindName(SegmentKind kind) {
+    switch (kind) {
+        case SegmentKind::Raw: return "raw";
+        case SegmentKind::Minute: return "minute";
+        case SegmentKind::Hour: return "hour";
+    }
+    return "unknown";
+}
+
+bool SegmentStore::parseKind(const std::string& name, SegmentKind& kind) {
+    for (int i = 0; i < KIND_COUNT; ++i) {
+        if (name == kindName(static_cast<SegmentKind>(i))) {
+            kind = static_cast<SegmentKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string SegmentStore::encodeName(const std::string& sensor) {
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string name;
+    for (size_t i = 0; i < sensor.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(sensor[i]);
+        // A leading dot would make hidden names, "." or ".."
+        bool plain = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                     c == '_' || c == '-' || (c == '.' && i > 0);
+        if (plain) {
+            name += static_cast<char>(c);
+        } else {
+            name += '%';
+            name += HEX[c >> 4];
+            name += HEX[c & 0x0F];
+        }
+    }
+    return name;
+}
+
+std::string SegmentStore::decodeName(const std::string& name) {
+    std::string sensor;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '%' && i + 2 < name.size()) {
+            sensor += static_cast<char>(std::strtol(name.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            sensor += name[i];
+        }
+    }
+    return sensor;
+}
+
+bool SegmentStore::open(const std::string& path, uint32_t blocks, uint64_t records) {
+    std::lock_guard<std::mutex> lock(mutex);
+    closeLocked();
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create segment store " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!isDirectory(path)) {
+        std::cerr << "Segment store " << path << " is not a directory" << std::endl;
+        return false;
+    }
+    directory = path;
+    blockRecords = std::max<uint32_t>(1, blocks);
+    segmentRecords = std::max<uint64_t>(1, records);
+
+    std::map<std::string, SegmentInfo> catalog;
+    size_t catalogLines = loadCatalog(catalog);
+
+    // The catalog is only a cache of the sealed segments' headers; the files decide
+    size_t sealed = 0;
+    bool changed = false;
+    for (const std::string& name : listDirectory(directory)) {
+        std::string sensorPath = directory + "/" + name;
+        if (name[0] == '.' || !isDirectory(sensorPath)) continue;
+
+        std::vector<std::string> files;
+        for (const std::string& file : listDirectory(sensorPath)) {
+            if (endsWith(file, ".seg")) {
+                files.push_back(file);
+            } else if (endsWith(file, ".tmp")) {
+                unlink((sensorPath + "/" + file).c_str());     // compaction output never swapped in
+            }
+        }
+        if (files.empty()) continue;
+
+        std::string sensor = decodeName(name);
+        Series& entry = series[sensor];
+        entry.directory = name;
+        // Names sort by kind, then time: the newest raw segment is the last "raw-" file
+        size_t lastRaw = files.size();
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (files[i].compare(0, 4, "raw-") == 0) lastRaw = i;
+        }
+        for (size_t i = 0; i < files.size(); ++i) {
+            Segment segment;
+            segment.info.sensor = sensor;
+            segment.info.path = name + "/" + files[i];
+            auto known = catalog.find(segment.info.path);
+            if (known != catalog.end()) {
+                segment.info = known->second;
+                segment.info.sensor = sensor;
+                segment.blockRecords = 0;   // read with the index
+            } else {
+                changed = true;
+                if (!recover(entry, segment, i == lastRaw)) continue;
+            }
+            if (segment.info.sealed) sealed++;
+            entry.tiers[static_cast<int>(segment.info.kind)].push_back(segment);
+        }
+        for (const std::vector<Segment>& tier : entry.tiers) {
+            if (!tier.empty()) {
+                entry.lastTimestamp = std::max(entry.lastTimestamp, tier.back().info.maxTimestamp);
+            }
+        }
+    }
+
+    // Rewritten without the entries and removals appended since it was last compacted
+    if (changed || sealed != catalog.size() || catalogLines != sealed) {
+        writeCatalog();
+    }
+    return true;
+}
+
+void SegmentStore::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closeLocked();
+}
+
+void SegmentStore::closeLocked() {
+    for (auto& item : series) {
+        Series& entry = item.second;
+        writeBuffer(entry);
+        if (entry.fd >= 0) {
+            syncData(entry.fd);
+            ::close(entry.fd);
+            entry.fd = -1;
+        }
+    }
+    series.clear();
+    directory.clear();
+}
+
+bool SegmentStore::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !directory.empty();
+}
+
+std::string SegmentStore::getDirectory() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return directory;
+}
+
+size_t SegmentStore::loadCatalog(std::map<std::string, SegmentInfo>& catalog) const {
+    std::ifstream in((directory + "/" + CATALOG_FILE).c_str());
+
+    // "<kind> <min_ms> <max_ms> <records> <path>" adds a segment and "- <path>" drops it;
+    // the sensor comes from the directory name. A torn last line is skipped.
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        lines++;
+        std::istringstream iss(line);
+        std::string kind;
+        SegmentInfo info;
+        if (line.compare(0, 2, "- ") == 0) {
+            catalog.erase(line.substr(2));
+            continue;
+        }
+        if (!(iss >> kind >> info.minTimestamp >> info.maxTimestamp >> info.records >> info.path) ||
+            !parseKind(kind, info.kind)) {
+            continue;
+        }
+        info.sealed = true;
+        catalog[info.path] = info;
+    }
+    return lines;
+}
+
+std::string SegmentStore::catalogLine(const SegmentInfo& info) {
+    char line[96];
+    snprintf(line, sizeof(line), "%s %lld %lld %llu ", kindName(info.kind), static_cast<long long>(info.minTimestamp),
+             static_cast<long long>(info.maxTimestamp), static_cast<unsigned long long>(info.records));
+    return line + info.path + "\n";
+}
+
+bool SegmentStore::writeCatalog() const {
+    // Written aside, synced and renamed, so a crash leaves the old or the new catalog
+    std::string path = directory + "/" + CATALOG_FILE;
+    std::string temporary = path + ".tmp";
+    std::string text = "# kind min_ms max_ms records path, or - path\n";
+    for (const auto& item : series) {
+        for (const std::vector<Segment>& tier : item.second.tiers) {
+            for (const Segment& segment : tier) {
+                if (segment.info.sealed) text += catalogLine(segment.info);
+            }
+        }
+    }
+
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && writeAll(fd, text.data(), text.size(), 0) && syncData(fd);
+    if (fd >= 0) ::close(fd);
+    if (!ok) {
+        std::cerr << "Cannot write segment catalog " << temporary << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0 || !syncDirectory(directory)) {
+        std::cerr << "Cannot replace segment catalog " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SegmentStore::appendCatalog(const std::string& lines) const {
+    // One O_APPEND write: the catalog changes in O(1) whatever its size, and a crash tears at most the last line.
+    // It is synced, so a segment the lines drop can be deleted afterwards.
+    std::string path = directory + "/" + CATALOG_FILE;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write(fd, lines.data(), lines.size()) == static_cast<ssize_t>(lines.size()) &&
+              syncData(fd);
+    if (fd >= 0) ::close(fd);
+    if (!ok) {
+        std::cerr << "Cannot append to segment catalog " << path << ": " << strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+bool SegmentStore::recover(Series& entry, Segment& segment, bool last) {
+    std::string path = directory + "/" + segment.info.path;
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    SegmentHeader header;
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || !readHeader(fd, header)) {
+        std::cerr << "Ignoring invalid segment " << path << std::endl;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    segment.info.kind = static_cast<SegmentKind>(header.kind);
+    segment.blockRecords = header.blockRecords;
+    if (header.indexOffset != 0) {
+        segment.info.records = header.records;
+        segment.info.minTimestamp = header.minTimestamp;
+        segment.info.maxTimestamp = header.maxTimestamp;
+        segment.info.sealed = true;
+        ::close(fd);
+        return true;
+    }
+    if (segment.info.kind != SegmentKind::Raw) {
+        // Aggregates are written whole; an open one is a write that never finished
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    // Still open when the process stopped: keep the whole records, rebuild the index
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+    uint64_t records = size > sizeof(header) ? (size - sizeof(header)) / sizeof(SegmentRecord) : 0;
+    if (records == 0) {
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(sizeof(header) + records * sizeof(SegmentRecord))) != 0) {
+        std::cerr << "Cannot truncate torn segment " << path << std::endl;
+    }
+
+    uint64_t blocks = blockCount(records, segment.blockRecords);
+    segment.index.resize(blocks);
+    SegmentRecord lastRecord;
+    for (uint64_t block = 0; block < blocks; ++block) {
+        uint64_t offset = sizeof(header) + block * segment.blockRecords * sizeof(SegmentRecord);
+        if (!readAll(fd, &segment.index[block], sizeof(int64_t), offset)) {
+            ::close(fd);
+            return false;
+        }
+    }
+    if (!readAll(fd, &lastRecord, sizeof(lastRecord), sizeof(header) + (records - 1) * sizeof(SegmentRecord))) {
+        ::close(fd);
+        return false;
+    }
+    segment.info.records = records;
+    segment.info.minTimestamp = segment.index[0];
+    segment.info.maxTimestamp = lastRecord.timestamp_ms;
+
+    entry.fd = fd;
+    if (last) {
+        return true;
+    }
+    // An older segment left open: the process stopped while sealing it
+    return seal(entry, segment);
+}
+
+bool SegmentStore::makeDirectory(Series& entry, const std::string& sensor) {
+    if (!entry.directory.empty()) {
+        return true;
+    }
+    std::string name = encodeName(sensor);
+    std::string path = directory + "/" + name;
+    if ((mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) || !syncDirectory(directory)) {
+        std::cerr << "Cannot create segment directory " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    entry.directory = name;
+    return true;
+}
+
+bool SegmentStore::startSegment(Series& entry, const std::string& sensor, int64_t timestampMs) {
+    if (!makeDirectory(entry, sensor)) {
+        return false;
+    }
+
+    Segment segment;
+    segment.info.sensor = sensor;
+    segment.info.path = entry.directory + "/" + segmentName(SegmentKind::Raw, timestampMs);
+    segment.info.kind = SegmentKind::Raw;
+    segment.info.minTimestamp = segment.info.maxTimestamp = timestampMs;
+    segment.blockRecords = blockRecords;
+
+    std::string path = directory + "/" + segment.info.path;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    SegmentHeader header = makeHeader(SegmentKind::Raw, blockRecords);
+    // The file must outlive a crash once sync() says its readings are on disk
+    if (fd < 0 || !writeAll(fd, &header, sizeof(header), 0) || !syncDirectory(directory + "/" + entry.directory)) {
+        std::cerr << "Cannot create segment " << path << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    entry.fd = fd;
+    entry.tiers[static_cast<int>(SegmentKind::Raw)].push_back(segment);
+    return true;
+}
+
+bool SegmentStore::append(const std::string& sensor, const HistoryRow& row) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (directory.empty()) {
+        return false;
+    }
+    Series& entry = series[sensor];
+    SegmentRecord record = SegmentRecord::fromRow(row);
+    record.timestamp_ms = std::max(record.timestamp_ms, entry.lastTimestamp);
+    if (entry.fd < 0 && !startSegment(entry, sensor, record.timestamp_ms)) {
+        return false;
+    }
+
+    Segment& segment = entry.tiers[static_cast<int>(SegmentKind::Raw)].back();
+    if (segment.info.records % segment.blockRecords == 0) {
+        segment.index.push_back(record.timestamp_ms);
+    }
+    segment.info.maxTimestamp = record.timestamp_ms;
+    segment.info.records++;
+    entry.buffer.push_back(record);
+    entry.lastTimestamp = record.timestamp_ms;
+
+    if (entry.buffer.size() >= WRITE_BATCH && !writeBuffer(entry)) {
+        return false;
+    }
+    if (segment.info.records >= segmentRecords) {
+        if (!seal(entry, segment)) {
+            return false;
+        }
+        std::string line = catalogLine(segment.info);
+        lock.unlock();
+        return appendCatalog(line);
+    }
+    return true;
+}
+
+bool SegmentStore::writeBuffer(Series& entry) {
+    if (entry.buffer.empty() || entry.fd < 0) {
+        return true;
+    }
+    const Segment& segment = entry.tiers[static_cast<int>(SegmentKind::Raw)].back();
+    uint64_t offset = sizeof(SegmentHeader) + (segment.info.records - entry.buffer.size()) * sizeof(SegmentRecord);
+    if (!writeAll(entry.fd, entry.buffer.data(), entry.buffer.size() * sizeof(SegmentRecord), offset)) {
+        std::cerr << "Error writing segment " << segment.info.path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    entry.buffer.clear();
+    return true;
+}
+
+bool SegmentStore::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool ok = true;
+    for (auto& item : series) {
+        ok = writeBuffer(item.second) && ok;
+    }
+    return ok;
+}
+
+bool SegmentStore::sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool ok = true;
+    for (auto& item : series) {
+        Series& entry = item.second;
+        ok = writeBuffer(entry) && ok;
+        if (entry.fd >= 0 && !syncData(entry.fd)) {
+            std::cerr << "Error syncing segment of " << item.first << ": " << strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+std::vector<SegmentInfo> SegmentStore::openSegments() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SegmentInfo> result;
+    for (const auto& item : series) {
+        if (item.second.fd >= 0) {
+            result.push_back(item.second.tiers[static_cast<int>(SegmentKind::Raw)].back().info);
+        }
+    }
+    return result;
+}
+
+bool SegmentStore::rollback(const std::vector<SegmentInfo>& durable) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, const SegmentInfo*> known;
+    for (const SegmentInfo& info : durable) {
+        known[info.path] = &info;
+    }
+
+    bool ok = true;
+    for (auto& item : series) {
+        Series& entry = item.second;
+        if (entry.fd < 0) continue;
+        std::vector<Segment>& raw = entry.tiers[static_cast<int>(SegmentKind::Raw)];
+        Segment& segment = raw.back();
+        entry.buffer.clear();
+        auto found = known.find(segment.info.path);
+        uint64_t records = (found == known.end()) ? 0 : std::min(found->second->records, segment.info.records);
+
+        if (records == 0) {
+            // Started after the durable state: everything in it is unsynced
+            ::close(entry.fd);
+            entry.fd = -1;
+            unlink((directory + "/" + segment.info.path).c_str());
+            raw.pop_back();
+        } else if (records < segment.info.records) {
+            if (ftruncate(entry.fd, static_cast<off_t>(sizeof(SegmentHeader) + records * sizeof(SegmentRecord))) != 0) {
+                std::cerr << "Cannot truncate segment " << segment.info.path << ": " << strerror(errno) << std::endl;
+                ok = false;
+                continue;
+            }
+            segment.info.records = records;
+            segment.info.maxTimestamp = found->second->maxTimestamp;
+            segment.index.resize(blockCount(records, segment.blockRecords));
+        }
+
+        entry.lastTimestamp = INT64_MIN;
+        for (const std::vector<Segment>& tier : entry.tiers) {
+            if (!tier.empty()) {
+                entry.lastTimestamp = std::max(entry.lastTimestamp, tier.back().info.maxTimestamp);
+            }
+        }
+    }
+    return ok;
+}
+
+int64_t SegmentStore::lastTimestamp(const std::string& sensor) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = series.find(sensor);
+    return found == series.end() ? INT64_MIN : found->second.lastTimestamp;
+}
+
+bool SegmentStore::seal(Series& entry, Segment& segment) {
+    if (!writeBuffer(entry)) {
+        return false;
+    }
+
+    // The index reaches the disk before the header that points to it
+    uint64_t indexOffset = sizeof(SegmentHeader) + segment.info.records * sizeof(SegmentRecord);
+    SegmentHeader header;
+    bool ok = writeAll(entry.fd, segment.index.data(), segment.index.size() * sizeof(int64_t), indexOffset) &&
+              syncData(entry.fd) && readAll(entry.fd, &header, sizeof(header), 0);
+    if (ok) {
+        header.records = segment.info.records;
+        header.minTimestamp = segment.info.minTimestamp;
+        header.maxTimestamp = segment.info.maxTimestamp;
+        header.indexOffset = indexOffset;
+        ok = writeAll(entry.fd, &header, sizeof(header), 0) && syncData(entry.fd);
+    }
+    if (!ok) {
+        std::cerr << "Error sealing segment " << segment.info.path << ": " << strerror(errno) << std::endl;
+    }
+    ::close(entry.fd);
+    entry.fd = -1;
+    segment.info.sealed = ok;
+    return ok;
+}
+
+bool SegmentStore::loadIndex(Segment& segment) const {
+    if (!segment.index.empty() || segment.info.records == 0) {
+        return true;
+    }
+
+    std::string path = directory + "/" + segment.info.path;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    SegmentHeader header;
+    bool ok = fd >= 0 && readHeader(fd, header) && header.indexOffset != 0;
+    if (ok) {
+        segment.blockRecords = header.blockRecords;
+        segment.index.resize(blockCount(segment.info.records, segment.blockRecords));
+        ok = readAll(fd, segment.index.data(), segment.index.size() * sizeof(int64_t), header.indexOffset);
+    }
+    if (fd >= 0) ::close(fd);
+    if (!ok) {
+        std::cerr << "Cannot read the index of segment " << path << std::endl;
+        segment.index.clear();
+    }
+    return ok;
+}
+
+template <typename Record, typename Fn>
+void SegmentStore::scan(Series& entry, SegmentKind kind, int64_t fromMs, int64_t toMs, SegmentQueryStats* stats,
+                        Fn fn) {
+    // Segments of a tier do not overlap, so their max times are sorted too
+    std::vector<Segment>& list = entry.tiers[static_cast<int>(kind)];
+    auto segment = std::partition_point(list.begin(), list.end(), [fromMs](const Segment& candidate) {
+        return candidate.info.maxTimestamp < fromMs;
+    });
+
+    std::vector<Record> records;
+    bool done = false;
+    for (; segment != list.end() && !done && segment->info.minTimestamp < toMs; ++segment) {
+        if (!loadIndex(*segment) || segment->index.empty()) continue;
+        bool open = (kind == SegmentKind::Raw && entry.fd >= 0 && &*segment == &list.back());
+        int fd = open ? entry.fd : ::open((directory + "/" + segment->info.path).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+
+        // The block before the first one starting at fromMs may end with matching records
+        size_t block = std::lower_bound(segment->index.begin(), segment->index.end(), fromMs) - segment->index.begin();
+        uint64_t row = (block > 0 ? block - 1 : 0) * static_cast<uint64_t>(segment->blockRecords);
+        while (!done && row < segment->info.records) {
+            size_t count = static_cast<size_t>(std::min<uint64_t>(READ_BLOCKS * segment->blockRecords,
+                                                                  segment->info.records - row));
+            records.resize(count);
+            if (!readAll(fd, records.data(), count * sizeof(Record), sizeof(SegmentHeader) + row * sizeof(Record))) {
+                break;
+            }
+            if (stats) {
+                stats->blocks += blockCount(count, segment->blockRecords);
+                stats->bytes += count * sizeof(Record);
+            }
+            for (const Record& record : records) {
+                if (recordTime(record) < fromMs) continue;
+                if (recordTime(record) >= toMs || !fn(record)) {
+                    done = true;
+                    break;
+                }
+            }
+            row += count;
+        }
+
+        if (stats) stats->segments++;
+        if (!open) ::close(fd);
+    }
+}
+
+size_t SegmentStore::query(const std::string& sensor, int64_t fromMs, int64_t toMs, std::vector<HistoryRow>& out,
+                           SegmentQueryStats* stats, size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = series.find(sensor);
+    if (found == series.end() || fromMs >= toMs) {
+        return 0;
+    }
+    writeBuffer(found->second);
+
+    size_t before = out.size();
+    scan<SegmentRecord>(found->second, SegmentKind::Raw, fromMs, toMs, stats,
+                        [&out, before, limit](const SegmentRecord& record) {
+        if (out.size() - before >= limit) {
+            return false;
+        }
+        out.push_back(record.toRow());
+        return true;
+    });
+    return out.size() - before;
+}
+
+size_t SegmentStore::queryAggregates(const std::string& sensor, SegmentKind kind, int64_t fromMs, int64_t toMs,
+                                     std::vector<AggregateRecord>& out, SegmentQueryStats* stats, size_t limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = series.find(sensor);
+    if (found == series.end() || fromMs >= toMs || kind == SegmentKind::Raw) {
+        return 0;
+    }
+
+    size_t before = out.size();
+    scan<AggregateRecord>(found->second, kind, fromMs, toMs, stats,
+                          [&out, before, limit](const AggregateRecord& record) {
+        if (out.size() > before && out.back().start_ms == record.start_ms) {
+            out.back().merge(record);
+        } else if (out.size() - before >= limit) {
+            return false;
+        } else {
+            out.push_back(record);
+        }
+        return true;
+    });
+    return out.size() - before;
+}
+
+std::vector<std::string> SegmentStore::sensorIds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> ids;
+    for (const auto& item : series) {
+        for (const std::vector<Segment>& tier : item.second.tiers) {
+            if (!tier.empty()) {
+                ids.push_back(item.first);
+                break;
+            }
+        }
+    }
+    return ids;
+}
+
+std::vector<SegmentInfo> SegmentStore::segments(const std::string& sensor, SegmentKind kind) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SegmentInfo> result;
+    auto found = series.find(sensor);
+    if (found != series.end()) {
+        for (const Segment& segment : found->second.tiers[static_cast<int>(kind)]) {
+            result.push_back(segment.info);
+        }
+    }
+    return result;
+}
+
+std::vector<SegmentInfo> SegmentStore::sealedSegments() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<SegmentInfo> result;
+    for (const auto& item : series) {
+        for (const std::vector<Segment>& tier : item.second.tiers) {
+            for (const Segment& segment : tier) {
+                if (segment.info.sealed) result.push_back(segment.info);
+            }
+        }
+    }
+    return result;
+}
+
+uint64_t SegmentStore::sizeOnDisk() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t bytes = 0;
+    for (const auto& item : series) {
+        for (const std::vector<Segment>& tier : item.second.tiers) {
+            for (const Segment& segment : tier) {
+                bytes += segmentBytes(segment.info);
+            }
+        }
+    }
+    return bytes;
+}
+
+bool SegmentStore::writeSegment(const SegmentInfo& source, SegmentKind kind, const void* records, uint64_t count,
+                                SegmentInfo& info) {
+    size_t dash = source.path.rfind('-');
+    if (count == 0 || dash == std::string::npos) {
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(records);
+    const size_t size = recordSize(kind);
+    int64_t first, last;
+    memcpy(&first, bytes, sizeof(first));
+    memcpy(&last, bytes + (count - 1) * size, sizeof(last));
+
+    std::string path, parent;
+    uint32_t blocks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = series.find(source.sensor);
+        if (directory.empty() || found == series.end()) {
+            return false;
+        }
+        // "<dir>/raw-<time>.seg" becomes "<dir>/minute-<time>.seg"
+        info.sensor = source.sensor;
+        info.path = found->second.directory + "/" + kindName(kind) + source.path.substr(dash);
+        path = directory + "/" + info.path;
+        parent = directory + "/" + found->second.directory;
+        blocks = blockRecords;
+    }
+
+    std::vector<int64_t> index(blockCount(count, blocks));
+    for (size_t block = 0; block < index.size(); ++block) {
+        memcpy(&index[block], bytes + block * blocks * size, sizeof(int64_t));
+    }
+    SegmentHeader header = makeHeader(kind, blocks);
+    header.records = count;
+    header.minTimestamp = first;
+    header.maxTimestamp = last;
+    header.indexOffset = sizeof(header) + count * size;
+
+    // Complete and synced under a temporary name, so only whole segments ever carry the .seg name
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && writeAll(fd, &header, sizeof(header), 0) && writeAll(fd, bytes, count * size, sizeof(header)) &&
+              writeAll(fd, index.data(), index.size() * sizeof(int64_t), header.indexOffset) && syncData(fd);
+    if (fd >= 0) ::close(fd);
+    // replace() deletes the source once this is in the catalog, so the new name must be durable first
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0 || !syncDirectory(parent)) {
+        std::cerr << "Error writing segment " << path << ": " << strerror(errno) << std::endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    info.kind = kind;
+    info.minTimestamp = first;
+    info.maxTimestamp = last;
+    info.records = count;
+    info.sealed = true;
+    return true;
+}
+
+bool SegmentStore::replace(const SegmentInfo& segment, const SegmentInfo* replacement) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto found = series.find(segment.sensor);
+    if (found == series.end()) {
+        return false;
+    }
+    Series& entry = found->second;
+    std::vector<Segment>& tier = entry.tiers[static_cast<int>(segment.kind)];
+    auto old = std::find_if(tier.begin(), tier.end(), [&segment](const Segment& candidate) {
+        return candidate.info.path == segment.path;
+    });
+    if (old == tier.end() || !old->info.sealed) {
+        return false;
+    }
+    tier.erase(old);
+
+    if (replacement) {
+        // A compaction redone after a crash rewrites the same file; keep one entry for it
+        std::vector<Segment>& target = entry.tiers[static_cast<int>(replacement->kind)];
+        target.erase(std::remove_if(target.begin(), target.end(), [replacement](const Segment& candidate) {
+            return candidate.info.path == replacement->path;
+        }), target.end());
+        Segment added;
+        added.info = *replacement;
+        added.blockRecords = 0;     // read with the index
+        auto position = std::upper_bound(target.begin(), target.end(), added.info.minTimestamp,
+                                         [](int64_t time, const Segment& candidate) {
+            return time < candidate.info.minTimestamp;
+        });
+        target.insert(position, added);
+    }
+
+    // The old file goes only once the catalog no longer lists it
+    std::string path = directory + "/" + segment.path;
+    std::string lines = (replacement ? catalogLine(*replacement) : std::string()) + "- " + segment.path + "\n";
+    lock.unlock();
+    appendCatalog(lines);
+    unlink(path.c_str());
+    return true;
+}
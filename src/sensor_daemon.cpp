@@ -0,0 +1,1205 @@
+#include "sensor_daemon.h"
+#include "sds011_plugin.h"
+#include "metrics.h"
+#include "app_utils.h"
+#include "arrow_export.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    const size_t HISTORY_PIECE_ROWS = 1024;     // store rows read per piece of a HISTORY reply
+
+    int64_t unixMillis(std::chrono::system_clock::time_point tp) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+    }
+
+    bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool fillSocketAddress(const std::string& path, struct sockaddr_un& addr) {
+        if (path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Socket path too long: " << path << std::endl;
+            return false;
+        }
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return true;
+    }
+
+    DaemonReading toReading(const std::string& sensor, const HistoryRow& row) {
+        DaemonReading reading(sensor, row.timestamp_ms, row.pm25(), row.pm10());
+        if (row.flags & ReadingFlags::HumidityCorrected) {
+            reading.rh = row.humidity;
+            reading.pm25_corrected = row.pm25Corrected();
+            reading.pm10_corrected = row.pm10Corrected();
+        }
+        return reading;
+    }
+
+    // "BUCKET <sensor> <start_ms> <readings> <pm25 mean min max sd> <pm10 mean min max sd>", "-" without values
+    std::string toBucketLine(const std::string& sensor, const AggregateRecord& record) {
+        std::ostringstream oss;
+        oss << "BUCKET " << sensor << " " << record.start_ms << " " << record.readings;
+        for (int p = 0; p < 2; ++p) {
+            if (record.count[p] == 0) {
+                oss << " - - - -";
+                continue;
+            }
+            oss << " " << AppUtils::formatFloat(static_cast<float>(record.mean(p)))
+                << " " << AppUtils::formatFloat(record.min[p] / 10.0f)
+                << " " << AppUtils::formatFloat(record.max[p] / 10.0f)
+                << " " << AppUtils::formatFloat(static_cast<float>(record.stddev(p)));
+        }
+        return oss.str();
+    }
+}
+
+// DaemonReading implementation
+std::string DaemonReading::toLine() const {
+    std::ostringstream oss;
+    oss << "DATA " << sensor << " " << timestamp_ms << " "
+        << AppUtils::formatFloat(pm25) << " " << AppUtils::formatFloat(pm10);
+    if (isCorrected()) {
+        oss << " " << AppUtils::formatFloat(rh) << " " << AppUtils::formatFloat(pm25_corrected)
+            << " " << AppUtils::formatFloat(pm10_corrected);
+    }
+    return oss.str();
+}
+
+bool DaemonReading::fromLine(const std::string& line, DaemonReading& reading) {
+    std::istringstream iss(line);
+    std::string tag;
+    if (!(iss >> tag >> reading.sensor >> reading.timestamp_ms >> reading.pm25 >> reading.pm10) || tag != "DATA") {
+        return false;
+    }
+    if (!(iss >> reading.rh >> reading.pm25_corrected >> reading.pm10_corrected)) {
+        reading.rh = -1.0f;
+        reading.pm25_corrected = reading.pm25;
+        reading.pm10_corrected = reading.pm10;
+    }
+    return true;
+}
+
+// Rows copied out for an EXPORT, and what the worker made of them
+struct SensorDaemon::ExportJob {
+    std::string name;       // as the client gave it
+    std::string path;       // inside export_dir
+    ArrowExportFilter filter;
+    std::vector<std::pair<std::string, ReadingHistory>> histories;
+    std::atomic<bool> done;
+    bool ok;                // set before done
+    uint64_t rows;
+
+    ExportJob() : done(false), ok(false), rows(0) {}
+};
+
+// SensorDaemon implementation
+SensorDaemon::SensorDaemon(const DaemonConfig& cfg)
+    : config(cfg), dataFd(-1), listenFd(-1), stopRequested(false) {
+    wakePipe[0] = wakePipe[1] = -1;
+}
+
+SensorDaemon::~SensorDaemon() {
+    stop();
+    compactor.reset();
+    for (std::thread& thread : acquisitionThreads) {
+        thread.join();
+    }
+    reapExports(true);
+    closeClients();
+
+    // Readings published after run() returned, or without it
+    drainBuses();
+    persistPending(true);
+    if (io) {
+        io->drainWrites();
+    }
+    if (dataFd >= 0) {
+        close(dataFd);
+    }
+
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(config.socket_path.c_str());
+    }
+    for (int fd : wakePipe) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool SensorDaemon::start() {
+    struct sockaddr_un addr;
+    if (!fillSocketAddress(config.socket_path, addr)) {
+        return false;
+    }
+
+    // Claimed before any file is opened, so a second instance leaves the first one's alone.
+    // A previous instance that crashed leaves its socket file behind, refusing
+    // connections; one that accepts them belongs to a daemon still running
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+        bool live = connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        int error = errno;
+        close(probe);
+        if (live) {
+            std::cerr << "Control socket " << config.socket_path << " is in use by another daemon" << std::endl;
+            return false;
+        }
+        if (error == ECONNREFUSED) {
+            unlink(config.socket_path.c_str());
+        }
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Error creating control socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Commands can write exports and read every sensor: the owner only
+    if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        chmod(config.socket_path.c_str(), 0600) != 0 || listen(listenFd, 16) != 0) {
+        std::cerr << "Error binding control socket " << config.socket_path << ": "
+                  << strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    setNonBlocking(listenFd);
+
+    if (!config.humidity_source.empty() && !humidity.configure(config.humidity_source, config.humidity)) {
+        return false;
+    }
+
+    if (!config.data_file.empty()) {
+        loadHistory();
+        dataFd = open(config.data_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (dataFd < 0) {
+            std::cerr << "Error opening data file: " << config.data_file << std::endl;
+            return false;
+        }
+        io = IoBackend::create(config.io_backend);
+    }
+    if (!config.store_directory.empty() && !store.open(config.store_directory)) {
+        return false;
+    }
+    if (config.wal.enabled) {
+        if (!store.isOpen()) {
+            std::cerr << "--wal requires a segment store (--store)" << std::endl;
+            return false;
+        }
+        if (!recoverWal()) {
+            return false;
+        }
+    }
+    if (config.retention.enabled) {
+        if (!store.isOpen()) {
+            std::cerr << "--retention requires a segment store (--store)" << std::endl;
+            return false;
+        }
+        compactor.reset(new StoreCompactor(store, config.retention));
+        compactor->start();
+    }
+
+    alerts.setRules(config.alert_rules);
+    if (!config.alert_sink.empty()) {
+        alertSink.reset(new AlertSink());
+        if (!alertSink->open(config.alert_sink)) {
+            std::cerr << "Error opening alert sink: " << config.alert_sink << std::endl;
+            return false;
+        }
+    }
+
+    if (pipe(wakePipe) != 0 || !setNonBlocking(wakePipe[0]) || !setNonBlocking(wakePipe[1])) {
+        std::cerr << "Error creating wake-up pipe" << std::endl;
+        return false;
+    }
+
+    for (const std::string& port : config.ports) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stateFor(port).port = port;
+        }
+        std::unique_ptr<ReadingBus>& bus = buses[port];
+        if (!bus) {
+            bus.reset(new ReadingBus());
+            BusReader reader;
+            reader.port = port;
+            reader.consumer = bus->subscribe(BusPolicy::DropOldest);
+            reader.metrics = &MetricsRegistry::instance().forSensor(port);
+            busReaders.push_back(std::move(reader));
+        }
+    }
+    for (const auto& entry : buses) {
+        acquisitionThreads.emplace_back(&SensorDaemon::acquire, this, entry.first);
+    }
+
+    std::cout << "Daemon listening on " << config.socket_path << " with "
+              << config.ports.size() << " sensor(s)";
+    if (io) {
+        std::cout << ", writing " << config.data_file << " with " << io->name();
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+bool SensorDaemon::recoverWal() {
+    WalRecovery recovery;
+    if (!wal.open(config.store_directory + "/wal", config.wal, recovery)) {
+        return false;
+    }
+
+    // The store's unsynced tail may be torn: cut it back to the checkpoint, then re-append from the log
+    if (recovery.checkpointed) {
+        store.rollback(recovery.checkpoint);
+    }
+    size_t replayed = 0;
+    for (const auto& row : recovery.rows) {
+        if (row.second.timestamp_ms > store.lastTimestamp(row.first)) {
+            store.append(row.first, row.second);
+            replayed++;
+        }
+    }
+    if (!recovery.rows.empty() || recovery.tornBytes > 0) {
+        std::cout << "Recovered " << replayed << " readings from " << recovery.blocks << " write-ahead log blocks"
+                  << std::endl;
+    }
+
+    // Everything is in the store now; a checkpoint starts the log afresh
+    return store.sync() && wal.checkpoint(store.openSegments());
+}
+
+void SensorDaemon::loadHistory() {
+    std::ifstream in(config.data_file.c_str());
+    std::string line;
+    size_t loaded = 0;
+
+    // Lines are "unix_ms,sensor,pm25,pm10", plus ",rh,pm25_corrected,pm10_corrected" when corrected
+    while (std::getline(in, line)) {
+        std::istringstream iss(line);
+        std::string ts, sensor, pm25, pm10, rh, pm25c, pm10c;
+        if (!std::getline(iss, ts, ',') || !std::getline(iss, sensor, ',') ||
+            !std::getline(iss, pm25, ',') || !std::getline(iss, pm10, ',')) {
+            continue;
+        }
+
+        DaemonReading reading(sensor, std::atoll(ts.c_str()),
+                              std::strtof(pm25.c_str(), nullptr), std::strtof(pm10.c_str(), nullptr));
+        if (std::getline(iss, rh, ',') && std::getline(iss, pm25c, ',') && std::getline(iss, pm10c)) {
+            reading.rh = std::strtof(rh.c_str(), nullptr);
+            reading.pm25_corrected = std::strtof(pm25c.c_str(), nullptr);
+            reading.pm10_corrected = std::strtof(pm10c.c_str(), nullptr);
+        }
+        record(reading);
+        loaded++;
+    }
+
+    if (loaded > 0) {
+        std::cout << "Loaded " << loaded << " readings from " << config.data_file << std::endl;
+    }
+}
+
+void SensorDaemon::acquire(const std::string& port) {
+    ReadingBus& bus = *buses.at(port);
+    SDS011Plugin plugin;
+    SensorHealth health;
+    DeviceWatcher watcher;
+    SensorMetrics& metrics = MetricsRegistry::instance().forSensor(port);
+    bool opened = false;
+
+    while (g_running && !stopRequested) {
+        if (!health.isConnected()) {
+            // Wait out the backoff in short slices to stay responsive to shutdown;
+            // a new device node may be this sensor coming back, so try it at once
+            if (!health.reconnectDue(SampleClock::nowNs())) {
+                if (watcher.wait(100)) {
+                    health.onDeviceAdded(SampleClock::nowNs());
+                }
+                continue;
+            }
+            if (!plugin.initialize(port)) {
+                plugin.cleanup();
+                health.onConnectFailed(SampleClock::nowNs());
+                continue;
+            }
+            if (opened) {
+                metrics.reconnects.fetch_add(1, std::memory_order_relaxed);
+            }
+            opened = true;
+            health.onConnected(SampleClock::nowNs());
+        }
+
+        std::unique_ptr<SensorData> data = plugin.readData();
+        SDS011Data* sds = dynamic_cast<SDS011Data*>(data.get());
+        if (sds) {
+            BusReading reading;
+            reading.monotonic_ns = sds->monotonic_ns;
+            reading.timestamp_ms = sds->unixMs();
+            reading.pm25 = sds->pm25;
+            reading.pm10 = sds->pm10;
+            uint32_t missed = health.onFrame(sds->monotonic_ns);
+            if (missed) {
+                reading.flags |= ReadingFlags::GapBefore;
+                metrics.missedFrames.fetch_add(missed, std::memory_order_relaxed);
+            }
+            // Filtering, the history and clients are the consumers' business
+            bus.publish(reading);
+            wake();
+        }
+        health.observeChecksumFailures(metrics.checksumFailures.load(std::memory_order_relaxed));
+
+        // An unplugged or silent device is closed and reopened after the backoff
+        uint64_t now = SampleClock::nowNs();
+        if (plugin.isLinkLost() || health.state(now) == HealthState::Stalled) {
+            plugin.cleanup();
+            health.onDisconnected(now);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        SensorState& state = stateFor(port);
+        state.connected = health.isConnected();
+        state.health = health.state(now);
+        state.missedFrames = health.getMissedFrames();
+    }
+
+    plugin.cleanup();
+}
+
+SensorDaemon::SensorState& SensorDaemon::stateFor(const std::string& sensor) {
+    auto it = sensors.find(sensor);
+    if (it != sensors.end()) {
+        return it->second;
+    }
+
+    SensorState& state = sensors[sensor];
+    state.history.setCapacity(config.window_size);
+    state.filter.configure(config.filter);
+    state.aqi.setStandard(config.aqi_standard);
+    return state;
+}
+
+HistoryRow SensorDaemon::record(const DaemonReading& reading) {
+    SensorState& state = stateFor(reading.sensor);
+
+    // The filter is rebuilt from the same readings on restart, so flags need no persisting.
+    // It judges the sensor's own values; everything downstream uses the corrected ones.
+    uint8_t flags = state.filter.process(reading.timestamp_ms, reading.pm25, reading.pm10);
+
+    HistoryRow row = ReadingHistory::makeRow(reading.timestamp_ms, reading.pm25, reading.pm10,
+                                             reading.pm25_corrected, reading.pm10_corrected, reading.rh,
+                                             flags | reading.flags);
+    state.history.append(row);
+
+    if (!(flags & ReadingFlags::OutlierPM25)) state.pm25Digest.add(reading.pm25_corrected);
+    if (!(flags & ReadingFlags::OutlierPM10)) state.pm10Digest.add(reading.pm10_corrected);
+    if (!flags) {
+        state.aqi.addReading(reading.timestamp_ms / 1000, reading.pm25_corrected, reading.pm10_corrected);
+    }
+    return row;
+}
+
+size_t SensorDaemon::windowStart(const SensorState& state) const {
+    // The history keeps whole chunks; only the newest window_size readings are served
+    size_t size = state.history.size();
+    return (size > config.window_size) ? size - config.window_size : 0;
+}
+
+void SensorDaemon::publish(const DaemonReading& reading) {
+    ingest(reading);
+    wake();
+}
+
+void SensorDaemon::ingest(const DaemonReading& input) {
+    DaemonReading reading = input;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (humidity.isEnabled() && !reading.isCorrected()) {
+            CorrectedReading corrected = humidity.apply(reading.timestamp_ms, reading.pm25, reading.pm10);
+            if (corrected.corrected) {
+                reading.rh = corrected.rh;
+                reading.pm25_corrected = corrected.pm25;
+                reading.pm10_corrected = corrected.pm10;
+            }
+        }
+
+        HistoryRow row = record(reading);
+        uint8_t flags = row.flags & (ReadingFlags::OutlierPM25 | ReadingFlags::OutlierPM10);
+        if (flags) {
+            MetricsRegistry::instance().forSensor(reading.sensor).outliers.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (alerts.isEnabled()) {
+            // Outliers would fire alerts on a single glitch; their pollutant sits this one out
+            std::vector<AlertEvent> events;
+            alerts.process(reading.sensor, reading.timestamp_ms,
+                           (flags & ReadingFlags::OutlierPM25) ? NAN : reading.pm25_corrected,
+                           (flags & ReadingFlags::OutlierPM10) ? NAN : reading.pm10_corrected, events);
+            for (const AlertEvent& event : events) {
+                if (alertSink) {
+                    alertSink->write(event);
+                } else {
+                    std::cout << event.toLine() << std::endl;
+                }
+            }
+        }
+
+        if (dataFd >= 0) {
+            std::ostringstream line;
+            line << reading.timestamp_ms << "," << reading.sensor << ","
+                 << AppUtils::formatFloat(reading.pm25) << ","
+                 << AppUtils::formatFloat(reading.pm10);
+            if (reading.isCorrected()) {
+                line << "," << AppUtils::formatFloat(reading.rh) << ","
+                     << AppUtils::formatFloat(reading.pm25_corrected) << ","
+                     << AppUtils::formatFloat(reading.pm10_corrected);
+            }
+            line << "\n";
+            pendingLog += line.str();
+        }
+        if (!config.store_directory.empty()) {
+            pendingRows.push_back(std::make_pair(reading.sensor, row));
+        }
+
+        pending.push_back(reading);
+    }
+}
+
+void SensorDaemon::drainBuses() {
+    BusReading reading;
+    for (BusReader& reader : busReaders) {
+        while (reader.consumer->poll(reading)) {
+            DaemonReading converted(reader.port, reading.timestamp_ms, reading.pm25, reading.pm10);
+            converted.flags = reading.flags;
+            ingest(converted);
+            reader.metrics->queueWait.record(SampleClock::nowNs() - reading.monotonic_ns);
+        }
+        reader.metrics->busDropped.store(reader.consumer->stats().dropped, std::memory_order_relaxed);
+    }
+}
+
+std::unique_ptr<BusConsumer> SensorDaemon::subscribe(const std::string& port, BusPolicy policy) {
+    auto it = buses.find(port);
+    if (it == buses.end()) {
+        return std::unique_ptr<BusConsumer>();
+    }
+    return it->second->subscribe(policy);
+}
+
+void SensorDaemon::wake() {
+    if (wakePipe[1] >= 0) {
+        char byte = 1;
+        // A full pipe already guarantees a wake-up
+        ssize_t ignored = write(wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+void SensorDaemon::stop() {
+    stopRequested = true;
+    wake();
+}
+
+void SensorDaemon::run() {
+    std::vector<struct pollfd> fds;
+
+    while (g_running && !stopRequested) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakePipe[0], POLLIN, 0});
+        // Completions of earlier data file writes
+        fds.push_back({io ? io->fd() : -1, POLLIN, 0});
+        for (const Client& client : clients) {
+            // A client in the middle of a reply is not read until it is complete
+            short events = client.reply ? 0 : POLLIN;
+            if (!client.output.empty()) events |= POLLOUT;
+            fds.push_back({client.fd, events, 0});
+        }
+
+        // The timeout bounds how long a signal-driven shutdown can take, and a group commit waits
+        int64_t timeout = 500;
+        int64_t commitDue = wal.msUntilDue(SampleClock::nowNs());
+        if (commitDue >= 0) {
+            timeout = std::min(timeout, commitDue);
+        }
+        if (poll(fds.data(), fds.size(), static_cast<int>(timeout)) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Control socket poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+        }
+
+        // Existing clients first: indices in fds match clients before any change
+        std::vector<Client> alive;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            Client& client = clients[i];
+            short revents = fds[i + 3].revents;
+            bool ok = true;
+
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = readClient(client);
+            }
+            // A reply with nothing to send yet is waiting on an export; the worker wakes us when done
+            if (ok && ((revents & POLLOUT) || (client.reply && client.output.empty()))) {
+                ok = flushClient(client);
+            }
+
+            if (ok) {
+                alive.push_back(std::move(client));
+            } else {
+                close(client.fd);
+            }
+        }
+        clients.swap(alive);
+
+        drainBuses();
+        dispatchPending();
+        persistPending();
+
+        if (fds[0].revents & POLLIN) {
+            acceptClient();
+        }
+    }
+
+    closeClients();
+}
+
+void SensorDaemon::persistPending(bool force) {
+    std::string batch;
+    std::vector<std::pair<std::string, HistoryRow>> rows;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rows.swap(pendingRows);
+    }
+
+    uint64_t now = SampleClock::nowNs();
+    for (const auto& row : rows) {
+        store.append(row.first, row.second);
+        if (wal.isOpen()) {
+            wal.append(row.first, row.second, now);
+        }
+    }
+
+    // With a write-ahead log, writes wait for its group commit
+    if (wal.isOpen() && !force && !wal.due(now)) {
+        if (io) {
+            io->runOnce(0);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pendingLog);
+    }
+    if (wal.isOpen() && wal.commit() && wal.needsCheckpoint() && store.sync()) {
+        wal.checkpoint(store.openSegments());
+    }
+    if (!rows.empty() || wal.isOpen()) {
+        store.flush();
+    }
+
+    if (!io) {
+        return;
+    }
+    // Everything published since the last wake-up shares one write and one sync
+    if (!batch.empty()) {
+        io->queueWrite(dataFd, batch.data(), batch.size(), true);
+    }
+    io->runOnce(0);
+}
+
+void SensorDaemon::acceptClient() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        setNonBlocking(fd);
+
+        Client client;
+        client.fd = fd;
+        clients.push_back(std::move(client));
+    }
+}
+
+bool SensorDaemon::readClient(Client& client) {
+    char buffer[512];
+    while (true) {
+        ssize_t n = read(client.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            client.input.append(buffer, n);
+            continue;
+        }
+        if (n == 0) {
+            return false; // Client detached
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        break;
+    }
+
+    handleInput(client);
+
+    // A client that never sends a newline must not grow the buffer forever
+    if (client.input.size() > 4096 && client.input.find('\n') == std::string::npos) {
+        return false;
+    }
+    return flushClient(client);
+}
+
+void SensorDaemon::handleInput(Client& client) {
+    size_t newline;
+    while (!client.reply && (newline = client.input.find('\n')) != std::string::npos) {
+        std::string line = client.input.substr(0, newline);
+        client.input.erase(0, newline + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            handleCommand(client, line);
+        }
+    }
+}
+
+bool SensorDaemon::flushClient(Client& client) {
+    while (true) {
+        // A long reply is produced as the socket takes it
+        while (client.reply && client.output.size() < REPLY_PIECE_BYTES) {
+            size_t before = client.output.size();
+            if (!client.reply(client.output)) {
+                client.reply = nullptr;
+                client.output += client.held;
+                client.held.clear();
+                handleInput(client);
+            } else if (client.output.size() == before) {
+                break;      // nothing ready yet
+            }
+        }
+        if (client.output.empty()) {
+            break;
+        }
+
+        ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            client.output.erase(0, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+
+    // Only subscription traffic counts: a reply grows no faster than the client reads it
+    size_t backlog = client.held.size() + (client.reply ? 0 : client.output.size());
+    return backlog <= MAX_CLIENT_BACKLOG;
+}
+
+void SensorDaemon::handleCommand(Client& client, const std::string& line) {
+    std::istringstream iss(line);
+    std::string command;
+    iss >> command;
+
+    if (command == "PING") {
+        client.output += "OK\n";
+    } else if (command == "SENSORS") {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : sensors) {
+            client.output += "SENSOR " + entry.first + " " +
+                             (entry.second.connected ? "connected" : "waiting") + " " +
+                             std::to_string(entry.second.history.size() - windowStart(entry.second)) + " " +
+                             SensorHealth::stateName(entry.second.health) + " " +
+                             std::to_string(entry.second.missedFrames) + "\n";
+        }
+        client.output += "OK\n";
+    } else if (command == "ALERTS") {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const AlertEngine::ActiveAlert& alert : alerts.active()) {
+            client.output += "ALERT " + alert.rule + " " + alert.sensor + " " + std::to_string(alert.sinceMs) + " " +
+                             AppUtils::formatFloat(static_cast<float>(alert.value)) + "\n";
+        }
+        client.output += "OK\n";
+    } else if (command == "BUS") {
+        for (const auto& entry : buses) {
+            for (const BusConsumerStats& stats : entry.second->consumerStats()) {
+                client.output += "BUS " + entry.first + " " + std::to_string(stats.consumer) + " " +
+                                 ReadingBus::policyName(stats.policy) + " " +
+                                 std::to_string(stats.delivered) + " " + std::to_string(stats.dropped) + " " +
+                                 std::to_string(stats.skipped) + " " + std::to_string(stats.lag) + " " +
+                                 std::to_string(stats.maxLag) + "\n";
+            }
+        }
+        client.output += "OK\n";
+    } else if (command == "QUERY") {
+        std::string sensor;
+        double seconds = 0.0;
+        if (!(iss >> sensor >> seconds) || seconds < 0.0) {
+            client.output += "ERR usage: QUERY <sensor|*> <seconds>\n";
+            return;
+        }
+
+        ReplyPosition position;
+        position.filter = sensor;
+        position.startMs = unixMillis(std::chrono::system_clock::now()) - static_cast<int64_t>(seconds * 1000.0);
+        client.reply = [this, position](std::string& out) mutable {
+            return queryPiece(position, out);
+        };
+    } else if (command == "HISTORY") {
+        std::string sensor, tier;
+        int64_t from = 0, to = 0;
+        SegmentKind kind = SegmentKind::Raw;
+        if (!(iss >> sensor >> from >> to) || from > to || ((iss >> tier) && !SegmentStore::parseKind(tier, kind))) {
+            client.output += "ERR usage: HISTORY <sensor|*> <from_ms> <to_ms> [raw|minute|hour]\n";
+            return;
+        }
+        if (!store.isOpen()) {
+            client.output += "ERR no segment store (--store)\n";
+            return;
+        }
+
+        ReplyPosition position;
+        position.filter = sensor;
+        position.startMs = from;
+        position.toMs = to;
+        position.kind = kind;
+        client.reply = [this, position](std::string& out) mutable {
+            return historyPiece(position, out);
+        };
+    } else if (command == "EXPORT") {
+        std::string name, sensor, extra;
+        int64_t from = 0, to = 0;
+        bool valid = static_cast<bool>(iss >> name >> sensor);
+        bool ranged = valid && !(iss >> std::ws).eof();
+        if (ranged) {
+            valid = (iss >> from >> to) && from < to && !(iss >> extra);
+        }
+        if (!valid) {
+            client.output += "ERR usage: EXPORT <file> <sensor|*> [<from_ms> <to_ms>]\n";
+            return;
+        }
+        if (config.export_dir.empty()) {
+            client.output += "ERR export disabled: the daemon has no export directory\n";
+            return;
+        }
+        // Any client may export, so only a plain file name inside export_dir
+        if (name.find('/') != std::string::npos || name.find("..") != std::string::npos) {
+            client.output += "ERR export file must be a plain name: " + name + "\n";
+            return;
+        }
+
+        std::shared_ptr<ExportJob> job = std::make_shared<ExportJob>();
+        job->name = name;
+        job->path = config.export_dir + "/" + name;
+        if (ranged) {
+            job->filter.fromMs = from;
+            job->filter.toMs = to;
+        }
+        if (sensor != "*") {
+            job->filter.sensors.push_back(sensor);
+        }
+        {
+            // Only column slices are copied under the lock; the file is written by the worker
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& entry : sensors) {
+                if (!job->filter.includes(entry.first)) continue;
+                const ReadingHistory& history = entry.second.history;
+                size_t first = history.lowerBound(job->filter.fromMs);
+                size_t last = history.lowerBound(job->filter.toMs);
+                ReadingHistory copy(last - first);
+                history.forEachSlice(first, last - first,
+                                     [&copy](const ReadingHistory::Chunk& chunk, size_t begin, size_t end) {
+                    copy.appendSlice(chunk, begin, end);
+                });
+                job->histories.push_back(std::make_pair(entry.first, std::move(copy)));
+            }
+        }
+
+        reapExports(false);
+        exports.push_back(std::make_pair(job, std::thread([this, job]() {
+            std::vector<std::pair<std::string, const ReadingHistory*>> histories;
+            for (const auto& entry : job->histories) {
+                histories.push_back(std::make_pair(entry.first, &entry.second));
+            }
+            job->ok = ArrowWriter::exportHistories(job->path, histories, job->filter, &job->rows);
+            job->done = true;
+            wake();
+        })));
+        client.reply = [job](std::string& out) {
+            if (!job->done) {
+                return true;
+            }
+            if (job->ok) {
+                out += "EXPORTED " + std::to_string(job->rows) + " " + job->name + "\nOK\n";
+            } else {
+                out += "ERR cannot write " + job->name + "\n";
+            }
+            return false;
+        };
+    } else if (command == "SUBSCRIBE") {
+        std::string sensor;
+        if (!(iss >> sensor)) {
+            sensor = "*";
+        }
+        client.subscribed = true;
+        client.filter = sensor;
+        client.output += "OK\n";
+    } else if (command == "UNSUBSCRIBE") {
+        client.subscribed = false;
+        client.output += "OK\n";
+    } else if (command == "QUANTILES") {
+        std::string sensor;
+        if (!(iss >> sensor)) {
+            sensor = "*";
+        }
+        std::vector<double> qs;
+        double q;
+        while (iss >> q) {
+            if (q < 0.0 || q > 1.0) {
+                client.output += "ERR quantiles must be between 0 and 1\n";
+                return;
+            }
+            qs.push_back(q);
+        }
+        if (qs.empty()) {
+            qs = {0.5, 0.9, 0.98};
+        }
+
+        // Fleet-wide figures come from merging the per-sensor digests
+        TDigest pm25, pm10;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& entry : sensors) {
+                if (sensor != "*" && sensor != entry.first) continue;
+                pm25.merge(entry.second.pm25Digest);
+                pm10.merge(entry.second.pm10Digest);
+            }
+        }
+        if (pm25.count() == 0) {
+            client.output += "ERR no readings for " + sensor + "\n";
+            return;
+        }
+        for (double quantile : qs) {
+            client.output += "QUANTILE " + sensor + " " + AppUtils::formatFloat(quantile, 3) + " " +
+                             AppUtils::formatFloat(pm25.quantile(quantile)) + " " +
+                             AppUtils::formatFloat(pm10.quantile(quantile)) + "\n";
+        }
+        client.output += "OK\n";
+    } else if (command == "AQI") {
+        std::string sensor;
+        if (!(iss >> sensor)) {
+            sensor = "*";
+        }
+
+        // '*' marks figures whose averaging period is not fully covered yet
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : sensors) {
+            if (sensor != "*" && sensor != entry.first) continue;
+            AQIResult now = entry.second.aqi.nowCastAQI();
+            AQIResult daily = entry.second.aqi.dailyAQI();
+            if (!now.valid) continue;
+            client.output += "AQI " + entry.first + " " + AQIEngine::standardName(config.aqi_standard) + " " +
+                             std::to_string(now.index) + (now.provisional ? "*" : "") + " " +
+                             std::to_string(daily.index) + (daily.provisional ? "*" : "") + " " +
+                             now.category + "\n";
+        }
+        client.output += "OK\n";
+    } else if (command == "METRICS") {
+        std::ostringstream oss;
+        MetricsRegistry::instance().exportText(oss);
+        writeQuantiles(oss);
+        if (store.isOpen()) {
+            oss << "# TYPE store_bytes gauge\nstore_bytes " << store.sizeOnDisk() << "\n";
+        }
+        if (wal.isOpen()) {
+            WalStats log = wal.stats();
+            oss << "# TYPE store_wal_commits_total counter\nstore_wal_commits_total " << log.commits << "\n"
+                << "# TYPE store_wal_records_total counter\nstore_wal_records_total " << log.records << "\n"
+                << "# TYPE store_wal_bytes_total counter\nstore_wal_bytes_total " << log.bytes << "\n"
+                << "# TYPE store_wal_checkpoints_total counter\nstore_wal_checkpoints_total " << log.checkpoints
+                << "\n";
+        }
+        if (compactor) {
+            CompactionStats compaction = compactor->stats();
+            oss << "# TYPE store_compactions_total counter\nstore_compactions_total " << compaction.compacted << "\n"
+                << "# TYPE store_segments_deleted_total counter\nstore_segments_deleted_total "
+                << compaction.deleted << "\n"
+                << "# TYPE store_compaction_bytes_total counter\n"
+                << "store_compaction_bytes_total{direction=\"read\"} " << compaction.bytesRead << "\n"
+                << "store_compaction_bytes_total{direction=\"written\"} " << compaction.bytesWritten << "\n"
+                << "# TYPE store_compaction_throttled_seconds_total counter\n"
+                << "store_compaction_throttled_seconds_total " << compaction.throttledNs / 1e9 << "\n";
+        }
+        client.output += oss.str() + "OK\n";
+    } else {
+        client.output += "ERR unknown command " + command + "\n";
+    }
+}
+
+void SensorDaemon::reapExports(bool all) {
+    std::vector<std::pair<std::shared_ptr<ExportJob>, std::thread>> running;
+    for (auto& entry : exports) {
+        if (all || entry.first->done) {
+            entry.second.join();
+        } else {
+            running.push_back(std::move(entry));
+        }
+    }
+    exports.swap(running);
+}
+
+bool SensorDaemon::queryPiece(ReplyPosition& position, std::string& out) {
+    // The lock is held for one piece; the window may move on in between
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = position.sensor.empty() ? sensors.begin() : sensors.lower_bound(position.sensor);
+    for (; entry != sensors.end(); ++entry) {
+        if (position.filter != "*" && position.filter != entry->first) continue;
+        if (entry->first != position.sensor) {
+            position.sensor = entry->first;
+            position.fromMs = position.startMs;
+            position.sent = 0;
+        }
+
+        const ReadingHistory& history = entry->second.history;
+        size_t i = std::max(history.lowerBound(position.fromMs), windowStart(entry->second));
+        for (size_t skipped = 0; i < history.size() && skipped < position.sent; ++i, ++skipped) {
+            if (history.at(i).timestamp_ms != position.fromMs) break;
+        }
+        for (; i < history.size(); ++i) {
+            if (out.size() >= REPLY_PIECE_BYTES) {
+                return true;
+            }
+            HistoryRow row = history.at(i);
+            if (row.timestamp_ms != position.fromMs) {
+                position.fromMs = row.timestamp_ms;
+                position.sent = 0;
+            }
+            position.sent++;
+            out += toReading(entry->first, row).toLine() + "\n";
+        }
+    }
+    out += "OK\n";
+    return false;
+}
+
+bool SensorDaemon::historyPiece(ReplyPosition& position, std::string& out) {
+    // Sensor ids come sorted, so a piece finds its sensor again after new ones appeared
+    std::vector<std::string> ids = store.sensorIds();
+    std::vector<HistoryRow> rows;
+    std::vector<AggregateRecord> buckets;
+    for (auto id = std::lower_bound(ids.begin(), ids.end(), position.sensor); id != ids.end(); ++id) {
+        if (position.filter != "*" && position.filter != *id) continue;
+        if (*id != position.sensor) {
+            position.sensor = *id;
+            position.fromMs = position.startMs;
+            position.sent = 0;
+        }
+        if (out.size() >= REPLY_PIECE_BYTES) {
+            return true;
+        }
+
+        if (position.kind != SegmentKind::Raw) {
+            buckets.clear();
+            store.queryAggregates(*id, position.kind, position.fromMs, position.toMs, buckets, nullptr,
+                                  HISTORY_PIECE_ROWS);
+            for (const AggregateRecord& bucket : buckets) {
+                out += toBucketLine(*id, bucket) + "\n";
+            }
+            if (buckets.size() == HISTORY_PIECE_ROWS) {
+                position.fromMs = buckets.back().start_ms + 1;
+                return true;
+            }
+            continue;
+        }
+
+        // Rows at fromMs that the previous piece sent come first
+        size_t limit = HISTORY_PIECE_ROWS + position.sent;
+        rows.clear();
+        store.query(*id, position.fromMs, position.toMs, rows, nullptr, limit);
+        size_t i = 0;
+        while (i < rows.size() && i < position.sent && rows[i].timestamp_ms == position.fromMs) {
+            i++;
+        }
+        for (; i < rows.size(); ++i) {
+            if (rows[i].timestamp_ms != position.fromMs) {
+                position.fromMs = rows[i].timestamp_ms;
+                position.sent = 0;
+            }
+            position.sent++;
+            out += toReading(*id, rows[i]).toLine() + "\n";
+        }
+        if (rows.size() == limit) {
+            return true;
+        }
+    }
+    out += "OK\n";
+    return false;
+}
+
+void SensorDaemon::writeQuantiles(std::ostream& out) {
+    static const double QUANTILES[] = {0.5, 0.9, 0.98};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    TDigest fleet25, fleet10;
+    out << "# TYPE sensor_pm25_ugm3 summary\n";
+    for (auto& entry : sensors) {
+        SensorState& state = entry.second;
+        for (double q : QUANTILES) {
+            out << "sensor_pm25_ugm3{sensor=\"" << entry.first << "\",quantile=\"" << q << "\"} "
+                << state.pm25Digest.quantile(q) << "\n";
+        }
+        out << "sensor_pm25_ugm3_count{sensor=\"" << entry.first << "\"} "
+            << state.pm25Digest.count() << "\n";
+        fleet25.merge(state.pm25Digest);
+    }
+    out << "# TYPE sensor_pm10_ugm3 summary\n";
+    for (auto& entry : sensors) {
+        SensorState& state = entry.second;
+        for (double q : QUANTILES) {
+            out << "sensor_pm10_ugm3{sensor=\"" << entry.first << "\",quantile=\"" << q << "\"} "
+                << state.pm10Digest.quantile(q) << "\n";
+        }
+        fleet10.merge(state.pm10Digest);
+    }
+    out << "# TYPE fleet_pm_ugm3 summary\n";
+    for (double q : QUANTILES) {
+        out << "fleet_pm_ugm3{size=\"pm25\",quantile=\"" << q << "\"} " << fleet25.quantile(q) << "\n";
+        out << "fleet_pm_ugm3{size=\"pm10\",quantile=\"" << q << "\"} " << fleet10.quantile(q) << "\n";
+    }
+}
+
+void SensorDaemon::dispatchPending() {
+    std::vector<DaemonReading> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    for (Client& client : clients) {
+        if (!client.subscribed) continue;
+        std::string& lines = client.reply ? client.held : client.output;
+        for (const DaemonReading& reading : batch) {
+            if (client.filter == "*" || client.filter == reading.sensor) {
+                lines += reading.toLine() + "\n";
+            }
+        }
+    }
+
+    // Push what we can now; slow subscribers are dropped once their backlog is too big
+    std::vector<Client> alive;
+    for (Client& client : clients) {
+        if (flushClient(client)) {
+            alive.push_back(std::move(client));
+        } else {
+            close(client.fd);
+        }
+    }
+    clients.swap(alive);
+}
+
+void SensorDaemon::closeClients() {
+    for (const Client& client : clients) {
+        close(client.fd);
+    }
+    clients.clear();
+}
+
+// ControlClient implementation
+ControlClient::ControlClient() : fd(-1) {}
+
+ControlClient::~ControlClient() {
+    disconnect();
+}
+
+bool ControlClient::connect(const std::string& socketPath) {
+    disconnect();
+
+    struct sockaddr_un addr;
+    if (!fillSocketAddress(socketPath, addr)) {
+        return false;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void ControlClient::disconnect() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    buffer.clear();
+}
+
+bool ControlClient::send(const std::string& line) {
+    if (fd < 0) return false;
+
+    std::string data = line + "\n";
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t n = ::send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            disconnect();
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+bool ControlClient::readLine(std::string& line, int timeoutMs) {
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            return true;
+        }
+        if (fd < 0) {
+            return false;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) {
+            return false;
+        }
+
+        char chunk[4096];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+            disconnect();
+            return false;
+        }
+        buffer.append(chunk, n);
+    }
+}
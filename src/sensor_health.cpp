@@ -0,0 +1,159 @@
+#include "sensor_health.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Intervals averaged before the cadence estimate is trusted to find gaps
+    const uint32_t WARMUP_INTERVALS = 4;
+    // Frames read back to back from a buffered backlog say nothing about the cadence
+    const uint64_t MIN_INTERVAL_NS = 10000000ULL;
+    // Per-frame decay of the error-rate weights, about the last 30 frames
+    const double RATE_DECAY = 0.97;
+    const uint64_t NO_BASELINE = ~0ULL;
+}
+
+SensorHealth::SensorHealth(const HealthConfig& cfg) : config(cfg) {
+    reset();
+}
+
+void SensorHealth::reset() {
+    connected = false;
+    connectedAtNs = 0;
+    lastGoodNs = 0;
+    cadenceNs = config.initialCadenceNs;
+    intervalsSeen = 0;
+    gapPending = false;
+    missed = 0;
+    lastChecksumTotal = NO_BASELINE;
+    goodWeight = 0.0;
+    errorWeight = 0.0;
+    failedAttempts = 0;
+    nextAttemptNs = 0;
+    reconnects = 0;
+}
+
+void SensorHealth::scheduleRetry(uint64_t nowNs) {
+    // initial, 2x, 4x, ... up to the cap
+    uint64_t delay = config.initialBackoffNs;
+    for (uint32_t i = 0; i < failedAttempts && delay < config.maxBackoffNs; ++i) {
+        delay *= 2;
+    }
+    nextAttemptNs = nowNs + std::min(delay, config.maxBackoffNs);
+}
+
+void SensorHealth::onConnected(uint64_t nowNs) {
+    if (lastGoodNs != 0) {
+        reconnects++;
+        gapPending = true;
+    }
+    connected = true;
+    connectedAtNs = nowNs;
+    failedAttempts = 0;
+}
+
+void SensorHealth::onConnectFailed(uint64_t nowNs) {
+    connected = false;
+    failedAttempts++;
+    scheduleRetry(nowNs);
+}
+
+void SensorHealth::onDisconnected(uint64_t nowNs) {
+    connected = false;
+    failedAttempts = 0;
+    scheduleRetry(nowNs);
+}
+
+void SensorHealth::onDeviceAdded(uint64_t nowNs) {
+    if (!connected) {
+        nextAttemptNs = std::min(nextAttemptNs, nowNs);
+    }
+}
+
+uint32_t SensorHealth::onFrame(uint64_t arrivalNs) {
+    uint32_t gap = 0;
+    if (lastGoodNs != 0 && arrivalNs > lastGoodNs) {
+        uint64_t interval = arrivalNs - lastGoodNs;
+        if (intervalsSeen >= WARMUP_INTERVALS && interval > config.gapFactor * cadenceNs) {
+            gap = static_cast<uint32_t>(std::max(1.0, std::floor(static_cast<double>(interval) / cadenceNs + 0.5) - 1.0));
+        } else if (interval >= MIN_INTERVAL_NS) {
+            // Plain average while warming up, then a slow moving average
+            if (intervalsSeen < WARMUP_INTERVALS) {
+                cadenceNs = (intervalsSeen == 0) ? interval : (cadenceNs * intervalsSeen + interval) / (intervalsSeen + 1);
+            } else {
+                cadenceNs = static_cast<uint64_t>(static_cast<int64_t>(cadenceNs) +
+                                                  (static_cast<int64_t>(interval) - static_cast<int64_t>(cadenceNs)) / 8);
+            }
+            intervalsSeen++;
+        }
+    }
+    if (gapPending) {
+        gap = std::max<uint32_t>(gap, 1);
+        gapPending = false;
+    }
+
+    missed += gap;
+    lastGoodNs = arrivalNs;
+    goodWeight = goodWeight * RATE_DECAY + 1.0;
+    errorWeight *= RATE_DECAY;
+    return gap;
+}
+
+void SensorHealth::observeChecksumFailures(uint64_t total) {
+    if (lastChecksumTotal != NO_BASELINE && total > lastChecksumTotal) {
+        errorWeight += static_cast<double>(total - lastChecksumTotal);
+    }
+    lastChecksumTotal = total;
+}
+
+double SensorHealth::checksumErrorRate() const {
+    double attempts = goodWeight + errorWeight;
+    return attempts > 0.0 ? errorWeight / attempts : 0.0;
+}
+
+uint64_t SensorHealth::stallAfterNs() const {
+    return std::max(config.minStallNs, static_cast<uint64_t>(config.stallFactor * cadenceNs));
+}
+
+uint64_t SensorHealth::nextChangeNs(uint64_t nowNs) const {
+    if (!connected) {
+        return nextAttemptNs;
+    }
+    bool framedSinceConnect = lastGoodNs >= connectedAtNs && lastGoodNs != 0;
+    uint64_t since = framedSinceConnect ? lastGoodNs : connectedAtNs;
+    uint64_t late = since + static_cast<uint64_t>(config.gapFactor * cadenceNs);
+    if (framedSinceConnect && late > nowNs) {
+        return late;
+    }
+    // Once stalled, the owner disconnects; nothing changes after that by itself
+    return std::max(nowNs, since + stallAfterNs() + 1);
+}
+
+HealthState SensorHealth::state(uint64_t nowNs) const {
+    if (!connected) {
+        return HealthState::Connecting;
+    }
+
+    bool framedSinceConnect = lastGoodNs >= connectedAtNs && lastGoodNs != 0;
+    uint64_t since = framedSinceConnect ? lastGoodNs : connectedAtNs;
+    uint64_t silent = (nowNs > since) ? nowNs - since : 0;
+    if (silent > stallAfterNs()) {
+        return HealthState::Stalled;
+    }
+    if (!framedSinceConnect) {
+        return HealthState::Connecting;
+    }
+    if (silent > config.gapFactor * cadenceNs || checksumErrorRate() >= config.degradedErrorRate) {
+        return HealthState::Degraded;
+    }
+    return HealthState::Healthy;
+}
+
+const char* SensorHealth::stateName(HealthState state) {
+    switch (state) {
+        case HealthState::Connecting: return "connecting";
+        case HealthState::Healthy: return "healthy";
+        case HealthState::Degraded: return "degraded";
+        case HealthState::Stalled: return "stalled";
+    }
+    return "unknown";
+}
@@ -0,0 +1,142 @@
+#include "serial_port.h"
+#include <map>
+#include <mutex>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#if defined(__linux__) && !defined(LINUX)
+#error "LINUX is not defined; build with CMake or the Makefile, which set the platform macro"
+#endif
+#ifdef LINUX
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+    std::mutex profilesMutex;
+    std::map<std::string, SerialIOProfile> portProfiles;
+    SerialIOProfile defaultProfile = SerialIOProfile::Timed;
+
+    // Ask the USB-serial driver to push bytes immediately instead of
+    // batching them behind its latency timer (16 ms by default on FTDI)
+    void setLowLatency(int fd, bool enable) {
+#ifdef LINUX
+        struct serial_struct serial;
+        if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+            if (enable) {
+                serial.flags |= ASYNC_LOW_LATENCY;
+            } else {
+                serial.flags &= ~ASYNC_LOW_LATENCY;
+            }
+            ioctl(fd, TIOCSSERIAL, &serial);
+        }
+#else
+        (void)fd;
+        (void)enable;
+#endif
+    }
+}
+
+namespace SerialPort {
+    bool configure(int fd, SerialIOProfile profile) {
+        struct termios tty;
+        if (tcgetattr(fd, &tty) != 0) {
+            return false;
+        }
+
+        // Set baud rate to 9600 (SDS011 default)
+        cfsetospeed(&tty, B9600);
+        cfsetispeed(&tty, B9600);
+
+        // Configure 8N1 (8 data bits, no parity, 1 stop bit)
+        tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
+        tty.c_iflag &= ~IGNBRK;                         // disable break processing
+        tty.c_lflag = 0;                                // no signaling chars, no echo,
+                                                        // no canonical processing
+        tty.c_oflag = 0;                                // no remapping, no delays
+
+        switch (profile) {
+            case SerialIOProfile::Timed:
+                tty.c_cc[VMIN] = 0;                     // read doesn't block
+                tty.c_cc[VTIME] = 5;                    // 0.5 seconds read timeout
+                break;
+            case SerialIOProfile::FrameBlocking:
+                tty.c_cc[VMIN] = 10;                    // one SDS011 frame per read
+                tty.c_cc[VTIME] = 1;                    // give up after a 0.1 s gap
+                break;
+            case SerialIOProfile::Poll:
+            case SerialIOProfile::LowLatency:
+                tty.c_cc[VMIN] = 0;                     // poll() does the waiting
+                tty.c_cc[VTIME] = 0;
+                break;
+        }
+
+        tty.c_iflag &= ~(IXON | IXOFF | IXANY);         // shut off xon/xoff ctrl
+
+        tty.c_cflag |= (CLOCAL | CREAD);                // ignore modem controls,
+                                                        // enable reading
+        tty.c_cflag &= ~(PARENB | PARODD);              // shut off parity
+        tty.c_cflag &= ~CSTOPB;
+        tty.c_cflag &= ~CRTSCTS;
+
+        if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+            return false;
+        }
+
+        int flags = fcntl(fd, F_GETFL);
+        if (flags >= 0) {
+            bool nonBlocking = (profile == SerialIOProfile::Poll || profile == SerialIOProfile::LowLatency);
+            fcntl(fd, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+        }
+
+        setLowLatency(fd, profile == SerialIOProfile::LowLatency);
+        return true;
+    }
+
+    bool usesPoll(SerialIOProfile profile) {
+        return profile != SerialIOProfile::Timed;
+    }
+
+    int pollTimeoutMs() {
+        return 500; // Same patience as VTIME=5 in the timed profile
+    }
+
+    const char* profileName(SerialIOProfile profile) {
+        switch (profile) {
+            case SerialIOProfile::Timed: return "timed";
+            case SerialIOProfile::FrameBlocking: return "frame";
+            case SerialIOProfile::Poll: return "poll";
+            case SerialIOProfile::LowLatency: return "lowlatency";
+        }
+        return "unknown";
+    }
+
+    bool parseProfile(const std::string& name, SerialIOProfile& profile) {
+        static const SerialIOProfile ALL[] = {
+            SerialIOProfile::Timed, SerialIOProfile::FrameBlocking,
+            SerialIOProfile::Poll, SerialIOProfile::LowLatency
+        };
+        for (SerialIOProfile candidate : ALL) {
+            if (name == profileName(candidate)) {
+                profile = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void setProfile(const std::string& port, SerialIOProfile profile) {
+        std::lock_guard<std::mutex> lock(profilesMutex);
+        if (port.empty()) {
+            defaultProfile = profile;
+        } else {
+            portProfiles[port] = profile;
+        }
+    }
+
+    SerialIOProfile profileFor(const std::string& port) {
+        std::lock_guard<std::mutex> lock(profilesMutex);
+        auto it = portProfiles.find(port);
+        return it != portProfiles.end() ? it->second : defaultProfile;
+    }
+}
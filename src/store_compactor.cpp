@@ -0,0 +1,360 @@
+#include "store_compactor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    const size_t CHUNK_BYTES = 64 * 1024;           // read, and paced, in pieces this size
+    const int64_t MINUTE_MS = 60000;
+    const int64_t HOUR_MS = 3600000;
+
+    int64_t bucketStart(int64_t timestampMs, int64_t widthMs) {
+        int64_t start = timestampMs - timestampMs % widthMs;
+        return start > timestampMs ? start - widthMs : start;
+    }
+
+    bool parseNumber(const std::string& text, const char* units, const double* scales, double& value) {
+        char* end = nullptr;
+        value = std::strtod(text.c_str(), &end);
+        if (text.empty() || end == text.c_str() || value < 0.0) {
+            return false;
+        }
+        if (*end == '\0') {
+            return true;
+        }
+        const char* unit = end[1] == '\0' ? strchr(units, *end) : nullptr;
+        if (!unit) {
+            return false;
+        }
+        value *= scales[unit - units];
+        return true;
+    }
+
+    bool parseDuration(const std::string& text, int64_t& ms) {
+        static const double SCALES[] = {1.0, 60.0, 3600.0, 86400.0};
+        double seconds;
+        if (!parseNumber(text, "smhd", SCALES, seconds)) {
+            return false;
+        }
+        ms = static_cast<int64_t>(std::llround(seconds * 1000.0));
+        return true;
+    }
+
+    bool parseSize(const std::string& text, uint64_t& bytes) {
+        static const double SCALES[] = {1024.0, 1024.0 * 1024.0, 1024.0 * 1024.0 * 1024.0};
+        double value;
+        if (!parseNumber(text, "KMG", SCALES, value)) {
+            return false;
+        }
+        bytes = static_cast<uint64_t>(std::llround(value));
+        return true;
+    }
+
+    std::string formatDuration(int64_t ms) {
+        static const struct { int64_t ms; const char* suffix; } UNITS[] = {
+            {86400000, "d"}, {3600000, "h"}, {60000, "m"}, {1000, "s"}};
+        for (const auto& unit : UNITS) {
+            if (ms != 0 && ms % unit.ms == 0) return std::to_string(ms / unit.ms) + unit.suffix;
+        }
+        std::ostringstream oss;
+        oss << ms / 1000.0;
+        return oss.str();
+    }
+
+    std::string formatSize(uint64_t bytes) {
+        static const struct { uint64_t bytes; const char* suffix; } UNITS[] = {
+            {1ULL << 30, "G"}, {1ULL << 20, "M"}, {1ULL << 10, "K"}};
+        for (const auto& unit : UNITS) {
+            if (bytes != 0 && bytes % unit.bytes == 0) return std::to_string(bytes / unit.bytes) + unit.suffix;
+        }
+        return std::to_string(bytes);
+    }
+
+    // Lowest CPU and I/O priority, so the compactor only uses what acquisition leaves idle
+    void lowerPriority() {
+#ifdef LINUX
+        struct sched_param param;
+        param.sched_priority = 0;
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            std::cerr << "Compactor: cannot switch to SCHED_IDLE" << std::endl;
+        }
+        const int IOPRIO_WHO_PROCESS = 1;   // a thread id, 0 for the calling thread
+        const int IOPRIO_CLASS_IDLE = 3;
+        const int IOPRIO_CLASS_SHIFT = 13;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+            std::cerr << "Compactor: cannot switch to the idle I/O class: " << strerror(errno) << std::endl;
+        }
+#endif
+    }
+}
+
+// RetentionPolicy implementation
+bool RetentionPolicy::parse(const std::string& spec, RetentionPolicy& policy) {
+    RetentionPolicy result;
+    if (spec == "off" || spec == "none") {
+        policy = result;
+        return true;
+    }
+    result.enabled = true;
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string text = item.substr(equals + 1);
+
+        bool ok;
+        if (key == "raw") {
+            ok = parseDuration(text, result.rawMs);
+        } else if (key == "minute") {
+            ok = parseDuration(text, result.minuteMs);
+        } else if (key == "hour") {
+            ok = parseDuration(text, result.hourMs);
+        } else if (key == "size") {
+            ok = parseSize(text, result.maxBytes);
+        } else if (key == "rate") {
+            ok = parseSize(text, result.rateBytes);
+        } else if (key == "interval") {
+            ok = parseDuration(text, result.intervalMs) && result.intervalMs > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    policy = result;
+    return true;
+}
+
+std::string RetentionPolicy::toString() const {
+    if (!enabled) {
+        return "off";
+    }
+    std::ostringstream oss;
+    oss << "raw=" << formatDuration(rawMs) << ",minute=" << formatDuration(minuteMs)
+        << ",hour=" << formatDuration(hourMs) << ",size=" << formatSize(maxBytes)
+        << ",rate=" << formatSize(rateBytes) << ",interval=" << formatDuration(intervalMs);
+    return oss.str();
+}
+
+// StoreCompactor implementation
+StoreCompactor::StoreCompactor(SegmentStore& segmentStore, const RetentionPolicy& retention)
+    : store(segmentStore), policy(retention), stopping(false), passes(0), compacted(0), deleted(0),
+      bytesRead(0), bytesWritten(0), throttledNs(0), tokens(0.0), lastRefill(std::chrono::steady_clock::now()) {}
+
+StoreCompactor::~StoreCompactor() {
+    stop();
+}
+
+void StoreCompactor::start() {
+    if (worker.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+    }
+    worker = std::thread(&StoreCompactor::run, this);
+}
+
+void StoreCompactor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void StoreCompactor::run() {
+    lowerPriority();
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        runOnce(now);
+        lock.lock();
+        wakeUp.wait_for(lock, std::chrono::milliseconds(policy.intervalMs), [this] { return stopping; });
+    }
+}
+
+bool StoreCompactor::throttle(uint64_t bytes) {
+    if (policy.rateBytes == 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !stopping;
+    }
+
+    // Token bucket holding at most a quarter second of I/O, so bursts stay short
+    auto now = std::chrono::steady_clock::now();
+    double capacity = std::max<double>(CHUNK_BYTES, policy.rateBytes / 4.0);
+    double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+    tokens = std::min(capacity, tokens + elapsed * policy.rateBytes) - static_cast<double>(bytes);
+    lastRefill = now;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (tokens < 0.0 && !stopping) {
+        auto wait = std::chrono::duration<double>(-tokens / policy.rateBytes);
+        wakeUp.wait_for(lock, wait, [this] { return stopping; });
+        auto waited = std::chrono::steady_clock::now() - now;
+        throttledNs += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+    }
+    return !stopping;
+}
+
+template <typename Record, typename Fn>
+bool StoreCompactor::readSegment(const SegmentInfo& segment, Fn fn) {
+    // Sealed segments never change, so the file is read without the store's mutex
+    std::string path = store.getDirectory() + "/" + segment.path;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Compactor: cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<Record> records(std::max<size_t>(1, CHUNK_BYTES / sizeof(Record)));
+    uint64_t offset = SegmentStore::HEADER_BYTES;
+    uint64_t remaining = segment.records;
+    bool ok = true;
+    while (ok && remaining > 0) {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(records.size(), remaining));
+        size_t bytes = count * sizeof(Record);
+        ssize_t n = pread(fd, records.data(), bytes, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n != static_cast<ssize_t>(bytes)) {
+            std::cerr << "Compactor: short read from " << path << std::endl;
+            ok = false;
+            break;
+        }
+        bytesRead += bytes;
+        for (size_t i = 0; i < count; ++i) {
+            fn(records[i]);
+        }
+        offset += bytes;
+        remaining -= count;
+        ok = throttle(bytes);
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool StoreCompactor::compact(const SegmentInfo& segment, SegmentKind target) {
+    std::vector<AggregateRecord> buckets;
+    bool ok;
+    if (segment.kind == SegmentKind::Raw) {
+        ok = readSegment<SegmentRecord>(segment, [&buckets](const SegmentRecord& record) {
+            int64_t start = bucketStart(record.timestamp_ms, MINUTE_MS);
+            if (buckets.empty() || buckets.back().start_ms != start) {
+                buckets.push_back(AggregateRecord::empty(start));
+            }
+            buckets.back().add(record);
+        });
+    } else {
+        ok = readSegment<AggregateRecord>(segment, [&buckets](const AggregateRecord& record) {
+            int64_t start = bucketStart(record.start_ms, HOUR_MS);
+            if (buckets.empty() || buckets.back().start_ms != start) {
+                buckets.push_back(AggregateRecord::empty(start));
+            }
+            buckets.back().merge(record);
+        });
+    }
+    if (!ok || buckets.empty()) {
+        return false;
+    }
+
+    SegmentInfo rolled;
+    if (!store.writeSegment(segment, target, buckets.data(), buckets.size(), rolled)) {
+        return false;
+    }
+    uint64_t bytes = buckets.size() * sizeof(AggregateRecord);
+    bytesWritten += bytes;
+    if (!store.replace(segment, &rolled)) {
+        unlink((store.getDirectory() + "/" + rolled.path).c_str());
+        return false;
+    }
+    compacted++;
+    return throttle(bytes);
+}
+
+size_t StoreCompactor::runOnce(int64_t nowMs) {
+    static const struct { SegmentKind source; SegmentKind target; } ROLLUPS[] = {
+        {SegmentKind::Raw, SegmentKind::Minute}, {SegmentKind::Minute, SegmentKind::Hour}};
+    const int64_t ages[] = {policy.rawMs, policy.minuteMs};
+    size_t changed = 0;
+
+    // Oldest first within each tier; minute segments made by the first step can go on to the second
+    for (int step = 0; step < 2; ++step) {
+        if (ages[step] <= 0) continue;
+        for (const SegmentInfo& segment : store.sealedSegments()) {
+            if (segment.kind != ROLLUPS[step].source || segment.maxTimestamp >= nowMs - ages[step]) continue;
+            if (compact(segment, ROLLUPS[step].target)) {
+                changed++;
+            }
+            if (!throttle(0)) {
+                return changed;
+            }
+        }
+    }
+
+    std::vector<SegmentInfo> sealed = store.sealedSegments();
+    if (policy.hourMs > 0) {
+        for (const SegmentInfo& segment : sealed) {
+            if (segment.kind == SegmentKind::Hour && segment.maxTimestamp < nowMs - policy.hourMs &&
+                store.replace(segment, nullptr)) {
+                deleted++;
+                changed++;
+            }
+        }
+        sealed = store.sealedSegments();
+    }
+
+    if (policy.maxBytes > 0) {
+        // Whatever tier it is in, the oldest data goes first
+        uint64_t size = store.sizeOnDisk();
+        std::sort(sealed.begin(), sealed.end(), [](const SegmentInfo& a, const SegmentInfo& b) {
+            return a.maxTimestamp < b.maxTimestamp;
+        });
+        for (size_t i = 0; i < sealed.size() && size > policy.maxBytes; ++i) {
+            if (store.replace(sealed[i], nullptr)) {
+                size -= std::min(size, SegmentStore::segmentBytes(sealed[i]));
+                deleted++;
+                changed++;
+            }
+        }
+    }
+
+    passes++;
+    return changed;
+}
+
+CompactionStats StoreCompactor::stats() const {
+    CompactionStats result;
+    result.passes = passes.load();
+    result.compacted = compacted.load();
+    result.deleted = deleted.load();
+    result.bytesRead = bytesRead.load();
+    result.bytesWritten = bytesWritten.load();
+    result.throttledNs = throttledNs.load();
+    return result;
+}
@@ -0,0 +1,135 @@
+#include "tdigest.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+TDigest::TDigest(double comp)
+    : compression(comp), bufferLimit(static_cast<size_t>(comp * 5)) {
+    // k1 bounds the merged centroid count by about pi/2 * compression
+    centroids.reserve(static_cast<size_t>(comp * 2) + 10);
+    buffer.reserve(bufferLimit);
+    scratch.reserve(centroids.capacity() + bufferLimit);
+    reset();
+}
+
+void TDigest::reset() {
+    centroids.clear();
+    buffer.clear();
+    totalWeight = 0.0;
+    minValue = std::numeric_limits<double>::infinity();
+    maxValue = -std::numeric_limits<double>::infinity();
+}
+
+double TDigest::scale(double q) const {
+    return compression / (2.0 * M_PI) * std::asin(2.0 * q - 1.0);
+}
+
+void TDigest::append(const Centroid& centroid) {
+    if (buffer.size() >= bufferLimit) {
+        compress();
+    }
+    buffer.push_back(centroid);
+    totalWeight += centroid.weight;
+}
+
+void TDigest::add(double value, double weight) {
+    if (std::isnan(value) || weight <= 0.0) {
+        return;
+    }
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+    append(Centroid{value, weight});
+}
+
+void TDigest::merge(const TDigest& other) {
+    if (other.totalWeight <= 0.0) {
+        return;
+    }
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+    for (const Centroid& centroid : other.centroids) {
+        append(centroid);
+    }
+    for (const Centroid& centroid : other.buffer) {
+        append(centroid);
+    }
+}
+
+void TDigest::compress() {
+    if (buffer.empty()) {
+        return;
+    }
+
+    scratch.clear();
+    scratch.insert(scratch.end(), centroids.begin(), centroids.end());
+    scratch.insert(scratch.end(), buffer.begin(), buffer.end());
+    buffer.clear();
+    std::sort(scratch.begin(), scratch.end());
+
+    // Every weight currently in the digest is in scratch now
+    double total = 0.0;
+    for (const Centroid& centroid : scratch) {
+        total += centroid.weight;
+    }
+
+    centroids.clear();
+    Centroid current = scratch[0];
+    double weightSoFar = 0.0;
+    double kLeft = scale(0.0);
+
+    for (size_t i = 1; i < scratch.size(); ++i) {
+        const Centroid& next = scratch[i];
+        double proposed = current.weight + next.weight;
+        double qRight = (weightSoFar + proposed) / total;
+
+        if (scale(qRight) - kLeft <= 1.0) {
+            current.mean += (next.mean - current.mean) * next.weight / proposed;
+            current.weight = proposed;
+        } else {
+            weightSoFar += current.weight;
+            kLeft = scale(weightSoFar / total);
+            centroids.push_back(current);
+            current = next;
+        }
+    }
+    centroids.push_back(current);
+}
+
+size_t TDigest::centroidCount() {
+    compress();
+    return centroids.size();
+}
+
+double TDigest::quantile(double q) {
+    compress();
+    if (centroids.empty()) {
+        return 0.0;
+    }
+    if (q <= 0.0) return minValue;
+    if (q >= 1.0) return maxValue;
+    if (centroids.size() == 1) {
+        return centroids[0].mean;
+    }
+
+    double index = q * totalWeight;
+
+    // Each centroid's weight is taken to be centred on its mean
+    double left = centroids[0].weight / 2.0;
+    if (index < left) {
+        return minValue + (centroids[0].mean - minValue) * (index / left);
+    }
+
+    for (size_t i = 0; i + 1 < centroids.size(); ++i) {
+        double right = left + (centroids[i].weight + centroids[i + 1].weight) / 2.0;
+        if (index < right) {
+            double fraction = (index - left) / (right - left);
+            return centroids[i].mean + (centroids[i + 1].mean - centroids[i].mean) * fraction;
+        }
+        left = right;
+    }
+
+    const Centroid& last = centroids.back();
+    double tail = totalWeight - left;
+    double fraction = tail > 0.0 ? (index - left) / tail : 1.0;
+    return last.mean + (maxValue - last.mean) * std::min(1.0, fraction);
+}
@@ -0,0 +1,385 @@
+#include "trace_recorder.h"
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <signal.h>
+
+std::atomic<bool> TraceRecorder::enabled(false);
+thread_local TraceBuffer* TraceRecorder::localBuffer = nullptr;
+
+namespace {
+    // Binary file layout: FileHeader followed by a sequence of chunks
+    const char TRACE_MAGIC[8] = {'S', 'D', 'S', 'T', 'R', 'A', 'C', 'E'};
+    const uint32_t TRACE_VERSION = 1;
+
+    enum ChunkType : uint32_t {
+        CHUNK_EVENTS = 1,       // id = thread id, count = number of TraceRecords
+        CHUNK_SENSOR_NAME = 2,  // id = sensor id, count = name length in bytes
+        CHUNK_DROPPED = 3       // id = thread id, count = records lost to overruns
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+    };
+
+    struct ChunkHeader {
+        uint32_t type;
+        uint32_t id;
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    const std::chrono::milliseconds FLUSH_INTERVAL(100);
+
+    struct RecorderState {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TraceBuffer>> buffers;
+        uint32_t nextThreadId;
+        std::map<std::string, uint16_t> sensorIds;
+        std::vector<std::string> sensorNames;
+        size_t namesWritten;
+
+        std::ofstream file;
+        std::thread flusher;
+        std::condition_variable wakeup;
+        bool stopping;
+        std::vector<TraceRecord> scratch;
+
+        RecorderState() : nextThreadId(1), namesWritten(0), stopping(false) {}
+    };
+
+    RecorderState& state() {
+        static RecorderState instance;
+        return instance;
+    }
+
+    void writeChunk(std::ofstream& file, uint32_t type, uint32_t id, uint32_t count,
+                    const void* payload, size_t payloadSize) {
+        ChunkHeader header = {type, id, count, 0};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (payloadSize > 0) {
+            file.write(static_cast<const char*>(payload), payloadSize);
+        }
+    }
+
+    // Caller holds state().mutex
+    void drainBuffers(RecorderState& s) {
+        while (s.namesWritten < s.sensorNames.size()) {
+            const std::string& name = s.sensorNames[s.namesWritten];
+            writeChunk(s.file, CHUNK_SENSOR_NAME, static_cast<uint32_t>(s.namesWritten),
+                       static_cast<uint32_t>(name.size()), name.data(), name.size());
+            s.namesWritten++;
+        }
+
+        for (auto it = s.buffers.begin(); it != s.buffers.end();) {
+            TraceBuffer* buffer = it->get();
+            // Loaded before head: once retired, head is final
+            bool retired = buffer->retired.load(std::memory_order_acquire);
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t tail = buffer->tail;
+            if (head == tail) {
+                it = retired ? s.buffers.erase(it) : it + 1;
+                continue;
+            }
+
+            // Slot head & (CAPACITY - 1) is the one being written, which is also slot head - CAPACITY
+            uint64_t dropped = 0;
+            if (head - tail >= TraceBuffer::CAPACITY) {
+                dropped = head + 1 - TraceBuffer::CAPACITY - tail;
+                tail = head + 1 - TraceBuffer::CAPACITY;
+            }
+
+            s.scratch.clear();
+            for (uint64_t i = tail; i < head; ++i) {
+                s.scratch.push_back(buffer->records[i & (TraceBuffer::CAPACITY - 1)]);
+            }
+
+            // The writer may have lapped us while copying; those slots are torn
+            uint64_t after = buffer->head.load(std::memory_order_acquire);
+            size_t skip = 0;
+            if (after - tail >= TraceBuffer::CAPACITY) {
+                skip = static_cast<size_t>(after + 1 - TraceBuffer::CAPACITY - tail);
+                if (skip > s.scratch.size()) skip = s.scratch.size();
+                dropped += skip;
+            }
+            buffer->tail = head;
+
+            if (dropped > 0) {
+                writeChunk(s.file, CHUNK_DROPPED, buffer->threadId,
+                           static_cast<uint32_t>(dropped), nullptr, 0);
+            }
+            size_t count = s.scratch.size() - skip;
+            if (count > 0) {
+                writeChunk(s.file, CHUNK_EVENTS, buffer->threadId, static_cast<uint32_t>(count),
+                           s.scratch.data() + skip, count * sizeof(TraceRecord));
+            }
+
+            it = retired ? s.buffers.erase(it) : it + 1;
+        }
+
+        s.file.flush();
+    }
+
+    void flusherLoop() {
+        // Signals belong to the main thread, which may take them through an EventLoop
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, nullptr);
+        
+        RecorderState& s = state();
+        std::unique_lock<std::mutex> lock(s.mutex);
+        while (!s.stopping) {
+            s.wakeup.wait_for(lock, FLUSH_INTERVAL);
+            drainBuffers(s);
+        }
+    }
+
+    const char* rejectReasonName(uint32_t reason) {
+        switch (static_cast<TraceRejectReason>(reason)) {
+            case TraceRejectReason::ShortRead: return "short read";
+            case TraceRejectReason::BadHeader: return "bad header";
+            case TraceRejectReason::BadChecksum: return "bad checksum";
+        }
+        return "unknown";
+    }
+
+    std::string jsonEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += ' ';
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+}
+
+TraceBuffer* TraceRecorder::attachThread() {
+    // Hands the buffer to the flusher when the thread exits
+    struct Retirement {
+        ~Retirement() {
+            if (localBuffer) {
+                localBuffer->retired.store(true, std::memory_order_release);
+                localBuffer = nullptr;
+            }
+        }
+    };
+    static thread_local Retirement retirement;
+    (void)retirement;
+
+    RecorderState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    s.buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer()));
+    TraceBuffer* buffer = s.buffers.back().get();
+    buffer->threadId = s.nextThreadId++;
+    localBuffer = buffer;
+    return buffer;
+}
+
+bool TraceRecorder::start(const std::string& path) {
+    stop();
+
+    RecorderState& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        s.file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!s.file.is_open()) {
+            std::cerr << "Error opening trace file: " << path << std::endl;
+            return false;
+        }
+
+        FileHeader header;
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        s.file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        // Skip anything left over from a previous session, and threads gone since
+        for (auto it = s.buffers.begin(); it != s.buffers.end();) {
+            if ((*it)->retired.load(std::memory_order_acquire)) {
+                it = s.buffers.erase(it);
+            } else {
+                (*it)->tail = (*it)->head.load(std::memory_order_acquire);
+                ++it;
+            }
+        }
+        s.namesWritten = 0;
+        s.stopping = false;
+    }
+
+    s.flusher = std::thread(flusherLoop);
+    enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void TraceRecorder::stop() {
+    RecorderState& s = state();
+    enabled.store(false, std::memory_order_release);
+
+    if (s.flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.stopping = true;
+        }
+        s.wakeup.notify_all();
+        s.flusher.join();
+    }
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.file.is_open()) {
+        drainBuffers(s);
+        s.file.close();
+    }
+}
+
+uint16_t TraceRecorder::sensorId(const std::string& name) {
+    RecorderState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto it = s.sensorIds.find(name);
+    if (it != s.sensorIds.end()) {
+        return it->second;
+    }
+
+    uint16_t id = static_cast<uint16_t>(s.sensorNames.size());
+    s.sensorIds[name] = id;
+    s.sensorNames.push_back(name);
+    return id;
+}
+
+bool TraceRecorder::convertToChromeJson(const std::string& inputPath, const std::string& outputPath) {
+    std::ifstream in(inputPath.c_str(), std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error opening trace file: " << inputPath << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+        std::cerr << "Not a supported trace file: " << inputPath << std::endl;
+        return false;
+    }
+
+    std::ofstream out(outputPath.c_str(), std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error opening output file: " << outputPath << std::endl;
+        return false;
+    }
+
+    std::map<uint32_t, std::string> sensorNames;
+    std::map<uint32_t, bool> threadsSeen;
+    std::vector<TraceRecord> records;
+    uint64_t origin = 0;
+    bool first = true;
+    uint64_t totalEvents = 0;
+    uint64_t totalDropped = 0;
+
+    out << "{\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+
+    ChunkHeader chunk;
+    while (in.read(reinterpret_cast<char*>(&chunk), sizeof(chunk))) {
+        if (chunk.type == CHUNK_SENSOR_NAME) {
+            std::string name(chunk.count, '\0');
+            if (!in.read(&name[0], chunk.count)) break;
+            sensorNames[chunk.id] = name;
+            continue;
+        }
+
+        if (chunk.type == CHUNK_DROPPED) {
+            totalDropped += chunk.count;
+            continue;
+        }
+
+        if (chunk.type != CHUNK_EVENTS) {
+            std::cerr << "Unknown chunk type " << chunk.type << " in " << inputPath << std::endl;
+            break;
+        }
+
+        records.resize(chunk.count);
+        if (!in.read(reinterpret_cast<char*>(records.data()), chunk.count * sizeof(TraceRecord))) {
+            std::cerr << "Truncated trace file: " << inputPath << std::endl;
+            break;
+        }
+
+        if (!threadsSeen[chunk.id]) {
+            threadsSeen[chunk.id] = true;
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << chunk.id
+                << ",\"args\":{\"name\":\"thread " << chunk.id << "\"}}";
+            first = false;
+        }
+
+        for (const TraceRecord& record : records) {
+            if (totalEvents == 0) {
+                origin = record.timestamp_ns;
+            }
+            totalEvents++;
+
+            double ts = (static_cast<int64_t>(record.timestamp_ns - origin)) / 1000.0;
+            std::string sensor = jsonEscape(sensorNames.count(record.sensor) ?
+                                            sensorNames[record.sensor] : "unknown");
+
+            out << (first ? "" : ",\n") << "{\"pid\":1,\"tid\":" << chunk.id << ",\"ts\":" << ts;
+            first = false;
+
+            switch (static_cast<TraceEvent>(record.event)) {
+                case TraceEvent::ReadStart:
+                    out << ",\"name\":\"read\",\"cat\":\"serial\",\"ph\":\"B\""
+                        << ",\"args\":{\"sensor\":\"" << sensor << "\"}}";
+                    break;
+                case TraceEvent::ReadEnd:
+                    out << ",\"name\":\"read\",\"cat\":\"serial\",\"ph\":\"E\""
+                        << ",\"args\":{\"bytes\":" << static_cast<int32_t>(record.arg) << "}}";
+                    break;
+                case TraceEvent::FrameAccepted:
+                    out << ",\"name\":\"frame accepted\",\"cat\":\"parser\",\"ph\":\"i\",\"s\":\"t\""
+                        << ",\"args\":{\"sensor\":\"" << sensor << "\",\"pm25\":"
+                        << record.arg / 10.0 << "}}";
+                    break;
+                case TraceEvent::FrameRejected:
+                    out << ",\"name\":\"frame rejected\",\"cat\":\"parser\",\"ph\":\"i\",\"s\":\"t\""
+                        << ",\"args\":{\"sensor\":\"" << sensor << "\",\"reason\":\""
+                        << rejectReasonName(record.arg) << "\"}}";
+                    break;
+                case TraceEvent::RedrawStart:
+                    out << ",\"name\":\"redraw\",\"cat\":\"tui\",\"ph\":\"B\"}";
+                    break;
+                case TraceEvent::RedrawEnd:
+                    out << ",\"name\":\"redraw\",\"cat\":\"tui\",\"ph\":\"E\"}";
+                    break;
+                default:
+                    out << ",\"name\":\"event " << record.event << "\",\"ph\":\"i\",\"s\":\"t\"}";
+                    break;
+            }
+        }
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << totalDropped << "}}\n";
+
+    std::cout << "Converted " << totalEvents << " events";
+    if (totalDropped > 0) {
+        std::cout << " (" << totalDropped << " dropped during recording)";
+    }
+    std::cout << " to " << outputPath << std::endl;
+    return true;
+}
@@ -0,0 +1,133 @@
+#include "trend_buckets.h"
+#include <algorithm>
+
+namespace {
+    // Bucket width and number of buckets kept per level
+    const struct {
+        int64_t widthMs;
+        size_t buckets;
+    } LEVEL_LAYOUT[TrendBuckets::LEVELS] = {
+        {1000, 900},            // 15 min of 1 s buckets
+        {10000, 720},           // 2 h
+        {60000, 720},           // 12 h
+        {300000, 576},          // 48 h
+        {1800000, 336},         // 7 days
+    };
+}
+
+TrendBuckets::TrendBuckets() {
+    for (int i = 0; i < LEVELS; ++i) {
+        levels[i].widthMs = LEVEL_LAYOUT[i].widthMs;
+        levels[i].ring.resize(LEVEL_LAYOUT[i].buckets);
+    }
+    reset();
+}
+
+void TrendBuckets::reset() {
+    for (Level& level : levels) {
+        for (Bucket& bucket : level.ring) {
+            bucket.slot = -1;
+            bucket.count = 0;
+        }
+    }
+}
+
+void TrendBuckets::add(int64_t timestampMs, float pm25, float pm10) {
+    if (timestampMs < 0) return;
+    const float values[2] = {pm25, pm10};
+
+    for (Level& level : levels) {
+        int64_t slot = timestampMs / level.widthMs;
+        Bucket& bucket = level.ring[slot % level.ring.size()];
+        if (bucket.slot != slot) {
+            if (bucket.slot > slot) continue;   // Older than the ring covers
+            bucket.slot = slot;
+            bucket.count = 0;
+        }
+        for (int c = 0; c < 2; ++c) {
+            if (bucket.count == 0) {
+                bucket.sum[c] = 0.0;
+                bucket.min[c] = bucket.max[c] = values[c];
+            }
+            bucket.sum[c] += values[c];
+            bucket.min[c] = std::min(bucket.min[c], values[c]);
+            bucket.max[c] = std::max(bucket.max[c], values[c]);
+        }
+        bucket.count++;
+    }
+}
+
+const TrendBuckets::Level& TrendBuckets::levelFor(int64_t spanMs, size_t columns) const {
+    for (const Level& level : levels) {
+        int64_t covered = level.widthMs * static_cast<int64_t>(level.ring.size());
+        if (covered >= spanMs && spanMs / level.widthMs <= static_cast<int64_t>(columns * MAX_BUCKETS_PER_COLUMN)) {
+            return level;
+        }
+    }
+    return levels[LEVELS - 1];
+}
+
+int64_t TrendBuckets::resolutionMs(int64_t spanMs, size_t columns) const {
+    return levelFor(spanMs, std::max<size_t>(columns, 1)).widthMs;
+}
+
+template <typename Fn>
+void TrendBuckets::forEachBucket(const Level& level, int64_t endMs, int64_t spanMs, size_t columns, Fn fn) const {
+    if (columns == 0 || spanMs <= 0 || endMs < 0) return;
+
+    int64_t startMs = std::max<int64_t>(0, endMs - spanMs);
+    int64_t lastSlot = endMs / level.widthMs;
+    int64_t firstSlot = (startMs + level.widthMs - 1) / level.widthMs;
+    // Anything older has been overwritten
+    firstSlot = std::max(firstSlot, lastSlot - static_cast<int64_t>(level.ring.size()) + 1);
+
+    for (int64_t slot = firstSlot; slot <= lastSlot; ++slot) {
+        const Bucket& bucket = level.ring[slot % level.ring.size()];
+        if (bucket.slot != slot || bucket.count == 0) continue;
+
+        // A bucket belongs to the column its start time falls into
+        int64_t offset = slot * level.widthMs - (endMs - spanMs);
+        size_t column = static_cast<size_t>(offset * static_cast<int64_t>(columns) / spanMs);
+        fn(bucket, std::min(column, columns - 1));
+    }
+}
+
+void TrendBuckets::series(HistoryColumn column, int64_t endMs, int64_t spanMs, size_t columns,
+                          std::vector<TrendPoint>& points) const {
+    points.assign(columns, TrendPoint());
+    const int c = pollutantIndex(column);
+
+    forEachBucket(levelFor(spanMs, columns), endMs, spanMs, columns, [&](const Bucket& bucket, size_t index) {
+        TrendPoint& point = points[index];
+        if (point.count == 0) {
+            point.min = bucket.min[c];
+            point.max = bucket.max[c];
+        } else {
+            point.min = std::min<double>(point.min, bucket.min[c]);
+            point.max = std::max<double>(point.max, bucket.max[c]);
+        }
+        // mean holds the running sum until the end
+        point.mean += bucket.sum[c];
+        point.count += bucket.count;
+    });
+
+    for (TrendPoint& point : points) {
+        if (point.count > 0) {
+            point.mean /= point.count;
+        }
+    }
+}
+
+void TrendBuckets::histogram(HistoryColumn column, int64_t endMs, int64_t spanMs, size_t columns,
+                             double maxValue, std::vector<uint32_t>& bins) const {
+    const int c = pollutantIndex(column);
+    const size_t binCount = bins.size();
+    std::fill(bins.begin(), bins.end(), 0);
+    if (binCount == 0 || maxValue <= 0.0) return;
+
+    forEachBucket(levelFor(spanMs, columns), endMs, spanMs, columns, [&](const Bucket& bucket, size_t) {
+        double mean = bucket.sum[c] / bucket.count;
+        size_t bin = static_cast<size_t>(std::max(0.0, mean) / maxValue * binCount);
+        bins[std::min(bin, binCount - 1)] += bucket.count;
+    });
+}
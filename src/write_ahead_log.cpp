@@ -0,0 +1,440 @@
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char WAL_MAGIC[4] = {'S', 'W', 'A', 'L'};
+    const uint32_t KIND_READINGS = 0;
+    const uint32_t KIND_CHECKPOINT = 1;
+
+    struct BlockHeader {
+        char magic[4];
+        uint32_t kind;
+        uint64_t sequence;
+        uint32_t payloadBytes;
+        uint32_t count;
+        uint32_t crc;               // CRC-32C of the header with crc = 0, then the payload
+        uint32_t reserved;
+    };
+    static_assert(sizeof(BlockHeader) == WriteAheadLog::BLOCK_HEADER_BYTES, "BlockHeader is an on-disk format");
+
+    bool syncData(int fd) {
+#ifdef LINUX
+        return fdatasync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    // A rename only survives a power loss once the directory holding it is synced
+    bool syncParentDirectory(const std::string& file) {
+        size_t slash = file.rfind('/');
+        std::string parent = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : file.substr(0, slash));
+        int fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        bool ok = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        return ok;
+    }
+
+    bool writeAll(int fd, const char* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t n = pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    // Byte-at-a-time CRC-32C table (reflected polynomial 0x82F63B78)
+    struct CrcTable {
+        uint32_t entries[256];
+
+        CrcTable() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1u)));
+                }
+                entries[i] = value;
+            }
+        }
+    };
+
+    void putString(std::string& out, const std::string& value) {
+        uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.append(value, 0, length);
+    }
+
+    // Bounds-checked reader over a block payload
+    struct Cursor {
+        const char* data;
+        size_t size;
+        size_t offset;
+
+        template <typename T>
+        bool get(T& value) {
+            if (size - offset < sizeof(T)) return false;
+            memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+
+        bool getString(std::string& value) {
+            uint16_t length;
+            if (!get(length) || size - offset < length) return false;
+            value.assign(data + offset, length);
+            offset += length;
+            return true;
+        }
+    };
+
+    bool parseSize(const std::string& text, uint64_t& bytes) {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (text.empty() || end == text.c_str() || value < 0.0) return false;
+        std::string unit = end;
+        if (unit == "K") value *= 1024.0;
+        else if (unit == "M") value *= 1024.0 * 1024.0;
+        else if (unit == "G") value *= 1024.0 * 1024.0 * 1024.0;
+        else if (!unit.empty()) return false;
+        bytes = static_cast<uint64_t>(std::llround(value));
+        return true;
+    }
+
+    std::string formatSize(uint64_t bytes) {
+        if (bytes != 0 && bytes % (1 << 20) == 0) return std::to_string(bytes >> 20) + "M";
+        if (bytes != 0 && bytes % (1 << 10) == 0) return std::to_string(bytes >> 10) + "K";
+        return std::to_string(bytes);
+    }
+}
+
+// WalConfig implementation
+bool WalConfig::parse(const std::string& spec, WalConfig& config) {
+    WalConfig result;
+    if (spec == "off" || spec == "none") {
+        config = result;
+        return true;
+    }
+    result.enabled = true;
+
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string text = item.substr(equals + 1);
+
+        if (key == "interval") {
+            char* end = nullptr;
+            double value = std::strtod(text.c_str(), &end);
+            std::string unit = end;
+            if (text.empty() || end == text.c_str() || value < 0.0 || (unit != "" && unit != "s" && unit != "ms")) {
+                return false;
+            }
+            result.intervalMs = static_cast<int64_t>(std::llround(unit == "ms" ? value : value * 1000.0));
+        } else if (key == "size") {
+            if (!parseSize(text, result.flushBytes)) return false;
+        } else if (key == "checkpoint") {
+            if (!parseSize(text, result.checkpointBytes) || result.checkpointBytes == 0) return false;
+        } else {
+            return false;
+        }
+    }
+
+    config = result;
+    return true;
+}
+
+std::string WalConfig::toString() const {
+    if (!enabled) {
+        return "off";
+    }
+    std::ostringstream oss;
+    oss << "interval=" << intervalMs << "ms,size=" << formatSize(flushBytes)
+        << ",checkpoint=" << formatSize(checkpointBytes);
+    return oss.str();
+}
+
+// WriteAheadLog implementation
+WriteAheadLog::WriteAheadLog() : fd(-1), fileBytes(0), sequence(0), firstBufferedNs(0) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+uint32_t WriteAheadLog::crc32c(const void* data, size_t size, uint32_t crc) {
+    static const CrcTable table;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool WriteAheadLog::open(const std::string& file, const WalConfig& cfg, WalRecovery& recovery) {
+    close();
+    recovery = WalRecovery();
+    path = file;
+    config = cfg;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Cannot open write-ahead log " << path << ": " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    // The log is bounded by the checkpoint size, so it is read whole
+    std::string contents(static_cast<size_t>(info.st_size), '\0');
+    size_t got = 0;
+    while (got < contents.size()) {
+        ssize_t n = pread(fd, &contents[got], contents.size() - got, static_cast<off_t>(got));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    contents.resize(got);
+
+    size_t offset = 0;
+    std::vector<std::string> blockNames;
+    while (contents.size() - offset >= sizeof(BlockHeader)) {
+        BlockHeader header;
+        memcpy(&header, contents.data() + offset, sizeof(header));
+        if (memcmp(header.magic, WAL_MAGIC, sizeof(header.magic)) != 0 ||
+            header.payloadBytes > contents.size() - offset - sizeof(header) ||
+            (recovery.blocks > 0 && header.sequence != sequence) ||
+            (header.kind != KIND_READINGS && header.kind != KIND_CHECKPOINT)) {
+            break;
+        }
+        uint32_t stored = header.crc;
+        header.crc = 0;
+        uint32_t crc = crc32c(&header, sizeof(header));
+        crc = crc32c(contents.data() + offset + sizeof(header), header.payloadBytes, crc);
+        if (crc != stored) {
+            break;
+        }
+
+        Cursor cursor = {contents.data() + offset + sizeof(header), header.payloadBytes, 0};
+        bool valid = true;
+        if (header.kind == KIND_CHECKPOINT) {
+            // A checkpoint starts a log and supersedes anything before it
+            recovery.checkpointed = true;
+            recovery.checkpoint.clear();
+            recovery.rows.clear();
+            for (uint32_t i = 0; i < header.count && valid; ++i) {
+                SegmentInfo segment;
+                valid = cursor.getString(segment.sensor) && cursor.getString(segment.path) &&
+                        cursor.get(segment.records) && cursor.get(segment.maxTimestamp);
+                recovery.checkpoint.push_back(segment);
+            }
+        } else {
+            uint16_t nameCount = 0;
+            valid = cursor.get(nameCount);
+            blockNames.assign(nameCount, std::string());
+            for (uint16_t i = 0; i < nameCount && valid; ++i) {
+                valid = cursor.getString(blockNames[i]);
+            }
+            for (uint32_t i = 0; i < header.count && valid; ++i) {
+                Record record;
+                valid = cursor.get(record) && record.sensor < nameCount;
+                if (!valid) break;
+                HistoryRow row;
+                row.timestamp_ms = record.timestamp_ms;
+                row.pm25_raw = record.pm25_raw;
+                row.pm10_raw = record.pm10_raw;
+                row.pm25_corrected_raw = record.pm25_corrected_raw;
+                row.pm10_corrected_raw = record.pm10_corrected_raw;
+                row.humidity = record.humidity;
+                row.flags = record.flags;
+                recovery.rows.push_back(std::make_pair(blockNames[record.sensor], row));
+            }
+        }
+        if (!valid) {
+            break;
+        }
+
+        recovery.blocks++;
+        sequence = header.sequence + 1;
+        offset += sizeof(header) + header.payloadBytes;
+    }
+
+    // Whatever follows the last valid block is a write that never completed
+    fileBytes = offset;
+    recovery.tornBytes = contents.size() - offset;
+    if (recovery.tornBytes > 0) {
+        std::cerr << "Write-ahead log " << path << ": cut " << recovery.tornBytes << " bytes of torn tail" << std::endl;
+        if (ftruncate(fd, static_cast<off_t>(offset)) != 0 || !syncData(fd)) {
+            std::cerr << "Cannot truncate write-ahead log " << path << ": " << strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (fd < 0) {
+        return;
+    }
+    commit();
+    ::close(fd);
+    fd = -1;
+}
+
+void WriteAheadLog::append(const std::string& sensor, const HistoryRow& row, uint64_t nowNs) {
+    auto found = names.find(sensor);
+    if (found == names.end()) {
+        found = names.insert(std::make_pair(sensor, static_cast<uint16_t>(names.size()))).first;
+        putString(nameTable, sensor);
+    }
+
+    Record record;
+    record.timestamp_ms = row.timestamp_ms;
+    record.pm25_raw = row.pm25_raw;
+    record.pm10_raw = row.pm10_raw;
+    record.pm25_corrected_raw = row.pm25_corrected_raw;
+    record.pm10_corrected_raw = row.pm10_corrected_raw;
+    record.humidity = row.humidity;
+    record.flags = row.flags;
+    record.sensor = found->second;
+    record.reserved = 0;
+    if (records.empty()) {
+        firstBufferedNs = nowNs;
+    }
+    records.push_back(record);
+
+    // A block names at most 65535 sensors
+    if (names.size() == 0xFFFF) {
+        commit();
+    }
+}
+
+bool WriteAheadLog::due(uint64_t nowNs) const {
+    return !records.empty() && (records.size() * sizeof(Record) + nameTable.size() >= config.flushBytes ||
+                                nowNs - firstBufferedNs >= static_cast<uint64_t>(config.intervalMs) * 1000000ULL);
+}
+
+int64_t WriteAheadLog::msUntilDue(uint64_t nowNs) const {
+    if (records.empty()) {
+        return -1;
+    }
+    if (due(nowNs)) {
+        return 0;
+    }
+    uint64_t deadline = firstBufferedNs + static_cast<uint64_t>(config.intervalMs) * 1000000ULL;
+    return static_cast<int64_t>((deadline - nowNs + 999999) / 1000000);
+}
+
+bool WriteAheadLog::writeBlock(int target, uint32_t kind, const std::string& payload, uint32_t count,
+                               uint64_t offset) {
+    BlockHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+    header.kind = kind;
+    header.sequence = sequence;
+    header.payloadBytes = static_cast<uint32_t>(payload.size());
+    header.count = count;
+    header.crc = crc32c(&header, sizeof(header));
+    header.crc = crc32c(payload.data(), payload.size(), header.crc);
+
+    // Header and payload in one write, then one sync for the whole block
+    std::string block(reinterpret_cast<const char*>(&header), sizeof(header));
+    block += payload;
+    if (!writeAll(target, block.data(), block.size(), offset) || !syncData(target)) {
+        return false;
+    }
+    counters.bytes += block.size();
+    sequence++;
+    return true;
+}
+
+bool WriteAheadLog::commit() {
+    if (fd < 0 || records.empty()) {
+        return fd >= 0;
+    }
+
+    std::string payload;
+    payload.reserve(sizeof(uint16_t) + nameTable.size() + records.size() * sizeof(Record));
+    uint16_t nameCount = static_cast<uint16_t>(names.size());
+    payload.append(reinterpret_cast<const char*>(&nameCount), sizeof(nameCount));
+    payload += nameTable;
+    payload.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+
+    if (!writeBlock(fd, KIND_READINGS, payload, static_cast<uint32_t>(records.size()), fileBytes)) {
+        std::cerr << "Error committing write-ahead log " << path << ": " << strerror(errno) << std::endl;
+        // A partial block would hide every later one from recovery
+        if (ftruncate(fd, static_cast<off_t>(fileBytes)) != 0) {
+            std::cerr << "Cannot truncate write-ahead log " << path << std::endl;
+        }
+        return false;
+    }
+
+    fileBytes += sizeof(BlockHeader) + payload.size();
+    counters.commits++;
+    counters.records += records.size();
+    names.clear();
+    nameTable.clear();
+    records.clear();
+    firstBufferedNs = 0;
+    return true;
+}
+
+bool WriteAheadLog::checkpoint(const std::vector<SegmentInfo>& synced) {
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string payload;
+    for (const SegmentInfo& segment : synced) {
+        putString(payload, segment.sensor);
+        putString(payload, segment.path);
+        payload.append(reinterpret_cast<const char*>(&segment.records), sizeof(segment.records));
+        payload.append(reinterpret_cast<const char*>(&segment.maxTimestamp), sizeof(segment.maxTimestamp));
+    }
+
+    // Complete and synced before it replaces the old log, which stays valid until then
+    std::string temporary = path + ".tmp";
+    int next = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (next < 0 || !writeBlock(next, KIND_CHECKPOINT, payload, static_cast<uint32_t>(synced.size()), 0) ||
+        rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error checkpointing write-ahead log " << path << ": " << strerror(errno) << std::endl;
+        if (next >= 0) ::close(next);
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    // Buffered readings are in the synced store already
+    ::close(fd);
+    fd = next;
+    fileBytes = sizeof(BlockHeader) + payload.size();
+    names.clear();
+    nameTable.clear();
+    records.clear();
+    firstBufferedNs = 0;
+
+    // Until the directory is synced a power loss may bring the old log back, and recovery would then roll the
+    // store back past rows it already had on disk
+    if (!syncParentDirectory(path)) {
+        std::cerr << "Error syncing the directory of write-ahead log " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    counters.checkpoints++;
+    return true;
+}
@@ -1,6 +1,90 @@
+#include "metrics.h"
+#include "trace_recorder.h"
+#include "sds011_protocol.h"
+#include "raw_capture.h"
+#include "capture_replayer.h"
+#include "serial_port.h"
+#include "sensor_daemon.h"
+#include "tdigest.h"
+#include "aqi_engine.h"
+#include "aggregate_kernels.h"
+#include "reading_history.h"
+#include "trend_buckets.h"
+#include "outlier_filter.h"
+#include "humidity_correction.h"
+#include "sample_clock.h"
+#include "sensor_health.h"
+#include "device_lookup.h"
+#include "event_loop.h"
+#include "async_sensor.h"
+#include "io_backend.h"
+#include "reading_bus.h"
+#include "alert_engine.h"
+#include "segment_store.h"
+#include "store_compactor.h"
+#include "write_ahead_log.h"
+#include "arrow_export.h"
+#include "sds011_stream.h"
+#include "sds011_plugin.h"
 #include <iostream>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Build a valid SDS011 measurement frame
+static std::vector<unsigned char> makeFrame(uint16_t pm25Raw, uint16_t pm10Raw) {
+    std::vector<unsigned char> frame = {
+        0xAA, 0xC0,
+        static_cast<unsigned char>(pm25Raw & 0xFF), static_cast<unsigned char>(pm25Raw >> 8),
+        static_cast<unsigned char>(pm10Raw & 0xFF), static_cast<unsigned char>(pm10Raw >> 8),
+        0x12, 0x34, 0x00, 0xAB
+    };
+    unsigned char checksum = 0;
+    for (int i = 2; i < 8; ++i) checksum += frame[i];
+    frame[8] = checksum;
+    return frame;
+}
+
+// Delete a directory and the files one level below it, as a segment store leaves them
+static void removeStore(const std::string& path) {
+    if (DIR* dir = opendir(path.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") continue;
+            std::string child = path + "/" + name;
+            if (DIR* sub = opendir(child.c_str())) {
+                while (struct dirent* file = readdir(sub)) {
+                    std::string fileName = file->d_name;
+                    if (fileName != "." && fileName != "..") unlink((child + "/" + fileName).c_str());
+                }
+                closedir(sub);
+                rmdir(child.c_str());
+            } else {
+                unlink(child.c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
 
 // Simple unit tests that don't require a terminal
 // These test basic functionality without GUI components
@@ -47,6 +131,1909 @@ void test_data_structures() {
     std::cout << "✓ Data validation works (PM2.5: " << pm25 << ", PM10: " << pm10 << ")" << std::endl;
 }
 
+// Test latency histogram bucketing and percentiles
+void test_latency_histogram() {
+    std::cout << "Testing latency histogram..." << std::endl;
+    
+    // Bucket boundaries must be monotonic and round-trip
+    for (int i = 1; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+        assert(LatencyHistogram::bucketLowerBound(i) > LatencyHistogram::bucketLowerBound(i - 1));
+        assert(LatencyHistogram::bucketIndex(LatencyHistogram::bucketLowerBound(i)) == i);
+    }
+    
+    LatencyHistogram histogram;
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        histogram.record(v * 1000); // 1us .. 1ms
+    }
+    assert(histogram.count() == 1000);
+    assert(histogram.min() == 1000);
+    assert(histogram.max() == 1000000);
+    
+    // Log-linear buckets keep percentiles within ~3% of the exact value
+    uint64_t p50 = histogram.valueAtPercentile(50);
+    uint64_t p99 = histogram.valueAtPercentile(99);
+    assert(p50 > 485000 && p50 < 515000);
+    assert(p99 > 960000 && p99 <= 1000000);
+    
+    SensorMetrics& metrics = MetricsRegistry::instance().forSensor("/dev/test0");
+    metrics.readSyscall.record(2500);
+    metrics.checksumFailures.fetch_add(3);
+    assert(&metrics == &MetricsRegistry::instance().forSensor("/dev/test0"));
+    
+    std::ostringstream out;
+    MetricsRegistry::instance().exportText(out);
+    assert(out.str().find("sensor_checksum_failures_total{sensor=\"/dev/test0\"} 3") != std::string::npos);
+    assert(out.str().find("sensor_read_syscall_seconds_count{sensor=\"/dev/test0\"} 1") != std::string::npos);
+    
+    std::cout << "✓ Histogram percentiles and metrics export work" << std::endl;
+}
+
+// Test binary trace recording and Chrome JSON conversion
+void test_trace_recorder() {
+    std::cout << "Testing trace recorder..." << std::endl;
+    
+    const std::string binPath = "test_trace.bin";
+    const std::string jsonPath = "test_trace.json";
+    
+    // Disabled recorder must ignore events
+    TraceRecorder::record(TraceEvent::ReadStart, 0);
+    
+    assert(TraceRecorder::start(binPath));
+    uint16_t sensor = TraceRecorder::sensorId("/dev/ttyTEST");
+    assert(sensor == TraceRecorder::sensorId("/dev/ttyTEST"));
+    
+    TraceRecorder::record(TraceEvent::ReadStart, sensor);
+    TraceRecorder::record(TraceEvent::ReadEnd, sensor, 10);
+    TraceRecorder::record(TraceEvent::FrameAccepted, sensor, 123);
+    std::thread other([sensor]() {
+        TraceRecorder::record(TraceEvent::FrameRejected, sensor,
+                              static_cast<uint32_t>(TraceRejectReason::BadChecksum));
+    });
+    other.join();
+    TraceRecorder::stop();
+    
+    assert(TraceRecorder::convertToChromeJson(binPath, jsonPath));
+    std::ifstream in(jsonPath.c_str());
+    std::stringstream json;
+    json << in.rdbuf();
+    
+    assert(json.str().find("\"ph\":\"B\",\"args\":{\"sensor\":\"/dev/ttyTEST\"}") != std::string::npos);
+    assert(json.str().find("\"bytes\":10") != std::string::npos);
+    assert(json.str().find("\"pm25\":12.3") != std::string::npos);
+    assert(json.str().find("\"reason\":\"bad checksum\"") != std::string::npos);
+    
+    std::remove(binPath.c_str());
+    std::remove(jsonPath.c_str());
+    
+    std::cout << "✓ Trace events round-trip to Chrome JSON" << std::endl;
+}
+
+// Test frame parser resynchronisation and checksum handling
+void test_frame_parser() {
+    std::cout << "Testing frame parser..." << std::endl;
+    
+    SDS011FrameParser parser;
+    std::vector<unsigned char> stream = {0x00, 0xAB, 0xAA}; // junk, then a lone header
+    std::vector<unsigned char> good = makeFrame(123, 456);
+    std::vector<unsigned char> bad = makeFrame(10, 20);
+    bad[8] ^= 0xFF;
+    stream.insert(stream.end(), good.begin(), good.end());
+    stream.insert(stream.end(), bad.begin(), bad.end());
+    stream.insert(stream.end(), good.begin(), good.begin() + 4); // split across reads
+    stream.insert(stream.end(), good.begin() + 4, good.end());
+    
+    int frames = 0, checksumErrors = 0, resyncs = 0;
+    for (unsigned char byte : stream) {
+        switch (parser.push(byte)) {
+            case SDS011FrameParser::FrameReady:
+                frames++;
+                assert(parser.frame().pm25_raw == 123);
+                assert(parser.frame().pm10_raw == 456);
+                assert(parser.frame().pm25() == 12.3f);
+                break;
+            case SDS011FrameParser::BadChecksum: checksumErrors++; break;
+            case SDS011FrameParser::Resync: resyncs++; break;
+            case SDS011FrameParser::NeedMore: break;
+        }
+    }
+    
+    assert(frames == 2);
+    assert(checksumErrors == 1);
+    assert(resyncs >= 1);
+    
+    std::cout << "✓ Parser resyncs after junk and rejects bad checksums" << std::endl;
+}
+
+// Test capture file round trip through the replay path
+void test_capture_replay() {
+    std::cout << "Testing capture replay..." << std::endl;
+    
+    const std::string path = "test_capture.raw";
+    RawCaptureWriter writer;
+    assert(writer.open(path));
+    
+    uint64_t t = 1000000;
+    for (uint16_t i = 0; i < 50; ++i) {
+        std::vector<unsigned char> frame = makeFrame(100 + i, 200 + i);
+        // Deliver each frame in two reads, as a slow UART would
+        writer.writeBytes(t, frame.data(), 3);
+        writer.writeBytes(t + 1000, frame.data() + 3, frame.size() - 3);
+        writer.writeFrame(t + 1000, 100 + i, 200 + i);
+        t += 1000000;
+    }
+    writer.close();
+    
+    CaptureReplayer replayer(path, false);
+    assert(replayer.load());
+    ReplayReport report;
+    assert(replayer.run(report));
+    assert(report.framesRecorded == 50);
+    assert(report.framesDecoded == 50);
+    assert(report.mismatches == 0);
+    assert(report.firstDivergence == -1);
+    assert(report.bytes == 500);
+    
+    std::remove(path.c_str());
+    
+    std::cout << "✓ Replay decodes " << report.framesDecoded << " frames without divergence" << std::endl;
+}
+
+void test_serial_profiles() {
+    std::cout << "Testing serial I/O profiles..." << std::endl;
+    
+    const SerialIOProfile ALL[] = {
+        SerialIOProfile::Timed, SerialIOProfile::FrameBlocking,
+        SerialIOProfile::Poll, SerialIOProfile::LowLatency
+    };
+    for (SerialIOProfile profile : ALL) {
+        SerialIOProfile parsed;
+        assert(SerialPort::parseProfile(SerialPort::profileName(profile), parsed));
+        assert(parsed == profile);
+    }
+    SerialIOProfile unused;
+    assert(!SerialPort::parseProfile("fast", unused));
+    assert(!SerialPort::usesPoll(SerialIOProfile::Timed));
+    assert(SerialPort::usesPoll(SerialIOProfile::FrameBlocking));
+    
+    // Per-port overrides win over the default
+    assert(SerialPort::profileFor("/dev/test0") == SerialIOProfile::Timed);
+    SerialPort::setProfile("/dev/test1", SerialIOProfile::Poll);
+    SerialPort::setProfile("", SerialIOProfile::FrameBlocking);
+    assert(SerialPort::profileFor("/dev/test0") == SerialIOProfile::FrameBlocking);
+    assert(SerialPort::profileFor("/dev/test1") == SerialIOProfile::Poll);
+    SerialPort::setProfile("", SerialIOProfile::Timed);
+    
+    std::cout << "✓ Profile names round-trip and per-port overrides apply" << std::endl;
+}
+
+void test_daemon_control_socket() {
+    std::cout << "Testing daemon control socket..." << std::endl;
+    
+    DaemonConfig config;
+    config.socket_path = "test_daemon.sock";
+    config.data_file = "test_daemon.csv";
+    config.store_directory = "test_daemon_store";
+    config.export_dir = ".";
+    config.window_size = 5;
+    std::remove(config.data_file.c_str());
+    removeStore(config.store_directory);
+    
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    {
+        SensorDaemon daemon(config);
+        assert(daemon.start());
+        std::thread server(&SensorDaemon::run, &daemon);
+        struct stat socketStat;
+        assert(stat(config.socket_path.c_str(), &socketStat) == 0 && (socketStat.st_mode & 0777) == 0600);
+        {
+            // A second daemon on the same socket refuses to start instead of taking it over
+            SensorDaemon second(config);
+            assert(!second.start());
+        }
+        
+        ControlClient subscriber;
+        assert(subscriber.connect(config.socket_path));
+        std::string line;
+        assert(subscriber.send("SUBSCRIBE sensorA"));
+        assert(subscriber.readLine(line, 2000) && line == "OK");
+        
+        for (int i = 0; i < 8; ++i) {
+            daemon.publish(DaemonReading("sensorA", now - 8000 + i * 1000, 10.0f + i, 20.0f + i));
+        }
+        daemon.publish(DaemonReading("sensorB", now, 99.0f, 99.0f));
+        
+        // The subscriber sees every sensorA reading, in order, and nothing else
+        for (int i = 0; i < 8; ++i) {
+            DaemonReading reading;
+            assert(subscriber.readLine(line, 2000));
+            assert(DaemonReading::fromLine(line, reading));
+            assert(reading.sensor == "sensorA");
+            assert(reading.pm25 == 10.0f + i);
+        }
+        assert(!subscriber.readLine(line, 50));
+        
+        // Queries are answered from the bounded window
+        ControlClient query;
+        assert(query.connect(config.socket_path));
+        assert(query.send("QUERY sensorA 3600"));
+        int rows = 0;
+        while (query.readLine(line, 2000) && line != "OK") rows++;
+        assert(rows == 5);
+        assert(query.send("QUERY sensorA 2.5"));
+        rows = 0;
+        while (query.readLine(line, 2000) && line != "OK") rows++;
+        assert(rows == 2);
+        
+        // The store keeps every reading, beyond the window
+        assert(query.send("HISTORY sensorA " + std::to_string(now - 8000) + " " + std::to_string(now)));
+        rows = 0;
+        while (query.readLine(line, 2000) && line != "OK") rows++;
+        assert(rows == 8);
+        assert(query.send("HISTORY * " + std::to_string(now) + " " + std::to_string(now + 1)));
+        assert(query.readLine(line, 2000) && line.compare(0, 13, "DATA sensorB ") == 0);
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.send("HISTORY * 0 " + std::to_string(now) + " minute"));
+        assert(query.readLine(line, 2000) && line == "OK");     // nothing rolled up yet
+        assert(query.send("HISTORY * 0 1 weekly"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        assert(query.send("QUANTILES * 1"));
+        assert(query.readLine(line, 2000) && line == "QUANTILE * 1.0 99.0 99.0");
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.send("BUS"));
+        assert(query.readLine(line, 2000) && line == "OK");     // no ports, no buses
+        assert(query.send("EXPORT test_daemon.arrow sensorA"));
+        assert(query.readLine(line, 2000) && line == "EXPORTED 8 test_daemon.arrow");
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.send("EXPORT test_daemon.arrow * " + std::to_string(now) + " " + std::to_string(now + 1)));
+        assert(query.readLine(line, 2000) && line == "EXPORTED 1 test_daemon.arrow");
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.send("EXPORT test_daemon.arrow * 5"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        assert(query.send("EXPORT test_daemon.arrow * abc"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        assert(query.send("EXPORT test_daemon.arrow * 1 2 3"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        assert(query.send("EXPORT ../test_daemon.arrow *"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        assert(query.send("EXPORT /tmp/test_daemon.arrow *"));
+        assert(query.readLine(line, 2000) && line.compare(0, 4, "ERR ") == 0);
+        // The command after an EXPORT waits for the worker's reply
+        assert(query.send("EXPORT test_daemon.arrow sensorA\nPING"));
+        assert(query.readLine(line, 2000) && line == "EXPORTED 8 test_daemon.arrow");
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.readLine(line, 2000) && line == "OK");
+        std::remove("test_daemon.arrow");
+        assert(query.send("BOGUS"));
+        assert(query.readLine(line, 2000) && line.compare(0, 3, "ERR") == 0);
+        
+        daemon.stop();
+        server.join();
+    }
+    
+    // A restarted daemon recovers its window from the data file, and starts a write-ahead log for the store
+    assert(WalConfig::parse("interval=5s", config.wal));
+    {
+        SensorDaemon daemon(config);
+        assert(daemon.start());
+        std::thread server(&SensorDaemon::run, &daemon);
+        
+        ControlClient query;
+        assert(query.connect(config.socket_path));
+        assert(query.send("QUERY * 3600"));
+        int rows = 0;
+        std::string line;
+        while (query.readLine(line, 2000) && line != "OK") rows++;
+        assert(rows == 6);
+        assert(query.send("HISTORY * 0 " + std::to_string(now + 1)));
+        rows = 0;
+        while (query.readLine(line, 2000) && line != "OK") rows++;
+        assert(rows == 9);
+        assert(query.send("METRICS"));
+        bool checkpointed = false;
+        while (query.readLine(line, 2000) && line != "OK") {
+            checkpointed = checkpointed || line == "store_wal_checkpoints_total 1";
+        }
+        assert(checkpointed);
+        
+        daemon.stop();
+        server.join();
+    }
+    std::remove(config.data_file.c_str());
+    removeStore(config.store_directory);
+
+    // The socket file of a daemon that died refuses connections and is replaced
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un staleAddr;
+    std::memset(&staleAddr, 0, sizeof(staleAddr));
+    staleAddr.sun_family = AF_UNIX;
+    std::strncpy(staleAddr.sun_path, config.socket_path.c_str(), sizeof(staleAddr.sun_path) - 1);
+    assert(stale >= 0 && bind(stale, reinterpret_cast<struct sockaddr*>(&staleAddr), sizeof(staleAddr)) == 0);
+    close(stale);
+
+    // A reply far over the subscription backlog limit reaches a client that reads it late
+    DaemonConfig large;
+    large.socket_path = config.socket_path;
+    large.data_file = "";
+    large.window_size = 60000;
+    large.store_directory = config.store_directory;
+    {
+        SensorDaemon daemon(large);
+        assert(daemon.start());
+        std::thread server(&SensorDaemon::run, &daemon);
+
+        ControlClient stalled;
+        assert(stalled.connect(large.socket_path));
+        std::string line;
+        assert(stalled.send("SUBSCRIBE *"));
+        assert(stalled.readLine(line, 2000) && line == "OK");
+        for (int i = 0; i < 60000; ++i) {
+            daemon.publish(DaemonReading("sensorC", now - 60000 + i, 12.5f, 25.0f));
+        }
+
+        ControlClient query;
+        assert(query.connect(large.socket_path));
+        assert(query.send("QUERY sensorC 3600"));
+        assert(query.send("PING"));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int rows = 0;
+        while (query.readLine(line, 2000) && line.compare(0, 5, "DATA ") == 0) rows++;
+        assert(rows == 60000 && line == "OK");
+        assert(query.readLine(line, 2000) && line == "OK");
+
+        // HISTORY reads the store a piece at a time; rows with one timestamp span pieces
+        for (int i = 0; i < 3000; ++i) {
+            daemon.publish(DaemonReading("sensorD", now, 1.0f, 2.0f));
+        }
+        assert(query.send("PING"));     // answered once the readings above are in the store
+        assert(query.readLine(line, 2000) && line == "OK");
+        assert(query.send("HISTORY * 0 " + std::to_string(now + 1)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        rows = 0;
+        int same = 0;
+        while (query.readLine(line, 2000) && line.compare(0, 5, "DATA ") == 0) {
+            rows++;
+            same += line.compare(0, 13, "DATA sensorD ") == 0;
+        }
+        assert(rows == 63000 && same == 3000 && line == "OK");
+
+        // The subscriber that never read was dropped after its backlog
+        rows = 0;
+        while (stalled.readLine(line, 2000)) rows++;
+        assert(!stalled.isConnected() && rows < 60000);
+
+        daemon.stop();
+        server.join();
+    }
+    removeStore(large.store_directory);
+
+    std::cout << "✓ Subscriptions stream live readings and queries survive a restart" << std::endl;
+}
+
+void test_tdigest() {
+    std::cout << "Testing t-digest quantiles..." << std::endl;
+    
+    // Deterministic, skewed sample resembling PM2.5 readings
+    std::vector<double> values;
+    uint32_t seed = 12345;
+    for (int i = 0; i < 100000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        double u = ((seed >> 8) & 0xFFFF) / 65536.0;
+        values.push_back(5.0 + 40.0 * u * u * u);
+    }
+    
+    TDigest digest;
+    TDigest halves[2];
+    for (size_t i = 0; i < values.size(); ++i) {
+        digest.add(values[i]);
+        halves[i % 2].add(values[i]);
+    }
+    
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    const double QUANTILES[] = {0.5, 0.9, 0.98};
+    for (double q : QUANTILES) {
+        double exact = sorted[static_cast<size_t>(q * (sorted.size() - 1))];
+        assert(std::fabs(digest.quantile(q) - exact) < 0.01 * exact);
+    }
+    assert(digest.count() == values.size());
+    assert(digest.min() == sorted.front() && digest.max() == sorted.back());
+    
+    // Memory stays bounded no matter how many samples went in
+    assert(digest.centroidCount() <= 200);
+    
+    // Merged digests (per sensor -> fleet) agree with the single digest
+    TDigest fleet;
+    fleet.merge(halves[0]);
+    fleet.merge(halves[1]);
+    assert(fleet.count() == digest.count());
+    for (double q : QUANTILES) {
+        assert(std::fabs(fleet.quantile(q) - digest.quantile(q)) < 0.01 * digest.quantile(q));
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    double sink = 0.0;
+    for (int i = 0; i < 1000; ++i) {
+        sink += digest.quantile(0.98);
+    }
+    double perQueryUs = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / 1000;
+    assert(sink > 0.0);
+    
+    fleet.reset();
+    assert(fleet.count() == 0 && fleet.quantile(0.5) == 0.0);
+    
+    std::cout << "✓ P50/P90/P98 within 1% using " << digest.centroidCount()
+              << " centroids, " << perQueryUs << " us per query" << std::endl;
+}
+
+void test_aqi_engine() {
+    std::cout << "Testing AQI engine..." << std::endl;
+    
+    // Breakpoint edges and interpolation
+    assert(AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, 9.0).index == 50);
+    assert(AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, 35.4).index == 100);
+    AQIResult usg = AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, 35.5);
+    assert(usg.index == 101 && usg.level == 2);
+    assert(AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, 12.0).index == 56);
+    assert(AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM10, 154).index == 100);
+    assert(AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, 900).index == 500);
+    assert(AQIEngine::classify(AQIStandard::IndiaNAQI, Pollutant::PM25, 60).index == 100);
+    AQIResult uk = AQIEngine::classify(AQIStandard::UKDAQI, Pollutant::PM25, 40);
+    assert(uk.index == 4 && std::string(uk.category) == "Moderate");
+    assert(!AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, -1.0).valid);
+    
+    // NowCast weights recent hours more when the air is changing
+    AQIEngine engine;
+    const int64_t base = 1700000000 / 3600 * 3600;
+    for (int i = 0; i < 60; ++i) {
+        engine.addReading(base + i * 60, 10.0f, 20.0f);
+        engine.addReading(base + 3600 + i * 60, 30.0f, 40.0f);
+    }
+    bool provisional = true;
+    double nowcast = engine.nowCast(Pollutant::PM25, provisional);
+    assert(!provisional);
+    assert(std::fabs(nowcast - (30.0 + 0.5 * 10.0) / 1.5) < 1e-6);
+    assert(std::fabs(engine.mean24h(Pollutant::PM25) - 20.0) < 1e-6);
+    assert(engine.nowCastAQI().index == AQIEngine::classify(AQIStandard::USEPA, Pollutant::PM25, nowcast).index);
+    assert(engine.dailyAQI().provisional);
+    
+    // Hours older than 24 h drop out of the running sums
+    engine.addReading(base + 30 * 3600, 50.0f, 60.0f);
+    assert(std::fabs(engine.mean24h(Pollutant::PM25) - 50.0) < 1e-6);
+    engine.nowCast(Pollutant::PM25, provisional);
+    assert(provisional);
+    
+    // Steady air over 24 h gives a complete daily index
+    AQIEngine steady(AQIStandard::UKDAQI);
+    for (int h = 0; h < 24; ++h) {
+        steady.addReading(base + h * 3600, 40.0f, 10.0f);
+    }
+    AQIResult daily = steady.dailyAQI();
+    assert(daily.valid && !daily.provisional && daily.index == 4);
+    
+    std::cout << "✓ Breakpoints, NowCast weighting and 24 h eviction behave as specified" << std::endl;
+}
+
+void test_aggregate_kernels() {
+    std::cout << "Testing aggregation kernels..." << std::endl;
+    
+    std::vector<uint16_t> raw(100003);
+    std::vector<float> values(raw.size());
+    uint32_t seed = 7;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        seed = seed * 1664525 + 1013904223;
+        raw[i] = static_cast<uint16_t>(seed >> 16);
+        values[i] = raw[i] / 10.0f;
+    }
+    raw[5] = 0;
+    raw[99999] = 65535;
+    
+    // Lengths around the vector widths exercise the scalar tails
+    const size_t LENGTHS[] = {0, 1, 7, 8, 15, 16, 17, 33, 1000, raw.size()};
+    const KernelIsa ISAS[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2};
+    int checked = 0;
+    for (KernelIsa isa : ISAS) {
+        if (!AggregateKernels::isSupported(isa)) continue;
+        for (size_t n : LENGTHS) {
+            ColumnSummary expected = AggregateKernels::summarizeU16With(KernelIsa::Scalar, raw.data(), n);
+            ColumnSummary actual = AggregateKernels::summarizeU16With(isa, raw.data(), n);
+            assert(actual.count == n && actual.count == expected.count);
+            assert(actual.sum == expected.sum);
+            assert(actual.min == expected.min && actual.max == expected.max);
+            
+            ColumnSummary expectedF = AggregateKernels::summarizeFloatWith(KernelIsa::Scalar, values.data(), n);
+            ColumnSummary actualF = AggregateKernels::summarizeFloatWith(isa, values.data(), n);
+            assert(actualF.count == n);
+            assert(std::fabs(actualF.sum - expectedF.sum) <= 1e-9 * std::max(1.0, expectedF.sum));
+            assert(actualF.min == expectedF.min && actualF.max == expectedF.max);
+            checked++;
+        }
+    }
+    assert(AggregateKernels::summarizeU16(raw.data(), raw.size()).min == 0);
+    assert(AggregateKernels::summarizeU16(raw.data(), raw.size()).max == 65535);
+    
+    // Summaries of adjacent ranges merge into the summary of the whole
+    ColumnSummary left = AggregateKernels::summarizeFloat(values.data(), 500);
+    left.merge(AggregateKernels::summarizeFloat(values.data() + 500, 500));
+    ColumnSummary whole = AggregateKernels::summarizeFloat(values.data(), 1000);
+    assert(left.count == whole.count && left.min == whole.min && left.max == whole.max);
+    assert(std::fabs(left.mean() - whole.mean()) < 1e-9);
+    
+    std::cout << "✓ " << checked << " kernel/length combinations match the scalar reference (active: "
+              << AggregateKernels::isaName(AggregateKernels::activeIsa()) << ")" << std::endl;
+}
+
+void test_reading_history() {
+    std::cout << "Testing columnar reading history..." << std::endl;
+    
+    const size_t CHUNK = ReadingHistory::CHUNK_ROWS;
+    ReadingHistory history(2 * CHUNK);
+    assert(history.empty() && history.lowerBound(0) == 0);
+    
+    // Readings every second; values cycle so chunk boundaries are covered by summaries
+    const size_t N = 2 * CHUNK + 100;
+    for (size_t i = 0; i < N; ++i) {
+        history.append(static_cast<int64_t>(i) * 1000, static_cast<uint16_t>(i % 1000),
+                       static_cast<uint16_t>(2 * (i % 1000)), static_cast<uint8_t>(i & 1));
+    }
+    
+    // Capacity reached: the oldest chunk was recycled for the newest readings
+    assert(history.size() == CHUNK + 100);
+    HistoryRow oldest = history.at(0);
+    assert(oldest.timestamp_ms == static_cast<int64_t>(CHUNK) * 1000);
+    assert(oldest.pm25_raw == CHUNK % 1000 && oldest.flags == (CHUNK & 1));
+    HistoryRow newest = history.at(history.size() - 1);
+    assert(newest.timestamp_ms == static_cast<int64_t>(N - 1) * 1000);
+    assert(newest.pm10() == 2 * ((N - 1) % 1000) / 10.0f);
+    
+    // Binary search lands on exact, in-between and out-of-range timestamps
+    assert(history.lowerBound(0) == 0);
+    assert(history.lowerBound(static_cast<int64_t>(CHUNK + 10) * 1000) == 10);
+    assert(history.lowerBound(static_cast<int64_t>(CHUNK + 10) * 1000 - 1) == 10);
+    assert(history.lowerBound(static_cast<int64_t>(N - 1) * 1000) == history.size() - 1);
+    assert(history.lowerBound(static_cast<int64_t>(N) * 1000) == history.size());
+    
+    // A range spanning two chunks agrees with a row-by-row reference
+    size_t first = CHUNK - 50, count = 120;
+    ColumnSummary summary = history.summarize(HistoryColumn::PM10, first, count);
+    double sum = 0.0, lo = 1e9, hi = -1.0;
+    for (size_t i = first; i < first + count; ++i) {
+        double value = history.at(i).pm10_raw;
+        sum += value;
+        lo = std::min(lo, value);
+        hi = std::max(hi, value);
+    }
+    assert(summary.count == count && summary.sum == sum && summary.min == lo && summary.max == hi);
+    
+    // A slice copied a column at a time keeps its rows and their outlier counts
+    ReadingHistory copy(count);
+    history.forEachSlice(first, count, [&copy](const ReadingHistory::Chunk& chunk, size_t begin, size_t end) {
+        copy.appendSlice(chunk, begin, end);
+    });
+    assert(copy.size() == count && copy.at(count - 1).timestamp_ms == history.at(first + count - 1).timestamp_ms);
+    ColumnSummary copied = copy.summarizeAll(HistoryColumn::PM25);
+    ColumnSummary original = history.summarize(HistoryColumn::PM25, first, count);
+    assert(copied.count == original.count && copied.count == count / 2);
+    
+    // Float appends keep the sensor's 0.1 µg/m³ resolution; summarizeAll is in µg/m³
+    ReadingHistory small;
+    small.append(1000, 12.3f, 45.6f);
+    small.append(2000, 7.7f, 1.0f);
+    small.append(3000, -1.0f, 70000.0f);
+    assert(small.at(0).pm25_raw == 123 && small.at(2).pm25_raw == 0 && small.at(2).pm10_raw == 65535);
+    ColumnSummary pm25 = small.summarizeAll(HistoryColumn::PM25);
+    assert(std::fabs(pm25.max - 12.3) < 1e-9 && std::fabs(pm25.sum - 20.0) < 1e-9);
+    
+    history.setCapacity(100);
+    assert(history.size() == 100);
+    history.clear();
+    assert(history.empty());
+    
+    std::cout << "✓ Columns append, recycle chunks, seek and summarise across chunk boundaries" << std::endl;
+}
+
+void test_history_ring() {
+    std::cout << "Testing memory-mapped history ring..." << std::endl;
+    
+    const size_t CHUNK = ReadingHistory::CHUNK_ROWS;
+    const std::string path = "test_history.ring";
+    const size_t N = 2 * CHUNK + 100;
+    std::remove(path.c_str());
+    {
+        // Rows already in memory move into a new ring, later ones are written through it
+        ReadingHistory history(2 * CHUNK);
+        history.append(0, static_cast<uint16_t>(0), static_cast<uint16_t>(0), ReadingFlags::OutlierPM25);
+        assert(history.attach(path, "/dev/ttyUSB0") && history.attached() && history.size() == 1);
+        for (size_t i = 1; i < N; ++i) {
+            uint8_t flags = (i % 100 == 0) ? ReadingFlags::OutlierPM25 : 0;
+            history.append(static_cast<int64_t>(i) * 1000, static_cast<uint16_t>(i % 1000),
+                           static_cast<uint16_t>(2 * (i % 1000)), flags);
+        }
+        assert(history.size() == CHUNK + 100);
+    }
+    struct stat info;
+    assert(stat(path.c_str(), &info) == 0 && info.st_size == static_cast<off_t>(4096 + 2 * sizeof(ReadingHistory::Chunk)));
+    
+    // Re-attached, the ring is back as it was and carries on
+    {
+        ReadingHistory history(2 * CHUNK);
+        assert(history.attach(path, "/dev/ttyUSB0") && history.size() == CHUNK + 100);
+        assert(history.at(0).timestamp_ms == static_cast<int64_t>(CHUNK) * 1000);
+        assert(history.at(history.size() - 1).pm10_raw == 2 * ((N - 1) % 1000));
+        assert(history.lowerBound(static_cast<int64_t>(CHUNK + 10) * 1000) == 10);
+        ColumnSummary pm25 = history.summarize(HistoryColumn::PM25, 0, history.size());
+        size_t outliers = 0;
+        for (size_t i = CHUNK; i < N; ++i) outliers += (i % 100 == 0);
+        assert(pm25.count == CHUNK + 100 - outliers);
+        history.append(static_cast<int64_t>(N) * 1000, static_cast<uint16_t>(7), static_cast<uint16_t>(8));
+        
+        // Detached, the rows stay in memory and the file keeps them too
+        history.detach();
+        assert(!history.attached() && history.size() == CHUNK + 101 && history.at(CHUNK + 100).pm25_raw == 7);
+    }
+    
+    // A writer that stopped while recycling the oldest chunk left it empty: it is dropped
+    {
+        int fd = open(path.c_str(), O_RDWR);
+        assert(fd >= 0);
+        uint64_t first = 0;
+        size_t zero = 0;
+        assert(pread(fd, &first, sizeof(first), 40) == sizeof(first));
+        off_t rows = static_cast<off_t>(4096 + first * sizeof(ReadingHistory::Chunk) +
+                                        offsetof(ReadingHistory::Chunk, rows));
+        assert(pwrite(fd, &zero, sizeof(zero), rows) == sizeof(zero));
+        close(fd);
+        
+        ReadingHistory history(2 * CHUNK);
+        assert(history.attach(path, "/dev/ttyUSB0") && history.size() == 101);
+        assert(history.at(0).timestamp_ms == static_cast<int64_t>(2 * CHUNK) * 1000);
+    }
+    
+    // A smaller capacity keeps the newest chunk; another owner or layout starts afresh
+    {
+        ReadingHistory history(CHUNK);
+        assert(history.attach(path, "/dev/ttyUSB0") && history.size() == 101);
+        assert(stat(path.c_str(), &info) == 0 && info.st_size == static_cast<off_t>(4096 + sizeof(ReadingHistory::Chunk)));
+        
+        // One writer at a time: the ring is locked until the first history lets go of it
+        ReadingHistory other(CHUNK);
+        assert(!other.attach(path, "/dev/ttyUSB0") && !other.attached());
+        history.detach();
+        assert(other.attach(path, "/dev/ttyUSB1") && other.empty());
+    }
+    {
+        int fd = open(path.c_str(), O_RDWR);
+        assert(fd >= 0);
+        uint32_t version = 99;
+        assert(pwrite(fd, &version, sizeof(version), 8) == sizeof(version));
+        close(fd);
+        
+        ReadingHistory history(CHUNK);
+        assert(history.attach(path, "/dev/ttyUSB1") && history.empty());
+    }
+    std::remove(path.c_str());
+    
+    std::cout << "✓ A re-attached ring brings the history back without replaying it" << std::endl;
+}
+
+void test_trend_buckets() {
+    std::cout << "Testing chart trend buckets..." << std::endl;
+    
+    // A day of 1 Hz readings: PM2.5 ramps with the hour, PM10 is constant
+    const int64_t START_MS = 1700000000000LL;
+    const int64_t DAY_MS = 24 * 3600 * 1000LL;
+    TrendBuckets trend;
+    ReadingHistory history(24 * 3600);
+    for (int64_t t = 0; t < DAY_MS; t += 1000) {
+        float pm25 = static_cast<float>((t / 3600000) * 2 + (t / 1000) % 3);
+        trend.add(START_MS + t, pm25, 15.0f);
+        history.append(START_MS + t, pm25, 15.0f);
+    }
+    int64_t endMs = START_MS + DAY_MS - 1;
+    
+    // Each column matches a brute-force pass over the raw readings
+    const size_t COLUMNS = 72;
+    const int64_t spans[] = {5 * 60 * 1000LL, 3600 * 1000LL, 6 * 3600 * 1000LL, DAY_MS};
+    for (int64_t spanMs : spans) {
+        std::vector<TrendPoint> points;
+        trend.series(HistoryColumn::PM25, endMs, spanMs, COLUMNS, points);
+        assert(points.size() == COLUMNS);
+        
+        int64_t width = trend.resolutionMs(spanMs, COLUMNS);
+        assert(spanMs / width <= static_cast<int64_t>(COLUMNS * TrendBuckets::MAX_BUCKETS_PER_COLUMN));
+        
+        uint64_t total = 0;
+        for (size_t c = 0; c < COLUMNS; ++c) {
+            TrendPoint expected;
+            double sum = 0.0;
+            for (size_t i = 0; i < history.size(); ++i) {
+                HistoryRow row = history.at(i);
+                int64_t slotStart = row.timestamp_ms / width * width;
+                if (slotStart < endMs - spanMs || slotStart > endMs) continue;
+                size_t column = std::min<size_t>(COLUMNS - 1, (slotStart - (endMs - spanMs)) * COLUMNS / spanMs);
+                if (column != c) continue;
+                expected.min = expected.count ? std::min<double>(expected.min, row.pm25()) : row.pm25();
+                expected.max = expected.count ? std::max<double>(expected.max, row.pm25()) : row.pm25();
+                sum += row.pm25();
+                expected.count++;
+            }
+            assert(points[c].count == expected.count);
+            if (expected.count) {
+                assert(points[c].min == expected.min && points[c].max == expected.max);
+                assert(std::fabs(points[c].mean - sum / expected.count) < 1e-6);
+            }
+            total += points[c].count;
+        }
+        assert(total >= static_cast<uint64_t>(spanMs / 1000) - width / 1000);
+        
+        // The histogram accounts for the same readings
+        std::vector<uint32_t> bins(COLUMNS);
+        trend.histogram(HistoryColumn::PM25, endMs, spanMs, COLUMNS, 100.0, bins);
+        uint64_t binned = 0;
+        for (uint32_t count : bins) binned += count;
+        assert(binned == total);
+    }
+    
+    // PM10 never moves, so every bucket's mean is exact and lands in one bin
+    std::vector<uint32_t> bins(10);
+    trend.histogram(HistoryColumn::PM10, endMs, 3600 * 1000LL, COLUMNS, 100.0, bins);
+    assert(bins[1] > 0 && bins[0] == 0 && bins[2] == 0);
+    
+    // Gaps are empty columns, not zeros
+    trend.reset();
+    trend.add(START_MS, 5.0f, 5.0f);
+    trend.add(START_MS + 290 * 1000, 7.0f, 7.0f);
+    std::vector<TrendPoint> points;
+    trend.series(HistoryColumn::PM25, START_MS + 299 * 1000, 300 * 1000, 30, points);
+    int filled = 0;
+    for (const TrendPoint& point : points) filled += point.count ? 1 : 0;
+    assert(filled == 2 && points.front().mean == 5.0 && points.back().mean == 7.0);
+    
+    std::cout << "✓ Bucketed series and distributions match the raw readings for 5m..24h spans" << std::endl;
+}
+
+void test_outlier_filter() {
+    std::cout << "Testing outlier filter stage..." << std::endl;
+    
+    FilterConfig config;
+    assert(FilterConfig::parse("window=9,rate=20", config));
+    assert(config.enabled && config.window == 9 && config.maxRatePerSecond == 20.0f && config.threshold == 3.0);
+    assert(FilterConfig::parse("off", config) && !config.enabled);
+    assert(!FilterConfig::parse("window=100", config));
+    assert(!FilterConfig::parse("window=abc", config));
+    assert(!FilterConfig::parse("bogus=1", config));
+    
+    // Noisy 10 ug/m3 baseline with a saturated PM2.5 spike and a moderate PM10 one
+    FilterPipeline pipeline;
+    const int64_t START_MS = 1700000000000LL;
+    int flagged = 0;
+    for (int i = 0; i < 200; ++i) {
+        float noise = static_cast<float>((i * 7) % 5) * 0.4f;
+        float pm25 = (i == 50) ? 999.9f : 10.0f + noise;
+        float pm10 = (i == 120) ? 60.0f : 14.0f + noise;
+        uint8_t flags = pipeline.process(START_MS + i * 1000, pm25, pm10);
+        if (i == 50) assert(flags == ReadingFlags::OutlierPM25);
+        else if (i == 120) assert(flags == ReadingFlags::OutlierPM10);
+        else assert(flags == 0);
+        flagged += flags ? 1 : 0;
+    }
+    assert(flagged == 2);
+    
+    // A lasting change of level is only held back until it fills half the window
+    FilterPipeline hampel;
+    int held = 0;
+    for (int i = 0; i < 100; ++i) {
+        float value = (i < 50) ? 10.0f : 40.0f;
+        uint8_t flags = hampel.process(START_MS + i * 1000, value, value);
+        if (i >= 50 && flags) held++;
+        if (i >= 60) assert(flags == 0);
+    }
+    assert(held > 0 && held <= 8);
+    
+    // Rate limit: 20 ug/m3 in a second is too fast at 5/s, until the level persists
+    FilterConfig rateOnly;
+    assert(FilterConfig::parse("window=0,rate=5,min=1", rateOnly));
+    FilterPipeline rate(rateOnly);
+    assert(rate.process(START_MS, 10.0f, 10.0f) == 0);
+    assert(rate.process(START_MS + 1000, 13.0f, 10.0f) == 0);     // 3/s
+    assert(rate.process(START_MS + 2000, 33.0f, 10.0f) == ReadingFlags::OutlierPM25);
+    assert(rate.process(START_MS + 3000, 33.0f, 10.0f) == ReadingFlags::OutlierPM25);
+    assert(rate.process(START_MS + 4000, 33.0f, 10.0f) == 0);     // re-anchored
+    assert(rate.process(START_MS + 30000, 60.0f, 10.0f) == 0);    // slow enough over 26 s
+    
+    // Disabled: nothing is ever flagged
+    FilterConfig off;
+    FilterConfig::parse("off", off);
+    FilterPipeline none(off);
+    assert(none.process(START_MS, 999.9f, 999.9f) == 0);
+    
+    // Flagged rows stay in the history but not in its summaries
+    ReadingHistory history;
+    for (int i = 0; i < 5000; ++i) {
+        bool spike = (i == 4500);
+        history.append(START_MS + i * 1000, static_cast<uint16_t>(spike ? 9999 : 100 + i % 10),
+                       static_cast<uint16_t>(200), spike ? ReadingFlags::OutlierPM25 : 0);
+    }
+    assert(history.size() == 5000 && history.at(4500).excluded(HistoryColumn::PM25));
+    ColumnSummary pm25 = history.summarize(HistoryColumn::PM25, 0, history.size());
+    assert(pm25.count == 4999 && pm25.max == 109);
+    ColumnSummary pm10 = history.summarize(HistoryColumn::PM10, 4000, 1000);
+    assert(pm10.count == 1000 && pm10.min == 200 && pm10.max == 200);
+    
+    std::cout << "✓ Spikes are flagged per pollutant, level changes pass, summaries skip outliers" << std::endl;
+}
+
+void test_humidity_correction() {
+    std::cout << "Testing humidity correction stage..." << std::endl;
+    
+    // kappa-Koehler divisor: 1 + (0.4 / 1.65) / (100 / 90 - 1) = 3.18 at 90%
+    HumidityModel model;
+    assert(std::fabs(model.growthFactor(0.4, 90.0) - 3.1818) < 1e-3);
+    assert(model.growthFactor(0.4, 0.0) == 1.0);
+    assert(model.growthFactor(0.4, 99.0) == model.growthFactor(0.4, 95.0));   // capped at max-rh
+    assert(HumidityModel::parse("kappa=0.3,max-rh=90,max-age=60", model));
+    assert(model.kappa25 == 0.3 && model.kappa10 == 0.3 && model.maxRH == 90.0 && model.maxAgeMs == 60000);
+    assert(!HumidityModel::parse("max-rh=100", model) && !HumidityModel::parse("gamma=1", model));
+    
+    // As-of join: latest sample at or before the reading, within max-age; late samples slot in
+    const int64_t START_MS = 1700000000000LL;
+    HumidityJoin join;
+    float rh = 0.0f;
+    assert(!join.lookup(START_MS, 60000, rh));
+    join.addSample(START_MS, 50.0f);
+    join.addSample(START_MS + 60000, 70.0f);
+    join.addSample(START_MS + 30000, 60.0f);
+    assert(join.lookup(START_MS + 45000, 60000, rh) && rh == 60.0f);
+    assert(join.lookup(START_MS + 60000, 60000, rh) && rh == 70.0f);
+    assert(!join.lookup(START_MS - 1, 60000, rh));
+    assert(!join.lookup(START_MS + 200000, 60000, rh));     // stale
+    for (size_t i = 0; i < 3 * HumidityJoin::CAPACITY; ++i) {
+        join.addSample(START_MS + 100000 + static_cast<int64_t>(i) * 1000, 80.0f);
+    }
+    assert(join.size() == HumidityJoin::CAPACITY);
+    
+    // File source, followed as it grows; seconds and milliseconds both accepted
+    const std::string path = "test_humidity.txt";
+    {
+        std::ofstream out(path.c_str());
+        out << "# unix_time,rh\n1700000000,40\n1700000060000 55.5\nbogus\n1700000120,";
+    }
+    HumidityCorrector corrector;
+    assert(corrector.configure(path, HumidityModel()));
+    CorrectedReading before = corrector.apply(START_MS + 30000, 20.0f, 30.0f);
+    assert(before.corrected && before.rh == 40.0f);
+    assert(std::fabs(before.pm25 - 20.0f / HumidityModel().growthFactor(0.4, 40.0)) < 1e-4);
+    {
+        std::ofstream out(path.c_str(), std::ios::app);
+        out << "90\n";
+    }
+    CorrectedReading after = corrector.apply(START_MS + 125000, 20.0f, 30.0f);
+    assert(after.corrected && after.rh == 90.0f && after.pm25 < 7.0f && after.pm10 > 30.0f / 3.1818f);   // lower kappa10
+    CorrectedReading stale = corrector.apply(START_MS + 125000 + 16 * 60000, 20.0f, 30.0f);
+    assert(!stale.corrected && stale.pm25 == 20.0f);
+    std::remove(path.c_str());
+    
+    HumidityCorrector missing;
+    assert(!missing.configure("/nonexistent/humidity", HumidityModel()) && !missing.isEnabled());
+    
+    // The history keeps the raw and corrected values side by side
+    ReadingHistory history;
+    history.append(ReadingHistory::makeRow(START_MS, 20.0f, 30.0f, after.pm25, after.pm10, after.rh, 0));
+    history.append(ReadingHistory::makeRow(START_MS + 1000, 10.0f, 12.0f, 10.0f, 12.0f, -1.0f, 0));
+    HistoryRow row = history.at(0);
+    assert(row.pm25_raw == 200 && row.hasHumidity() && row.humidity == 90);
+    assert((row.flags & ReadingFlags::HumidityCorrected) && std::fabs(row.pm25Corrected() - after.pm25) < 0.051f);
+    assert(!history.at(1).hasHumidity() && history.at(1).flags == 0);
+    assert(history.summarizeAll(HistoryColumn::PM25).max == 20.0);
+    assert(history.summarizeAll(HistoryColumn::PM25Corrected).max == 10.0);
+    
+    // Corrected values travel with DATA lines; plain lines still parse
+    DaemonReading reading("sensor", START_MS, 20.0f, 30.0f);
+    reading.rh = 90.0f;
+    reading.pm25_corrected = 6.3f;
+    reading.pm10_corrected = 10.4f;
+    DaemonReading parsed;
+    assert(DaemonReading::fromLine(reading.toLine(), parsed));
+    assert(parsed.isCorrected() && parsed.rh == 90.0f && std::fabs(parsed.pm25_corrected - 6.3f) < 1e-4);
+    assert(DaemonReading::fromLine("DATA sensor 1700000000000 20 30", parsed));
+    assert(!parsed.isCorrected() && parsed.pm25_corrected == 20.0f);
+    
+    std::cout << "✓ Readings join the latest humidity in O(1) and keep raw and corrected values" << std::endl;
+}
+
+void test_sample_clock() {
+    std::cout << "Testing monotonic sample clock..." << std::endl;
+    
+    // The wall-clock mapping agrees with the system clock and keeps monotonic spacing exactly
+    int64_t offset = SampleClock::offsetNs();
+    uint64_t now = SampleClock::nowNs();
+    int64_t systemNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    assert(std::llabs(SampleClock::toUnixNs(now) - systemNs) < 50000000LL);
+    assert(SampleClock::toUnixNs(now + 1500000000ULL) - SampleClock::toUnixNs(now) == 1500000000LL);
+    assert(SampleClock::toUnixNs(now) == static_cast<int64_t>(now) + offset);
+    
+    // A frame is stamped when its last byte is read, not when the first arrived or when it is used
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::vector<unsigned char> frame = makeFrame(42, 84);
+    assert(write(fds[1], frame.data(), 4) == 4);
+    uint64_t firstHalf = SampleClock::nowNs();
+    std::thread writer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        ssize_t n = write(fds[1], frame.data() + 4, frame.size() - 4);
+        (void)n;
+    });
+    SDS011Stream stream;
+    stream.bind(fds[0], "test_clock");
+    SDS011Frame decoded;
+    assert(stream.readFrame(decoded));
+    uint64_t returned = SampleClock::nowNs();
+    writer.join();
+    assert(decoded.pm25_raw == 42);
+    assert(decoded.arrival_ns >= firstHalf + 25000000ULL && decoded.arrival_ns <= returned);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    SDS011Data reading(decoded.pm25(), decoded.pm10(), decoded.arrival_ns);
+    assert(reading.monotonic_ns == decoded.arrival_ns);
+    assert(reading.unixMs() == SampleClock::toUnixMs(decoded.arrival_ns));
+    close(fds[0]);
+    close(fds[1]);
+    
+    std::cout << "✓ Frames carry their last-byte monotonic stamp and map to wall time" << std::endl;
+}
+
+void test_sensor_health() {
+    std::cout << "Testing sensor health tracking..." << std::endl;
+    
+    const uint64_t S = 1000000000ULL;
+    SensorHealth health;
+    health.onConnected(0);
+    assert(health.state(4 * S) == HealthState::Connecting);
+    assert(health.state(6 * S) == HealthState::Stalled);     // opened, but never sent a frame
+    
+    // The cadence is learned from the intervals; a buffered backlog does not count
+    for (uint64_t t = 1; t <= 6; ++t) {
+        assert(health.onFrame(t * S) == 0);
+    }
+    assert(health.onFrame(6 * S + 1000) == 0);
+    assert(health.getCadenceNs() > S - S / 100 && health.getCadenceNs() < S + S / 100);
+    assert(health.state(6 * S + S / 2) == HealthState::Healthy);
+    uint64_t late = health.nextChangeNs(6 * S + S / 2);         // the next state change, for sleeping until then
+    assert(late > 8 * S && late < 9 * S);
+    assert(health.nextChangeNs(late) > 11 * S && health.nextChangeNs(late) < 12 * S);
+    
+    // Three frames missing before the one at 10 s
+    assert(health.onFrame(10 * S) == 3);
+    assert(health.getMissedFrames() == 3);
+    assert(health.state(10 * S + S / 2) == HealthState::Healthy);
+    assert(health.state(13 * S) == HealthState::Degraded);
+    assert(health.state(16 * S) == HealthState::Stalled);
+    
+    // Reconnects back off exponentially up to the cap
+    health.onDisconnected(16 * S);
+    assert(health.state(16 * S) == HealthState::Connecting);
+    assert(!health.reconnectDue(16 * S + S / 4));
+    assert(health.nextChangeNs(16 * S) == health.getNextAttemptNs());
+    assert(health.reconnectDue(16 * S + S / 2));
+    uint64_t now = 16 * S + S / 2;
+    uint64_t previousDelay = S / 2;
+    for (int attempt = 0; attempt < 12; ++attempt) {
+        health.onConnectFailed(now);
+        uint64_t delay = health.getNextAttemptNs() - now;
+        assert(delay == std::min(previousDelay * 2, HealthConfig().maxBackoffNs));
+        previousDelay = delay;
+        now = health.getNextAttemptNs();
+    }
+    assert(previousDelay == HealthConfig().maxBackoffNs);
+    
+    // The first frame after a reconnect is always a gap
+    health.onConnected(now);
+    assert(health.getFailedAttempts() == 0 && health.getReconnects() == 1);
+    assert(health.onFrame(now + S / 2) >= 1);
+    assert(health.onFrame(now + S / 2 + S) == 0);
+    
+    // Frequent checksum failures degrade a sensor that is otherwise on time
+    SensorHealth noisy;
+    noisy.onConnected(0);
+    noisy.observeChecksumFailures(7);   // earlier failures are only the baseline
+    for (uint64_t t = 1; t <= 10; ++t) {
+        noisy.onFrame(t * S);
+    }
+    assert(noisy.checksumErrorRate() == 0.0);
+    assert(noisy.state(10 * S + S / 2) == HealthState::Healthy);
+    noisy.observeChecksumFailures(10);
+    assert(noisy.checksumErrorRate() > 0.1);
+    assert(noisy.state(10 * S + S / 2) == HealthState::Degraded);
+    
+    std::cout << "✓ Health tracks cadence, gaps, stalls and backs off reconnects" << std::endl;
+}
+
+void test_device_lookup() {
+    std::cout << "Testing stable device identities..." << std::endl;
+    
+    // A fake /sys and /dev: adapter 1-1 has a serial number, 1-2 only its USB port
+    const std::string root = "test_devroot";
+    auto endsWith = [](const std::string& s, const std::string& suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    auto addTty = [&](const std::string& usbDevice, const std::string& name) {
+        std::string port = "devices/usb1/" + usbDevice + "/" + usbDevice + ":1.0/" + name;
+        assert(std::system(("mkdir -p " + root + "/sys/" + port + " " + root + "/sys/class/tty/" + name).c_str()) == 0);
+        assert(symlink(("../../../" + port).c_str(), (root + "/sys/class/tty/" + name + "/device").c_str()) == 0);
+        std::ofstream(root + "/dev/" + name);
+    };
+    auto removeTty = [&](const std::string& name) {
+        assert(std::system(("rm -rf " + root + "/sys/class/tty/" + name + " " + root + "/dev/" + name).c_str()) == 0);
+    };
+    assert(std::system(("rm -rf " + root + " && mkdir -p " + root + "/dev/serial/by-id " +
+                        root + "/sys/devices/usb1/1-1 " + root + "/sys/devices/usb1/1-2").c_str()) == 0);
+    std::ofstream(root + "/sys/devices/usb1/1-1/idVendor") << "1a86\n";
+    std::ofstream(root + "/sys/devices/usb1/1-1/idProduct") << "7523\n";
+    std::ofstream(root + "/sys/devices/usb1/1-1/serial") << "A1\n";
+    std::ofstream(root + "/sys/devices/usb1/1-2/idVendor") << "10c4\n";
+    std::ofstream(root + "/sys/devices/usb1/1-2/idProduct") << "ea60\n";
+    addTty("1-1", "ttyUSB0");
+    addTty("1-2", "ttyUSB1");
+    std::ofstream(root + "/dev/ttyS0");
+    const std::string byId = root + "/dev/serial/by-id/usb-1a86_USB_Serial_A1-if00-port0";
+    assert(symlink("../../ttyUSB0", byId.c_str()) == 0);
+    DeviceLookup::setRoot(root);
+    
+    DeviceId first = DeviceLookup::identify(root + "/dev/ttyUSB0");
+    assert(first.key == "usb-1a86:7523-A1:1.0");
+    assert(endsWith(first.byIdPath, "/dev/serial/by-id/usb-1a86_USB_Serial_A1-if00-port0"));
+    assert(DeviceLookup::identify(byId).key == first.key);
+    DeviceId second = DeviceLookup::identify(root + "/dev/ttyUSB1");
+    assert(second.key == "usb-path-1-2:1.0" && second.byIdPath.empty());
+    assert(DeviceLookup::identify(root + "/dev/ttyS0").empty());
+    assert(endsWith(DeviceLookup::locate(first), "/dev/ttyUSB0"));
+    
+    // The adapter resets and comes back as ttyUSB2
+    removeTty("ttyUSB0");
+    assert(DeviceLookup::locate(first).empty());
+    addTty("1-1", "ttyUSB2");
+    assert(endsWith(DeviceLookup::locate(first), "/dev/ttyUSB2"));     // before udev updated the link
+    std::remove(byId.c_str());
+    assert(symlink("../../ttyUSB1", byId.c_str()) == 0);               // a stale link is not trusted
+    assert(endsWith(DeviceLookup::locate(first), "/dev/ttyUSB2"));
+    assert(endsWith(DeviceLookup::locate(second), "/dev/ttyUSB1"));
+    
+    // A node appearing cuts the reconnect backoff short
+    SensorHealth health;
+    health.onConnected(0);
+    health.onDisconnected(1000);
+    assert(!health.reconnectDue(2000));
+    health.onDeviceAdded(2000);
+    assert(health.reconnectDue(2000));
+    
+    DeviceLookup::setRoot("");
+    assert(std::system(("rm -rf " + root).c_str()) == 0);
+    
+    std::cout << "✓ Sensors are found again by their USB identity after re-enumeration" << std::endl;
+}
+
+void test_event_loop() {
+    std::cout << "Testing event loop..." << std::endl;
+    
+    EventLoop events;
+    assert(events.runOnce(0) == 0);
+    
+    // Descriptors are dispatched when readable, not before
+    int first[2], second[2];
+    assert(pipe(first) == 0 && pipe(second) == 0);
+    int firstReads = 0, secondReads = 0;
+    events.watchReadable(first[0], [&]() {
+        char c;
+        assert(read(first[0], &c, 1) == 1);
+        firstReads++;
+        events.unwatch(second[0]);      // ready in the same round, must not run
+    });
+    events.watchReadable(second[0], [&]() { secondReads++; });
+    assert(events.runOnce(0) == 0);
+    assert(write(first[1], "x", 1) == 1 && write(second[1], "y", 1) == 1);
+    assert(events.runOnce() == 1);
+    assert(firstReads == 1 && secondReads == 0);
+    
+    // A timer sleeps in one wait until its deadline, and fires once
+    int fired = 0;
+    int timer = events.addTimer([&]() { fired++; });
+    uint64_t start = SampleClock::nowNs();
+    events.armTimer(timer, start + 20000000ULL);
+    uint64_t wakeups = events.getWakeups();
+    assert(events.runOnce() == 1 && fired == 1);
+    assert(SampleClock::nowNs() - start >= 20000000ULL);
+    assert(events.getWakeups() - wakeups == 1);
+    assert(events.runOnce(30) == 0 && fired == 1);
+    events.armTimer(timer, SampleClock::nowNs() + 1000000ULL);
+    events.disarmTimer(timer);
+    assert(events.runOnce(20) == 0 && fired == 1);
+    
+    // Signals arrive as events instead of interrupting
+    int received = 0;
+    assert(events.watchSignals({SIGUSR1}, [&](int signal) { received = signal; }));
+    raise(SIGUSR1);
+    assert(events.runOnce(1000) == 1 && received == SIGUSR1);
+    
+    for (int fd : {first[0], first[1], second[0], second[1]}) {
+        close(fd);
+    }
+    
+    std::cout << "✓ Descriptors, timers and signals share one wait with no idle wakeups" << std::endl;
+}
+
+void test_io_backend() {
+    std::cout << "Testing I/O backends..." << std::endl;
+    
+    IoBackendKind kind;
+    assert(IoBackend::parseKind("uring", kind) && kind == IoBackendKind::IoUring);
+    assert(IoBackend::parseKind("epoll", kind) && kind == IoBackendKind::Readiness);
+    assert(!IoBackend::parseKind("select", kind));
+    
+    // Auto is io_uring where the kernel allows it; both must behave the same
+    for (IoBackendKind backendKind : {IoBackendKind::Readiness, IoBackendKind::Auto}) {
+        std::unique_ptr<IoBackend> io = IoBackend::create(backendKind);
+        
+        int ports[2];
+        assert(pipe(ports) == 0);
+        fcntl(ports[0], F_SETFL, O_NONBLOCK);
+        std::string received;
+        bool ended = false;
+        assert(io->addReader(ports[0], [&](const unsigned char* data, ssize_t length) {
+            if (length > 0) {
+                received.append(reinterpret_cast<const char*>(data), static_cast<size_t>(length));
+            } else {
+                ended = true;
+            }
+        }));
+        
+        std::vector<unsigned char> frame = makeFrame(123, 456);
+        assert(write(ports[1], frame.data(), frame.size()) == static_cast<ssize_t>(frame.size()));
+        while (received.size() < frame.size()) {
+            io->runOnce(1000);
+        }
+        assert(received == std::string(frame.begin(), frame.end()));
+        
+        // Writes to one file are coalesced and synced once, in order
+        const char* logPath = "test_io_backend.csv";
+        int log = open(logPath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        assert(log >= 0);
+        io->queueWrite(log, "a,1\n", 4, false);
+        io->queueWrite(log, "b,2\n", 4, true);
+        io->runOnce(0);
+        io->queueWrite(log, "c,3\n", 4, true);
+        io->drainWrites();
+        assert(io->stats().bytesWritten == 12 && io->stats().writeErrors == 0);
+        assert(io->stats().syncs >= 1);
+        std::ifstream in(logPath);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        assert(contents == "a,1\nb,2\nc,3\n");
+        close(log);
+        std::remove(logPath);
+        
+        // End of file is delivered once, then the descriptor is no longer read
+        close(ports[1]);
+        while (!ended) {
+            io->runOnce(1000);
+        }
+        assert(io->runOnce(0) == 0);
+        close(ports[0]);
+    }
+    
+    std::cout << "✓ epoll and io_uring deliver the same input and durable appends" << std::endl;
+}
+
+void test_reading_bus() {
+    std::cout << "Testing reading bus..." << std::endl;
+    
+    ReadingBus bus(6);
+    assert(bus.getCapacity() == 8);
+    std::unique_ptr<BusConsumer> storage = bus.subscribe(BusPolicy::DropOldest);
+    std::unique_ptr<BusConsumer> display = bus.subscribe(BusPolicy::Sample);
+    BusReading reading;
+    assert(!storage->poll(reading));
+    
+    // Every consumer sees the same readings through its own cursor
+    for (int i = 0; i < 20; ++i) {
+        reading.timestamp_ms = i;
+        reading.pm25 = 10.0f + i;
+        bus.publish(reading);
+    }
+    // Lapped by 12: the oldest surviving reading comes next
+    assert(storage->poll(reading) && reading.timestamp_ms == 12 && reading.pm25 == 22.0f);
+    BusConsumerStats stats = storage->stats();
+    assert(stats.dropped == 12 && stats.delivered == 1 && stats.lag == 7 && stats.maxLag == 20);
+    int64_t expected = 13;
+    while (storage->poll(reading)) {
+        assert(reading.timestamp_ms == expected++);
+    }
+    assert(expected == 20);
+    
+    // Sampling jumps to the newest and counts the rest as skipped, not dropped
+    assert(display->poll(reading) && reading.timestamp_ms == 19);
+    assert(!display->poll(reading));
+    stats = display->stats();
+    assert(stats.skipped == 19 && stats.dropped == 0 && stats.delivered == 1);
+    
+    // A new consumer starts with the next reading
+    std::unique_ptr<BusConsumer> late = bus.subscribe(BusPolicy::DropOldest);
+    assert(!late->poll(reading));
+    assert(bus.consumerStats().size() == 3);
+    late.reset();
+    assert(bus.consumerStats().size() == 2);
+    
+    // A blocking consumer holds the producer back instead of losing readings
+    ReadingBus blocking(16);
+    std::unique_ptr<BusConsumer> archive = blocking.subscribe(BusPolicy::Block);
+    const int64_t COUNT = 20000;
+    std::thread producer([&]() {
+        BusReading sent;
+        for (int64_t i = 0; i < COUNT; ++i) {
+            sent.timestamp_ms = i;
+            sent.monotonic_ns = static_cast<uint64_t>(i) * 3;
+            sent.pm10 = static_cast<float>(i);
+            blocking.publish(sent);
+        }
+    });
+    int64_t next = 0;
+    while (next < COUNT) {
+        if (!archive->poll(reading)) {
+            std::this_thread::yield();
+            continue;
+        }
+        // No torn readings: every word belongs to the same publish
+        assert(reading.timestamp_ms == next);
+        assert(reading.monotonic_ns == static_cast<uint64_t>(next) * 3);
+        assert(reading.pm10 == static_cast<float>(next));
+        next++;
+    }
+    producer.join();
+    stats = archive->stats();
+    assert(stats.delivered == static_cast<uint64_t>(COUNT) && stats.dropped == 0 && stats.maxLag <= 16);
+    assert(stats.policy == BusPolicy::Block);
+    
+    std::cout << "✓ Consumers keep their own cursors; drop, sample and block behave as configured" << std::endl;
+}
+
+void test_alert_engine() {
+    std::cout << "Testing alert engine..." << std::endl;
+    
+    AlertRule rule;
+    assert(AlertRule::parse("name=high,above=35,for=3,clear=25,clear-for=2", rule));
+    assert(rule.condition == AlertCondition::Above && rule.forMs == 3000 && rule.clearLevel == 25.0);
+    AlertRule reparsed;
+    assert(AlertRule::parse(rule.toString(), reparsed) && reparsed.toString() == rule.toString());
+    assert(!AlertRule::parse("above=35", rule));                         // no name
+    assert(!AlertRule::parse("name=x,above=35,below=5", rule));          // two conditions
+    assert(!AlertRule::parse("name=x,above=35,clear=40", rule));         // clear past the threshold
+    assert(!AlertRule::parse("name=x,rise=10", rule));                   // rise needs a window
+    assert(!AlertRule::parse("name=x,above=35,metric=co2", rule));
+    
+    std::vector<AlertRule> rules(3);
+    assert(AlertRule::parse("name=high,above=35,for=3,clear=25,clear-for=2", rules[0]));
+    assert(AlertRule::parse("name=spike,rise=20,window=5,sensor=s1", rules[1]));
+    assert(AlertRule::parse("name=hourly,above=30,window=3600,metric=pm10,sensor=s3", rules[2]));
+    AlertEngine engine;
+    engine.setRules(rules);
+    
+    const int64_t T0 = 1700000000000LL;
+    std::vector<AlertEvent> events;
+    auto feed = [&](const char* sensor, int second, float pm25, float pm10) {
+        events.clear();
+        engine.process(sensor, T0 + second * 1000LL, pm25, pm10, events);
+    };
+    
+    // Above 35 must last 3 s before firing
+    feed("s2", 0, 40.0f, 10.0f);
+    feed("s2", 1, 40.0f, 10.0f);
+    feed("s2", 2, 20.0f, 10.0f);     // dips: pending starts over
+    feed("s2", 3, 40.0f, 10.0f);
+    feed("s2", 5, 41.0f, 10.0f);
+    assert(events.empty());
+    feed("s2", 6, 42.0f, 10.0f);
+    assert(events.size() == 1 && events[0].firing && events[0].rule == "high" && events[0].sensor == "s2");
+    assert(events[0].timestamp_ms == T0 + 6000 && events[0].value == 42.0);
+    
+    // Hysteresis: 30 is under the threshold but above the clear level
+    feed("s2", 7, 30.0f, 10.0f);
+    feed("s2", 8, 20.0f, 10.0f);
+    feed("s2", 9, 30.0f, 10.0f);     // back into the band: clearing starts over
+    feed("s2", 10, 20.0f, 10.0f);
+    feed("s2", 11, 20.0f, 10.0f);
+    assert(events.empty() && engine.active().size() == 1);
+    feed("s2", 12, 20.0f, 10.0f);
+    assert(events.size() == 1 && !events[0].firing && events[0].threshold == 25.0);
+    assert(engine.active().empty());
+    
+    // Rules only touch the sensors they name; rise compares across the window
+    feed("s1", 0, 10.0f, 0.0f);
+    feed("s1", 2, 15.0f, 0.0f);
+    feed("s1", 4, 31.0f, 0.0f);
+    assert(events.size() == 1 && events[0].rule == "spike" && events[0].value == 21.0);
+    feed("s1", 10, 31.0f, 0.0f);     // the window has moved past the jump
+    assert(events.size() == 1 && !events[0].firing && events[0].rule == "spike");
+    
+    // Windowed rules compare the mean; NaN (an outlier) leaves the window alone
+    for (int second = 100; second < 110; ++second) {
+        feed("s3", second, 10.0f, 29.0f);
+    }
+    feed("s3", 110, 10.0f, NAN);
+    feed("s3", 111, 10.0f, 60.0f);
+    assert(events.size() == 1 && events[0].rule == "hourly" && events[0].firing);
+    assert(engine.active().size() == 1 && engine.active()[0].sensor == "s3");
+    assert(std::fabs(events[0].value - (29.0 * 10 + 60.0) / 11) < 1e-9);
+    
+    // Events reach a file sink as lines
+    const char* sinkPath = "test_alerts.log";
+    std::remove(sinkPath);
+    {
+        AlertSink sink;
+        assert(sink.open(sinkPath) && sink.getKind() == AlertSink::Kind::File);
+        assert(sink.write(events[0]));
+    }
+    std::ifstream in(sinkPath);
+    std::string line;
+    assert(std::getline(in, line) && line == events[0].toLine());
+    assert(line.compare(0, 25, "ALERT FIRING hourly s3 17") == 0);
+    std::remove(sinkPath);
+    
+    // A FIFO without a reader drops events instead of blocking
+    const char* fifoPath = "test_alerts.fifo";
+    unlink(fifoPath);
+    assert(mkfifo(fifoPath, 0600) == 0);
+    {
+        AlertSink sink;
+        assert(sink.open(fifoPath) && sink.getKind() == AlertSink::Kind::Fifo);
+        assert(!sink.write(events[0]) && sink.getDropped() == 1);
+        int reader = open(fifoPath, O_RDONLY | O_NONBLOCK);
+        assert(reader >= 0);
+        assert(sink.write(events[0]));
+        char buffer[256];
+        ssize_t n = read(reader, buffer, sizeof(buffer));
+        assert(n > 0 && std::string(buffer, static_cast<size_t>(n)) == events[0].toLine() + "\n");
+        close(reader);
+    }
+    unlink(fifoPath);
+    
+    std::cout << "✓ Rules fire after their duration, clear with hysteresis and reach the sink" << std::endl;
+}
+
+void test_segment_store() {
+    std::cout << "Testing segment store..." << std::endl;
+    
+    assert(SegmentStore::encodeName("/dev/ttyUSB0") == "%2Fdev%2FttyUSB0");
+    assert(SegmentStore::encodeName("..") == "%2E.");
+    assert(SegmentStore::decodeName(SegmentStore::encodeName("/dev/serial/by-id/usb-1a86:7523")) ==
+           "/dev/serial/by-id/usb-1a86:7523");
+    
+    const std::string path = "test_segment_store";
+    const std::string sensor = "/dev/ttyUSB0";
+    const int64_t start = 1700000000000LL;
+    removeStore(path);
+    {
+        // 16 readings per block, sealed every 100
+        SegmentStore store;
+        assert(store.open(path, 16, 100));
+        for (int i = 0; i < 350; ++i) {
+            uint8_t flags = (i % 7 == 0) ? ReadingFlags::OutlierPM25 : 0;
+            assert(store.append(sensor, ReadingHistory::makeRow(start + i * 1000, i / 10.0f, 2.0f, i / 10.0f, 2.0f,
+                                                               -1.0f, flags)));
+        }
+        for (int i = 0; i < 20; ++i) {
+            assert(store.append("s2", ReadingHistory::makeRow(start + i * 1000, 5.0f, 6.0f, 5.0f, 6.0f, 40.0f, 0)));
+        }
+        
+        std::vector<SegmentInfo> segments = store.segments(sensor);
+        assert(segments.size() == 4);
+        assert(segments[0].sealed && segments[2].sealed && !segments[3].sealed);
+        assert(segments[1].minTimestamp == start + 100000 && segments[1].maxTimestamp == start + 199000);
+        assert(segments[3].records == 50);
+        
+        // [95 s, 205 s) spans three segments and reads only the blocks around it
+        std::vector<HistoryRow> rows;
+        SegmentQueryStats stats;
+        assert(store.query(sensor, start + 95000, start + 205000, rows, &stats) == 110);
+        assert(rows.front().timestamp_ms == start + 95000 && rows.back().timestamp_ms == start + 204000);
+        assert(rows.front().pm25() == 9.5f && rows[3].flags == ReadingFlags::OutlierPM25);
+        assert(stats.segments == 3 && stats.blocks < 22);
+        
+        rows.clear();
+        assert(store.query(sensor, start - 5000, start, rows) == 0);
+        assert(store.query(sensor, start + 350000, start + 400000, rows) == 0);
+        assert(store.query("s2", start, start + 3000, rows) == 3 && rows[0].hasHumidity());
+        
+        // Earlier timestamps are stored as the latest so far
+        assert(store.append("s2", ReadingHistory::makeRow(start, 7.0f, 8.0f, 7.0f, 8.0f, -1.0f, 0)));
+        assert(store.segments("s2").back().maxTimestamp == start + 19000);
+    }
+    
+    // Reopened from the catalog, the open segment continues where it stopped
+    {
+        std::ifstream catalog((path + "/catalog").c_str());
+        std::string line;
+        int lines = 0;
+        while (std::getline(catalog, line)) {
+            if (line[0] != '#') lines++;
+        }
+        assert(lines == 3);
+        
+        SegmentStore store;
+        assert(store.open(path, 16, 100));
+        assert(store.sensorIds().size() == 2);
+        assert(store.append(sensor, ReadingHistory::makeRow(start + 350000, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, 0)));
+        assert(store.segments(sensor).back().records == 51);
+    }
+    
+    // A torn record and a lost catalog: the tail is cut and the catalog rebuilt from the headers
+    {
+        std::string openSegment = path + "/" + SegmentStore::encodeName(sensor) + "/raw-" + "0001700000300000.seg";
+        int fd = open(openSegment.c_str(), O_WRONLY | O_APPEND);
+        assert(fd >= 0);
+        assert(write(fd, "torn", 4) == 4);
+        close(fd);
+        std::remove((path + "/catalog").c_str());
+        
+        SegmentStore store;
+        assert(store.open(path, 16, 100));
+        std::vector<SegmentInfo> segments = store.segments(sensor);
+        assert(segments.size() == 4 && segments[1].sealed && segments[3].records == 51);
+        std::vector<HistoryRow> rows;
+        assert(store.query(sensor, start, start + 400000, rows) == 351);
+        assert(rows.back().timestamp_ms == start + 350000);
+        struct stat info;
+        assert(stat((path + "/catalog").c_str(), &info) == 0);
+    }
+    removeStore(path);
+    
+    std::cout << "✓ Range queries seek through the catalog and block index, and survive a crash" << std::endl;
+}
+
+void test_store_compactor() {
+    std::cout << "Testing store compactor..." << std::endl;
+    
+    RetentionPolicy policy;
+    assert(!policy.enabled && RetentionPolicy::parse("raw=2h,minute=1d,hour=30d,size=1M,rate=0", policy));
+    assert(policy.enabled && policy.rawMs == 7200000 && policy.minuteMs == 86400000);
+    assert(policy.hourMs == 30 * 86400000LL && policy.maxBytes == (1 << 20) && policy.rateBytes == 0);
+    assert(policy.toString() == "raw=2h,minute=1d,hour=30d,size=1M,rate=0,interval=1m");
+    assert(RetentionPolicy::parse("raw=90", policy) && policy.rawMs == 90000 && policy.minuteMs == 365 * 86400000LL);
+    assert(RetentionPolicy::parse("off", policy) && !policy.enabled && policy.toString() == "off");
+    assert(!RetentionPolicy::parse("raw=5x", policy));
+    assert(!RetentionPolicy::parse("raw=-1h", policy));
+    assert(!RetentionPolicy::parse("keep=1d", policy));
+    
+    // Five hours at 1 Hz, one sealed segment per hour; every 60th PM2.5 value is an outlier
+    const std::string path = "test_store_compactor";
+    const std::string sensor = "/dev/ttyUSB0";
+    const int64_t start = 1699999200000LL;      // on the hour
+    const int64_t hour = 3600000;
+    const int64_t now = start + 5 * hour;
+    removeStore(path);
+    {
+        SegmentStore store;
+        assert(store.open(path, 256, 3600));
+        for (int i = 0; i < 5 * 3600; ++i) {
+            uint8_t flags = (i % 60 == 59) ? ReadingFlags::OutlierPM25 : 0;
+            assert(store.append(sensor, ReadingHistory::makeRow(start + i * 1000LL, (i % 60) / 10.0f, 2.0f,
+                                                               (i % 60) / 10.0f, 2.0f, -1.0f, flags)));
+        }
+        assert(store.segments(sensor).size() == 5 && store.sealedSegments().size() == 5);
+        uint64_t rawBytes = store.sizeOnDisk();
+        
+        // Raw segments older than two hours become minute aggregates
+        assert(RetentionPolicy::parse("raw=2h,minute=0,rate=0", policy));
+        StoreCompactor compactor(store, policy);
+        assert(compactor.runOnce(now) == 3);
+        assert(store.segments(sensor).size() == 2 && store.segments(sensor, SegmentKind::Minute).size() == 3);
+        assert(store.sizeOnDisk() < rawBytes / 2);
+        
+        std::vector<HistoryRow> rows;
+        assert(store.query(sensor, start, start + 3 * hour, rows) == 0);
+        assert(store.query(sensor, start + 3 * hour, now, rows) == 7200);
+        
+        std::vector<AggregateRecord> minutes;
+        assert(store.queryAggregates(sensor, SegmentKind::Minute, start, start + 3 * hour, minutes) == 180);
+        const AggregateRecord& first = minutes.front();
+        assert(first.start_ms == start && minutes.back().start_ms == start + 3 * hour - 60000);
+        assert(first.readings == 60 && first.count[0] == 59 && first.count[1] == 60);
+        assert(first.sum[0] == 58 * 59 / 2 && first.min[0] == 0 && first.max[0] == 58);
+        assert(std::fabs(first.mean(0) - 1711.0 / 59 / 10) < 1e-9 && first.mean(1) == 2.0 && first.stddev(1) == 0.0);
+        
+        CompactionStats stats = compactor.stats();
+        assert(stats.compacted == 3 && stats.deleted == 0 && stats.bytesRead == 3 * 3600 * sizeof(SegmentRecord));
+        assert(stats.bytesWritten == 180 * sizeof(AggregateRecord) && stats.passes == 1);
+        
+        // Nothing is old enough for a second pass
+        assert(compactor.runOnce(now) == 0);
+        
+        // Minute segments older than an hour become hour aggregates
+        assert(RetentionPolicy::parse("raw=2h,minute=1h,rate=0", policy));
+        StoreCompactor rollup(store, policy);
+        assert(rollup.runOnce(now) == 3);
+        assert(store.segments(sensor, SegmentKind::Minute).empty());
+        assert(store.segments(sensor, SegmentKind::Hour).size() == 3);
+    }
+    
+    // A compaction interrupted before its rename leaves a .tmp file, removed on open
+    std::string leftover = path + "/" + SegmentStore::encodeName(sensor) + "/minute-0001700010000000.seg.tmp";
+    std::ofstream(leftover.c_str()) << "partial";
+    {
+        SegmentStore store;
+        assert(store.open(path, 256, 3600));
+        struct stat info;
+        assert(stat(leftover.c_str(), &info) != 0);
+        
+        std::vector<AggregateRecord> hours;
+        assert(store.queryAggregates(sensor, SegmentKind::Hour, start, start + 5 * hour, hours) == 3);
+        assert(hours[0].start_ms == start && hours[2].start_ms == start + 2 * hour);
+        assert(hours[1].readings == 3600 && hours[1].count[0] == 3540 && hours[1].sum[0] == 60 * 1711);
+        assert(hours[1].min[0] == 0 && hours[1].max[0] == 58 && hours[1].max[1] == 20);
+        
+        // Over the size limit the oldest segments go first, whatever their tier
+        assert(RetentionPolicy::parse("raw=0,minute=0,size=100K,rate=0", policy));
+        StoreCompactor retention(store, policy);
+        assert(retention.runOnce(now) == 4);
+        assert(store.segments(sensor, SegmentKind::Hour).empty() && store.segments(sensor).size() == 1);
+        assert(store.sizeOnDisk() <= 100 * 1024 && retention.stats().deleted == 4);
+        
+        // The background thread runs a pass at once and stops promptly
+        assert(RetentionPolicy::parse("raw=1h,interval=1h", policy));
+        StoreCompactor background(store, policy);
+        background.start();
+        for (int i = 0; i < 200 && background.stats().passes == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        background.stop();
+        assert(background.stats().passes == 1);
+    }
+    removeStore(path);
+    
+    std::cout << "✓ Old segments roll up into minute and hour aggregates and expire by age and size" << std::endl;
+}
+
+void test_write_ahead_log() {
+    std::cout << "Testing write-ahead log..." << std::endl;
+    
+    WalConfig config;
+    assert(!config.enabled && WalConfig::parse("interval=250ms,size=4K,checkpoint=1M", config));
+    assert(config.enabled && config.intervalMs == 250 && config.flushBytes == 4096 && config.checkpointBytes == (1 << 20));
+    assert(config.toString() == "interval=250ms,size=4K,checkpoint=1M");
+    assert(WalConfig::parse("interval=2", config) && config.intervalMs == 2000 && config.flushBytes == 64 * 1024);
+    assert(WalConfig::parse("off", config) && !config.enabled && config.toString() == "off");
+    assert(!WalConfig::parse("interval=1h", config));
+    assert(!WalConfig::parse("checkpoint=0", config));
+    assert(!WalConfig::parse("sync=1", config));
+    
+    // CRC-32C check value
+    assert(WriteAheadLog::crc32c("123456789", 9) == 0xE3069283u);
+    
+    const std::string path = "test_write_ahead_log";
+    const std::string file = path + "/wal";
+    const int64_t start = 1700000000000LL;
+    removeStore(path);
+    mkdir(path.c_str(), 0755);
+    
+    // Readings wait for the interval or the size, then go out as one block
+    {
+        assert(WalConfig::parse("interval=1s,size=1K", config));
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(wal.open(file, config, recovery) && recovery.blocks == 0 && recovery.rows.empty());
+        assert(wal.msUntilDue(0) == -1);
+        wal.append("a", ReadingHistory::makeRow(start, 1.0f, 2.0f, 1.0f, 2.0f, 40.0f, 0), 1000000000ULL);
+        wal.append("b", ReadingHistory::makeRow(start, 3.0f, 4.0f, 3.0f, 4.0f, -1.0f, ReadingFlags::OutlierPM25),
+                   1200000000ULL);
+        assert(!wal.due(1500000000ULL) && wal.msUntilDue(1500000000ULL) == 500);
+        assert(wal.due(2000000000ULL) && wal.msUntilDue(2000000000ULL) == 0);
+        assert(wal.commit() && wal.buffered() == 0 && wal.size() > WriteAheadLog::BLOCK_HEADER_BYTES);
+        for (int i = 1; i < 60; ++i) {
+            wal.append("a", ReadingHistory::makeRow(start + i * 1000, 1.0f, 2.0f, 1.0f, 2.0f, -1.0f, 0), 3000000000ULL);
+        }
+        assert(wal.due(3000000000ULL));
+        assert(wal.commit());
+        WalStats stats = wal.stats();
+        assert(stats.commits == 2 && stats.records == 61 && stats.bytes == wal.size());
+        
+        // Closing commits what is still buffered
+        wal.append("b", ReadingHistory::makeRow(start + 1000, 5.0f, 6.0f, 5.0f, 6.0f, -1.0f, 0), 4000000000ULL);
+    }
+    uint64_t committed;
+    {
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(wal.open(file, config, recovery));
+        assert(!recovery.checkpointed && recovery.blocks == 3 && recovery.tornBytes == 0 && recovery.rows.size() == 62);
+        assert(recovery.rows[0].first == "a" && recovery.rows[0].second.pm25() == 1.0f);
+        assert(recovery.rows[0].second.humidity == 40);
+        assert(recovery.rows[1].first == "b" && recovery.rows[1].second.flags == ReadingFlags::OutlierPM25);
+        assert(recovery.rows[61].first == "b" && recovery.rows[61].second.timestamp_ms == start + 1000);
+        committed = wal.size();
+    }
+    
+    // A torn block at the end is cut; a flipped bit in the last block is caught by its checksum
+    {
+        int fd = open(file.c_str(), O_WRONLY | O_APPEND);
+        assert(fd >= 0);
+        assert(write(fd, "SWAL torn", 9) == 9);
+        close(fd);
+        
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(wal.open(file, config, recovery));
+        assert(recovery.tornBytes == 9 && recovery.rows.size() == 62 && wal.size() == committed);
+        
+        fd = open(file.c_str(), O_RDWR);
+        assert(fd >= 0);
+        char byte;
+        assert(pread(fd, &byte, 1, committed - 3) == 1);
+        byte ^= 0x10;
+        assert(pwrite(fd, &byte, 1, committed - 3) == 1);
+        close(fd);
+    }
+    {
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(wal.open(file, config, recovery));
+        assert(recovery.blocks == 2 && recovery.rows.size() == 61 && recovery.tornBytes > 0);
+        
+        // Later commits continue after the cut
+        wal.append("c", ReadingHistory::makeRow(start, 7.0f, 8.0f, 7.0f, 8.0f, -1.0f, 0), 0);
+        assert(wal.commit());
+    }
+    {
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(wal.open(file, config, recovery));
+        assert(recovery.blocks == 3 && recovery.tornBytes == 0 && recovery.rows.back().first == "c");
+    }
+    
+    // With a store: unsynced store writes past the checkpoint are rolled back and replayed from the log
+    removeStore(path);
+    {
+        assert(WalConfig::parse("interval=0", config));
+        SegmentStore store;
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(store.open(path, 16, 100));
+        assert(wal.open(file, config, recovery));
+        for (int i = 0; i < 30; ++i) {
+            assert(store.append("a", ReadingHistory::makeRow(start + i * 1000, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, 0)));
+        }
+        assert(store.sync() && wal.checkpoint(store.openSegments()));
+        assert(wal.stats().checkpoints == 1 && wal.size() < 1024);
+        for (int i = 30; i < 140; ++i) {
+            HistoryRow row = ReadingHistory::makeRow(start + i * 1000, 2.0f, 2.0f, 2.0f, 2.0f, -1.0f, 0);
+            assert(store.append("a", row));
+            wal.append("a", row, 0);
+        }
+        assert(store.append("b", ReadingHistory::makeRow(start, 3.0f, 3.0f, 3.0f, 3.0f, -1.0f, 0)));
+        wal.append("b", ReadingHistory::makeRow(start, 3.0f, 3.0f, 3.0f, 3.0f, -1.0f, 0), 0);
+        assert(wal.commit());
+        store.flush();
+    }
+    {
+        // A torn record in the open segment, as after a crash between store write and sync
+        std::string openSegment = path + "/a/raw-" + "0001700000100000.seg";
+        int fd = open(openSegment.c_str(), O_WRONLY | O_APPEND);
+        assert(fd >= 0);
+        assert(write(fd, "torn", 4) == 4);
+        close(fd);
+        
+        SegmentStore store;
+        WriteAheadLog wal;
+        WalRecovery recovery;
+        assert(store.open(path, 16, 100));
+        assert(wal.open(file, config, recovery));
+        assert(recovery.checkpointed && recovery.checkpoint.size() == 1 && recovery.checkpoint[0].records == 30);
+        assert(recovery.rows.size() == 111);
+        assert(store.rollback(recovery.checkpoint));
+        assert(store.lastTimestamp("a") == start + 99000 && store.lastTimestamp("b") == INT64_MIN);
+        size_t replayed = 0;
+        for (const auto& row : recovery.rows) {
+            if (row.second.timestamp_ms > store.lastTimestamp(row.first)) {
+                assert(store.append(row.first, row.second));
+                replayed++;
+            }
+        }
+        assert(replayed == 41);
+        
+        std::vector<HistoryRow> rows;
+        assert(store.query("a", start, start + 200000, rows) == 140);
+        assert(rows[29].pm25() == 1.0f && rows[30].pm25() == 2.0f && rows.back().timestamp_ms == start + 139000);
+        rows.clear();
+        assert(store.query("b", start, start + 1000, rows) == 1);
+        assert(store.sync() && wal.checkpoint(store.openSegments()));
+    }
+    removeStore(path);
+    
+    std::cout << "✓ Group commits survive torn writes and replay into a rolled-back store" << std::endl;
+}
+
+void test_arrow_export() {
+    std::cout << "Testing Arrow IPC export..." << std::endl;
+    
+    ArrowExportFilter filter;
+    assert(filter.includes("any") && filter.fromMs == INT64_MIN && filter.toMs == INT64_MAX);
+    assert(ArrowExportFilter::parse("from=1000,to=5000,sensor=/dev/ttyUSB0,sensor=b", filter));
+    assert(filter.fromMs == 1000 && filter.toMs == 5000 && filter.sensors.size() == 2);
+    assert(filter.includes("b") && !filter.includes("c"));
+    assert(ArrowExportFilter::parse("", filter) && filter.sensors.empty() && filter.toMs == INT64_MAX);
+    assert(!ArrowExportFilter::parse("from=5,to=5", filter));
+    assert(!ArrowExportFilter::parse("from=1h", filter));
+    assert(!ArrowExportFilter::parse("sensor", filter));
+    
+    // Two chunks of one sensor, a few rows of another
+    const int64_t start = 1700000000000LL;
+    const size_t N = ReadingHistory::CHUNK_ROWS + 904;
+    ReadingHistory a, b, c;
+    for (size_t i = 0; i < N; ++i) {
+        a.append(ReadingHistory::makeRow(start + static_cast<int64_t>(i) * 1000, (i % 500) / 10.0f, 3.5f,
+                                         (i % 500) / 10.0f, 3.5f, -1.0f, (i % 97 == 0) ? ReadingFlags::OutlierPM25 : 0));
+    }
+    for (int i = 0; i < 10; ++i) {
+        b.append(start + i * 1000, 12.3f, 45.6f);
+        c.append(start + i * 1000, 1.0f, 2.0f);
+    }
+    std::vector<std::pair<std::string, const ReadingHistory*>> histories;
+    histories.push_back(std::make_pair(std::string("/dev/ttyUSB0"), &a));
+    histories.push_back(std::make_pair(std::string("b"), &b));
+    histories.push_back(std::make_pair(std::string("c"), &c));
+    
+    const std::string path = "test_export.arrow";
+    uint64_t rows = 0;
+    assert(ArrowExportFilter::parse("from=" + std::to_string(start + 5000) + ",sensor=/dev/ttyUSB0,sensor=b", filter));
+    assert(ArrowWriter::exportHistories(path, histories, filter, &rows));
+    assert(rows == N - 5 + 5);
+    
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    assert(file.size() % 8 == 2 && file.compare(0, 8, std::string("ARROW1\0\0", 8)) == 0);
+    assert(file.compare(file.size() - 6, 6, "ARROW1") == 0);
+    int32_t footerBytes = 0, marker = 0;
+    memcpy(&footerBytes, &file[file.size() - 10], sizeof(footerBytes));
+    memcpy(&marker, &file[8], sizeof(marker));
+    assert(footerBytes > 0 && static_cast<size_t>(footerBytes) < file.size() && marker == -1);
+    
+    // The first batch starts at the range, with its timestamps copied as they are
+    int64_t expected[2] = {start + 5000, start + 6000};
+    size_t at = file.find(std::string(reinterpret_cast<const char*>(expected), sizeof(expected)));
+    assert(at != std::string::npos && at % 8 == 0);
+    struct stat info;
+    assert(stat((path + ".tmp").c_str(), &info) != 0);
+    
+    // An empty selection is still a valid file
+    assert(ArrowExportFilter::parse("sensor=none", filter));
+    assert(ArrowWriter::exportHistories(path, histories, filter, &rows) && rows == 0);
+    std::remove(path.c_str());
+    
+    std::cout << "✓ History streams into Arrow IPC record batches, filtered by time and sensor" << std::endl;
+}
+
+#ifdef ENABLE_COROUTINES
+static Task<int> addLater(Scheduler& scheduler, int a, int b) {
+    co_await scheduler.sleepFor(std::chrono::milliseconds(1));
+    co_return a + b;
+}
+
+static Task<> failLater(Scheduler& scheduler) {
+    co_await scheduler.sleepFor(std::chrono::milliseconds(1));
+    throw std::runtime_error("sensor gone");
+}
+
+void test_async_sensor() {
+    std::cout << "Testing coroutine sensor API..." << std::endl;
+    
+    EventLoop events;
+    Scheduler scheduler(events);
+    
+    // Sleepers wake in deadline order, all in one thread
+    std::vector<int> order;
+    auto sleeper = [&](int id, int ms) -> Task<> {
+        co_await scheduler.sleepFor(std::chrono::milliseconds(ms));
+        order.push_back(id);
+    };
+    uint64_t start = SampleClock::nowNs();
+    scheduler.spawn(sleeper(1, 30));
+    scheduler.spawn(sleeper(2, 10));
+    scheduler.spawn(sleeper(3, 20));
+    assert(scheduler.activeTasks() == 3);
+    scheduler.run();
+    assert((order == std::vector<int>{2, 3, 1}));
+    assert(SampleClock::nowNs() - start >= 30000000ULL);
+    assert(scheduler.activeTasks() == 0);
+    
+    // Nested tasks return values and pass exceptions to their awaiter
+    int sum = 0;
+    bool caught = false;
+    // Lambda coroutines keep their captures in the closure, which must outlive them
+    auto nested = [&]() -> Task<> {
+        sum = co_await addLater(scheduler, 2, 3);
+        try {
+            co_await failLater(scheduler);
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+    };
+    scheduler.spawn(nested());
+    scheduler.run();
+    assert(sum == 5 && caught);
+    
+    // Many sensors on one thread; frames split across writes are reassembled
+    const int sensorCount = 64;
+    std::vector<int> pipes(2 * sensorCount);
+    std::vector<std::unique_ptr<AsyncSensor>> sensors;
+    std::vector<int> frames(sensorCount, 0);
+    for (int i = 0; i < sensorCount; ++i) {
+        assert(pipe(&pipes[2 * i]) == 0);
+        sensors.emplace_back(new AsyncSensor(scheduler));
+        sensors.back()->attach(pipes[2 * i], "async" + std::to_string(i));
+    }
+    auto monitor = [&](int i) -> Task<> {
+        while (auto frame = co_await sensors[i]->nextFrame(std::chrono::seconds(5))) {
+            assert(frame->pm25_raw == 100 + frames[i] && frame->pm10_raw == 200);
+            frames[i]++;
+        }
+    };
+    auto writer = [&]() -> Task<> {
+        for (int n = 0; n < 3; ++n) {
+            std::vector<unsigned char> frame = makeFrame(static_cast<uint16_t>(100 + n), 200);
+            for (int i = 0; i < sensorCount; ++i) {
+                assert(write(pipes[2 * i + 1], frame.data(), 4) == 4);
+            }
+            co_await scheduler.sleepFor(std::chrono::milliseconds(2));
+            for (int i = 0; i < sensorCount; ++i) {
+                assert(write(pipes[2 * i + 1], frame.data() + 4, 6) == 6);
+            }
+        }
+        for (int i = 0; i < sensorCount; ++i) {
+            close(pipes[2 * i + 1]);
+        }
+    };
+    for (int i = 0; i < sensorCount; ++i) {
+        scheduler.spawn(monitor(i));
+    }
+    scheduler.spawn(writer());
+    uint64_t wakeups = events.getWakeups();
+    scheduler.run();
+    assert(std::count(frames.begin(), frames.end(), 3) == sensorCount);
+    assert(sensors[0]->atEndOfStream());
+    assert(events.getWakeups() - wakeups < 20);
+    
+    // A silent sensor times out instead of holding the thread
+    int quiet[2];
+    assert(pipe(quiet) == 0);
+    AsyncSensor silent(scheduler);
+    silent.attach(quiet[0], "async_silent");
+    bool timedOut = false;
+    start = SampleClock::nowNs();
+    auto wait = [&]() -> Task<> {
+        timedOut = !(co_await silent.nextFrame(std::chrono::milliseconds(20)));
+    };
+    scheduler.spawn(wait());
+    scheduler.run();
+    assert(timedOut && SampleClock::nowNs() - start >= 20000000ULL);
+    
+    // Errors escaping a spawned task stop run()
+    scheduler.spawn(failLater(scheduler));
+    caught = false;
+    try {
+        scheduler.run();
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+    
+    for (int i = 0; i < sensorCount; ++i) {
+        close(pipes[2 * i]);
+    }
+    close(quiet[0]);
+    close(quiet[1]);
+    
+    std::cout << "✓ Coroutines wait for frames and timers on one thread" << std::endl;
+}
+#endif
+
 int main() {
     std::cout << "Running CI-compatible unit tests..." << std::endl;
     std::cout << "=====================================" << std::endl;
@@ -55,6 +2042,34 @@ int main() {
         test_basic_functionality();
         test_platform_detection();
         test_data_structures();
+        test_latency_histogram();
+        test_trace_recorder();
+        test_frame_parser();
+        test_capture_replay();
+        test_serial_profiles();
+        test_daemon_control_socket();
+        test_tdigest();
+        test_aqi_engine();
+        test_aggregate_kernels();
+        test_reading_history();
+        test_history_ring();
+        test_trend_buckets();
+        test_outlier_filter();
+        test_humidity_correction();
+        test_sample_clock();
+        test_sensor_health();
+        test_device_lookup();
+        test_event_loop();
+        test_io_backend();
+        test_reading_bus();
+        test_alert_engine();
+        test_segment_store();
+        test_store_compactor();
+        test_write_ahead_log();
+        test_arrow_export();
+#ifdef ENABLE_COROUTINES
+        test_async_sensor();
+#endif
         
         std::cout << "=====================================" << std::endl;
         std::cout << "✅ All tests passed!" << std::endl;